@@ -0,0 +1,525 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <corosync/corotypes.h>
+#include <corosync/logsys.h>
+#include <corosync/icmap.h>
+
+#include "affinity.h"
+
+LOGSYS_DECLARE_SUBSYS ("MAIN");
+
+/*
+ * Threads whose type is known, all others are AFFINITY_THREAD_OTHER
+ */
+#define AFFINITY_THREADS_MAX		64
+
+#define AFFINITY_CPU_LIST_MAX		1024
+
+#define AFFINITY_TASK_DIR		"/proc/self/task"
+
+#define AFFINITY_NUMA_NODE_CPULIST	"/sys/devices/system/node/node%u/cpulist"
+
+static const char *affinity_thread_type_names[AFFINITY_THREAD_TYPE_MAX] = {
+	"main",
+	"log",
+	"transport",
+	"other"
+};
+
+/*
+ * Configuration key of each type, system.cpu_affinity is used for types
+ * without their own key
+ */
+static const char *affinity_thread_type_keys[AFFINITY_THREAD_TYPE_MAX] = {
+	"system.cpu_affinity_main",
+	"system.cpu_affinity_log",
+	"system.cpu_affinity_transport",
+	NULL
+};
+
+struct affinity_thread {
+	pid_t tid;
+	enum affinity_thread_type type;
+};
+
+static struct affinity_thread affinity_threads[AFFINITY_THREADS_MAX];
+
+static unsigned int affinity_threads_entries = 0;
+
+static pid_t affinity_snapshot[AFFINITY_THREADS_MAX];
+
+static unsigned int affinity_snapshot_entries = 0;
+
+#ifdef HAVE_SCHED_SETAFFINITY
+
+/*
+ * CPUs the process was allowed to run on before anything was changed, used
+ * for the threads nothing is configured for
+ */
+static cpu_set_t affinity_initial_set;
+
+static int affinity_initial_set_valid = 0;
+
+/*
+ * Call fn for every thread of the process
+ */
+static void affinity_threads_for_each (void (*fn) (pid_t tid, void *data), void *data)
+{
+	struct dirent *dirent;
+	char *ep;
+	long tid;
+	DIR *dir;
+
+	dir = opendir (AFFINITY_TASK_DIR);
+	if (dir == NULL) {
+		/*
+		 * No procfs, only the calling thread is known
+		 */
+		fn (getpid (), data);
+		return;
+	}
+
+	while ((dirent = readdir (dir)) != NULL) {
+		errno = 0;
+		tid = strtol (dirent->d_name, &ep, 10);
+		if (errno != 0 || *ep != '\0' || tid <= 0) {
+			continue;
+		}
+		fn ((pid_t)tid, data);
+	}
+	closedir (dir);
+}
+
+static enum affinity_thread_type affinity_thread_type_get (pid_t tid)
+{
+	unsigned int i;
+
+	if (tid == getpid ()) {
+		return (AFFINITY_THREAD_MAIN);
+	}
+
+	for (i = 0; i < affinity_threads_entries; i++) {
+		if (affinity_threads[i].tid == tid) {
+			return (affinity_threads[i].type);
+		}
+	}
+
+	return (AFFINITY_THREAD_OTHER);
+}
+
+static void affinity_snapshot_add (pid_t tid, void *data)
+{
+	if (affinity_snapshot_entries < AFFINITY_THREADS_MAX) {
+		affinity_snapshot[affinity_snapshot_entries++] = tid;
+	}
+}
+
+void affinity_threads_snapshot (void)
+{
+	affinity_snapshot_entries = 0;
+	affinity_threads_for_each (affinity_snapshot_add, NULL);
+}
+
+static void affinity_new_thread_add (pid_t tid, void *data)
+{
+	enum affinity_thread_type type = *(enum affinity_thread_type *)data;
+	unsigned int i;
+
+	for (i = 0; i < affinity_snapshot_entries; i++) {
+		if (affinity_snapshot[i] == tid) {
+			return;
+		}
+	}
+
+	if (affinity_thread_type_get (tid) != AFFINITY_THREAD_OTHER ||
+	    affinity_threads_entries >= AFFINITY_THREADS_MAX) {
+		return;
+	}
+
+	affinity_threads[affinity_threads_entries].tid = tid;
+	affinity_threads[affinity_threads_entries].type = type;
+	affinity_threads_entries++;
+}
+
+void affinity_threads_new_type_set (enum affinity_thread_type type)
+{
+	affinity_threads_for_each (affinity_new_thread_add, &type);
+}
+
+/*
+ * Parse a list of CPUs like "0-3,8,10-11" as used by the kernel
+ */
+static int affinity_cpu_list_parse (const char *str, cpu_set_t *set)
+{
+	unsigned long first, last, cpu;
+	const char *p = str;
+	char *ep;
+
+	CPU_ZERO (set);
+
+	while (*p != '\0' && *p != '\n') {
+		errno = 0;
+		first = strtoul (p, &ep, 10);
+		if (errno != 0 || ep == p || first >= CPU_SETSIZE) {
+			return (-1);
+		}
+		last = first;
+		p = ep;
+
+		if (*p == '-') {
+			p++;
+			errno = 0;
+			last = strtoul (p, &ep, 10);
+			if (errno != 0 || ep == p || last >= CPU_SETSIZE || last < first) {
+				return (-1);
+			}
+			p = ep;
+		}
+
+		for (cpu = first; cpu <= last; cpu++) {
+			CPU_SET (cpu, set);
+		}
+
+		if (*p == ',') {
+			p++;
+			if (*p == '\0') {
+				return (-1);
+			}
+		} else if (*p != '\0' && *p != '\n') {
+			return (-1);
+		}
+	}
+
+	return (CPU_COUNT (set) > 0 ? 0 : -1);
+}
+
+static void affinity_cpu_list_format (const cpu_set_t *set, char *str, size_t len)
+{
+	size_t used = 0;
+	int first = -1;
+	int cpu;
+	int res;
+
+	str[0] = '\0';
+
+	for (cpu = 0; cpu <= CPU_SETSIZE; cpu++) {
+		if (cpu < CPU_SETSIZE && CPU_ISSET (cpu, set)) {
+			if (first == -1) {
+				first = cpu;
+			}
+			continue;
+		}
+		if (first == -1) {
+			continue;
+		}
+
+		if (first == cpu - 1) {
+			res = snprintf (str + used, len - used, "%s%d", used ? "," : "", first);
+		} else {
+			res = snprintf (str + used, len - used, "%s%d-%d", used ? "," : "", first, cpu - 1);
+		}
+		if (res < 0 || (size_t)res >= len - used) {
+			return;
+		}
+		used += res;
+		first = -1;
+	}
+}
+
+static int affinity_numa_node_cpus_get (unsigned int node, cpu_set_t *set)
+{
+	char path[PATH_MAX];
+	char cpulist[AFFINITY_CPU_LIST_MAX];
+	FILE *f;
+	int res;
+
+	snprintf (path, sizeof (path), AFFINITY_NUMA_NODE_CPULIST, node);
+	f = fopen (path, "r");
+	if (f == NULL) {
+		return (-1);
+	}
+	res = (fgets (cpulist, sizeof (cpulist), f) != NULL) ? 0 : -1;
+	fclose (f);
+	if (res == -1) {
+		return (-1);
+	}
+
+	return (affinity_cpu_list_parse (cpulist, set));
+}
+
+/*
+ * CPUs for each thread type from the configuration
+ */
+static int affinity_config_read (
+	cpu_set_t sets[AFFINITY_THREAD_TYPE_MAX],
+	const char **error_string)
+{
+	static char error_string_response[256];
+	cpu_set_t default_set;
+	cpu_set_t numa_set;
+	int numa = 0;
+	unsigned long numa_node = 0;
+	char *str;
+	char *ep;
+	int i;
+
+	if (icmap_get_string ("system.numa_node", &str) == CS_OK) {
+		errno = 0;
+		numa_node = strtoul (str, &ep, 10);
+		if (errno != 0 || ep == str || *ep != '\0' || numa_node > UINT_MAX) {
+			snprintf (error_string_response, sizeof (error_string_response),
+				"Invalid system.numa_node %s", str);
+			free (str);
+			*error_string = error_string_response;
+			return (-1);
+		}
+		free (str);
+
+		if (affinity_numa_node_cpus_get (numa_node, &numa_set) != 0) {
+			snprintf (error_string_response, sizeof (error_string_response),
+				"Can't get the CPUs of NUMA node %lu", numa_node);
+			*error_string = error_string_response;
+			return (-1);
+		}
+		numa = 1;
+	}
+
+	memcpy (&default_set, &affinity_initial_set, sizeof (cpu_set_t));
+	if (icmap_get_string ("system.cpu_affinity", &str) == CS_OK) {
+		if (affinity_cpu_list_parse (str, &default_set) != 0) {
+			snprintf (error_string_response, sizeof (error_string_response),
+				"Invalid CPU list %s in system.cpu_affinity", str);
+			free (str);
+			*error_string = error_string_response;
+			return (-1);
+		}
+		free (str);
+	}
+
+	for (i = 0; i < AFFINITY_THREAD_TYPE_MAX; i++) {
+		memcpy (&sets[i], &default_set, sizeof (cpu_set_t));
+
+		if (affinity_thread_type_keys[i] != NULL &&
+		    icmap_get_string (affinity_thread_type_keys[i], &str) == CS_OK) {
+			if (affinity_cpu_list_parse (str, &sets[i]) != 0) {
+				snprintf (error_string_response, sizeof (error_string_response),
+					"Invalid CPU list %s in %s", str, affinity_thread_type_keys[i]);
+				free (str);
+				*error_string = error_string_response;
+				return (-1);
+			}
+			free (str);
+		}
+
+		if (numa) {
+			CPU_AND (&sets[i], &sets[i], &numa_set);
+			if (CPU_COUNT (&sets[i]) == 0) {
+				snprintf (error_string_response, sizeof (error_string_response),
+					"No CPU of NUMA node %lu is allowed for %s threads",
+					numa_node, affinity_thread_type_names[i]);
+				*error_string = error_string_response;
+				return (-1);
+			}
+		}
+	}
+
+	return (0);
+}
+
+static void affinity_thread_apply (pid_t tid, void *data)
+{
+	cpu_set_t *sets = data;
+	enum affinity_thread_type type = affinity_thread_type_get (tid);
+
+	if (sched_setaffinity (tid, sizeof (cpu_set_t), &sets[type]) == -1 && errno != ESRCH) {
+		LOGSYS_PERROR (errno, LOGSYS_LEVEL_WARNING,
+			"Could not set CPU affinity of %s thread %d",
+			affinity_thread_type_names[type], (int)tid);
+	}
+}
+
+/*
+ * Forget threads which exited so their ids can't be mistaken for new ones
+ */
+static void affinity_threads_expire (void)
+{
+	cpu_set_t set;
+	unsigned int i = 0;
+
+	while (i < affinity_threads_entries) {
+		if (sched_getaffinity (affinity_threads[i].tid, sizeof (cpu_set_t),
+		    &set) == -1 && errno == ESRCH) {
+			affinity_threads[i] = affinity_threads[--affinity_threads_entries];
+		} else {
+			i++;
+		}
+	}
+}
+
+/*
+ * Report the CPUs each type of thread runs on in runtime.system.cpu_affinity.*
+ */
+static void affinity_runtime_update (cpu_set_t sets[AFFINITY_THREAD_TYPE_MAX])
+{
+	char key_name[ICMAP_KEYNAME_MAXLEN];
+	char cpulist[AFFINITY_CPU_LIST_MAX];
+	cpu_set_t set;
+	unsigned int i;
+	int type;
+
+	for (type = 0; type < AFFINITY_THREAD_TYPE_MAX; type++) {
+		memcpy (&set, &sets[type], sizeof (cpu_set_t));
+
+		/*
+		 * Read back from a thread of the type, the kernel may have
+		 * limited the set further (cpusets)
+		 */
+		if (type == AFFINITY_THREAD_MAIN) {
+			(void)sched_getaffinity (getpid (), sizeof (cpu_set_t), &set);
+		}
+		for (i = 0; i < affinity_threads_entries; i++) {
+			if (affinity_threads[i].type == type &&
+			    sched_getaffinity (affinity_threads[i].tid, sizeof (cpu_set_t), &set) == 0) {
+				break;
+			}
+		}
+
+		affinity_cpu_list_format (&set, cpulist, sizeof (cpulist));
+		snprintf (key_name, sizeof (key_name), "runtime.system.cpu_affinity.%s",
+			affinity_thread_type_names[type]);
+		icmap_set_string (key_name, cpulist);
+	}
+}
+
+int affinity_apply (const char **error_string)
+{
+	cpu_set_t sets[AFFINITY_THREAD_TYPE_MAX];
+
+	if (!affinity_initial_set_valid) {
+		if (sched_getaffinity (0, sizeof (cpu_set_t), &affinity_initial_set) == -1) {
+			*error_string = "Can't get CPU affinity of the process";
+			return (-1);
+		}
+		affinity_initial_set_valid = 1;
+	}
+
+	if (affinity_config_read (sets, error_string) != 0) {
+		return (-1);
+	}
+
+	affinity_threads_expire ();
+	affinity_threads_for_each (affinity_thread_apply, sets);
+	affinity_runtime_update (sets);
+
+	return (0);
+}
+
+#else
+
+void affinity_threads_snapshot (void)
+{
+}
+
+void affinity_threads_new_type_set (enum affinity_thread_type type)
+{
+}
+
+int affinity_apply (const char **error_string)
+{
+	char *str;
+	int i;
+
+	if (icmap_get_string ("system.cpu_affinity", &str) == CS_OK ||
+	    icmap_get_string ("system.numa_node", &str) == CS_OK) {
+		free (str);
+		log_printf (LOGSYS_LEVEL_WARNING,
+			"The platform doesn't support setting CPU affinity, ignoring it");
+		return (0);
+	}
+
+	for (i = 0; i < AFFINITY_THREAD_TYPE_MAX; i++) {
+		if (affinity_thread_type_keys[i] != NULL &&
+		    icmap_get_string (affinity_thread_type_keys[i], &str) == CS_OK) {
+			free (str);
+			log_printf (LOGSYS_LEVEL_WARNING,
+				"The platform doesn't support setting CPU affinity, ignoring it");
+			break;
+		}
+	}
+
+	return (0);
+}
+
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+static void affinity_reload_notify_fn (
+	int32_t event,
+	const char *key_name,
+	struct icmap_notify_value new_val,
+	struct icmap_notify_value old_val,
+	void *user_data)
+{
+	const char *error_string;
+
+	if (new_val.len != sizeof (uint8_t) || *(uint8_t *)new_val.data != 0) {
+		return;
+	}
+
+	if (affinity_apply (&error_string) != 0) {
+		log_printf (LOGSYS_LEVEL_ERROR, "%s, keeping the current CPU affinity",
+			error_string);
+	}
+}
+
+void affinity_reload_track_init (void)
+{
+	icmap_track_t icmap_track = NULL;
+
+	icmap_track_add ("config.reload_in_progress",
+		ICMAP_TRACK_ADD | ICMAP_TRACK_MODIFY,
+		affinity_reload_notify_fn,
+		NULL,
+		&icmap_track);
+}
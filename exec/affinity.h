@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef AFFINITY_H_DEFINED
+#define AFFINITY_H_DEFINED
+
+/*
+ * CPU placement of the corosync threads. Each kind of thread can be limited
+ * to its own set of CPUs (system.cpu_affinity_main, ..._log and
+ * ..._transport, system.cpu_affinity for the rest), optionally restricted to
+ * the CPUs of one NUMA node (system.numa_node).
+ */
+
+enum affinity_thread_type {
+	AFFINITY_THREAD_MAIN,
+	AFFINITY_THREAD_LOG,
+	AFFINITY_THREAD_TRANSPORT,
+	AFFINITY_THREAD_OTHER,
+	AFFINITY_THREAD_TYPE_MAX
+};
+
+/*
+ * Remember the threads running now, so the ones started before the next
+ * affinity_threads_new_type_set call can be told apart
+ */
+extern void affinity_threads_snapshot (void);
+
+/*
+ * Threads started since affinity_threads_snapshot are of type
+ */
+extern void affinity_threads_new_type_set (enum affinity_thread_type type);
+
+/*
+ * Read the configuration from icmap and apply it to all threads of the
+ * process. Returns -1 and sets error_string if the configuration is invalid,
+ * nothing is changed then.
+ */
+extern int affinity_apply (const char **error_string);
+
+/*
+ * Apply the configuration again after every configuration reload
+ */
+extern void affinity_reload_track_init (void);
+
+#endif /* AFFINITY_H_DEFINED */
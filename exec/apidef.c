@@ -107,9 +107,12 @@ static struct corosync_api_v1 apidef_corosync_api_v1 = {
 	.ipc_dispatch_iov_send = cs_ipcs_dispatch_iov_send,
 	.ipc_refcnt_inc =  cs_ipc_refcnt_inc,
 	.ipc_refcnt_dec = cs_ipc_refcnt_dec,
+	.ipc_credentials_get = cs_ipcs_credentials_get,
 	.totem_nodeid_get = totempg_my_nodeid_get,
 	.totem_family_get = totempg_my_family_get,
 	.totem_mcast = main_mcast,
+	.totem_mcast_lane = main_mcast_lane,
+	.totem_lanes_get = totempg_lanes_get,
 	.totem_ifaces_get = totempg_ifaces_get,
 	.totem_ifaces_print = totempg_ifaces_print,
 	.totem_ip_print = totemip_print,
@@ -608,6 +608,7 @@ static void remove_ro_entries(icmap_map_t temp_map)
 #endif
 	delete_and_notify_if_changed(temp_map, "totem.version");
 	delete_and_notify_if_changed(temp_map, "totem.threads");
+	delete_and_notify_if_changed(temp_map, "totem.lanes");
 	delete_and_notify_if_changed(temp_map, "totem.ip_version");
 	delete_and_notify_if_changed(temp_map, "totem.rrp_mode");
 	delete_and_notify_if_changed(temp_map, "totem.netmtu");
@@ -636,15 +637,30 @@ static void remove_ro_entries(icmap_map_t temp_map)
  */
 static void remove_deleted_entries(icmap_map_t temp_map, const char *prefix)
 {
-	icmap_iter_t old_iter;
+	icmap_snapshot_t old_snapshot;
 	icmap_iter_t new_iter;
 	const char *old_key, *new_key;
 	int ret;
 
-	old_iter = icmap_iter_init(prefix);
+	/*
+	 * Keys are deleted from the live map while walking it, so walk a snapshot
+	 */
+	old_snapshot = icmap_snapshot_create(prefix);
+	if (old_snapshot == NULL) {
+		return ;
+	}
+
+	/*
+	 * Snapshot is taken by the first read, later reads cannot fail
+	 */
+	if (icmap_snapshot_iter_next(old_snapshot, &old_key, NULL, NULL) == CS_ERR_NO_MEMORY) {
+		log_printf(LOGSYS_LEVEL_ERROR, "Unable to take snapshot of %s, deleted keys are kept",
+		    prefix);
+		icmap_snapshot_destroy(old_snapshot);
+		return ;
+	}
 	new_iter = icmap_iter_init_r(temp_map, prefix);
 
-	old_key = icmap_iter_next(old_iter, NULL, NULL);
 	new_key = icmap_iter_next(new_iter, NULL, NULL);
 
 	while (old_key || new_key) {
@@ -658,7 +674,7 @@ static void remove_deleted_entries(icmap_map_t temp_map, const char *prefix)
 				/* Remove it from icmap & send notifications */
 				icmap_delete(old_key);
 
-				old_key = icmap_iter_next(old_iter, NULL, NULL);
+				(void)icmap_snapshot_iter_next(old_snapshot, &old_key, NULL, NULL);
 				ret = nullcheck_strcmp(old_key, new_key);
 			} while (ret < 0 && old_key);
 		}
@@ -677,11 +693,11 @@ static void remove_deleted_entries(icmap_map_t temp_map, const char *prefix)
 		}
 		if (ret == 0) {
 			new_key = icmap_iter_next(new_iter, NULL, NULL);
-			old_key = icmap_iter_next(old_iter, NULL, NULL);
+			(void)icmap_snapshot_iter_next(old_snapshot, &old_key, NULL, NULL);
 		}
 	}
 	icmap_iter_finalize(new_iter);
-	icmap_iter_finalize(old_iter);
+	icmap_snapshot_destroy(old_snapshot);
 }
 
 /*
@@ -734,6 +750,8 @@ static void message_handler_req_exec_cfg_reload_config (
 	remove_deleted_entries(temp_map, "quorum.");
 	remove_deleted_entries(temp_map, "uidgid.config.");
 	remove_deleted_entries(temp_map, "nozzle.");
+	remove_deleted_entries(temp_map, "system.cpu_affinity");
+	remove_deleted_entries(temp_map, "system.numa_node");
 
 	/* Remove entries that cannot be changed */
 	remove_ro_entries(temp_map);
@@ -50,12 +50,16 @@
 #include <corosync/corotypes.h>
 #include <corosync/corodefs.h>
 #include <corosync/mar_gen.h>
+#include <corosync/totem/totemip.h>
+#include <corosync/totem/totem.h>
+#include <corosync/cmap.h>
 #include <corosync/ipc_cmap.h>
 #include <corosync/logsys.h>
 #include <corosync/coroapi.h>
 #include <corosync/icmap.h>
 
 #include "service.h"
+#include "main.h"
 #include "ipcs_stats.h"
 #include "stats.h"
 
@@ -81,9 +85,10 @@ struct cmap_map {
 
 	int (*map_is_key_ro)(const char *key_name);
 
-	icmap_iter_t (*map_iter_init)(const char *prefix);
-	const char * (*map_iter_next)(icmap_iter_t iter, size_t *value_len, icmap_value_types_t *type);
-	void (*map_iter_finalize)(icmap_iter_t iter);
+	void * (*map_iter_init)(const char *prefix);
+	cs_error_t (*map_iter_next)(void *iter, const char **key_name, size_t *value_len,
+				    icmap_value_types_t *type);
+	void (*map_iter_finalize)(void *iter);
 
 	cs_error_t (*map_track_add)(const char *key_name,
 				    int32_t track_type,
@@ -95,15 +100,43 @@ struct cmap_map {
 	void * (*map_track_get_user_data)(icmap_track_t icmap_track);
 };
 
+/*
+ * Iterators of the default map hold a snapshot, so clients walking a big
+ * prefix see a consistent view
+ */
+static void *cmap_icmap_iter_init(const char *prefix)
+{
+	return (icmap_snapshot_create(prefix));
+}
+
+static cs_error_t cmap_icmap_iter_next(void *iter, const char **key_name, size_t *value_len,
+				       icmap_value_types_t *type)
+{
+	return (icmap_snapshot_iter_next((icmap_snapshot_t)iter, key_name, value_len, type));
+}
+
+static void cmap_icmap_iter_finalize(void *iter)
+{
+	icmap_snapshot_destroy((icmap_snapshot_t)iter);
+}
+
+static cs_error_t cmap_stats_iter_next(void *iter, const char **key_name, size_t *value_len,
+				       icmap_value_types_t *type)
+{
+	*key_name = stats_map_iter_next(iter, value_len, type);
+
+	return (*key_name != NULL ? CS_OK : CS_ERR_NO_SECTIONS);
+}
+
 struct cmap_map icmap_map = {
 	.map_get = icmap_get,
 	.map_set = icmap_set,
 	.map_adjust_int = icmap_adjust_int,
 	.map_delete = icmap_delete,
 	.map_is_key_ro = icmap_is_key_ro,
-	.map_iter_init = icmap_iter_init,
-	.map_iter_next = icmap_iter_next,
-	.map_iter_finalize = icmap_iter_finalize,
+	.map_iter_init = cmap_icmap_iter_init,
+	.map_iter_next = cmap_icmap_iter_next,
+	.map_iter_finalize = cmap_icmap_iter_finalize,
 	.map_track_add = icmap_track_add,
 	.map_track_delete = icmap_track_delete,
 	.map_track_get_user_data = icmap_track_get_user_data,
@@ -116,7 +149,7 @@ struct cmap_map stats_map = {
 	.map_delete = stats_map_delete,
 	.map_is_key_ro = stats_map_is_key_ro,
 	.map_iter_init = stats_map_iter_init,
-	.map_iter_next = stats_map_iter_next,
+	.map_iter_next = cmap_stats_iter_next,
 	.map_iter_finalize = stats_map_iter_finalize,
 	.map_track_add = stats_map_track_add,
 	.map_track_delete = stats_map_track_delete,
@@ -129,15 +162,35 @@ struct cmap_conn_info {
 	struct cmap_map map_fns;
 };
 
-typedef uint64_t cmap_iter_handle_t;
-typedef uint64_t cmap_track_handle_t;
+/*
+ * One changed key waiting in the batch of CMAP_TRACK_BATCH tracker. Values
+ * are private copies.
+ */
+struct cmap_batch_entry {
+	int32_t event;
+	char *key_name;
+	struct icmap_notify_value new_val;
+	struct icmap_notify_value old_val;
+	struct qb_list_head list;
+};
 
 struct cmap_track_user_data {
 	void *conn;
 	cmap_track_handle_t track_handle;
 	uint64_t track_inst_handle;
+	int batch;
+	struct qb_list_head batch_entries;
+	/* key_name -> last entry of the key, for coalescing */
+	qb_map_t *batch_keys;
+	/* Size of serialized batch_entries */
+	size_t batch_size;
+	/* In cmap_batch_pending_list_head while batch_entries is not empty */
+	struct qb_list_head batch_pending_list;
 };
 
+QB_LIST_DECLARE (cmap_batch_pending_list_head);
+static int cmap_batch_flush_scheduled = 0;
+
 enum cmap_message_req_types {
 	MESSAGE_REQ_EXEC_CMAP_MCAST = 0,
 };
@@ -165,6 +218,7 @@ static void message_handler_req_lib_cmap_iter_finalize(void *conn, const void *m
 static void message_handler_req_lib_cmap_track_add(void *conn, const void *message);
 static void message_handler_req_lib_cmap_track_delete(void *conn, const void *message);
 static void message_handler_req_lib_cmap_set_current_map(void *conn, const void *message);
+static void message_handler_req_lib_cmap_txn_commit(void *conn, const void *message);
 
 static void cmap_notify_fn(int32_t event,
 		const char *key_name,
@@ -172,6 +226,17 @@ static void cmap_notify_fn(int32_t event,
 		struct icmap_notify_value old_val,
 		void *user_data);
 
+/*
+ * Send (and clear) collected batch of tracker. Called from main loop job once per
+ * iteration or when batch would grow over CMAP_NOTIFY_BATCH_MAX_SIZE.
+ */
+static void cmap_batch_flush(struct cmap_track_user_data *cmap_track_user_data);
+
+/*
+ * Drop collected batch without sending it and free user data of tracker
+ */
+static void cmap_track_user_data_free(struct cmap_track_user_data *cmap_track_user_data);
+
 static void message_handler_req_exec_cmap_mcast(
 		const void *message,
 		unsigned int nodeid);
@@ -250,6 +315,10 @@ static struct corosync_lib_handler cmap_lib_engine[] =
 		.lib_handler_fn				= message_handler_req_lib_cmap_set_current_map,
 		.flow_control				= CS_LIB_FLOW_CONTROL_NOT_REQUIRED
 	},
+	{ /* 10 */
+		.lib_handler_fn				= message_handler_req_lib_cmap_txn_commit,
+		.flow_control				= CS_LIB_FLOW_CONTROL_NOT_REQUIRED
+	},
 };
 
 static struct corosync_exec_handler cmap_exec_engine[] =
@@ -386,7 +455,7 @@ static int cmap_lib_exit_fn (void *conn)
 {
 	struct cmap_conn_info *conn_info = (struct cmap_conn_info *)api->ipc_private_data_get (conn);
 	hdb_handle_t iter_handle = 0;
-	icmap_iter_t *iter;
+	void **iter;
 	hdb_handle_t track_handle = 0;
 	icmap_track_t *track;
 
@@ -407,7 +476,7 @@ static int cmap_lib_exit_fn (void *conn)
         while (hdb_iterator_next(&conn_info->track_db,
                 (void*)&track, &track_handle) == 0) {
 
-		free(conn_info->map_fns.map_track_get_user_data(*track));
+		cmap_track_user_data_free(conn_info->map_fns.map_track_get_user_data(*track));
 
 		conn_info->map_fns.map_track_delete(*track);
 
@@ -616,8 +685,8 @@ static void message_handler_req_lib_cmap_iter_init(void *conn, const void *messa
 	const struct req_lib_cmap_iter_init *req_lib_cmap_iter_init = message;
 	struct res_lib_cmap_iter_init res_lib_cmap_iter_init;
 	cs_error_t ret;
-	icmap_iter_t iter;
-	icmap_iter_t *hdb_iter;
+	void *iter;
+	void **hdb_iter;
 	cmap_iter_handle_t handle = 0ULL;
 	const char *prefix;
 	struct cmap_conn_info *conn_info = (struct cmap_conn_info *)api->ipc_private_data_get (conn);
@@ -663,7 +732,7 @@ static void message_handler_req_lib_cmap_iter_next(void *conn, const void *messa
 	const struct req_lib_cmap_iter_next *req_lib_cmap_iter_next = message;
 	struct res_lib_cmap_iter_next res_lib_cmap_iter_next;
 	cs_error_t ret;
-	icmap_iter_t *iter;
+	void **iter;
 	size_t value_len = 0;
 	icmap_value_types_t type = 0;
 	const char *res = NULL;
@@ -675,10 +744,7 @@ static void message_handler_req_lib_cmap_iter_next(void *conn, const void *messa
 		goto reply_send;
 	}
 
-	res = conn_info->map_fns.map_iter_next(*iter, &value_len, &type);
-	if (res == NULL) {
-		ret = CS_ERR_NO_SECTIONS;
-	}
+	ret = conn_info->map_fns.map_iter_next(*iter, &res, &value_len, &type);
 
 	(void)hdb_handle_put (&conn_info->iter_db, req_lib_cmap_iter_next->iter_handle);
 
@@ -706,7 +772,7 @@ static void message_handler_req_lib_cmap_iter_finalize(void *conn, const void *m
 	const struct req_lib_cmap_iter_finalize *req_lib_cmap_iter_finalize = message;
 	struct res_lib_cmap_iter_finalize res_lib_cmap_iter_finalize;
 	cs_error_t ret;
-	icmap_iter_t *iter;
+	void **iter;
 	struct cmap_conn_info *conn_info = (struct cmap_conn_info *)api->ipc_private_data_get (conn);
 
 	ret = hdb_error_to_cs(hdb_handle_get(&conn_info->iter_db,
@@ -730,13 +796,12 @@ reply_send:
 	api->ipc_response_send(conn, &res_lib_cmap_iter_finalize, sizeof(res_lib_cmap_iter_finalize));
 }
 
-static void cmap_notify_fn(int32_t event,
+static void cmap_notify_send(struct cmap_track_user_data *cmap_track_user_data,
+		int32_t event,
 		const char *key_name,
 		struct icmap_notify_value new_val,
-		struct icmap_notify_value old_val,
-		void *user_data)
+		struct icmap_notify_value old_val)
 {
-	struct cmap_track_user_data *cmap_track_user_data = (struct cmap_track_user_data *)user_data;
 	struct res_lib_cmap_notify_callback res_lib_cmap_notify_callback;
 	struct iovec iov[3];
 
@@ -768,6 +833,236 @@ static void cmap_notify_fn(int32_t event,
 	api->ipc_dispatch_iov_send(cmap_track_user_data->conn, iov, 3);
 }
 
+static size_t cmap_batch_entry_size(const struct cmap_batch_entry *entry)
+{
+	size_t size;
+
+	size = sizeof(struct res_lib_cmap_notify_batch_item) + strlen(entry->key_name) + 1 +
+	    entry->new_val.len + entry->old_val.len;
+
+	return ((size + 7) & ~(size_t)7);
+}
+
+static void cmap_batch_entry_free(struct cmap_batch_entry *entry)
+{
+
+	free(entry->key_name);
+	free((void *)entry->new_val.data);
+	free((void *)entry->old_val.data);
+	free(entry);
+}
+
+static int cmap_notify_value_dup(struct icmap_notify_value *dst, const struct icmap_notify_value *src)
+{
+
+	*dst = *src;
+	dst->data = NULL;
+
+	if (src->len > 0) {
+		dst->data = malloc(src->len);
+		if (dst->data == NULL) {
+			return (-1);
+		}
+		memcpy((void *)dst->data, src->data, src->len);
+	}
+
+	return (0);
+}
+
+static void cmap_batch_flush_job(void *data)
+{
+	struct qb_list_head *iter, *tmp_iter;
+	struct cmap_track_user_data *cmap_track_user_data;
+
+	cmap_batch_flush_scheduled = 0;
+
+	qb_list_for_each_safe(iter, tmp_iter, &cmap_batch_pending_list_head) {
+		cmap_track_user_data = qb_list_entry(iter, struct cmap_track_user_data, batch_pending_list);
+
+		cmap_batch_flush(cmap_track_user_data);
+	}
+}
+
+static void cmap_batch_flush(struct cmap_track_user_data *cmap_track_user_data)
+{
+	struct qb_list_head *iter, *tmp_iter;
+	struct cmap_batch_entry *entry;
+	struct res_lib_cmap_notify_batch_callback *res;
+	struct res_lib_cmap_notify_batch_item *item;
+	size_t res_size;
+	size_t item_size;
+	char *ptr;
+
+	if (qb_list_empty(&cmap_track_user_data->batch_entries)) {
+		return ;
+	}
+
+	res_size = sizeof(*res) + cmap_track_user_data->batch_size;
+	res = malloc(res_size);
+	if (res != NULL) {
+		memset(res, 0, res_size);
+		res->header.size = res_size;
+		res->header.id = MESSAGE_RES_CMAP_NOTIFY_BATCH_CALLBACK;
+		res->header.error = CS_OK;
+		res->track_inst_handle = cmap_track_user_data->track_inst_handle;
+	}
+
+	ptr = (res != NULL) ? (char *)res->data : NULL;
+	qb_list_for_each_safe(iter, tmp_iter, &cmap_track_user_data->batch_entries) {
+		entry = qb_list_entry(iter, struct cmap_batch_entry, list);
+
+		if (res != NULL) {
+			item_size = cmap_batch_entry_size(entry);
+			item = (struct res_lib_cmap_notify_batch_item *)ptr;
+			item->size = item_size;
+			item->event = entry->event;
+			item->new_value_type = entry->new_val.type;
+			item->old_value_type = entry->old_val.type;
+			item->key_name_len = strlen(entry->key_name);
+			item->new_value_len = entry->new_val.len;
+			item->old_value_len = entry->old_val.len;
+			memcpy(item->data, entry->key_name, item->key_name_len + 1);
+			memcpy(item->data + item->key_name_len + 1, entry->new_val.data, entry->new_val.len);
+			memcpy(item->data + item->key_name_len + 1 + entry->new_val.len,
+			    entry->old_val.data, entry->old_val.len);
+			ptr += item_size;
+			res->items++;
+		} else {
+			/*
+			 * Not enough memory for whole batch -> send one by one
+			 */
+			cmap_notify_send(cmap_track_user_data, entry->event, entry->key_name,
+			    entry->new_val, entry->old_val);
+		}
+
+		qb_map_rm(cmap_track_user_data->batch_keys, entry->key_name);
+		qb_list_del(&entry->list);
+		cmap_batch_entry_free(entry);
+	}
+
+	cmap_track_user_data->batch_size = 0;
+	qb_list_del(&cmap_track_user_data->batch_pending_list);
+	qb_list_init(&cmap_track_user_data->batch_pending_list);
+
+	if (res != NULL) {
+		api->ipc_dispatch_send(cmap_track_user_data->conn, res, res_size);
+		free(res);
+	}
+}
+
+/*
+ * Returns 0 if change was added to batch, otherwise (no memory) -1 and caller
+ * has to send it directly
+ */
+static int cmap_batch_add(struct cmap_track_user_data *cmap_track_user_data,
+		int32_t event,
+		const char *key_name,
+		struct icmap_notify_value new_val,
+		struct icmap_notify_value old_val)
+{
+	struct cmap_batch_entry *entry;
+	struct icmap_notify_value coalesced_val;
+	size_t old_entry_size;
+
+	entry = qb_map_get(cmap_track_user_data->batch_keys, key_name);
+	if (entry != NULL && event == ICMAP_TRACK_MODIFY &&
+	    (entry->event == ICMAP_TRACK_ADD || entry->event == ICMAP_TRACK_MODIFY)) {
+		/*
+		 * Coalesce with previous change of the key. Keep its event and old value.
+		 */
+		if (cmap_notify_value_dup(&coalesced_val, &new_val) != 0) {
+			return (-1);
+		}
+
+		old_entry_size = cmap_batch_entry_size(entry);
+		free((void *)entry->new_val.data);
+		entry->new_val = coalesced_val;
+		cmap_track_user_data->batch_size += cmap_batch_entry_size(entry) - old_entry_size;
+
+		return (0);
+	}
+
+	entry = malloc(sizeof(*entry));
+	if (entry == NULL) {
+		return (-1);
+	}
+	memset(entry, 0, sizeof(*entry));
+
+	entry->event = event;
+	entry->key_name = strdup(key_name);
+	if (entry->key_name == NULL ||
+	    cmap_notify_value_dup(&entry->new_val, &new_val) != 0 ||
+	    cmap_notify_value_dup(&entry->old_val, &old_val) != 0) {
+		cmap_batch_entry_free(entry);
+		return (-1);
+	}
+
+	if (cmap_track_user_data->batch_size + cmap_batch_entry_size(entry) >
+	    CMAP_NOTIFY_BATCH_MAX_SIZE - sizeof(struct res_lib_cmap_notify_batch_callback)) {
+		cmap_batch_flush(cmap_track_user_data);
+	}
+
+	if (qb_list_empty(&cmap_track_user_data->batch_entries)) {
+		qb_list_add_tail(&cmap_track_user_data->batch_pending_list, &cmap_batch_pending_list_head);
+	}
+
+	qb_list_init(&entry->list);
+	qb_list_add_tail(&entry->list, &cmap_track_user_data->batch_entries);
+	qb_map_put(cmap_track_user_data->batch_keys, entry->key_name, entry);
+	cmap_track_user_data->batch_size += cmap_batch_entry_size(entry);
+
+	if (!cmap_batch_flush_scheduled) {
+		if (qb_loop_job_add(cs_poll_handle_get(), QB_LOOP_MED, NULL, cmap_batch_flush_job) == 0) {
+			cmap_batch_flush_scheduled = 1;
+		} else {
+			cmap_batch_flush(cmap_track_user_data);
+		}
+	}
+
+	return (0);
+}
+
+static void cmap_notify_fn(int32_t event,
+		const char *key_name,
+		struct icmap_notify_value new_val,
+		struct icmap_notify_value old_val,
+		void *user_data)
+{
+	struct cmap_track_user_data *cmap_track_user_data = (struct cmap_track_user_data *)user_data;
+
+	if (cmap_track_user_data->batch &&
+	    cmap_batch_add(cmap_track_user_data, event, key_name, new_val, old_val) == 0) {
+		return ;
+	}
+
+	/*
+	 * Keep ordering with changes which are already in the batch
+	 */
+	if (cmap_track_user_data->batch) {
+		cmap_batch_flush(cmap_track_user_data);
+	}
+
+	cmap_notify_send(cmap_track_user_data, event, key_name, new_val, old_val);
+}
+
+static void cmap_track_user_data_free(struct cmap_track_user_data *cmap_track_user_data)
+{
+	struct qb_list_head *iter, *tmp_iter;
+	struct cmap_batch_entry *entry;
+
+	if (cmap_track_user_data->batch) {
+		qb_map_destroy(cmap_track_user_data->batch_keys);
+		qb_list_for_each_safe(iter, tmp_iter, &cmap_track_user_data->batch_entries) {
+			entry = qb_list_entry(iter, struct cmap_batch_entry, list);
+			qb_list_del(&entry->list);
+			cmap_batch_entry_free(entry);
+		}
+		qb_list_del(&cmap_track_user_data->batch_pending_list);
+	}
+
+	free(cmap_track_user_data);
+}
+
 static void message_handler_req_lib_cmap_track_add(void *conn, const void *message)
 {
 	const struct req_lib_cmap_track_add *req_lib_cmap_track_add = message;
@@ -788,6 +1083,19 @@ static void message_handler_req_lib_cmap_track_add(void *conn, const void *messa
 		goto reply_send;
 	}
 	memset(cmap_track_user_data, 0, sizeof(*cmap_track_user_data));
+	qb_list_init(&cmap_track_user_data->batch_entries);
+	qb_list_init(&cmap_track_user_data->batch_pending_list);
+
+	if (req_lib_cmap_track_add->track_type & CMAP_TRACK_BATCH) {
+		cmap_track_user_data->batch_keys = qb_trie_create();
+		if (cmap_track_user_data->batch_keys == NULL) {
+			free(cmap_track_user_data);
+			ret = CS_ERR_NO_MEMORY;
+
+			goto reply_send;
+		}
+		cmap_track_user_data->batch = 1;
+	}
 
 	if (req_lib_cmap_track_add->key_name.length > 0) {
 		key_name = (char *)req_lib_cmap_track_add->key_name.value;
@@ -796,26 +1104,28 @@ static void message_handler_req_lib_cmap_track_add(void *conn, const void *messa
 	}
 
 	ret = conn_info->map_fns.map_track_add(key_name,
-					       req_lib_cmap_track_add->track_type,
+					       req_lib_cmap_track_add->track_type & ~CMAP_TRACK_BATCH,
 					       cmap_notify_fn,
 					       cmap_track_user_data,
 					       &track);
 	if (ret != CS_OK) {
-		free(cmap_track_user_data);
+		cmap_track_user_data_free(cmap_track_user_data);
 
 		goto reply_send;
 	}
 
 	ret = hdb_error_to_cs(hdb_handle_create(&conn_info->track_db, sizeof(track), &handle));
 	if (ret != CS_OK) {
-		free(cmap_track_user_data);
+		conn_info->map_fns.map_track_delete(track);
+		cmap_track_user_data_free(cmap_track_user_data);
 
 		goto reply_send;
 	}
 
 	ret = hdb_error_to_cs(hdb_handle_get(&conn_info->track_db, handle, (void *)&hdb_track));
 	if (ret != CS_OK) {
-		free(cmap_track_user_data);
+		conn_info->map_fns.map_track_delete(track);
+		cmap_track_user_data_free(cmap_track_user_data);
 
 		goto reply_send;
 	}
@@ -855,7 +1165,7 @@ static void message_handler_req_lib_cmap_track_delete(void *conn, const void *me
 	track_inst_handle = ((struct cmap_track_user_data *)
 	    conn_info->map_fns.map_track_get_user_data(*track))->track_inst_handle;
 
-	free(conn_info->map_fns.map_track_get_user_data(*track));
+	cmap_track_user_data_free(conn_info->map_fns.map_track_get_user_data(*track));
 
 	ret = conn_info->map_fns.map_track_delete(*track);
 
@@ -881,7 +1191,7 @@ static void message_handler_req_lib_cmap_set_current_map(void *conn, const void
 	struct cmap_conn_info *conn_info = (struct cmap_conn_info *)api->ipc_private_data_get (conn);
 	int handles_open = 0;
 	hdb_handle_t iter_handle = 0;
-	icmap_iter_t *iter;
+	void **iter;
 	hdb_handle_t track_handle = 0;
 	icmap_track_t *track;
 
@@ -923,6 +1233,268 @@ reply_send:
 	api->ipc_response_send(conn, &res, sizeof(res));
 }
 
+/*
+ * One operation of transaction together with value of key before the transaction
+ * (needed for rollback)
+ */
+struct cmap_txn_op {
+	const struct req_lib_cmap_txn_op *req;
+	const char *key_name;
+	const void *value;
+	void *old_value;
+	size_t old_value_len;
+	icmap_value_types_t old_type;
+};
+
+/*
+ * Parse ops of transaction into txn_ops array. Returns index of first malformed
+ * op or number of ops if all are ok.
+ */
+static uint32_t cmap_txn_parse(const struct req_lib_cmap_txn_commit *req, struct cmap_txn_op *txn_ops)
+{
+	const char *ptr;
+	const char *end;
+	const struct req_lib_cmap_txn_op *txn_op;
+	uint32_t i;
+
+	ptr = (const char *)req->data;
+	end = (const char *)req + req->header.size;
+
+	for (i = 0; i < req->ops; i++) {
+		txn_op = (const struct req_lib_cmap_txn_op *)ptr;
+
+		if (end - ptr < (ptrdiff_t)sizeof(*txn_op) ||
+		    txn_op->size < sizeof(*txn_op) || txn_op->size > end - ptr ||
+		    txn_op->size % 8 != 0 ||
+		    (size_t)txn_op->key_name_len + 1 + txn_op->value_len + 1 > txn_op->size - sizeof(*txn_op) ||
+		    txn_op->key_name_len >= CS_MAX_NAME_LENGTH ||
+		    txn_op->data[txn_op->key_name_len] != '\0' ||
+		    txn_op->data[txn_op->key_name_len + 1 + txn_op->value_len] != '\0' ||
+		    txn_op->op > CMAP_TXN_OP_COMPARE) {
+			return (i);
+		}
+
+		txn_ops[i].req = txn_op;
+		txn_ops[i].key_name = (const char *)txn_op->data;
+		txn_ops[i].value = txn_op->data + txn_op->key_name_len + 1;
+
+		ptr += txn_op->size;
+	}
+
+	return (i);
+}
+
+/*
+ * Returns CS_OK if key has value (or doesn't exist) as required by compare op
+ */
+static cs_error_t cmap_txn_op_compare(const struct cmap_map *map_fns, const struct cmap_txn_op *txn_op)
+{
+	cs_error_t ret;
+	size_t value_len;
+	size_t cmp_len;
+	icmap_value_types_t type;
+	void *value;
+
+	ret = map_fns->map_get(txn_op->key_name, NULL, &value_len, &type);
+
+	if (txn_op->req->type == ICMAP_VALUETYPE_NOT_EXIST) {
+		return (ret == CS_ERR_NOT_EXIST ? CS_OK : CS_ERR_FAILED_OPERATION);
+	}
+
+	if (ret == CS_ERR_NOT_EXIST || type != txn_op->req->type) {
+		return (CS_ERR_FAILED_OPERATION);
+	}
+
+	if (ret != CS_OK) {
+		return (ret);
+	}
+
+	/*
+	 * Stored string contains trailing zero, value in request may not
+	 */
+	cmp_len = txn_op->req->value_len;
+	if (type == ICMAP_VALUETYPE_STRING) {
+		cmp_len = strlen((const char *)txn_op->value) + 1;
+	}
+
+	if (value_len != cmp_len) {
+		return (CS_ERR_FAILED_OPERATION);
+	}
+
+	value = malloc(value_len + 1);
+	if (value == NULL) {
+		return (CS_ERR_NO_MEMORY);
+	}
+
+	ret = map_fns->map_get(txn_op->key_name, value, &value_len, &type);
+	if (ret == CS_OK && memcmp(value, txn_op->value, cmp_len) != 0) {
+		ret = CS_ERR_FAILED_OPERATION;
+	}
+
+	free(value);
+
+	return (ret);
+}
+
+/*
+ * Store current value of key so the op can be rolled back
+ */
+static cs_error_t cmap_txn_op_save_old_value(const struct cmap_map *map_fns, struct cmap_txn_op *txn_op)
+{
+	cs_error_t ret;
+
+	ret = map_fns->map_get(txn_op->key_name, NULL, &txn_op->old_value_len, &txn_op->old_type);
+	if (ret == CS_ERR_NOT_EXIST) {
+		txn_op->old_type = ICMAP_VALUETYPE_NOT_EXIST;
+		return (CS_OK);
+	}
+
+	if (ret != CS_OK) {
+		return (ret);
+	}
+
+	txn_op->old_value = malloc(txn_op->old_value_len + 1);
+	if (txn_op->old_value == NULL) {
+		return (CS_ERR_NO_MEMORY);
+	}
+
+	return (map_fns->map_get(txn_op->key_name, txn_op->old_value, &txn_op->old_value_len,
+	    &txn_op->old_type));
+}
+
+static void cmap_txn_op_rollback(const struct cmap_map *map_fns, const struct cmap_txn_op *txn_op)
+{
+	cs_error_t ret;
+
+	if (txn_op->old_type == ICMAP_VALUETYPE_NOT_EXIST) {
+		ret = map_fns->map_delete(txn_op->key_name);
+		if (ret == CS_ERR_NOT_EXIST) {
+			ret = CS_OK;
+		}
+	} else {
+		ret = map_fns->map_set(txn_op->key_name, txn_op->old_value, txn_op->old_value_len,
+		    txn_op->old_type);
+	}
+
+	if (ret != CS_OK) {
+		log_printf(LOGSYS_LEVEL_ERROR, "Can't roll back key %s of transaction: %s",
+		    txn_op->key_name, cs_strerror(ret));
+	}
+}
+
+static void message_handler_req_lib_cmap_txn_commit(void *conn, const void *message)
+{
+	const struct req_lib_cmap_txn_commit *req_lib_cmap_txn_commit = message;
+	struct cmap_conn_info *conn_info = (struct cmap_conn_info *)api->ipc_private_data_get (conn);
+	struct res_lib_cmap_txn_commit res_lib_cmap_txn_commit;
+	struct cmap_txn_op *txn_ops = NULL;
+	const struct req_lib_cmap_txn_op *req;
+	cs_error_t ret = CS_OK;
+	uint32_t ops;
+	uint32_t i, j;
+
+	ops = req_lib_cmap_txn_commit->ops;
+	i = 0;
+
+	if (req_lib_cmap_txn_commit->header.size < sizeof(*req_lib_cmap_txn_commit) ||
+	    ops > (req_lib_cmap_txn_commit->header.size - sizeof(*req_lib_cmap_txn_commit)) /
+	    sizeof(struct req_lib_cmap_txn_op)) {
+		ret = CS_ERR_MESSAGE_ERROR;
+		goto reply_send;
+	}
+
+	if (ops == 0) {
+		goto reply_send;
+	}
+
+	txn_ops = malloc(sizeof(*txn_ops) * ops);
+	if (txn_ops == NULL) {
+		ret = CS_ERR_NO_MEMORY;
+		goto reply_send;
+	}
+	memset(txn_ops, 0, sizeof(*txn_ops) * ops);
+
+	i = cmap_txn_parse(req_lib_cmap_txn_commit, txn_ops);
+	if (i != ops) {
+		ret = CS_ERR_MESSAGE_ERROR;
+		goto reply_send;
+	}
+
+	/*
+	 * Check everything what can be checked before changing map. Preconditions
+	 * are evaluated against state before transaction.
+	 */
+	for (i = 0; i < ops; i++) {
+		req = txn_ops[i].req;
+
+		if (req->op == CMAP_TXN_OP_COMPARE) {
+			ret = cmap_txn_op_compare(&conn_info->map_fns, &txn_ops[i]);
+		} else if (conn_info->map_fns.map_is_key_ro(txn_ops[i].key_name)) {
+			ret = CS_ERR_ACCESS;
+		}
+
+		if (ret != CS_OK) {
+			goto reply_send;
+		}
+	}
+
+	/*
+	 * Changes of transaction should go to batch trackers as one event
+	 */
+	cmap_batch_flush_job(NULL);
+
+	for (i = 0; i < ops; i++) {
+		req = txn_ops[i].req;
+
+		if (req->op == CMAP_TXN_OP_COMPARE) {
+			continue;
+		}
+
+		ret = cmap_txn_op_save_old_value(&conn_info->map_fns, &txn_ops[i]);
+		if (ret != CS_OK) {
+			break;
+		}
+
+		if (req->op == CMAP_TXN_OP_SET) {
+			ret = conn_info->map_fns.map_set(txn_ops[i].key_name, txn_ops[i].value,
+			    req->value_len, req->type);
+		} else {
+			ret = conn_info->map_fns.map_delete(txn_ops[i].key_name);
+		}
+
+		if (ret != CS_OK) {
+			break;
+		}
+	}
+
+	if (ret != CS_OK) {
+		/*
+		 * Op i failed (and didn't change map), undo previous ones in reverse order
+		 */
+		for (j = i; j > 0; j--) {
+			if (txn_ops[j - 1].req->op != CMAP_TXN_OP_COMPARE) {
+				cmap_txn_op_rollback(&conn_info->map_fns, &txn_ops[j - 1]);
+			}
+		}
+	}
+
+reply_send:
+	if (txn_ops != NULL) {
+		for (j = 0; j < ops; j++) {
+			free(txn_ops[j].old_value);
+		}
+		free(txn_ops);
+	}
+
+	memset(&res_lib_cmap_txn_commit, 0, sizeof(res_lib_cmap_txn_commit));
+	res_lib_cmap_txn_commit.header.size = sizeof(res_lib_cmap_txn_commit);
+	res_lib_cmap_txn_commit.header.id = MESSAGE_RES_CMAP_TXN_COMMIT;
+	res_lib_cmap_txn_commit.header.error = ret;
+	res_lib_cmap_txn_commit.failed_op = (ret == CS_OK ? 0 : i);
+
+	api->ipc_response_send(conn, &res_lib_cmap_txn_commit, sizeof(res_lib_cmap_txn_commit));
+}
+
 static cs_error_t cmap_mcast_send(enum cmap_mcast_reason reason, int argc, char *argv[])
 {
 	int i;
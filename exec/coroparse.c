@@ -39,6 +39,7 @@
 #include <sys/uio.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -133,6 +134,15 @@ struct main_cp_cb_data {
 
 static int read_config_file_into_icmap(
 	const char **error_string, icmap_map_t config_map);
+static void config_cache_deps_reset(void);
+static void config_cache_dep_add(const char *path);
+static int config_cache_load(const char *cache_file, icmap_map_t config_map);
+static void config_cache_save(const char *cache_file, icmap_map_t config_map);
+
+/*
+ * Binary configuration cache (-C), NULL when disabled
+ */
+static const char *config_cache_file = NULL;
 static char error_string_response[512];
 
 static int uid_determine (const char *req_user)
@@ -151,6 +161,9 @@ static int uid_determine (const char *req_user)
 		return (id);
 	}
 
+	config_cache_dep_add("/etc/nsswitch.conf");
+	config_cache_dep_add("/etc/passwd");
+
 	pwdlinelen = sysconf (_SC_GETPW_R_SIZE_MAX);
 
 	if (pwdlinelen == -1) {
@@ -205,6 +218,9 @@ static int gid_determine (const char *req_group)
 		return (id);
 	}
 
+	config_cache_dep_add("/etc/nsswitch.conf");
+	config_cache_dep_add("/etc/group");
+
 	grplinelen = sysconf (_SC_GETGR_R_SIZE_MAX);
 
 	if (grplinelen == -1) {
@@ -255,12 +271,31 @@ static char *strchr_rs (const char *haystack, int byte)
 	return ((char *) end_address);
 }
 
+void coroparse_config_cache_set (const char *cache_file)
+{
+	config_cache_file = cache_file;
+}
+
 int coroparse_configparse (icmap_map_t config_map, const char **error_string)
 {
+	if (config_cache_file != NULL &&
+	    config_cache_load(config_cache_file, config_map) == 0) {
+		snprintf (error_string_response, sizeof(error_string_response),
+			"Successfully read main configuration file '%s' from cache '%s'.",
+			corosync_get_config_file(), config_cache_file);
+		*error_string = error_string_response;
+
+		return 0;
+	}
+
 	if (read_config_file_into_icmap(error_string, config_map)) {
 		return -1;
 	}
 
+	if (config_cache_file != NULL) {
+		config_cache_save(config_cache_file, config_map);
+	}
+
 	return 0;
 }
 
@@ -683,6 +718,7 @@ static int main_config_parser_cb(const char *path,
 			if ((strcmp(path, "totem.version") == 0) ||
 			    (strcmp(path, "totem.nodeid") == 0) ||
 			    (strcmp(path, "totem.threads") == 0) ||
+			    (strcmp(path, "totem.lanes") == 0) ||
 			    (strcmp(path, "totem.token") == 0) ||
 			    (strcmp(path, "totem.token_coefficient") == 0) ||
 			    (strcmp(path, "totem.token_retransmit") == 0) ||
@@ -708,6 +744,7 @@ static int main_config_parser_cb(const char *path,
 			    (strcmp(path, "totem.miss_count_const") == 0) ||
 			    (strcmp(path, "totem.knet_pmtud_interval") == 0) ||
 			    (strcmp(path, "totem.knet_compression_threshold") == 0) ||
+			    (strcmp(path, "totem.resolve_cache_ttl") == 0) ||
 			    (strcmp(path, "totem.netmtu") == 0)) {
 				val_type = ICMAP_VALUETYPE_UINT32;
 				if (safe_atoq(value, &val, val_type) != 0) {
@@ -1569,6 +1606,8 @@ static int read_uidgid_files_into_icmap(
 		return (-1);
 	}
 
+	config_cache_dep_add(uidgid_dirname);
+
 	dp = opendir (uidgid_dirname);
 
 	if (dp == NULL)
@@ -1588,6 +1627,8 @@ static int read_uidgid_files_into_icmap(
 		res = stat (filename, &stat_buf);
 		if (res == 0 && S_ISREG(stat_buf.st_mode)) {
 
+			config_cache_dep_add(filename);
+
 			fp = fopen (filename, "r");
 			if (fp == NULL) continue;
 
@@ -1627,6 +1668,9 @@ static int read_config_file_into_icmap(
 
 	filename = corosync_get_config_file();
 
+	config_cache_deps_reset();
+	config_cache_dep_add(filename);
+
 	fp = fopen (filename, "r");
 	if (fp == NULL) {
 		char error_str[100];
@@ -1658,3 +1702,414 @@ static int read_config_file_into_icmap(
 
 	return res;
 }
+
+/*
+ * Binary configuration cache
+ *
+ * After a successful parse the whole resulting map is written to the cache
+ * file together with a record of every file the parse depended on (stat data
+ * and FNV-1a hash of the content, or of the entry names for directories).
+ * The next parse maps the cache, checks the records and the checksum of the
+ * cache itself and, when all match, sets the keys directly without parsing.
+ * The cache is host specific (native byte order) and must be owned by the
+ * user running corosync and not writable by anybody else.
+ */
+#define CONFIG_CACHE_MAGIC		0x43534343
+#define CONFIG_CACHE_VERSION		1
+#define CONFIG_CACHE_DEPS_MAX		256
+#define CONFIG_CACHE_ALIGN(len)		(((len) + 7) & ~7)
+
+enum config_cache_dep_kind {
+	CONFIG_CACHE_DEP_MISSING = 0,
+	CONFIG_CACHE_DEP_FILE = 1,
+	CONFIG_CACHE_DEP_DIR = 2,
+};
+
+struct config_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+	uint64_t checksum; /* of everything after the header */
+	uint32_t deps;
+	uint32_t keys;
+};
+
+struct config_cache_dep {
+	uint32_t kind;
+	uint32_t path_len; /* including terminating zero, padded to 8 */
+	uint64_t size;
+	uint64_t mtime_sec;
+	uint64_t mtime_nsec;
+	uint64_t hash;
+	char path[];
+};
+
+struct config_cache_key {
+	uint32_t type;
+	uint32_t key_len; /* including terminating zero, padded to 8 */
+	uint64_t value_len; /* padded to 8 */
+	char data[]; /* key followed by value */
+};
+
+struct config_cache_dep_data {
+	char path[PATH_MAX];
+	uint32_t kind;
+	uint64_t size;
+	uint64_t mtime_sec;
+	uint64_t mtime_nsec;
+	uint64_t hash;
+};
+
+static struct config_cache_dep_data config_cache_deps[CONFIG_CACHE_DEPS_MAX];
+static int config_cache_deps_entries;
+static int config_cache_deps_overflow;
+
+static uint64_t config_cache_hash(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ p[i]) * 1099511628211ULL;
+	}
+
+	return (hash);
+}
+
+static int config_cache_dep_fill(const char *path, struct config_cache_dep_data *dep)
+{
+	struct stat stat_buf;
+	char buf[8192];
+	struct dirent *dirent;
+	DIR *dp;
+	ssize_t bytes;
+	int fd;
+
+	memset(dep, 0, sizeof(*dep));
+	if (strlen(path) >= sizeof(dep->path)) {
+		return (-1);
+	}
+	strcpy(dep->path, path);
+	dep->hash = 14695981039346656037ULL;
+
+	if (stat(path, &stat_buf) != 0) {
+		dep->kind = CONFIG_CACHE_DEP_MISSING;
+		return (0);
+	}
+
+	dep->size = stat_buf.st_size;
+	dep->mtime_sec = stat_buf.st_mtim.tv_sec;
+	dep->mtime_nsec = stat_buf.st_mtim.tv_nsec;
+
+	if (S_ISDIR(stat_buf.st_mode)) {
+		dep->kind = CONFIG_CACHE_DEP_DIR;
+		dp = opendir(path);
+		if (dp == NULL) {
+			return (-1);
+		}
+		while ((dirent = readdir(dp)) != NULL) {
+			dep->hash = config_cache_hash(dep->hash, dirent->d_name,
+			    strlen(dirent->d_name) + 1);
+		}
+		closedir(dp);
+		return (0);
+	}
+
+	dep->kind = CONFIG_CACHE_DEP_FILE;
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return (-1);
+	}
+	while ((bytes = read(fd, buf, sizeof(buf))) != 0) {
+		if (bytes == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			close(fd);
+			return (-1);
+		}
+		dep->hash = config_cache_hash(dep->hash, buf, bytes);
+	}
+	close(fd);
+
+	return (0);
+}
+
+static void config_cache_deps_reset(void)
+{
+	config_cache_deps_entries = 0;
+	config_cache_deps_overflow = 0;
+}
+
+/*
+ * Remember a file the parse depends on, called before the file is read so
+ * a change made during the parse invalidates the cache
+ */
+static void config_cache_dep_add(const char *path)
+{
+	int i;
+
+	if (config_cache_file == NULL) {
+		return;
+	}
+
+	for (i = 0; i < config_cache_deps_entries; i++) {
+		if (strcmp(config_cache_deps[i].path, path) == 0) {
+			return;
+		}
+	}
+
+	if (config_cache_deps_entries == CONFIG_CACHE_DEPS_MAX ||
+	    config_cache_dep_fill(path, &config_cache_deps[config_cache_deps_entries]) != 0) {
+		config_cache_deps_overflow = 1;
+		return;
+	}
+	config_cache_deps_entries++;
+}
+
+static int config_cache_load(const char *cache_file, icmap_map_t config_map)
+{
+	struct config_cache_header *header;
+	struct config_cache_dep *dep;
+	struct config_cache_key *key;
+	struct config_cache_dep_data current;
+	struct stat stat_buf;
+	const char *pos;
+	const char *end;
+	void *addr;
+	size_t size;
+	uint32_t i;
+	int pass;
+	int res = -1;
+	int fd;
+
+	fd = open(cache_file, O_RDONLY | O_NOFOLLOW);
+	if (fd == -1) {
+		return (-1);
+	}
+
+	if (fstat(fd, &stat_buf) != 0 || !S_ISREG(stat_buf.st_mode) ||
+	    stat_buf.st_uid != geteuid() || (stat_buf.st_mode & (S_IWGRP | S_IWOTH)) ||
+	    stat_buf.st_size < sizeof(struct config_cache_header)) {
+		close(fd);
+		return (-1);
+	}
+	size = stat_buf.st_size;
+
+	addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		return (-1);
+	}
+
+	header = addr;
+	end = (const char *)addr + size;
+	if (header->magic != CONFIG_CACHE_MAGIC || header->version != CONFIG_CACHE_VERSION ||
+	    header->size != size ||
+	    header->checksum != config_cache_hash(14695981039346656037ULL, header + 1,
+	    size - sizeof(*header))) {
+		goto unmap;
+	}
+
+	/*
+	 * Check all dependencies
+	 */
+	pos = (const char *)(header + 1);
+	for (i = 0; i < header->deps; i++) {
+		dep = (struct config_cache_dep *)pos;
+		if (end - pos < sizeof(*dep) || end - pos - sizeof(*dep) < dep->path_len ||
+		    dep->path_len == 0 || dep->path[dep->path_len - 1] != '\0') {
+			goto unmap;
+		}
+
+		if (config_cache_dep_fill(dep->path, &current) != 0 ||
+		    current.kind != dep->kind || current.size != dep->size ||
+		    current.mtime_sec != dep->mtime_sec || current.mtime_nsec != dep->mtime_nsec ||
+		    current.hash != dep->hash) {
+			goto unmap;
+		}
+		pos += sizeof(*dep) + dep->path_len;
+	}
+
+	/*
+	 * Validate every key first and only then set them, so a bad cache
+	 * never leaves a partially filled map behind
+	 */
+	for (pass = 0; pass < 2; pass++) {
+		const char *keys_pos = pos;
+
+		for (i = 0; i < header->keys; i++) {
+			key = (struct config_cache_key *)keys_pos;
+			if (end - keys_pos < sizeof(*key) ||
+			    end - keys_pos - sizeof(*key) < key->key_len ||
+			    end - keys_pos - sizeof(*key) - key->key_len < key->value_len ||
+			    key->key_len == 0 || key->data[key->key_len - 1] != '\0' ||
+			    key->value_len < icmap_get_valuetype_len(key->type)) {
+				goto unmap;
+			}
+
+			if (pass == 1) {
+				size_t value_len = icmap_get_valuetype_len(key->type);
+
+				if (key->type == ICMAP_VALUETYPE_STRING) {
+					value_len = strnlen(key->data + key->key_len, key->value_len) + 1;
+				} else if (key->type == ICMAP_VALUETYPE_BINARY) {
+					value_len = key->value_len;
+				}
+				if (value_len > key->value_len ||
+				    icmap_set_r(config_map, key->data, key->data + key->key_len,
+				    value_len, key->type) != CS_OK) {
+					goto unmap;
+				}
+			}
+			keys_pos += sizeof(*key) + key->key_len + key->value_len;
+		}
+	}
+	res = 0;
+
+unmap:
+	munmap(addr, size);
+
+	return (res);
+}
+
+static int config_cache_write(int fd, const void *data, size_t len, uint64_t *checksum)
+{
+	const char *p = data;
+	ssize_t written;
+
+	if (checksum != NULL) {
+		*checksum = config_cache_hash(*checksum, data, len);
+	}
+
+	while (len > 0) {
+		written = write(fd, p, len);
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return (-1);
+		}
+		p += written;
+		len -= written;
+	}
+
+	return (0);
+}
+
+/*
+ * Errors are not reported, a missing cache only means the next start
+ * parses the configuration again
+ */
+static void config_cache_save(const char *cache_file, icmap_map_t config_map)
+{
+	struct config_cache_header header;
+	struct config_cache_dep dep;
+	struct config_cache_key key;
+	static const char zeros[8];
+	char tmp_file[PATH_MAX];
+	icmap_iter_t iter;
+	const char *key_name;
+	size_t value_len;
+	icmap_value_types_t type;
+	char *value = NULL;
+	size_t name_len;
+	uint64_t size;
+	mode_t old_umask;
+	int fd;
+	int i;
+
+	if (config_cache_deps_overflow) {
+		return;
+	}
+
+	if (snprintf(tmp_file, sizeof(tmp_file), "%s.XXXXXX", cache_file) >= sizeof(tmp_file)) {
+		return;
+	}
+	old_umask = umask(077);
+	fd = mkstemp(tmp_file);
+	(void)umask(old_umask);
+	if (fd == -1) {
+		return;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = CONFIG_CACHE_MAGIC;
+	header.version = CONFIG_CACHE_VERSION;
+	header.checksum = 14695981039346656037ULL;
+	size = sizeof(header);
+
+	/*
+	 * Header is rewritten once size and checksum are known
+	 */
+	if (config_cache_write(fd, &header, sizeof(header), NULL) != 0) {
+		goto error_unlink;
+	}
+
+	for (i = 0; i < config_cache_deps_entries; i++) {
+		name_len = strlen(config_cache_deps[i].path) + 1;
+		memset(&dep, 0, sizeof(dep));
+		dep.kind = config_cache_deps[i].kind;
+		dep.path_len = CONFIG_CACHE_ALIGN(name_len);
+		dep.size = config_cache_deps[i].size;
+		dep.mtime_sec = config_cache_deps[i].mtime_sec;
+		dep.mtime_nsec = config_cache_deps[i].mtime_nsec;
+		dep.hash = config_cache_deps[i].hash;
+		if (config_cache_write(fd, &dep, sizeof(dep), &header.checksum) != 0 ||
+		    config_cache_write(fd, config_cache_deps[i].path, name_len, &header.checksum) != 0 ||
+		    config_cache_write(fd, zeros, dep.path_len - name_len, &header.checksum) != 0) {
+			goto error_unlink;
+		}
+		size += sizeof(dep) + dep.path_len;
+		header.deps++;
+	}
+
+	iter = icmap_iter_init_r(config_map, NULL);
+	while ((key_name = icmap_iter_next(iter, &value_len, &type)) != NULL) {
+		free(value);
+		value = malloc(value_len);
+		if (value == NULL ||
+		    icmap_get_r(config_map, key_name, value, &value_len, &type) != CS_OK) {
+			icmap_iter_finalize(iter);
+			goto error_unlink;
+		}
+
+		name_len = strlen(key_name) + 1;
+		memset(&key, 0, sizeof(key));
+		key.type = type;
+		key.key_len = CONFIG_CACHE_ALIGN(name_len);
+		key.value_len = CONFIG_CACHE_ALIGN(value_len);
+		if (config_cache_write(fd, &key, sizeof(key), &header.checksum) != 0 ||
+		    config_cache_write(fd, key_name, name_len, &header.checksum) != 0 ||
+		    config_cache_write(fd, zeros, key.key_len - name_len, &header.checksum) != 0 ||
+		    config_cache_write(fd, value, value_len, &header.checksum) != 0 ||
+		    config_cache_write(fd, zeros, key.value_len - value_len, &header.checksum) != 0) {
+			icmap_iter_finalize(iter);
+			goto error_unlink;
+		}
+		size += sizeof(key) + key.key_len + key.value_len;
+		header.keys++;
+	}
+	icmap_iter_finalize(iter);
+
+	header.size = size;
+	if (lseek(fd, 0, SEEK_SET) != 0 ||
+	    config_cache_write(fd, &header, sizeof(header), NULL) != 0 ||
+	    fsync(fd) != 0 || close(fd) != 0) {
+		fd = -1;
+		goto error_unlink;
+	}
+	free(value);
+
+	if (rename(tmp_file, cache_file) != 0) {
+		unlink(tmp_file);
+	}
+	return;
+
+error_unlink:
+	free(value);
+	if (fd != -1) {
+		close(fd);
+	}
+	unlink(tmp_file);
+}
@@ -47,12 +47,14 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <errno.h>
 #include <time.h>
 #include <assert.h>
 #include <arpa/inet.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <qb/qblist.h>
 #include <qb/qbmap.h>
@@ -71,6 +73,7 @@
 #endif
 
 #include "service.h"
+#include "probes.h"
 
 LOGSYS_DECLARE_SUBSYS ("CPG");
 
@@ -84,6 +87,7 @@ enum cpg_message_req_types {
 	MESSAGE_REQ_EXEC_CPG_DOWNLIST_OLD = 4,
 	MESSAGE_REQ_EXEC_CPG_DOWNLIST = 5,
 	MESSAGE_REQ_EXEC_CPG_PARTIAL_MCAST = 6,
+	MESSAGE_REQ_EXEC_CPG_JOINLIST_COMPACT = 7,
 };
 
 struct zcb_mapped {
@@ -137,7 +141,10 @@ enum cpd_state {
 
 enum cpg_sync_state {
 	CPGSYNC_DOWNLIST,
-	CPGSYNC_JOINLIST
+	CPGSYNC_JOINLIST,
+	CPGSYNC_JOINLIST_CHECK,
+	CPGSYNC_JOINLIST_RESEND,
+	CPGSYNC_JOINLIST_WAIT
 };
 
 static struct qb_list_head joinlist_messages_head;
@@ -154,6 +161,91 @@ struct cpg_pd {
 	struct qb_list_head list;
 	struct qb_list_head iteration_instance_list_head;
 	struct qb_list_head zcb_mapped_list_head;
+	struct cpg_deliver_ring *ring; /* Shared delivery ring, if attached */
+	unsigned int ring_reader;
+	int ring_started;
+	unsigned int lane; /* totem lane of group_name, see cpg_group_lane */
+	struct cpg_zcb_deliver_area *zcb_deliver; /* Zero-copy delivery area, if attached */
+};
+
+/*
+ * Shared delivery ring of a group for local clients with same credentials,
+ * see ipc_cpg.h. head and tail are kept here and never read back from the
+ * mapping, only the reader cursors are.
+ */
+struct cpg_deliver_ring_slot {
+	void *conn; /* NULL when the slot is free */
+	int started;
+	int closing;
+	uint64_t start; /* head when the reader started */
+	uint64_t final; /* head when the reader left the group */
+};
+
+struct cpg_deliver_ring {
+	struct qb_list_head list;
+	mar_cpg_name_t group_name;
+	uid_t uid;
+	gid_t gid;
+	uint32_t id;
+	char path[CPG_ZC_PATH_LEN];
+	struct cpg_deliver_ring_header *header;
+	char *data;
+	size_t map_size;
+	uint64_t head;
+	uint64_t tail;
+	unsigned int readers;
+	uint64_t written_seq; /* deliver_seq of the message last written */
+	int written;
+	uint64_t written_offset;
+	uint64_t written_cursor;
+	struct cpg_deliver_ring_slot slots[CPG_DELIVER_RING_READERS_MAX];
+};
+
+QB_LIST_DECLARE (cpg_deliver_ring_list_head);
+
+static uint32_t cpg_deliver_ring_last_id = 0;
+
+/*
+ * Incremented for every delivered message so each ring is written once
+ */
+static uint64_t cpg_deliver_seq = 0;
+
+/*
+ * Zero-copy delivery area of a connection, see ipc_cpg.h. Records are
+ * allocated at head and given back at tail in allocation order, the space
+ * skipped at the end of the data area belongs to the next record. Only the
+ * released flags are read back from the mapping.
+ */
+struct cpg_zcb_deliver_alloc {
+	struct qb_list_head list;
+	uint64_t end;
+	uint64_t offset; /* of the record in the data area */
+	int announced; /* sent to the library, which sets released */
+	int dropped; /* never sent, free to reuse */
+};
+
+/*
+ * Fragmented message being reassembled straight into the area
+ */
+struct cpg_zcb_deliver_assembly {
+	struct qb_list_head list;
+	unsigned int nodeid;
+	uint32_t pid;
+	uint32_t msglen;
+	uint32_t filled;
+	struct cpg_zcb_deliver_alloc *alloc;
+};
+
+struct cpg_zcb_deliver_area {
+	char path[CPG_ZC_PATH_LEN];
+	struct cpg_zcb_deliver_header *header;
+	char *data;
+	size_t map_size;
+	uint64_t head;
+	uint64_t tail;
+	int started;
+	struct qb_list_head alloc_list_head;
+	struct qb_list_head assembly_list_head;
 };
 
 struct cpg_iteration_instance {
@@ -194,6 +286,29 @@ struct join_list_entry {
 	mar_cpg_name_t group_name;
 };
 
+/*
+ * Compact joinlist: a record per group with the name stored once followed
+ * by the pids of the sender's processes in that group. Nodes which all
+ * stayed in the ring send only the digest of their process list.
+ *
+ * Once every member's joinlist arrived, each node sends a check message
+ * (pid_entries nodeids instead of groups) naming the nodes whose digest
+ * didn't match or whose joinlist couldn't be parsed. These send their
+ * full joinlist again, flagged as resent, before the sync finishes.
+ */
+#define CPG_JOINLIST_COMPACT_FLAG_DIGEST	0x1
+#define CPG_JOINLIST_COMPACT_FLAG_CHECK		0x2
+#define CPG_JOINLIST_COMPACT_FLAG_RESENT	0x4
+
+struct join_list_compact_group {
+	mar_uint32_t pid_entries;
+	mar_uint32_t name_length;
+	/* name padded to 4 bytes then pid_entries pids */
+	mar_uint8_t data[];
+};
+
+#define JOIN_LIST_COMPACT_NAME_LEN(len) (((len) + 3) & ~3)
+
 struct join_list_confchg_data {
 	mar_cpg_name_t cpg_group;
 	mar_cpg_address_t join_list[CPG_MEMBERS_MAX];
@@ -221,6 +336,10 @@ static void message_handler_req_exec_cpg_joinlist (
 	const void *message,
 	unsigned int nodeid);
 
+static void message_handler_req_exec_cpg_joinlist_compact (
+	const void *message,
+	unsigned int nodeid);
+
 static void message_handler_req_exec_cpg_mcast (
 	const void *message,
 	unsigned int nodeid);
@@ -241,6 +360,8 @@ static void exec_cpg_procjoin_endian_convert (void *msg);
 
 static void exec_cpg_joinlist_endian_convert (void *msg);
 
+static void exec_cpg_joinlist_compact_endian_convert (void *msg);
+
 static void exec_cpg_mcast_endian_convert (void *msg);
 
 static void exec_cpg_partial_mcast_endian_convert (void *msg);
@@ -259,6 +380,8 @@ static void message_handler_req_lib_cpg_mcast (void *conn, const void *message);
 
 static void message_handler_req_lib_cpg_partial_mcast (void *conn, const void *message);
 
+static void message_handler_req_lib_cpg_mcast_batch (void *conn, const void *message);
+
 static void message_handler_req_lib_cpg_membership (void *conn,
 						    const void *message);
 
@@ -288,6 +411,20 @@ static void message_handler_req_lib_cpg_zc_free (
 static void message_handler_req_lib_cpg_zc_execute (
 	void *conn,
 	const void *message);
+static void message_handler_req_lib_cpg_ring_attach (
+	void *conn,
+	const void *message);
+static void message_handler_req_lib_cpg_ring_start (
+	void *conn,
+	const void *message);
+
+static void message_handler_req_lib_cpg_zcb_deliver_attach (
+	void *conn,
+	const void *message);
+
+static void message_handler_req_lib_cpg_zcb_deliver_start (
+	void *conn,
+	const void *message);
 
 static int cpg_node_joinleave_send (unsigned int pid, const mar_cpg_name_t *group_name, int fn, int reason);
 
@@ -295,6 +432,10 @@ static int cpg_exec_send_downlist(void);
 
 static int cpg_exec_send_joinlist(void);
 
+static int cpg_exec_send_joinlist_compact(unsigned int flags);
+
+static int cpg_exec_send_joinlist_check(void);
+
 static void downlist_inform_clients (void);
 
 static void joinlist_inform_clients (void);
@@ -334,6 +475,19 @@ static int notify_lib_totem_membership (
 
 static inline int zcb_all_free (
 	struct cpg_pd *cpd);
+static void cpg_deliver_ring_detach (struct cpg_pd *cpd);
+static void cpg_deliver_ring_release (void *conn);
+static void cpg_zcb_deliver_destroy (struct cpg_zcb_deliver_area *area);
+static void cpg_zcb_deliver_assemblies_drop (struct cpg_zcb_deliver_area *area,
+	const mar_cpg_address_t *left_list, int left_list_entries);
+static int cpg_zcb_deliver_send (struct cpg_pd *cpd,
+	const mar_cpg_name_t *group_name, unsigned int nodeid, uint32_t pid,
+	const void *msg, uint32_t msglen);
+struct req_exec_cpg_partial_mcast;
+static int cpg_zcb_deliver_partial_send (struct cpg_pd *cpd, unsigned int nodeid,
+	const struct req_exec_cpg_partial_mcast *req_exec_cpg_mcast);
+static int cpg_deliver_ring_send (struct cpg_pd *cpd,
+	const struct iovec *iovec);
 
 static char *cpg_print_group_name (
 	const mar_cpg_name_t *group);
@@ -395,6 +549,26 @@ static struct corosync_lib_handler cpg_lib_engine[] =
 		.lib_handler_fn				= message_handler_req_lib_cpg_partial_mcast,
 		.flow_control				= CS_LIB_FLOW_CONTROL_REQUIRED
 	},
+	{ /* 13 - MESSAGE_REQ_CPG_MCAST_BATCH */
+		.lib_handler_fn				= message_handler_req_lib_cpg_mcast_batch,
+		.flow_control				= CS_LIB_FLOW_CONTROL_REQUIRED
+	},
+	{ /* 14 - MESSAGE_REQ_CPG_RING_ATTACH */
+		.lib_handler_fn				= message_handler_req_lib_cpg_ring_attach,
+		.flow_control				= CS_LIB_FLOW_CONTROL_NOT_REQUIRED
+	},
+	{ /* 15 - MESSAGE_REQ_CPG_RING_START */
+		.lib_handler_fn				= message_handler_req_lib_cpg_ring_start,
+		.flow_control				= CS_LIB_FLOW_CONTROL_NOT_REQUIRED
+	},
+	{ /* 16 - MESSAGE_REQ_CPG_ZCB_DELIVER_ATTACH */
+		.lib_handler_fn				= message_handler_req_lib_cpg_zcb_deliver_attach,
+		.flow_control				= CS_LIB_FLOW_CONTROL_NOT_REQUIRED
+	},
+	{ /* 17 - MESSAGE_REQ_CPG_ZCB_DELIVER_START */
+		.lib_handler_fn				= message_handler_req_lib_cpg_zcb_deliver_start,
+		.flow_control				= CS_LIB_FLOW_CONTROL_NOT_REQUIRED
+	},
 
 };
 
@@ -428,6 +602,10 @@ static struct corosync_exec_handler cpg_exec_engine[] =
 		.exec_handler_fn	= message_handler_req_exec_cpg_partial_mcast,
 		.exec_endian_convert_fn	= exec_cpg_partial_mcast_endian_convert
 	},
+	{ /* 7 - MESSAGE_REQ_EXEC_CPG_JOINLIST_COMPACT */
+		.exec_handler_fn	= message_handler_req_exec_cpg_joinlist_compact,
+		.exec_endian_convert_fn	= exec_cpg_joinlist_compact_endian_convert
+	},
 };
 
 struct corosync_service_engine cpg_service_engine = {
@@ -496,6 +674,22 @@ struct req_exec_cpg_downlist {
 	/* downlist below */
 	mar_uint32_t left_nodes __attribute__((aligned(8)));
 	mar_uint32_t nodeids[PROCESSOR_COUNT_MAX]  __attribute__((aligned(8)));
+	/* not sent by older versions, check header.size */
+	mar_uint32_t flags __attribute__((aligned(8)));
+};
+
+#define CPG_DOWNLIST_FLAG_JOINLIST_COMPACT	0x1
+
+#define CPG_DOWNLIST_HAS_FLAGS(dl) \
+	((dl)->header.size >= offsetof(struct req_exec_cpg_downlist, flags) + sizeof(mar_uint32_t))
+
+struct req_exec_cpg_joinlist_compact {
+	struct qb_ipc_request_header header __attribute__((aligned(8)));
+	mar_uint32_t flags __attribute__((aligned(8)));
+	mar_uint32_t group_entries __attribute__((aligned(8)));
+	mar_uint32_t pid_entries __attribute__((aligned(8)));
+	mar_uint64_t digest __attribute__((aligned(8)));
+	mar_uint8_t groups[] __attribute__((aligned(8)));
 };
 
 struct joinlist_msg {
@@ -507,6 +701,47 @@ struct joinlist_msg {
 
 static struct req_exec_cpg_downlist g_req_exec_cpg_downlist;
 
+/*
+ * Downlists received in the current sync, the joinlist is only sent
+ * in the compact format once every member announced it can read it
+ */
+static unsigned int downlist_received_entries;
+
+static int downlist_all_compact;
+
+/*
+ * No node joined, every member already knows our processes
+ */
+static int joinlist_digest_allowed;
+
+/*
+ * Senders which sent a matching digest, their processes we already know
+ * about are kept as they are
+ */
+static unsigned int joinlist_digest_nodes[PROCESSOR_COUNT_MAX];
+
+static unsigned int joinlist_digest_nodes_entries;
+
+/*
+ * Compact joinlists and check messages received in the current sync
+ */
+static unsigned int joinlist_received_entries;
+
+static unsigned int joinlist_check_received_entries;
+
+/*
+ * Senders whose digest didn't match or whose joinlist was unusable, we
+ * wait for their full joinlist
+ */
+static unsigned int joinlist_resend_nodes[PROCESSOR_COUNT_MAX];
+
+static unsigned int joinlist_resend_nodes_entries;
+
+/*
+ * Some member asked for our full joinlist
+ */
+static int joinlist_resend_requested;
+
 /*
  * Function print group name. It's not reentrant
  */
@@ -554,6 +789,17 @@ static void cpg_sync_init (
 		sizeof (unsigned int));
 	my_member_list_entries = member_list_entries;
 
+	downlist_received_entries = 0;
+	downlist_all_compact = 1;
+	joinlist_received_entries = 0;
+	joinlist_check_received_entries = 0;
+	joinlist_resend_nodes_entries = 0;
+	joinlist_resend_requested = 0;
+	/*
+	 * The transitional membership is a subset of the new one
+	 */
+	joinlist_digest_allowed = (trans_list_entries == member_list_entries);
+
 	last_sync_ring_id.nodeid = ring_id->nodeid;
 	last_sync_ring_id.seq = ring_id->seq;
 
@@ -589,7 +835,45 @@ static int cpg_sync_process (void)
 		my_sync_state = CPGSYNC_JOINLIST;
 	}
 	if (my_sync_state == CPGSYNC_JOINLIST) {
+		/*
+		 * Wait for the downlists of all members, they tell which
+		 * joinlist format everybody understands
+		 */
+		if (downlist_received_entries < my_member_list_entries) {
+			return (-1);
+		}
 		res = cpg_exec_send_joinlist();
+		if (res == -1 || !downlist_all_compact) {
+			return (res);
+		}
+		my_sync_state = CPGSYNC_JOINLIST_CHECK;
+	}
+	if (my_sync_state == CPGSYNC_JOINLIST_CHECK) {
+		/*
+		 * Tell the others which joinlists we couldn't use
+		 */
+		if (joinlist_received_entries < my_member_list_entries) {
+			return (-1);
+		}
+		if (cpg_exec_send_joinlist_check() == -1) {
+			return (-1);
+		}
+		my_sync_state = CPGSYNC_JOINLIST_RESEND;
+	}
+	if (my_sync_state == CPGSYNC_JOINLIST_RESEND) {
+		if (joinlist_check_received_entries < my_member_list_entries) {
+			return (-1);
+		}
+		if (joinlist_resend_requested) {
+			if (cpg_exec_send_joinlist_compact(CPG_JOINLIST_COMPACT_FLAG_RESENT) == -1) {
+				return (-1);
+			}
+			joinlist_resend_requested = 0;
+		}
+		my_sync_state = CPGSYNC_JOINLIST_WAIT;
+	}
+	if (my_sync_state == CPGSYNC_JOINLIST_WAIT) {
+		res = (joinlist_resend_nodes_entries == 0) ? 0 : -1;
 	}
 	return (res);
 }
@@ -790,6 +1074,10 @@ static int notify_lib_joinlist(
 				api->ipc_dispatch_send (cpd->conn, buf, size);
 				cpd->transition_counter++;
 			}
+			if (cpd->zcb_deliver != NULL && left_list_entries) {
+				cpg_zcb_deliver_assemblies_drop (cpd->zcb_deliver,
+					left_list, left_list_entries);
+			}
 		}
 	}
 
@@ -810,6 +1098,11 @@ static int notify_lib_joinlist(
 						cpd->pid = 0;
 						memset (&cpd->group_name, 0, sizeof(cpd->group_name));
 						cpd->cpd_state = CPD_STATE_UNJOINED;
+						cpg_deliver_ring_detach (cpd);
+						if (cpd->zcb_deliver != NULL) {
+							cpg_zcb_deliver_assemblies_drop (cpd->zcb_deliver,
+								NULL, 0);
+						}
 					}
 				}
 			}
@@ -924,6 +1217,58 @@ static void downlist_inform_clients (void)
 	qb_map_destroy(group_map);
 }
 
+/*
+ * Order independent digest of the processes of a node, so the sender and
+ * the receivers get the same value whatever order their lists are in
+ */
+static uint64_t joinlist_entry_hash (const mar_cpg_name_t *group, uint32_t pid)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	unsigned int i;
+
+	for (i = 0; i < group->length; i++) {
+		hash = (hash ^ (unsigned char)group->value[i]) * 1099511628211ULL;
+	}
+	for (i = 0; i < 4; i++) {
+		hash = (hash ^ ((pid >> (i * 8)) & 0xff)) * 1099511628211ULL;
+	}
+	hash = (hash ^ group->length) * 1099511628211ULL;
+
+	return (hash);
+}
+
+static uint64_t joinlist_digest (unsigned int nodeid, uint32_t *entries)
+{
+	struct qb_list_head *iter;
+	struct process_info *pi;
+	uint64_t digest = 0;
+
+	*entries = 0;
+	qb_list_for_each(iter, &process_info_list_head) {
+		pi = qb_list_entry (iter, struct process_info, list);
+
+		if (pi->nodeid == nodeid) {
+			digest += joinlist_entry_hash (&pi->group, pi->pid);
+			(*entries)++;
+		}
+	}
+
+	return (digest);
+}
+
+static int joinlist_digest_node_find (unsigned int nodeid)
+{
+	unsigned int i;
+
+	for (i = 0; i < joinlist_digest_nodes_entries; i++) {
+		if (joinlist_digest_nodes[i] == nodeid) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
 /*
  * Remove processes that might have left the group while we were suspended.
  */
@@ -945,6 +1290,13 @@ static void joinlist_remove_zombie_pi_entries (void)
 			continue ;
 		}
 
+		/*
+		 * Node only sent a digest of the processes we already have
+		 */
+		if (joinlist_digest_node_find (pi->nodeid)) {
+			continue ;
+		}
+
 		/*
 		 * Try to find message in joinlist messages
 		 */
@@ -1024,6 +1376,8 @@ static void joinlist_messages_delete (void)
 		free (stored_msg);
 	}
 	qb_list_init (&joinlist_messages_head);
+
+	joinlist_digest_nodes_entries = 0;
 }
 
 static char *cpg_exec_init_fn (struct corosync_api_v1 *corosync_api)
@@ -1054,6 +1408,11 @@ static void cpg_pd_finalize (struct cpg_pd *cpd)
 	struct cpg_iteration_instance *cpii;
 
 	zcb_all_free(cpd);
+	cpg_deliver_ring_release(cpd->conn);
+	if (cpd->zcb_deliver != NULL) {
+		cpg_zcb_deliver_destroy (cpd->zcb_deliver);
+		cpd->zcb_deliver = NULL;
+	}
 	qb_list_for_each_safe(iter, tmp_iter, &(cpd->iteration_instance_list_head)) {
 		cpii = qb_list_entry (iter, struct cpg_iteration_instance, list);
 
@@ -1080,6 +1439,28 @@ static int cpg_lib_exit_fn (void *conn)
 	return (0);
 }
 
+/*
+ * Messages of a group are all sent on one lane chosen by the group name,
+ * so every node picks the same lane and groups on different lanes don't
+ * wait for each other. Sync messages stay on lane 0.
+ */
+static unsigned int cpg_group_lane (const mar_cpg_name_t *group_name)
+{
+	unsigned int lanes = api->totem_lanes_get ();
+	uint32_t hash = 2166136261U;
+	unsigned int i;
+
+	if (lanes <= 1) {
+		return (0);
+	}
+
+	for (i = 0; i < group_name->length; i++) {
+		hash = (hash ^ (unsigned char)group_name->value[i]) * 16777619U;
+	}
+
+	return (hash % lanes);
+}
+
 static int cpg_node_joinleave_send (unsigned int pid, const mar_cpg_name_t *group_name, int fn, int reason)
 {
 	struct req_exec_cpg_procjoin req_exec_cpg_procjoin;
@@ -1098,7 +1479,8 @@ static int cpg_node_joinleave_send (unsigned int pid, const mar_cpg_name_t *grou
 	req_exec_cpg_iovec.iov_base = (char *)&req_exec_cpg_procjoin;
 	req_exec_cpg_iovec.iov_len = sizeof(req_exec_cpg_procjoin);
 
-	result = api->totem_mcast (&req_exec_cpg_iovec, 1, TOTEM_AGREED);
+	result = api->totem_mcast_lane (&req_exec_cpg_iovec, 1, TOTEM_AGREED,
+		cpg_group_lane (group_name));
 
 	return (result);
 }
@@ -1128,6 +1510,58 @@ static void exec_cpg_joinlist_endian_convert (void *msg_v)
 	}
 }
 
+static void exec_cpg_joinlist_compact_endian_convert (void *msg)
+{
+	struct req_exec_cpg_joinlist_compact *req_exec_cpg_joinlist_compact = msg;
+	struct join_list_compact_group *jlg;
+	const char *end;
+	char *pos;
+	mar_uint32_t *pids;
+	unsigned int i, j;
+
+	swab_coroipc_request_header_t (&req_exec_cpg_joinlist_compact->header);
+	req_exec_cpg_joinlist_compact->flags = swab32(req_exec_cpg_joinlist_compact->flags);
+	req_exec_cpg_joinlist_compact->group_entries = swab32(req_exec_cpg_joinlist_compact->group_entries);
+	req_exec_cpg_joinlist_compact->pid_entries = swab32(req_exec_cpg_joinlist_compact->pid_entries);
+	swab_mar_uint64_t (&req_exec_cpg_joinlist_compact->digest);
+
+	end = (const char *)msg + req_exec_cpg_joinlist_compact->header.size;
+
+	if (req_exec_cpg_joinlist_compact->flags & CPG_JOINLIST_COMPACT_FLAG_CHECK) {
+		pids = (mar_uint32_t *)req_exec_cpg_joinlist_compact->groups;
+		for (j = 0; j < req_exec_cpg_joinlist_compact->pid_entries &&
+		    (const char *)(pids + j + 1) <= end; j++) {
+			pids[j] = swab32(pids[j]);
+		}
+		return;
+	}
+
+	/*
+	 * Stop at the first record which doesn't fit, the handler rejects it
+	 */
+	pos = (char *)req_exec_cpg_joinlist_compact->groups;
+	for (i = 0; i < req_exec_cpg_joinlist_compact->group_entries; i++) {
+		jlg = (struct join_list_compact_group *)pos;
+		if (pos + sizeof(*jlg) > end) {
+			return;
+		}
+		jlg->pid_entries = swab32(jlg->pid_entries);
+		jlg->name_length = swab32(jlg->name_length);
+		if (jlg->name_length > CPG_MAX_NAME_LENGTH ||
+		    jlg->pid_entries > (end - pos) / sizeof(mar_uint32_t)) {
+			return;
+		}
+		pids = (mar_uint32_t *)(jlg->data + JOIN_LIST_COMPACT_NAME_LEN(jlg->name_length));
+		if ((const char *)(pids + jlg->pid_entries) > end) {
+			return;
+		}
+		for (j = 0; j < jlg->pid_entries; j++) {
+			pids[j] = swab32(pids[j]);
+		}
+		pos = (char *)(pids + jlg->pid_entries);
+	}
+}
+
 static void exec_cpg_downlist_endian_convert_old (void *msg)
 {
 }
@@ -1137,12 +1571,17 @@ static void exec_cpg_downlist_endian_convert (void *msg)
 	struct req_exec_cpg_downlist *req_exec_cpg_downlist = msg;
 	unsigned int i;
 
+	swab_coroipc_request_header_t (&req_exec_cpg_downlist->header);
 	req_exec_cpg_downlist->left_nodes = swab32(req_exec_cpg_downlist->left_nodes);
 	req_exec_cpg_downlist->old_members = swab32(req_exec_cpg_downlist->old_members);
 
 	for (i = 0; i < req_exec_cpg_downlist->left_nodes; i++) {
 		req_exec_cpg_downlist->nodeids[i] = swab32(req_exec_cpg_downlist->nodeids[i]);
 	}
+
+	if (CPG_DOWNLIST_HAS_FLAGS(req_exec_cpg_downlist)) {
+		req_exec_cpg_downlist->flags = swab32(req_exec_cpg_downlist->flags);
+	}
 }
 
 
@@ -1287,6 +1726,9 @@ static void message_handler_req_exec_cpg_downlist_old (
 {
 	log_printf (LOGSYS_LEVEL_DEBUG, "downlist OLD from node " CS_PRI_NODE_ID,
 		nodeid);
+
+	downlist_received_entries++;
+	downlist_all_compact = 0;
 }
 
 static void message_handler_req_exec_cpg_downlist(
@@ -1297,6 +1739,12 @@ static void message_handler_req_exec_cpg_downlist(
 
 	log_printf (LOGSYS_LEVEL_DEBUG, "downlist left_list: %d received",
 			req_exec_cpg_downlist->left_nodes);
+
+	downlist_received_entries++;
+	if (!CPG_DOWNLIST_HAS_FLAGS(req_exec_cpg_downlist) ||
+	    !(req_exec_cpg_downlist->flags & CPG_DOWNLIST_FLAG_JOINLIST_COMPACT)) {
+		downlist_all_compact = 0;
+	}
 }
 
 
@@ -1358,6 +1806,171 @@ static void message_handler_req_exec_cpg_joinlist (
 	}
 }
 
+static void joinlist_msg_store (unsigned int nodeid, const mar_cpg_name_t *group_name, uint32_t pid)
+{
+	struct joinlist_msg *stored_msg;
+
+	stored_msg = malloc (sizeof (struct joinlist_msg));
+	if (!stored_msg) {
+		log_printf(LOGSYS_LEVEL_WARNING, "Unable to allocate joinlist entry");
+		return ;
+	}
+	memset(stored_msg, 0, sizeof (struct joinlist_msg));
+	stored_msg->sender_nodeid = nodeid;
+	stored_msg->pid = pid;
+	memcpy(&stored_msg->group_name, group_name, sizeof(mar_cpg_name_t));
+	qb_list_init (&stored_msg->list);
+	qb_list_add (&stored_msg->list, &joinlist_messages_head);
+}
+
+static int joinlist_resend_node_find (unsigned int nodeid)
+{
+	unsigned int i;
+
+	for (i = 0; i < joinlist_resend_nodes_entries; i++) {
+		if (joinlist_resend_nodes[i] == nodeid) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
+static void joinlist_resend_node_add (unsigned int nodeid)
+{
+	if (joinlist_resend_nodes_entries < PROCESSOR_COUNT_MAX &&
+	    !joinlist_resend_node_find (nodeid)) {
+		joinlist_resend_nodes[joinlist_resend_nodes_entries++] = nodeid;
+	}
+}
+
+static void joinlist_resend_node_del (unsigned int nodeid)
+{
+	unsigned int i;
+
+	for (i = 0; i < joinlist_resend_nodes_entries; i++) {
+		if (joinlist_resend_nodes[i] == nodeid) {
+			joinlist_resend_nodes[i] =
+				joinlist_resend_nodes[--joinlist_resend_nodes_entries];
+			return ;
+		}
+	}
+}
+
+static void message_handler_req_exec_cpg_joinlist_compact (
+	const void *message,
+	unsigned int nodeid)
+{
+	const struct req_exec_cpg_joinlist_compact *req_exec_cpg_joinlist_compact = message;
+	const struct join_list_compact_group *jlg;
+	const mar_uint32_t *pids;
+	const char *end;
+	const char *pos;
+	mar_cpg_name_t group_name;
+	uint64_t digest;
+	uint32_t entries;
+	unsigned int i, j;
+	int resent;
+
+	log_printf(LOGSYS_LEVEL_DEBUG, "got compact joinlist message from node " CS_PRI_NODE_ID
+		" (groups: %u, processes: %u%s%s%s)",
+		nodeid, req_exec_cpg_joinlist_compact->group_entries,
+		req_exec_cpg_joinlist_compact->pid_entries,
+		(req_exec_cpg_joinlist_compact->flags & CPG_JOINLIST_COMPACT_FLAG_DIGEST) ? ", digest" : "",
+		(req_exec_cpg_joinlist_compact->flags & CPG_JOINLIST_COMPACT_FLAG_CHECK) ? ", check" : "",
+		(req_exec_cpg_joinlist_compact->flags & CPG_JOINLIST_COMPACT_FLAG_RESENT) ? ", resent" : "");
+
+	end = (const char *)message + req_exec_cpg_joinlist_compact->header.size;
+
+	if (req_exec_cpg_joinlist_compact->flags & CPG_JOINLIST_COMPACT_FLAG_CHECK) {
+		joinlist_check_received_entries++;
+
+		pids = (const mar_uint32_t *)req_exec_cpg_joinlist_compact->groups;
+		if (req_exec_cpg_joinlist_compact->pid_entries >
+		    (end - (const char *)pids) / sizeof(mar_uint32_t)) {
+			log_printf(LOGSYS_LEVEL_WARNING, "malformed joinlist check message from node "
+				CS_PRI_NODE_ID, nodeid);
+			return ;
+		}
+		for (i = 0; i < req_exec_cpg_joinlist_compact->pid_entries; i++) {
+			if (pids[i] == api->totem_nodeid_get()) {
+				joinlist_resend_requested = 1;
+			}
+		}
+		return ;
+	}
+
+	resent = (req_exec_cpg_joinlist_compact->flags & CPG_JOINLIST_COMPACT_FLAG_RESENT) != 0;
+	if (!resent) {
+		joinlist_received_entries++;
+	}
+
+	if (nodeid == api->totem_nodeid_get()) {
+		return ;
+	}
+
+	if (resent) {
+		/*
+		 * Only the nodes which asked for it use the resent joinlist
+		 */
+		if (!joinlist_resend_node_find (nodeid)) {
+			return ;
+		}
+		joinlist_resend_node_del (nodeid);
+	}
+
+	if (req_exec_cpg_joinlist_compact->flags & CPG_JOINLIST_COMPACT_FLAG_DIGEST) {
+		digest = joinlist_digest (nodeid, &entries);
+		if (digest != req_exec_cpg_joinlist_compact->digest ||
+		    entries != req_exec_cpg_joinlist_compact->pid_entries) {
+			log_printf(LOGSYS_LEVEL_WARNING, "process list digest of node " CS_PRI_NODE_ID
+				" doesn't match (processes: %u, known here: %u), requesting full joinlist",
+				nodeid, req_exec_cpg_joinlist_compact->pid_entries, entries);
+			joinlist_resend_node_add (nodeid);
+		} else if (joinlist_digest_nodes_entries < PROCESSOR_COUNT_MAX &&
+		    !joinlist_digest_node_find (nodeid)) {
+			joinlist_digest_nodes[joinlist_digest_nodes_entries++] = nodeid;
+		}
+		return ;
+	}
+
+	pos = (const char *)req_exec_cpg_joinlist_compact->groups;
+	for (i = 0; i < req_exec_cpg_joinlist_compact->group_entries; i++) {
+		jlg = (const struct join_list_compact_group *)pos;
+		if (pos + sizeof(*jlg) > end ||
+		    jlg->name_length > CPG_MAX_NAME_LENGTH ||
+		    jlg->pid_entries > (end - pos) / sizeof(mar_uint32_t)) {
+			goto malformed;
+		}
+		pids = (const mar_uint32_t *)(jlg->data + JOIN_LIST_COMPACT_NAME_LEN(jlg->name_length));
+		if ((const char *)(pids + jlg->pid_entries) > end) {
+			goto malformed;
+		}
+
+		memset(&group_name, 0, sizeof(group_name));
+		group_name.length = jlg->name_length;
+		memcpy(group_name.value, jlg->data, jlg->name_length);
+
+		for (j = 0; j < jlg->pid_entries; j++) {
+			joinlist_msg_store (nodeid, &group_name, pids[j]);
+		}
+		pos = (const char *)(pids + jlg->pid_entries);
+	}
+	return ;
+
+malformed:
+	if (resent) {
+		log_printf(LOGSYS_LEVEL_ERROR, "malformed resent joinlist message from node " CS_PRI_NODE_ID
+			" (group %u of %u), processes not listed are removed",
+			nodeid, i, req_exec_cpg_joinlist_compact->group_entries);
+	} else {
+		log_printf(LOGSYS_LEVEL_WARNING, "malformed compact joinlist message from node " CS_PRI_NODE_ID
+			" (group %u of %u), requesting full joinlist",
+			nodeid, i, req_exec_cpg_joinlist_compact->group_entries);
+		joinlist_resend_node_add (nodeid);
+	}
+}
+
 static void message_handler_req_exec_cpg_mcast (
 	const void *message,
 	unsigned int nodeid)
@@ -1369,6 +1982,7 @@ static void message_handler_req_exec_cpg_mcast (
 	struct cpg_pd *cpd;
 	struct iovec iovec[2];
 	int known_node = 0;
+	int delivered = 0;
 
 	res_lib_cpg_mcast.header.id = MESSAGE_RES_CPG_DELIVER_CALLBACK;
 	res_lib_cpg_mcast.header.size = sizeof(res_lib_cpg_mcast) + msglen;
@@ -1384,6 +1998,8 @@ static void message_handler_req_exec_cpg_mcast (
 	iovec[1].iov_base = (char*)message+sizeof(*req_exec_cpg_mcast);
 	iovec[1].iov_len = msglen;
 
+	cpg_deliver_seq++;
+
 	qb_list_for_each_safe(iter, tmp_iter, &cpg_pd_list_head) {
 		cpd = qb_list_entry(iter, struct cpg_pd, list);
 		if ((cpd->cpd_state == CPD_STATE_LEAVE_STARTED || cpd->cpd_state == CPD_STATE_JOIN_COMPLETED)
@@ -1407,9 +2023,20 @@ static void message_handler_req_exec_cpg_mcast (
 				return ;
 			}
 
-			api->ipc_dispatch_iov_send (cpd->conn, iovec, 2);
+			if (cpg_zcb_deliver_send (cpd, &req_exec_cpg_mcast->group_name, nodeid,
+			    req_exec_cpg_mcast->pid, iovec[1].iov_base, msglen) == 0) {
+				delivered++;
+				continue;
+			}
+			if (cpd->ring == NULL || cpg_deliver_ring_send (cpd, iovec) != 0) {
+				api->ipc_dispatch_iov_send (cpd->conn, iovec, 2);
+			}
+			delivered++;
 		}
 	}
+
+	CS_PROBE5 (cpg_mcast_deliver, nodeid, req_exec_cpg_mcast->pid,
+		req_exec_cpg_mcast->group_name.value, msglen, delivered);
 }
 
 static void message_handler_req_exec_cpg_partial_mcast (
@@ -1466,7 +2093,9 @@ static void message_handler_req_exec_cpg_partial_mcast (
 				return ;
 			}
 
-			api->ipc_dispatch_iov_send (cpd->conn, iovec, 2);
+			if (cpg_zcb_deliver_partial_send (cpd, nodeid, req_exec_cpg_mcast) != 0) {
+				api->ipc_dispatch_iov_send (cpd->conn, iovec, 2);
+			}
 		}
 	}
 }
@@ -1481,21 +2110,172 @@ static int cpg_exec_send_downlist(void)
 
 	g_req_exec_cpg_downlist.old_members = my_old_member_list_entries;
 
+	g_req_exec_cpg_downlist.flags = CPG_DOWNLIST_FLAG_JOINLIST_COMPACT;
+
 	iov.iov_base = (void *)&g_req_exec_cpg_downlist;
 	iov.iov_len = g_req_exec_cpg_downlist.header.size;
 
 	return (api->totem_mcast (&iov, 1, TOTEM_AGREED));
 }
 
-static int cpg_exec_send_joinlist(void)
+static int process_info_group_compare (const void *a, const void *b)
 {
-	int count = 0;
-	struct qb_list_head *iter;
-	struct qb_ipc_response_header *res;
-	char *buf;
-	size_t buf_size;
-	struct join_list_entry *jle;
-	struct iovec req_exec_cpg_iovec;
+	const struct process_info *pi_a = *(const struct process_info * const *)a;
+	const struct process_info *pi_b = *(const struct process_info * const *)b;
+	int res;
+
+	res = mar_name_compare (&pi_a->group, &pi_b->group);
+	if (res == 0) {
+		res = (pi_a->pid > pi_b->pid) - (pi_a->pid < pi_b->pid);
+	}
+
+	return (res);
+}
+
+static int cpg_exec_send_joinlist_compact(unsigned int flags)
+{
+	struct req_exec_cpg_joinlist_compact *req_exec_cpg_joinlist_compact;
+	struct join_list_compact_group *jlg = NULL;
+	struct process_info **local_pi;
+	struct qb_list_head *iter;
+	struct iovec req_exec_cpg_iovec;
+	mar_uint32_t *pids = NULL;
+	unsigned int count = 0;
+	unsigned int groups = 0;
+	unsigned int i;
+	size_t buf_size;
+	char *buf;
+	int res;
+
+	qb_list_for_each(iter, &process_info_list_head) {
+		struct process_info *pi = qb_list_entry (iter, struct process_info, list);
+
+		if (pi->nodeid == api->totem_nodeid_get ()) {
+			count++;
+		}
+	}
+
+	/*
+	 * Always send something, the other members wait for our joinlist
+	 * before checking them
+	 */
+	if ((joinlist_digest_allowed && !(flags & CPG_JOINLIST_COMPACT_FLAG_RESENT)) || !count) {
+		struct req_exec_cpg_joinlist_compact req_exec_cpg_joinlist_digest;
+
+		memset(&req_exec_cpg_joinlist_digest, 0, sizeof(req_exec_cpg_joinlist_digest));
+		req_exec_cpg_joinlist_digest.header.id = SERVICE_ID_MAKE(CPG_SERVICE, MESSAGE_REQ_EXEC_CPG_JOINLIST_COMPACT);
+		req_exec_cpg_joinlist_digest.header.size = sizeof(req_exec_cpg_joinlist_digest);
+		req_exec_cpg_joinlist_digest.flags = flags;
+		if (count) {
+			req_exec_cpg_joinlist_digest.flags |= CPG_JOINLIST_COMPACT_FLAG_DIGEST;
+			req_exec_cpg_joinlist_digest.digest = joinlist_digest (api->totem_nodeid_get (),
+				&req_exec_cpg_joinlist_digest.pid_entries);
+		}
+
+		req_exec_cpg_iovec.iov_base = (void *)&req_exec_cpg_joinlist_digest;
+		req_exec_cpg_iovec.iov_len = sizeof(req_exec_cpg_joinlist_digest);
+
+		return (api->totem_mcast (&req_exec_cpg_iovec, 1, TOTEM_AGREED));
+	}
+
+	local_pi = malloc (sizeof (struct process_info *) * count);
+	if (!local_pi) {
+		log_printf(LOGSYS_LEVEL_WARNING, "Unable to allocate joinlist buffer");
+		return -1;
+	}
+
+	i = 0;
+	qb_list_for_each(iter, &process_info_list_head) {
+		struct process_info *pi = qb_list_entry (iter, struct process_info, list);
+
+		if (pi->nodeid == api->totem_nodeid_get ()) {
+			local_pi[i++] = pi;
+		}
+	}
+	qsort (local_pi, count, sizeof (struct process_info *), process_info_group_compare);
+
+	buf_size = sizeof(struct req_exec_cpg_joinlist_compact) + sizeof(mar_uint32_t) * count;
+	for (i = 0; i < count; i++) {
+		if (i == 0 || mar_name_compare (&local_pi[i - 1]->group, &local_pi[i]->group) != 0) {
+			buf_size += sizeof(struct join_list_compact_group) +
+				JOIN_LIST_COMPACT_NAME_LEN(local_pi[i]->group.length);
+		}
+	}
+
+	buf = malloc (buf_size);
+	if (!buf) {
+		log_printf(LOGSYS_LEVEL_WARNING, "Unable to allocate joinlist buffer");
+		free (local_pi);
+		return -1;
+	}
+	memset(buf, 0, buf_size);
+
+	req_exec_cpg_joinlist_compact = (struct req_exec_cpg_joinlist_compact *)buf;
+
+	jlg = (struct join_list_compact_group *)req_exec_cpg_joinlist_compact->groups;
+	for (i = 0; i < count; i++) {
+		if (i == 0 || mar_name_compare (&local_pi[i - 1]->group, &local_pi[i]->group) != 0) {
+			if (i != 0) {
+				jlg = (struct join_list_compact_group *)(pids + jlg->pid_entries);
+			}
+			jlg->name_length = local_pi[i]->group.length;
+			memcpy (jlg->data, local_pi[i]->group.value, local_pi[i]->group.length);
+			pids = (mar_uint32_t *)(jlg->data + JOIN_LIST_COMPACT_NAME_LEN(jlg->name_length));
+			groups++;
+		}
+		pids[jlg->pid_entries++] = local_pi[i]->pid;
+	}
+	free (local_pi);
+
+	req_exec_cpg_joinlist_compact->header.id = SERVICE_ID_MAKE(CPG_SERVICE, MESSAGE_REQ_EXEC_CPG_JOINLIST_COMPACT);
+	req_exec_cpg_joinlist_compact->header.size = buf_size;
+	req_exec_cpg_joinlist_compact->flags = flags;
+	req_exec_cpg_joinlist_compact->group_entries = groups;
+	req_exec_cpg_joinlist_compact->pid_entries = count;
+
+	req_exec_cpg_iovec.iov_base = buf;
+	req_exec_cpg_iovec.iov_len = buf_size;
+
+	res = api->totem_mcast (&req_exec_cpg_iovec, 1, TOTEM_AGREED);
+
+	free (buf);
+
+	return (res);
+}
+
+static int cpg_exec_send_joinlist_check(void)
+{
+	struct req_exec_cpg_joinlist_compact req_exec_cpg_joinlist_check;
+	struct iovec req_exec_cpg_iovec[2];
+
+	memset(&req_exec_cpg_joinlist_check, 0, sizeof(req_exec_cpg_joinlist_check));
+	req_exec_cpg_joinlist_check.header.id = SERVICE_ID_MAKE(CPG_SERVICE, MESSAGE_REQ_EXEC_CPG_JOINLIST_COMPACT);
+	req_exec_cpg_joinlist_check.header.size = sizeof(req_exec_cpg_joinlist_check) +
+		sizeof(mar_uint32_t) * joinlist_resend_nodes_entries;
+	req_exec_cpg_joinlist_check.flags = CPG_JOINLIST_COMPACT_FLAG_CHECK;
+	req_exec_cpg_joinlist_check.pid_entries = joinlist_resend_nodes_entries;
+
+	req_exec_cpg_iovec[0].iov_base = (void *)&req_exec_cpg_joinlist_check;
+	req_exec_cpg_iovec[0].iov_len = sizeof(req_exec_cpg_joinlist_check);
+	req_exec_cpg_iovec[1].iov_base = (void *)joinlist_resend_nodes;
+	req_exec_cpg_iovec[1].iov_len = sizeof(mar_uint32_t) * joinlist_resend_nodes_entries;
+
+	return (api->totem_mcast (req_exec_cpg_iovec, 2, TOTEM_AGREED));
+}
+
+static int cpg_exec_send_joinlist(void)
+{
+	int count = 0;
+	struct qb_list_head *iter;
+	struct qb_ipc_response_header *res;
+	char *buf;
+	size_t buf_size;
+	struct join_list_entry *jle;
+	struct iovec req_exec_cpg_iovec;
+
+	if (downlist_all_compact) {
+		return (cpg_exec_send_joinlist_compact(0));
+	}
 
 	qb_list_for_each(iter, &process_info_list_head) {
 		struct process_info *pi = qb_list_entry (iter, struct process_info, list);
@@ -1604,6 +2384,7 @@ static void message_handler_req_lib_cpg_join (void *conn, const void *message)
 		cpd->flags = req_lib_cpg_join->flags;
 		memcpy (&cpd->group_name, &req_lib_cpg_join->group_name,
 			sizeof (cpd->group_name));
+		cpd->lane = cpg_group_lane (&cpd->group_name);
 
 		cpg_node_joinleave_send (req_lib_cpg_join->pid,
 			&req_lib_cpg_join->group_name,
@@ -1810,6 +2591,689 @@ static inline int zcb_all_free (
 	return (0);
 }
 
+static struct cpg_deliver_ring *cpg_deliver_ring_create (
+	const mar_cpg_name_t *group_name,
+	uid_t uid,
+	gid_t gid)
+{
+	struct cpg_deliver_ring *ring;
+	size_t data_offset;
+	long int page_size;
+	mode_t old_umask;
+	void *addr;
+	int fd;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (page_size <= 0) {
+		return (NULL);
+	}
+
+	ring = calloc (1, sizeof (struct cpg_deliver_ring));
+	if (ring == NULL) {
+		return (NULL);
+	}
+
+	data_offset = (sizeof (struct cpg_deliver_ring_header) + page_size - 1) & ~(page_size - 1);
+	ring->map_size = data_offset + CPG_DELIVER_RING_DATA_SIZE;
+
+	snprintf (ring->path, sizeof (ring->path), "/dev/shm/corosync-cpg-ring-XXXXXX");
+	old_umask = umask (077);
+	fd = mkstemp (ring->path);
+	if (fd == -1) {
+		snprintf (ring->path, sizeof (ring->path), LOCALSTATEDIR "/run/corosync-cpg-ring-XXXXXX");
+		fd = mkstemp (ring->path);
+	}
+	(void)umask (old_umask);
+	if (fd == -1) {
+		goto error_free;
+	}
+
+	/*
+	 * Only the clients with the credentials this ring is for may map it
+	 */
+	if (fchown (fd, uid, gid) == -1 ||
+	    ftruncate (fd, ring->map_size) == -1) {
+		goto error_close_unlink;
+	}
+
+	addr = mmap (NULL, ring->map_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		goto error_close_unlink;
+	}
+	close (fd);
+
+	ring->header = addr;
+	ring->data = (char *)addr + data_offset;
+	ring->header->magic = CPG_DELIVER_RING_MAGIC;
+	ring->header->data_offset = data_offset;
+	ring->header->data_size = CPG_DELIVER_RING_DATA_SIZE;
+
+	memcpy (&ring->group_name, group_name, sizeof (mar_cpg_name_t));
+	ring->uid = uid;
+	ring->gid = gid;
+	ring->id = ++cpg_deliver_ring_last_id;
+	qb_list_init (&ring->list);
+	qb_list_add (&ring->list, &cpg_deliver_ring_list_head);
+
+	log_printf(LOGSYS_LEVEL_DEBUG, "created delivery ring %u for group %s, uid %u, gid %u",
+		ring->id, cpg_print_group_name (group_name), uid, gid);
+
+	return (ring);
+
+error_close_unlink:
+	close (fd);
+	unlink (ring->path);
+error_free:
+	free (ring);
+	return (NULL);
+}
+
+static void cpg_deliver_ring_destroy (struct cpg_deliver_ring *ring)
+{
+	log_printf(LOGSYS_LEVEL_DEBUG, "destroying delivery ring %u", ring->id);
+
+	qb_list_del (&ring->list);
+	munmap (ring->header, ring->map_size);
+	unlink (ring->path);
+	free (ring);
+}
+
+/*
+ * Cursor of a reader as stored by the library, limited to the part of the
+ * ring the reader may have consumed
+ */
+static uint64_t cpg_deliver_ring_cursor (struct cpg_deliver_ring *ring, unsigned int i)
+{
+	uint64_t cursor;
+	uint64_t start;
+
+	cursor = ring->header->readers[i].cursor;
+	start = ring->slots[i].start > ring->tail ? ring->slots[i].start : ring->tail;
+	if (cursor < start) {
+		cursor = start;
+	}
+	if (cursor > ring->head) {
+		cursor = ring->head;
+	}
+	return (cursor);
+}
+
+static void cpg_deliver_ring_tail_update (struct cpg_deliver_ring *ring)
+{
+	struct cpg_deliver_ring_slot *slot;
+	uint64_t tail = ring->head;
+	uint64_t cursor;
+	unsigned int i;
+
+	__sync_synchronize ();
+	for (i = 0; i < CPG_DELIVER_RING_READERS_MAX; i++) {
+		slot = &ring->slots[i];
+		if (slot->conn == NULL || !slot->started) {
+			continue;
+		}
+
+		cursor = cpg_deliver_ring_cursor (ring, i);
+		if (slot->closing && cursor >= slot->final) {
+			/*
+			 * Left the group and consumed everything sent before
+			 */
+			memset (slot, 0, sizeof (*slot));
+			ring->readers--;
+			continue;
+		}
+		if (cursor < tail) {
+			tail = cursor;
+		}
+	}
+	ring->tail = tail;
+}
+
+/*
+ * Store the message once in the ring, returns -1 when it doesn't fit
+ */
+static int cpg_deliver_ring_write (
+	struct cpg_deliver_ring *ring,
+	const struct iovec *iovec)
+{
+	uint64_t data_size = ring->header->data_size;
+	uint64_t size;
+	uint64_t start;
+	uint64_t offset;
+
+	size = (iovec[0].iov_len + iovec[1].iov_len + 7) & ~7;
+	if (size > data_size / 2) {
+		return (-1);
+	}
+
+	cpg_deliver_ring_tail_update (ring);
+
+	/*
+	 * Records are never split, skip the rest of the data area instead
+	 */
+	start = ring->head;
+	offset = start % data_size;
+	if (offset + size > data_size) {
+		start += data_size - offset;
+		offset = 0;
+	}
+	if (start + size - ring->tail > data_size) {
+		return (-1);
+	}
+
+	memcpy (ring->data + offset, iovec[0].iov_base, iovec[0].iov_len);
+	memcpy (ring->data + offset + iovec[0].iov_len, iovec[1].iov_base, iovec[1].iov_len);
+	__sync_synchronize ();
+
+	ring->head = start + size;
+	ring->written_offset = offset;
+	ring->written_cursor = ring->head;
+
+	return (0);
+}
+
+/*
+ * Deliver a message through the shared ring, returns -1 if the caller
+ * has to send it as an ordinary event
+ */
+static int cpg_deliver_ring_send (
+	struct cpg_pd *cpd,
+	const struct iovec *iovec)
+{
+	struct cpg_deliver_ring *ring = cpd->ring;
+	struct res_lib_cpg_ring_deliver_callback res_lib_cpg_ring_deliver;
+
+	if (!cpd->ring_started) {
+		return (-1);
+	}
+
+	if (ring->written_seq != cpg_deliver_seq) {
+		ring->written_seq = cpg_deliver_seq;
+		ring->written = (cpg_deliver_ring_write (ring, iovec) == 0);
+	}
+	if (!ring->written) {
+		return (-1);
+	}
+
+	res_lib_cpg_ring_deliver.header.id = MESSAGE_RES_CPG_RING_DELIVER_CALLBACK;
+	res_lib_cpg_ring_deliver.header.size = sizeof (res_lib_cpg_ring_deliver);
+	res_lib_cpg_ring_deliver.header.error = CS_OK;
+	res_lib_cpg_ring_deliver.ring_id = ring->id;
+	res_lib_cpg_ring_deliver.reader = cpd->ring_reader;
+	res_lib_cpg_ring_deliver.offset = ring->written_offset;
+	res_lib_cpg_ring_deliver.cursor = ring->written_cursor;
+
+	api->ipc_dispatch_send (cpd->conn, &res_lib_cpg_ring_deliver,
+		sizeof (res_lib_cpg_ring_deliver));
+	return (0);
+}
+
+static cs_error_t cpg_deliver_ring_attach (void *conn, struct cpg_pd *cpd)
+{
+	struct cpg_deliver_ring *ring = NULL;
+	struct cpg_deliver_ring *ring_iter;
+	struct qb_list_head *iter;
+	unsigned int i;
+	uid_t uid;
+	gid_t gid;
+
+	api->ipc_credentials_get (conn, &uid, &gid);
+
+	qb_list_for_each(iter, &cpg_deliver_ring_list_head) {
+		ring_iter = qb_list_entry (iter, struct cpg_deliver_ring, list);
+		if (ring_iter->uid == uid && ring_iter->gid == gid &&
+		    mar_name_compare (&ring_iter->group_name, &cpd->group_name) == 0) {
+			ring = ring_iter;
+			break;
+		}
+	}
+
+	if (ring == NULL) {
+		ring = cpg_deliver_ring_create (&cpd->group_name, uid, gid);
+		if (ring == NULL) {
+			return (CS_ERR_NO_RESOURCES);
+		}
+	}
+
+	cpg_deliver_ring_tail_update (ring);
+	for (i = 0; i < CPG_DELIVER_RING_READERS_MAX; i++) {
+		if (ring->slots[i].conn == NULL) {
+			break;
+		}
+	}
+	if (i == CPG_DELIVER_RING_READERS_MAX) {
+		return (CS_ERR_NO_RESOURCES);
+	}
+
+	ring->slots[i].conn = conn;
+	ring->readers++;
+	cpd->ring = ring;
+	cpd->ring_reader = i;
+	cpd->ring_started = 0;
+
+	return (CS_OK);
+}
+
+/*
+ * Called when the process leaves its group. The slot is kept until the
+ * library consumes the messages already announced to it.
+ */
+static void cpg_deliver_ring_detach (struct cpg_pd *cpd)
+{
+	struct cpg_deliver_ring *ring = cpd->ring;
+	struct cpg_deliver_ring_slot *slot;
+
+	if (ring == NULL) {
+		return;
+	}
+
+	slot = &ring->slots[cpd->ring_reader];
+	if (slot->started) {
+		slot->closing = 1;
+		slot->final = ring->head;
+	} else {
+		memset (slot, 0, sizeof (*slot));
+		ring->readers--;
+	}
+	cpd->ring = NULL;
+	cpd->ring_started = 0;
+
+	cpg_deliver_ring_tail_update (ring);
+	if (ring->readers == 0) {
+		cpg_deliver_ring_destroy (ring);
+	}
+}
+
+/*
+ * Called when the connection goes away, frees the slots it still holds
+ */
+static void cpg_deliver_ring_release (void *conn)
+{
+	struct cpg_deliver_ring *ring;
+	struct qb_list_head *iter, *tmp_iter;
+	unsigned int i;
+
+	qb_list_for_each_safe(iter, tmp_iter, &cpg_deliver_ring_list_head) {
+		ring = qb_list_entry (iter, struct cpg_deliver_ring, list);
+
+		for (i = 0; i < CPG_DELIVER_RING_READERS_MAX; i++) {
+			if (ring->slots[i].conn == conn) {
+				memset (&ring->slots[i], 0, sizeof (ring->slots[i]));
+				ring->readers--;
+			}
+		}
+		if (ring->readers == 0) {
+			cpg_deliver_ring_destroy (ring);
+		}
+	}
+}
+
+static struct cpg_zcb_deliver_area *cpg_zcb_deliver_create (uid_t uid, gid_t gid)
+{
+	struct cpg_zcb_deliver_area *area;
+	size_t data_offset;
+	long int page_size;
+	mode_t old_umask;
+	void *addr;
+	int fd;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (page_size <= 0) {
+		return (NULL);
+	}
+
+	area = calloc (1, sizeof (struct cpg_zcb_deliver_area));
+	if (area == NULL) {
+		return (NULL);
+	}
+
+	data_offset = (sizeof (struct cpg_zcb_deliver_header) + page_size - 1) & ~(page_size - 1);
+	area->map_size = data_offset + CPG_ZCB_DELIVER_DATA_SIZE;
+
+	snprintf (area->path, sizeof (area->path), "/dev/shm/corosync-cpg-zcb-XXXXXX");
+	old_umask = umask (077);
+	fd = mkstemp (area->path);
+	if (fd == -1) {
+		snprintf (area->path, sizeof (area->path), LOCALSTATEDIR "/run/corosync-cpg-zcb-XXXXXX");
+		fd = mkstemp (area->path);
+	}
+	(void)umask (old_umask);
+	if (fd == -1) {
+		goto error_free;
+	}
+
+	if (fchown (fd, uid, gid) == -1 ||
+	    ftruncate (fd, area->map_size) == -1) {
+		goto error_close_unlink;
+	}
+
+	addr = mmap (NULL, area->map_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		goto error_close_unlink;
+	}
+	close (fd);
+
+	area->header = addr;
+	area->data = (char *)addr + data_offset;
+	area->header->magic = CPG_ZCB_DELIVER_MAGIC;
+	area->header->data_offset = data_offset;
+	area->header->data_size = CPG_ZCB_DELIVER_DATA_SIZE;
+	qb_list_init (&area->alloc_list_head);
+	qb_list_init (&area->assembly_list_head);
+
+	return (area);
+
+error_close_unlink:
+	close (fd);
+	unlink (area->path);
+error_free:
+	free (area);
+	return (NULL);
+}
+
+static void cpg_zcb_deliver_destroy (struct cpg_zcb_deliver_area *area)
+{
+	struct qb_list_head *iter, *tmp_iter;
+
+	qb_list_for_each_safe(iter, tmp_iter, &area->assembly_list_head) {
+		qb_list_del (iter);
+		free (qb_list_entry (iter, struct cpg_zcb_deliver_assembly, list));
+	}
+	qb_list_for_each_safe(iter, tmp_iter, &area->alloc_list_head) {
+		qb_list_del (iter);
+		free (qb_list_entry (iter, struct cpg_zcb_deliver_alloc, list));
+	}
+
+	munmap (area->header, area->map_size);
+	if (!area->started) {
+		unlink (area->path);
+	}
+	free (area);
+}
+
+static struct cpg_zcb_deliver_record *cpg_zcb_deliver_record_get (
+	struct cpg_zcb_deliver_area *area,
+	const struct cpg_zcb_deliver_alloc *alloc)
+{
+	return ((struct cpg_zcb_deliver_record *)(area->data + alloc->offset));
+}
+
+/*
+ * Give back the space of the records released by the library, oldest first
+ */
+static void cpg_zcb_deliver_reclaim (struct cpg_zcb_deliver_area *area)
+{
+	struct cpg_zcb_deliver_alloc *alloc;
+
+	__sync_synchronize ();
+	while (!qb_list_empty (&area->alloc_list_head)) {
+		alloc = qb_list_first_entry (&area->alloc_list_head,
+			struct cpg_zcb_deliver_alloc, list);
+		if (!alloc->dropped &&
+		    !(alloc->announced && cpg_zcb_deliver_record_get (area, alloc)->released)) {
+			break;
+		}
+		area->tail = alloc->end;
+		qb_list_del (&alloc->list);
+		free (alloc);
+	}
+	if (qb_list_empty (&area->alloc_list_head)) {
+		area->tail = area->head;
+	}
+}
+
+/*
+ * Room for a message of msglen bytes, NULL when the area is too full
+ */
+static struct cpg_zcb_deliver_alloc *cpg_zcb_deliver_alloc_get (
+	struct cpg_zcb_deliver_area *area,
+	uint32_t msglen)
+{
+	uint64_t data_size = CPG_ZCB_DELIVER_DATA_SIZE;
+	struct cpg_zcb_deliver_alloc *alloc;
+	struct cpg_zcb_deliver_record *record;
+	uint64_t size;
+	uint64_t start;
+	uint64_t offset;
+
+	size = (sizeof (struct cpg_zcb_deliver_record) + (uint64_t)msglen + 7) & ~7;
+	if (size > data_size) {
+		return (NULL);
+	}
+
+	cpg_zcb_deliver_reclaim (area);
+
+	/*
+	 * Records are never split, skip the rest of the data area instead
+	 */
+	start = area->head;
+	offset = start % data_size;
+	if (offset + size > data_size) {
+		start += data_size - offset;
+		offset = 0;
+	}
+	if (start + size - area->tail > data_size) {
+		return (NULL);
+	}
+
+	alloc = malloc (sizeof (struct cpg_zcb_deliver_alloc));
+	if (alloc == NULL) {
+		return (NULL);
+	}
+	alloc->end = start + size;
+	alloc->offset = offset;
+	alloc->announced = 0;
+	alloc->dropped = 0;
+	qb_list_init (&alloc->list);
+	qb_list_add_tail (&alloc->list, &area->alloc_list_head);
+	area->head = alloc->end;
+
+	record = cpg_zcb_deliver_record_get (area, alloc);
+	record->released = 0;
+	record->msglen = msglen;
+
+	return (alloc);
+}
+
+/*
+ * Give back an allocation the library never heard of
+ */
+static void cpg_zcb_deliver_alloc_put (
+	struct cpg_zcb_deliver_alloc *alloc)
+{
+	alloc->dropped = 1;
+}
+
+static void cpg_zcb_deliver_callback_send (
+	struct cpg_pd *cpd,
+	const mar_cpg_name_t *group_name,
+	unsigned int nodeid,
+	uint32_t pid,
+	struct cpg_zcb_deliver_alloc *alloc,
+	uint32_t msglen)
+{
+	struct res_lib_cpg_zcb_deliver_callback res_lib_cpg_zcb_deliver;
+
+	alloc->announced = 1;
+	__sync_synchronize ();
+
+	res_lib_cpg_zcb_deliver.header.id = MESSAGE_RES_CPG_ZCB_DELIVER_CALLBACK;
+	res_lib_cpg_zcb_deliver.header.size = sizeof (res_lib_cpg_zcb_deliver);
+	res_lib_cpg_zcb_deliver.header.error = CS_OK;
+	memcpy (&res_lib_cpg_zcb_deliver.group_name, group_name, sizeof (mar_cpg_name_t));
+	res_lib_cpg_zcb_deliver.msglen = msglen;
+	res_lib_cpg_zcb_deliver.nodeid = nodeid;
+	res_lib_cpg_zcb_deliver.pid = pid;
+	res_lib_cpg_zcb_deliver.offset = alloc->offset +
+		offsetof (struct cpg_zcb_deliver_record, message);
+
+	api->ipc_dispatch_send (cpd->conn, &res_lib_cpg_zcb_deliver,
+		sizeof (res_lib_cpg_zcb_deliver));
+}
+
+/*
+ * Deliver a large message through the zero-copy area, returns -1 if the
+ * caller has to deliver it some other way
+ */
+static int cpg_zcb_deliver_send (
+	struct cpg_pd *cpd,
+	const mar_cpg_name_t *group_name,
+	unsigned int nodeid,
+	uint32_t pid,
+	const void *msg,
+	uint32_t msglen)
+{
+	struct cpg_zcb_deliver_area *area = cpd->zcb_deliver;
+	struct cpg_zcb_deliver_alloc *alloc;
+
+	if (area == NULL || !area->started || msglen < CPG_ZCB_DELIVER_MIN_SIZE) {
+		return (-1);
+	}
+
+	alloc = cpg_zcb_deliver_alloc_get (area, msglen);
+	if (alloc == NULL) {
+		return (-1);
+	}
+
+	memcpy (cpg_zcb_deliver_record_get (area, alloc)->message, msg, msglen);
+	cpg_zcb_deliver_callback_send (cpd, group_name, nodeid, pid, alloc, msglen);
+
+	return (0);
+}
+
+static struct cpg_zcb_deliver_assembly *cpg_zcb_deliver_assembly_find (
+	struct cpg_zcb_deliver_area *area,
+	unsigned int nodeid,
+	uint32_t pid)
+{
+	struct cpg_zcb_deliver_assembly *assembly;
+	struct qb_list_head *iter;
+
+	qb_list_for_each(iter, &area->assembly_list_head) {
+		assembly = qb_list_entry (iter, struct cpg_zcb_deliver_assembly, list);
+		if (assembly->nodeid == nodeid && assembly->pid == pid) {
+			return (assembly);
+		}
+	}
+	return (NULL);
+}
+
+static void cpg_zcb_deliver_assembly_drop (
+	struct cpg_zcb_deliver_area *area,
+	struct cpg_zcb_deliver_assembly *assembly)
+{
+	cpg_zcb_deliver_alloc_put (assembly->alloc);
+	qb_list_del (&assembly->list);
+	free (assembly);
+}
+
+/*
+ * Drop the messages being reassembled from the processes in left_list,
+ * or all of them if left_list is NULL. They will never be completed.
+ */
+static void cpg_zcb_deliver_assemblies_drop (
+	struct cpg_zcb_deliver_area *area,
+	const mar_cpg_address_t *left_list,
+	int left_list_entries)
+{
+	struct cpg_zcb_deliver_assembly *assembly;
+	struct qb_list_head *iter, *tmp_iter;
+	int i;
+
+	qb_list_for_each_safe(iter, tmp_iter, &area->assembly_list_head) {
+		assembly = qb_list_entry (iter, struct cpg_zcb_deliver_assembly, list);
+
+		if (left_list == NULL) {
+			cpg_zcb_deliver_assembly_drop (area, assembly);
+			continue;
+		}
+		for (i = 0; i < left_list_entries; i++) {
+			if (left_list[i].nodeid == assembly->nodeid &&
+			    left_list[i].pid == assembly->pid) {
+				cpg_zcb_deliver_assembly_drop (area, assembly);
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Reassemble a large fragmented message in the zero-copy area, so the
+ * library gets it in one piece. Returns -1 if the caller has to send the
+ * fragment as an ordinary partial deliver event.
+ */
+static int cpg_zcb_deliver_partial_send (
+	struct cpg_pd *cpd,
+	unsigned int nodeid,
+	const struct req_exec_cpg_partial_mcast *req_exec_cpg_mcast)
+{
+	struct cpg_zcb_deliver_area *area = cpd->zcb_deliver;
+	struct cpg_zcb_deliver_assembly *assembly;
+	struct cpg_zcb_deliver_alloc *alloc;
+
+	if (area == NULL || !area->started) {
+		return (-1);
+	}
+
+	assembly = cpg_zcb_deliver_assembly_find (area, nodeid, req_exec_cpg_mcast->pid);
+
+	if (req_exec_cpg_mcast->type == LIBCPG_PARTIAL_FIRST) {
+		/*
+		 * The previous message of the sender was interrupted
+		 */
+		if (assembly != NULL) {
+			cpg_zcb_deliver_assembly_drop (area, assembly);
+			assembly = NULL;
+		}
+
+		if (req_exec_cpg_mcast->msglen < CPG_ZCB_DELIVER_MIN_SIZE) {
+			return (-1);
+		}
+		alloc = cpg_zcb_deliver_alloc_get (area, req_exec_cpg_mcast->msglen);
+		if (alloc == NULL) {
+			return (-1);
+		}
+		assembly = malloc (sizeof (struct cpg_zcb_deliver_assembly));
+		if (assembly == NULL) {
+			cpg_zcb_deliver_alloc_put (alloc);
+			return (-1);
+		}
+		assembly->nodeid = nodeid;
+		assembly->pid = req_exec_cpg_mcast->pid;
+		assembly->msglen = req_exec_cpg_mcast->msglen;
+		assembly->filled = 0;
+		assembly->alloc = alloc;
+		qb_list_init (&assembly->list);
+		qb_list_add_tail (&assembly->list, &area->assembly_list_head);
+	}
+
+	if (assembly == NULL) {
+		return (-1);
+	}
+
+	if (req_exec_cpg_mcast->fraglen > assembly->msglen - assembly->filled) {
+		log_printf(LOGSYS_LEVEL_WARNING, "Fragment of node " CS_PRI_NODE_ID
+			" pid %u overflows its message, dropping it", nodeid, assembly->pid);
+		cpg_zcb_deliver_assembly_drop (area, assembly);
+		return (0);
+	}
+
+	memcpy (cpg_zcb_deliver_record_get (area, assembly->alloc)->message + assembly->filled,
+		(const char *)req_exec_cpg_mcast + sizeof (*req_exec_cpg_mcast),
+		req_exec_cpg_mcast->fraglen);
+	assembly->filled += req_exec_cpg_mcast->fraglen;
+
+	if (req_exec_cpg_mcast->type == LIBCPG_PARTIAL_LAST) {
+		cpg_zcb_deliver_callback_send (cpd, &req_exec_cpg_mcast->group_name,
+			nodeid, assembly->pid, assembly->alloc, assembly->filled);
+		qb_list_del (&assembly->list);
+		free (assembly);
+	}
+
+	return (0);
+}
+
 union u {
 	uint64_t server_addr;
 	void *server_ptr;
@@ -1880,6 +3344,138 @@ static void message_handler_req_lib_cpg_zc_free (
 		res_header.size);
 }
 
+static void message_handler_req_lib_cpg_ring_attach (
+	void *conn,
+	const void *message)
+{
+	struct cpg_pd *cpd = (struct cpg_pd *)api->ipc_private_data_get (conn);
+	struct res_lib_cpg_ring_attach res_lib_cpg_ring_attach;
+	cs_error_t error = CS_OK;
+
+	memset (&res_lib_cpg_ring_attach, 0, sizeof (res_lib_cpg_ring_attach));
+
+	switch (cpd->cpd_state) {
+	case CPD_STATE_UNJOINED:
+	case CPD_STATE_LEAVE_STARTED:
+		error = CS_ERR_NOT_EXIST;
+		break;
+	case CPD_STATE_JOIN_STARTED:
+	case CPD_STATE_JOIN_COMPLETED:
+		if (cpd->ring == NULL) {
+			error = cpg_deliver_ring_attach (conn, cpd);
+		}
+		break;
+	}
+
+	if (error == CS_OK) {
+		res_lib_cpg_ring_attach.map_size = cpd->ring->map_size;
+		res_lib_cpg_ring_attach.ring_id = cpd->ring->id;
+		res_lib_cpg_ring_attach.reader = cpd->ring_reader;
+		memcpy (res_lib_cpg_ring_attach.path_to_file, cpd->ring->path,
+			sizeof (res_lib_cpg_ring_attach.path_to_file));
+	}
+
+	res_lib_cpg_ring_attach.header.size = sizeof (res_lib_cpg_ring_attach);
+	res_lib_cpg_ring_attach.header.id = MESSAGE_RES_CPG_RING_ATTACH;
+	res_lib_cpg_ring_attach.header.error = error;
+	api->ipc_response_send (conn, &res_lib_cpg_ring_attach,
+		sizeof (res_lib_cpg_ring_attach));
+}
+
+/*
+ * The library has the ring mapped, messages delivered from now on go
+ * through the ring
+ */
+static void message_handler_req_lib_cpg_ring_start (
+	void *conn,
+	const void *message)
+{
+	const struct req_lib_cpg_ring_start *req_lib_cpg_ring_start = message;
+	struct cpg_pd *cpd = (struct cpg_pd *)api->ipc_private_data_get (conn);
+	struct res_lib_cpg_ring_start res_lib_cpg_ring_start;
+	struct cpg_deliver_ring_slot *slot;
+	cs_error_t error = CS_OK;
+
+	if (cpd->ring == NULL || cpd->ring->id != req_lib_cpg_ring_start->ring_id) {
+		error = CS_ERR_NOT_EXIST;
+	} else if (!cpd->ring_started) {
+		slot = &cpd->ring->slots[cpd->ring_reader];
+		slot->start = cpd->ring->head;
+		slot->started = 1;
+		cpd->ring_started = 1;
+	}
+
+	res_lib_cpg_ring_start.header.size = sizeof (res_lib_cpg_ring_start);
+	res_lib_cpg_ring_start.header.id = MESSAGE_RES_CPG_RING_START;
+	res_lib_cpg_ring_start.header.error = error;
+	api->ipc_response_send (conn, &res_lib_cpg_ring_start,
+		sizeof (res_lib_cpg_ring_start));
+}
+
+static void message_handler_req_lib_cpg_zcb_deliver_attach (
+	void *conn,
+	const void *message)
+{
+	struct cpg_pd *cpd = (struct cpg_pd *)api->ipc_private_data_get (conn);
+	struct res_lib_cpg_zcb_deliver_attach res_lib_cpg_zcb_deliver_attach;
+	cs_error_t error = CS_OK;
+	uid_t uid;
+	gid_t gid;
+
+	memset (&res_lib_cpg_zcb_deliver_attach, 0, sizeof (res_lib_cpg_zcb_deliver_attach));
+
+	if (cpd->zcb_deliver == NULL) {
+		api->ipc_credentials_get (conn, &uid, &gid);
+		cpd->zcb_deliver = cpg_zcb_deliver_create (uid, gid);
+		if (cpd->zcb_deliver == NULL) {
+			error = CS_ERR_NO_RESOURCES;
+		}
+	} else if (cpd->zcb_deliver->started) {
+		/*
+		 * The file is gone, the library has the area mapped already
+		 */
+		error = CS_ERR_EXIST;
+	}
+
+	if (error == CS_OK) {
+		res_lib_cpg_zcb_deliver_attach.map_size = cpd->zcb_deliver->map_size;
+		memcpy (res_lib_cpg_zcb_deliver_attach.path_to_file, cpd->zcb_deliver->path,
+			sizeof (res_lib_cpg_zcb_deliver_attach.path_to_file));
+	}
+
+	res_lib_cpg_zcb_deliver_attach.header.size = sizeof (res_lib_cpg_zcb_deliver_attach);
+	res_lib_cpg_zcb_deliver_attach.header.id = MESSAGE_RES_CPG_ZCB_DELIVER_ATTACH;
+	res_lib_cpg_zcb_deliver_attach.header.error = error;
+	api->ipc_response_send (conn, &res_lib_cpg_zcb_deliver_attach,
+		sizeof (res_lib_cpg_zcb_deliver_attach));
+}
+
+/*
+ * The library has the zero-copy area mapped, large messages delivered from
+ * now on are placed into it
+ */
+static void message_handler_req_lib_cpg_zcb_deliver_start (
+	void *conn,
+	const void *message)
+{
+	struct cpg_pd *cpd = (struct cpg_pd *)api->ipc_private_data_get (conn);
+	struct res_lib_cpg_zcb_deliver_start res_lib_cpg_zcb_deliver_start;
+	cs_error_t error = CS_OK;
+
+	if (cpd->zcb_deliver == NULL) {
+		error = CS_ERR_NOT_EXIST;
+	} else if (!cpd->zcb_deliver->started) {
+		unlink (cpd->zcb_deliver->path);
+		cpd->zcb_deliver->started = 1;
+	}
+
+	res_lib_cpg_zcb_deliver_start.header.size = sizeof (res_lib_cpg_zcb_deliver_start);
+	res_lib_cpg_zcb_deliver_start.header.id = MESSAGE_RES_CPG_ZCB_DELIVER_START;
+	res_lib_cpg_zcb_deliver_start.header.error = error;
+	api->ipc_response_send (conn, &res_lib_cpg_zcb_deliver_start,
+		sizeof (res_lib_cpg_zcb_deliver_start));
+}
+
 /* Fragmented mcast message from the library */
 static void message_handler_req_lib_cpg_partial_mcast (void *conn, const void *message)
 {
@@ -1939,7 +3535,8 @@ static void message_handler_req_lib_cpg_partial_mcast (void *conn, const void *m
 		req_exec_cpg_iovec[1].iov_base = (char *)&req_lib_cpg_mcast->message;
 		req_exec_cpg_iovec[1].iov_len = msglen;
 
-		result = api->totem_mcast (req_exec_cpg_iovec, 2, TOTEM_AGREED);
+		result = api->totem_mcast_lane (req_exec_cpg_iovec, 2, TOTEM_AGREED,
+			cpd->lane);
 		assert(result == 0);
 	} else {
 		log_printf(LOGSYS_LEVEL_ERROR, "*** %p can't mcast to group %s state:%d, error:%d",
@@ -1998,7 +3595,8 @@ static void message_handler_req_lib_cpg_mcast (void *conn, const void *message)
 		req_exec_cpg_iovec[1].iov_base = (char *)&req_lib_cpg_mcast->message;
 		req_exec_cpg_iovec[1].iov_len = msglen;
 
-		result = api->totem_mcast (req_exec_cpg_iovec, 2, TOTEM_AGREED);
+		result = api->totem_mcast_lane (req_exec_cpg_iovec, 2, TOTEM_AGREED,
+			cpd->lane);
 		assert(result == 0);
 	} else {
 		log_printf(LOGSYS_LEVEL_ERROR, "*** %p can't mcast to group %s state:%d, error:%d",
@@ -2006,6 +3604,110 @@ static void message_handler_req_lib_cpg_mcast (void *conn, const void *message)
 	}
 }
 
+/*
+ * Several mcast messages from the library in one request.  Each message
+ * goes out as a regular MESSAGE_REQ_EXEC_CPG_MCAST so other nodes see no
+ * difference.  The request was admitted on the reservation for its own
+ * size, which does not cover the exec headers, so stop at the first
+ * message totem has no room for and tell the library how many went out.
+ */
+static void message_handler_req_lib_cpg_mcast_batch (void *conn, const void *message)
+{
+	const struct req_lib_cpg_mcast_batch *req_lib_cpg_mcast_batch = message;
+	const struct req_lib_cpg_mcast_batch_msg *batch_msg;
+	struct cpg_pd *cpd = (struct cpg_pd *)api->ipc_private_data_get (conn);
+	mar_cpg_name_t group_name = cpd->group_name;
+
+	struct iovec req_exec_cpg_iovec[2];
+	struct req_exec_cpg_mcast req_exec_cpg_mcast;
+	struct res_lib_cpg_mcast_batch res_lib_cpg_mcast_batch;
+	const char *pos;
+	const char *end;
+	unsigned int msgs_sent = 0;
+	unsigned int i;
+	cs_error_t error = CS_ERR_NOT_EXIST;
+
+	log_printf(LOGSYS_LEVEL_TRACE, "got batch mcast request on %p", conn);
+
+	switch (cpd->cpd_state) {
+	case CPD_STATE_UNJOINED:
+		error = CS_ERR_NOT_EXIST;
+		break;
+	case CPD_STATE_LEAVE_STARTED:
+		error = CS_ERR_NOT_EXIST;
+		break;
+	case CPD_STATE_JOIN_STARTED:
+		error = CS_OK;
+		break;
+	case CPD_STATE_JOIN_COMPLETED:
+		error = CS_OK;
+		break;
+	}
+
+	/*
+	 * Validate the whole batch before sending any of it
+	 */
+	if (req_lib_cpg_mcast_batch->header.size < sizeof (struct req_lib_cpg_mcast_batch)) {
+		error = CS_ERR_INVALID_PARAM;
+	}
+	pos = (const char *)req_lib_cpg_mcast_batch->messages;
+	end = (const char *)message + req_lib_cpg_mcast_batch->header.size;
+	for (i = 0; error == CS_OK && i < req_lib_cpg_mcast_batch->msg_count; i++) {
+		batch_msg = (const struct req_lib_cpg_mcast_batch_msg *)pos;
+		if ((size_t)(end - pos) < sizeof (struct req_lib_cpg_mcast_batch_msg) ||
+		    (size_t)(end - pos) < CPG_MCAST_BATCH_MSG_SIZE ((size_t)batch_msg->msglen)) {
+			error = CS_ERR_INVALID_PARAM;
+			break;
+		}
+		pos += CPG_MCAST_BATCH_MSG_SIZE (batch_msg->msglen);
+	}
+
+	if (error == CS_OK) {
+		memset(&req_exec_cpg_mcast, 0, sizeof(req_exec_cpg_mcast));
+
+		req_exec_cpg_mcast.header.id = SERVICE_ID_MAKE(CPG_SERVICE,
+			MESSAGE_REQ_EXEC_CPG_MCAST);
+		req_exec_cpg_mcast.pid = cpd->pid;
+		api->ipc_source_set (&req_exec_cpg_mcast.source, conn);
+		memcpy(&req_exec_cpg_mcast.group_name, &group_name,
+			sizeof(mar_cpg_name_t));
+
+		req_exec_cpg_iovec[0].iov_base = (char *)&req_exec_cpg_mcast;
+		req_exec_cpg_iovec[0].iov_len = sizeof(req_exec_cpg_mcast);
+
+		pos = (const char *)req_lib_cpg_mcast_batch->messages;
+		for (i = 0; i < req_lib_cpg_mcast_batch->msg_count; i++) {
+			batch_msg = (const struct req_lib_cpg_mcast_batch_msg *)pos;
+
+			req_exec_cpg_mcast.header.size = sizeof(req_exec_cpg_mcast) +
+				batch_msg->msglen;
+			req_exec_cpg_mcast.msglen = batch_msg->msglen;
+
+			req_exec_cpg_iovec[1].iov_base = (char *)&batch_msg->message;
+			req_exec_cpg_iovec[1].iov_len = batch_msg->msglen;
+
+			if (api->totem_mcast_lane (req_exec_cpg_iovec, 2, TOTEM_AGREED,
+			    cpd->lane) != 0) {
+				error = CS_ERR_TRY_AGAIN;
+				break;
+			}
+			msgs_sent++;
+			pos += CPG_MCAST_BATCH_MSG_SIZE (batch_msg->msglen);
+		}
+	} else {
+		log_printf(LOGSYS_LEVEL_ERROR, "*** %p can't mcast batch to group %s state:%d, error:%d",
+			conn, group_name.value, cpd->cpd_state, error);
+	}
+
+	res_lib_cpg_mcast_batch.header.size = sizeof(res_lib_cpg_mcast_batch);
+	res_lib_cpg_mcast_batch.header.id = MESSAGE_RES_CPG_MCAST_BATCH;
+	res_lib_cpg_mcast_batch.header.error = error;
+	res_lib_cpg_mcast_batch.msgs_sent = msgs_sent;
+
+	api->ipc_response_send (conn, &res_lib_cpg_mcast_batch,
+		sizeof (res_lib_cpg_mcast_batch));
+}
+
 static void message_handler_req_lib_cpg_zc_execute (
 	void *conn,
 	const void *message)
@@ -2057,7 +3759,8 @@ static void message_handler_req_lib_cpg_zc_execute (
 		req_exec_cpg_iovec[1].iov_base = (char *)header + sizeof(struct req_lib_cpg_mcast);
 		req_exec_cpg_iovec[1].iov_len = req_exec_cpg_mcast.msglen;
 
-		result = api->totem_mcast (req_exec_cpg_iovec, 2, TOTEM_AGREED);
+		result = api->totem_mcast_lane (req_exec_cpg_iovec, 2, TOTEM_AGREED,
+			cpd->lane);
 		if (result == 0) {
 			res_lib_cpg_mcast.header.error = CS_OK;
 		} else {
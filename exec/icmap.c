@@ -45,15 +45,50 @@
 
 #define ICMAP_MAX_VALUE_LEN	(16*1024)
 
+/*
+ * Items and key names are allocated from per size class free lists carved
+ * out of ICMAP_SLAB_CHUNK_SIZE chunks. Classes are powers of two from
+ * ICMAP_SLAB_MIN_SIZE, anything bigger than the last class goes to malloc.
+ * Chunks are never given back, so the arena stays at the high-water mark
+ * of the map(s).
+ */
+#define ICMAP_SLAB_MIN_SHIFT	5
+#define ICMAP_SLAB_MIN_SIZE	(1 << ICMAP_SLAB_MIN_SHIFT)
+#define ICMAP_SLAB_CLASSES	6
+#define ICMAP_SLAB_MAX_SIZE	(ICMAP_SLAB_MIN_SIZE << (ICMAP_SLAB_CLASSES - 1))
+#define ICMAP_SLAB_CHUNK_SIZE	(16*1024)
+
+/*
+ * Items are reference counted. Reference is held by map(s) and snapshot(s). Shared
+ * item (refcount > 1) is never changed, update creates a new item instead.
+ */
 struct icmap_item {
 	char *key_name;
 	icmap_value_types_t type;
+	uint32_t refcount;
 	size_t value_len;
 	char value[];
 };
 
 struct icmap_map {
 	qb_map_t *qb_map;
+	struct qb_list_head pending_snapshots;
+};
+
+/*
+ * Snapshot is taken lazily. Until first read (or first change of the map under
+ * prefix) it is only on the pending_snapshots list of the map. Then it is
+ * materialized into the sorted array of (referenced) items.
+ */
+struct icmap_snapshot {
+	icmap_map_t map;
+	char *prefix;
+	int materialized;
+	cs_error_t error;
+	struct icmap_item **items;
+	size_t items_len;
+	size_t pos;
+	struct qb_list_head list;
 };
 
 static icmap_map_t icmap_global_map;
@@ -72,6 +107,14 @@ struct icmap_ro_access_item {
 	struct qb_list_head list;
 };
 
+struct icmap_slab_free {
+	struct icmap_slab_free *next;
+};
+
+static struct icmap_slab_free *icmap_slab_free_list[ICMAP_SLAB_CLASSES];
+
+static struct icmap_alloc_stats icmap_alloc_stats;
+
 QB_LIST_DECLARE (icmap_ro_access_item_list_head);
 QB_LIST_DECLARE (icmap_track_list_head);
 
@@ -100,6 +143,36 @@ static int icmap_item_eq(const struct icmap_item *item, const void *value, size_
  */
 static int icmap_is_valid_name_char(char c);
 
+/*
+ * Allocate/free size bytes from the slab (or malloc for big sizes). Size passed
+ * to icmap_slab_free must be the same as was used for allocation.
+ */
+static void *icmap_slab_alloc(size_t size);
+
+static void icmap_slab_free(void *ptr, size_t size);
+
+/*
+ * Returns !0 if a change of key_name in map would be seen by some tracker.
+ */
+static int icmap_is_key_tracked(const icmap_map_t map, const char *key_name);
+
+/*
+ * Drop reference to item, freeing it with the last one
+ */
+static void icmap_item_unref(struct icmap_item *item);
+
+/*
+ * Return unshared copy (refcount 1) of item, or NULL on allocation failure
+ */
+static struct icmap_item *icmap_item_copy(const struct icmap_item *item);
+
+/*
+ * Materialize all pending snapshots of map which cover key_name (or all of them for
+ * key_name NULL). Must be called before map is changed and map must be left untouched
+ * when it fails.
+ */
+static cs_error_t icmap_snapshot_prepare(const icmap_map_t map, const char *key_name);
+
 /*
  * Helper for getting integer and float value with given type for key key_name and store it in value.
  */
@@ -180,9 +253,129 @@ static void icmap_map_free_cb(uint32_t event,
 	 * value == old_value -> fast_adjust_int was used, don't free data
 	 */
 	if (item != NULL && value != old_value) {
-		free(item->key_name);
-		free(item);
+		icmap_item_unref(item);
+	}
+}
+
+static void icmap_item_unref(struct icmap_item *item)
+{
+
+	if (--item->refcount > 0) {
+		return ;
+	}
+
+	if (item->key_name != NULL) {
+		icmap_slab_free(item->key_name, strlen(item->key_name) + 1);
+	}
+	icmap_slab_free(item, sizeof(struct icmap_item) + item->value_len);
+	icmap_alloc_stats.items--;
+}
+
+static struct icmap_item *icmap_item_copy(const struct icmap_item *item)
+{
+	struct icmap_item *new_item;
+	size_t item_size;
+
+	item_size = sizeof(struct icmap_item) + item->value_len;
+	new_item = icmap_slab_alloc(item_size);
+	if (new_item == NULL) {
+		return (NULL);
+	}
+	memcpy(new_item, item, item_size);
+
+	new_item->key_name = icmap_slab_alloc(strlen(item->key_name) + 1);
+	if (new_item->key_name == NULL) {
+		icmap_slab_free(new_item, item_size);
+		return (NULL);
+	}
+	strcpy(new_item->key_name, item->key_name);
+	new_item->refcount = 1;
+	icmap_alloc_stats.items++;
+
+	return (new_item);
+}
+
+static int icmap_slab_class(size_t size)
+{
+	int slab_class;
+
+	for (slab_class = 0; slab_class < ICMAP_SLAB_CLASSES; slab_class++) {
+		if (size <= (ICMAP_SLAB_MIN_SIZE << slab_class)) {
+			return (slab_class);
+		}
+	}
+
+	return (-1);
+}
+
+static void *icmap_slab_alloc(size_t size)
+{
+	struct icmap_slab_free *obj;
+	size_t obj_size;
+	char *chunk;
+	int slab_class;
+	int i;
+
+	slab_class = icmap_slab_class(size);
+	if (slab_class < 0) {
+		obj = malloc(size);
+		if (obj != NULL) {
+			icmap_alloc_stats.large_allocs++;
+		}
+		return (obj);
+	}
+
+	if (icmap_slab_free_list[slab_class] == NULL) {
+		chunk = malloc(ICMAP_SLAB_CHUNK_SIZE);
+		if (chunk == NULL) {
+			return (NULL);
+		}
+		icmap_alloc_stats.arena_bytes += ICMAP_SLAB_CHUNK_SIZE;
+
+		obj_size = ICMAP_SLAB_MIN_SIZE << slab_class;
+		for (i = ICMAP_SLAB_CHUNK_SIZE / obj_size - 1; i >= 0; i--) {
+			obj = (struct icmap_slab_free *)(chunk + i * obj_size);
+			obj->next = icmap_slab_free_list[slab_class];
+			icmap_slab_free_list[slab_class] = obj;
+		}
+	}
+
+	obj = icmap_slab_free_list[slab_class];
+	icmap_slab_free_list[slab_class] = obj->next;
+
+	icmap_alloc_stats.slab_allocs++;
+	icmap_alloc_stats.arena_used_bytes += ICMAP_SLAB_MIN_SIZE << slab_class;
+
+	return (obj);
+}
+
+static void icmap_slab_free(void *ptr, size_t size)
+{
+	struct icmap_slab_free *obj = (struct icmap_slab_free *)ptr;
+	int slab_class;
+
+	if (ptr == NULL) {
+		return ;
+	}
+
+	slab_class = icmap_slab_class(size);
+	if (slab_class < 0) {
+		free(ptr);
+		icmap_alloc_stats.large_frees++;
+		return ;
 	}
+
+	obj->next = icmap_slab_free_list[slab_class];
+	icmap_slab_free_list[slab_class] = obj;
+
+	icmap_alloc_stats.slab_frees++;
+	icmap_alloc_stats.arena_used_bytes -= ICMAP_SLAB_MIN_SIZE << slab_class;
+}
+
+void icmap_get_alloc_stats(struct icmap_alloc_stats *stats)
+{
+
+	memcpy(stats, &icmap_alloc_stats, sizeof(*stats));
 }
 
 cs_error_t icmap_init_r(icmap_map_t *result)
@@ -199,6 +392,7 @@ cs_error_t icmap_init_r(icmap_map_t *result)
 		free(*result);
 		return (CS_ERR_INIT);
 	}
+	qb_list_init(&(*result)->pending_snapshots);
 
 	err = qb_map_notify_add((*result)->qb_map, NULL, icmap_map_free_cb, QB_MAP_NOTIFY_FREE, NULL);
 
@@ -237,6 +431,22 @@ static void icmap_del_all_track(void)
 
 void icmap_fini_r(const icmap_map_t map)
 {
+	struct qb_list_head *iter, *tmp_iter;
+	icmap_snapshot_t snapshot;
+
+	/*
+	 * Snapshots may outlive the map. Ones which cannot be taken any longer
+	 * report the error on read.
+	 */
+	if (icmap_snapshot_prepare(map, NULL) != CS_OK) {
+		qb_list_for_each_safe(iter, tmp_iter, &map->pending_snapshots) {
+			snapshot = qb_list_entry(iter, struct icmap_snapshot, list);
+
+			qb_list_del(&snapshot->list);
+			snapshot->materialized = 1;
+			snapshot->error = CS_ERR_NO_MEMORY;
+		}
+	}
 
 	qb_map_destroy(map->qb_map);
 	free(map);
@@ -438,6 +648,10 @@ cs_error_t icmap_set_r(
 		}
 	}
 
+	if (icmap_snapshot_prepare(map, key_name) != CS_OK) {
+		return (CS_ERR_NO_MEMORY);
+	}
+
 	if (type == ICMAP_VALUETYPE_BINARY || type == ICMAP_VALUETYPE_STRING) {
 		if (type == ICMAP_VALUETYPE_STRING) {
 			new_value_len = strlen((const char *)value);
@@ -452,24 +666,44 @@ cs_error_t icmap_set_r(
 		new_value_len = icmap_get_valuetype_len(type);
 	}
 
+	/*
+	 * Same type and size -> overwrite the value in place, unless a tracker
+	 * would want the old value, which must stay valid until notified.
+	 */
+	if (item != NULL && item->refcount == 1 && item->type == type &&
+	    item->value_len == new_value_len && !icmap_is_key_tracked(map, item->key_name)) {
+		memcpy(item->value, value, new_value_len);
+		if (type == ICMAP_VALUETYPE_STRING) {
+			((char *)item->value)[new_value_len - 1] = 0;
+		}
+		icmap_alloc_stats.in_place_updates++;
+
+		return (CS_OK);
+	}
+
 	new_item_size = sizeof(struct icmap_item) + new_value_len;
-	new_item = malloc(new_item_size);
+	new_item = icmap_slab_alloc(new_item_size);
 	if (new_item == NULL) {
 		return (CS_ERR_NO_MEMORY);
 	}
 	memset(new_item, 0, new_item_size);
 
-	if (item == NULL) {
-		new_item->key_name = strdup(key_name);
+	if (item == NULL || item->refcount > 1) {
+		/*
+		 * Shared item is still used by somebody else who needs its key
+		 */
+		new_item->key_name = icmap_slab_alloc(strlen(key_name) + 1);
 		if (new_item->key_name == NULL) {
-			free(new_item);
+			icmap_slab_free(new_item, new_item_size);
 			return (CS_ERR_NO_MEMORY);
 		}
+		strcpy(new_item->key_name, key_name);
 	} else {
 		new_item->key_name = item->key_name;
 		item->key_name = NULL;
 	}
 
+	new_item->refcount = 1;
 	new_item->type = type;
 	new_item->value_len = new_value_len;
 
@@ -479,6 +713,7 @@ cs_error_t icmap_set_r(
 		((char *)new_item->value)[new_value_len - 1] = 0;
 	}
 
+	icmap_alloc_stats.items++;
 	qb_map_put(map->qb_map, new_item->key_name, new_item);
 
 	return (CS_OK);
@@ -643,6 +878,10 @@ cs_error_t icmap_delete_r(const icmap_map_t map, const char *key_name)
 		return (CS_ERR_NOT_EXIST);
 	}
 
+	if (icmap_snapshot_prepare(map, key_name) != CS_OK) {
+		return (CS_ERR_NO_MEMORY);
+	}
+
 	if (qb_map_rm(map->qb_map, item->key_name) != QB_TRUE) {
 		return (CS_ERR_NOT_EXIST);
 	}
@@ -990,7 +1229,6 @@ cs_error_t icmap_fast_adjust_int_r(
 	int32_t step)
 {
 	struct icmap_item *item;
-	cs_error_t err = CS_OK;
 
 	if (key_name == NULL) {
 		return (CS_ERR_INVALID_PARAM);
@@ -1001,6 +1239,30 @@ cs_error_t icmap_fast_adjust_int_r(
 		return (CS_ERR_NOT_EXIST);
 	}
 
+	switch (item->type) {
+	case ICMAP_VALUETYPE_FLOAT:
+	case ICMAP_VALUETYPE_DOUBLE:
+	case ICMAP_VALUETYPE_STRING:
+	case ICMAP_VALUETYPE_BINARY:
+		return (CS_ERR_INVALID_PARAM);
+	default:
+		break;
+	}
+
+	if (icmap_snapshot_prepare(map, key_name) != CS_OK) {
+		return (CS_ERR_NO_MEMORY);
+	}
+
+	/*
+	 * Item is shared with snapshot or other map -> copy on write
+	 */
+	if (item->refcount > 1) {
+		item = icmap_item_copy(item);
+		if (item == NULL) {
+			return (CS_ERR_NO_MEMORY);
+		}
+	}
+
 	switch (item->type) {
 	case ICMAP_VALUETYPE_INT8:
 	case ICMAP_VALUETYPE_UINT8:
@@ -1018,19 +1280,13 @@ cs_error_t icmap_fast_adjust_int_r(
 	case ICMAP_VALUETYPE_UINT64:
 		*(uint64_t *)item->value += step;
 		break;
-	case ICMAP_VALUETYPE_FLOAT:
-	case ICMAP_VALUETYPE_DOUBLE:
-	case ICMAP_VALUETYPE_STRING:
-	case ICMAP_VALUETYPE_BINARY:
-		err = CS_ERR_INVALID_PARAM;
+	default:
 		break;
 	}
 
-	if (err == CS_OK) {
-		qb_map_put(map->qb_map, item->key_name, item);
-	}
+	qb_map_put(map->qb_map, item->key_name, item);
 
-	return (err);
+	return (CS_OK);
 }
 
 cs_error_t icmap_fast_adjust_int(
@@ -1118,6 +1374,41 @@ void icmap_iter_finalize(icmap_iter_t iter)
 	qb_map_iter_free(iter);
 }
 
+static int icmap_is_key_tracked(const icmap_map_t map, const char *key_name)
+{
+	struct qb_list_head *iter;
+	struct icmap_track *icmap_track;
+
+	/*
+	 * Tracks are only ever added to the global map
+	 */
+	if (map != icmap_global_map) {
+		return (0);
+	}
+
+	qb_list_for_each(iter, &icmap_track_list_head) {
+		icmap_track = qb_list_entry(iter, struct icmap_track, list);
+
+		if (!(icmap_track->track_type & ICMAP_TRACK_MODIFY)) {
+			continue;
+		}
+
+		if (icmap_track->key_name == NULL) {
+			return (1);
+		}
+
+		if (icmap_track->track_type & ICMAP_TRACK_PREFIX) {
+			if (strncmp(key_name, icmap_track->key_name, strlen(icmap_track->key_name)) == 0) {
+				return (1);
+			}
+		} else if (strcmp(key_name, icmap_track->key_name) == 0) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
 static void icmap_notify_fn(uint32_t event, char *key, void *old_value, void *value, void *user_data)
 {
 	icmap_track_t icmap_track = (icmap_track_t)user_data;
@@ -1298,33 +1589,187 @@ int icmap_is_key_ro(const char *key_name)
 cs_error_t icmap_copy_map(icmap_map_t dst_map, const icmap_map_t src_map)
 {
 	icmap_iter_t iter;
-	size_t value_len;
-	icmap_value_types_t value_type;
 	const char *key_name;
-	cs_error_t err;
-	void *value;
+	struct icmap_item *item;
+	struct icmap_item *dst_item;
 
 	iter = icmap_iter_init_r(src_map, NULL);
 	if (iter == NULL) {
 		return (CS_ERR_NO_MEMORY);
 	}
 
-	err = CS_OK;
-
-	while ((key_name = icmap_iter_next(iter, &value_len, &value_type)) != NULL) {
-		err = icmap_get_ref_r(src_map, key_name, &value, &value_len, &value_type);
-		if (err != CS_OK) {
-			goto exit_iter_finalize;
+	/*
+	 * Items are shared between maps (copy on write), not copied
+	 */
+	while ((key_name = qb_map_iter_next(iter, (void **)&item)) != NULL) {
+		dst_item = qb_map_get(dst_map->qb_map, key_name);
+		if (dst_item != NULL && icmap_item_eq(dst_item, item->value, item->value_len, item->type)) {
+			continue;
 		}
 
-		err = icmap_set_r(dst_map, key_name, value, value_len, value_type);
-		if (err != CS_OK) {
-			goto exit_iter_finalize;
+		if (icmap_snapshot_prepare(dst_map, key_name) != CS_OK) {
+			icmap_iter_finalize(iter);
+			return (CS_ERR_NO_MEMORY);
 		}
+
+		item->refcount++;
+		qb_map_put(dst_map->qb_map, item->key_name, item);
 	}
 
-exit_iter_finalize:
 	icmap_iter_finalize(iter);
 
-	return (err);
+	return (CS_OK);
+}
+
+/*
+ * Snapshot is either fully materialized or left pending (and untouched) on failure
+ */
+static int icmap_snapshot_materialize(icmap_snapshot_t snapshot)
+{
+	qb_map_iter_t *iter;
+	struct icmap_item *item;
+	struct icmap_item **items;
+	size_t items_len;
+	size_t i;
+
+	iter = qb_map_pref_iter_create(snapshot->map->qb_map, snapshot->prefix);
+	if (iter == NULL) {
+		return (-1);
+	}
+
+	items_len = 0;
+	while (qb_map_iter_next(iter, (void **)&item) != NULL) {
+		items_len++;
+	}
+	qb_map_iter_free(iter);
+
+	items = malloc((items_len > 0 ? items_len : 1) * sizeof(*items));
+	if (items == NULL) {
+		return (-1);
+	}
+
+	iter = qb_map_pref_iter_create(snapshot->map->qb_map, snapshot->prefix);
+	if (iter == NULL) {
+		free(items);
+		return (-1);
+	}
+
+	i = 0;
+	while (i < items_len && qb_map_iter_next(iter, (void **)&item) != NULL) {
+		item->refcount++;
+		items[i++] = item;
+	}
+	qb_map_iter_free(iter);
+
+	qb_list_del(&snapshot->list);
+	snapshot->materialized = 1;
+	snapshot->items = items;
+	snapshot->items_len = i;
+
+	return (0);
+}
+
+static cs_error_t icmap_snapshot_prepare(const icmap_map_t map, const char *key_name)
+{
+	struct qb_list_head *iter, *tmp_iter;
+	icmap_snapshot_t snapshot;
+
+	qb_list_for_each_safe(iter, tmp_iter, &map->pending_snapshots) {
+		snapshot = qb_list_entry(iter, struct icmap_snapshot, list);
+
+		if (key_name == NULL || snapshot->prefix == NULL ||
+		    strncmp(key_name, snapshot->prefix, strlen(snapshot->prefix)) == 0) {
+			if (icmap_snapshot_materialize(snapshot) != 0) {
+				return (CS_ERR_NO_MEMORY);
+			}
+		}
+	}
+
+	return (CS_OK);
+}
+
+icmap_snapshot_t icmap_snapshot_create_r(const icmap_map_t map, const char *prefix)
+{
+	icmap_snapshot_t snapshot;
+
+	snapshot = malloc(sizeof(*snapshot));
+	if (snapshot == NULL) {
+		return (NULL);
+	}
+	memset(snapshot, 0, sizeof(*snapshot));
+
+	if (prefix != NULL) {
+		snapshot->prefix = strdup(prefix);
+		if (snapshot->prefix == NULL) {
+			free(snapshot);
+			return (NULL);
+		}
+	}
+
+	snapshot->map = map;
+	snapshot->error = CS_OK;
+	qb_list_init(&snapshot->list);
+	qb_list_add_tail(&snapshot->list, &map->pending_snapshots);
+
+	return (snapshot);
+}
+
+icmap_snapshot_t icmap_snapshot_create(const char *prefix)
+{
+
+	return (icmap_snapshot_create_r(icmap_global_map, prefix));
+}
+
+cs_error_t icmap_snapshot_iter_next(
+	icmap_snapshot_t snapshot,
+	const char **key_name,
+	size_t *value_len,
+	icmap_value_types_t *type)
+{
+	struct icmap_item *item;
+
+	*key_name = NULL;
+
+	if (snapshot->error != CS_OK) {
+		return (snapshot->error);
+	}
+
+	if (!snapshot->materialized && icmap_snapshot_materialize(snapshot) != 0) {
+		return (CS_ERR_NO_MEMORY);
+	}
+
+	if (snapshot->pos >= snapshot->items_len) {
+		return (CS_ERR_NO_SECTIONS);
+	}
+
+	item = snapshot->items[snapshot->pos++];
+
+	if (value_len != NULL) {
+		*value_len = item->value_len;
+	}
+
+	if (type != NULL) {
+		*type = item->type;
+	}
+
+	*key_name = item->key_name;
+
+	return (CS_OK);
+}
+
+void icmap_snapshot_destroy(icmap_snapshot_t snapshot)
+{
+	size_t i;
+
+	if (!snapshot->materialized) {
+		qb_list_del(&snapshot->list);
+	}
+
+	for (i = 0; i < snapshot->items_len; i++) {
+		icmap_item_unref(snapshot->items[i]);
+	}
+
+	free(snapshot->items);
+	free(snapshot->prefix);
+	free(snapshot);
 }
@@ -62,6 +62,7 @@
 #include "service.h"
 #include "ipcs_stats.h"
 #include "stats.h"
+#include "probes.h"
 
 LOGSYS_DECLARE_SUBSYS ("MAIN");
 
@@ -170,7 +171,7 @@ int32_t cs_ipcs_service_destroy(int32_t service_id)
 	return 0;
 }
 
-static int32_t cs_ipcs_connection_accept (qb_ipcs_connection_t *c, uid_t euid, gid_t egid)
+static int32_t cs_ipcs_connection_allowed (qb_ipcs_connection_t *c, uid_t euid, gid_t egid)
 {
 	int32_t service = qb_ipcs_service_id_get(c);
 	uint8_t u8;
@@ -215,6 +216,40 @@ static int32_t cs_ipcs_connection_accept (qb_ipcs_connection_t *c, uid_t euid, g
 	return -EACCES;
 }
 
+static int32_t cs_ipcs_connection_accept (qb_ipcs_connection_t *c, uid_t euid, gid_t egid)
+{
+	int32_t service = qb_ipcs_service_id_get(c);
+	struct cs_ipcs_conn_context *context;
+	size_t size = sizeof(struct cs_ipcs_conn_context);
+	int32_t res;
+
+	res = cs_ipcs_connection_allowed(c, euid, egid);
+	if (res != 0) {
+		return res;
+	}
+
+	/*
+	 * Allocated here rather than in connection_created, this is the only
+	 * place the credentials of the client are known
+	 */
+	size += corosync_service[service]->private_data_size;
+	context = calloc(1, size);
+	if (context == NULL) {
+		return -ENOMEM;
+	}
+
+	qb_list_init(&context->outq_head);
+	context->queuing = QB_FALSE;
+	context->queued = 0;
+	context->sent = 0;
+	context->euid = euid;
+	context->egid = egid;
+
+	qb_ipcs_context_set(c, context);
+
+	return 0;
+}
+
 static char * pid_to_name (pid_t pid, char *out_name, size_t name_len)
 {
 	char *name;
@@ -264,26 +299,17 @@ static void cs_ipcs_connection_created(qb_ipcs_connection_t *c)
 	int32_t service = 0;
 	struct cs_ipcs_conn_context *context;
 	struct qb_ipcs_connection_stats stats;
-	size_t size = sizeof(struct cs_ipcs_conn_context);
 
 	log_printf(LOG_DEBUG, "connection created");
 
 	service = qb_ipcs_service_id_get(c);
 
-	size += corosync_service[service]->private_data_size;
-	context = calloc(1, size);
+	context = qb_ipcs_context_get(c);
 	if (context == NULL) {
 		qb_ipcs_disconnect(c);
 		return;
 	}
 
-	qb_list_init(&context->outq_head);
-	context->queuing = QB_FALSE;
-	context->queued = 0;
-	context->sent = 0;
-
-	qb_ipcs_context_set(c, context);
-
 	if (corosync_service[service]->lib_init_fn(c) != 0) {
 		log_printf(LOG_ERR, "lib_init_fn failed, disconnecting");
 		qb_ipcs_disconnect(c);
@@ -316,6 +342,14 @@ void *cs_ipcs_private_data_get(void *conn)
 	return &cnx->data[0];
 }
 
+void cs_ipcs_credentials_get(void *conn, uid_t *uid, gid_t *gid)
+{
+	struct cs_ipcs_conn_context *cnx;
+	cnx = qb_ipcs_context_get(conn);
+	*uid = cnx->euid;
+	*gid = cnx->egid;
+}
+
 static void cs_ipcs_connection_destroyed (qb_ipcs_connection_t *c)
 {
 	struct cs_ipcs_conn_context *context;
@@ -416,6 +450,7 @@ static void outq_flush (void *data)
 	} else {
 		qb_loop_job_add(cs_poll_handle_get(), QB_LOOP_HIGH, conn, outq_flush);
 	}
+	CS_PROBE3 (ipc_outq_flush, conn, context->sent, context->queued);
 }
 
 static void msg_send_or_queue(qb_ipcs_connection_t *conn, const struct iovec *iov, uint32_t iov_len)
@@ -436,6 +471,7 @@ static void msg_send_or_queue(qb_ipcs_connection_t *conn, const struct iovec *io
 		rc = qb_ipcs_event_sendv(conn, iov, iov_len);
 		if (rc == bytes_msg) {
 			context->sent++;
+			CS_PROBE2 (ipc_sent, conn, bytes_msg);
 			return;
 		}
 		if (rc == -EAGAIN) {
@@ -469,6 +505,7 @@ static void msg_send_or_queue(qb_ipcs_connection_t *conn, const struct iovec *io
 	qb_list_init (&outq_item->list);
 	qb_list_add_tail (&outq_item->list, &context->outq_head);
 	context->queued++;
+	CS_PROBE3 (ipc_queued, conn, bytes_msg, context->queued);
 }
 
 int cs_ipcs_dispatch_send(void *conn, const void *msg, size_t mlen)
@@ -39,6 +39,8 @@ struct cs_ipcs_conn_context {
 	uint64_t invalid_request;
 	uint64_t overload;
 	uint32_t sent;
+	uid_t euid;
+	gid_t egid;
 	char proc_name[32];
 	char data[1];
 };
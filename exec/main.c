@@ -126,6 +126,7 @@
 #include "schedwrk.h"
 #include "ipcs_stats.h"
 #include "stats.h"
+#include "affinity.h"
 
 #ifdef HAVE_SMALL_MEMORY_FOOTPRINT
 #define IPC_LOGSYS_SIZE			1024*64
@@ -167,6 +168,8 @@ static const char *corosync_lock_file = LOCALSTATEDIR"/run/corosync.pid";
 
 static char corosync_config_file[PATH_MAX + 1] = COROSYSCONFDIR "/corosync.conf";
 
+static char corosync_config_cache_file[PATH_MAX + 1];
+
 qb_loop_t *cs_poll_handle_get (void)
 {
 	return (corosync_poll_handle);
@@ -576,6 +579,7 @@ static void deliver_fn (
 	int32_t service;
 	int32_t fn_id;
 	uint32_t id;
+	uint64_t send_timestamp;
 
 	header = msg;
 	if (endian_conversion_required) {
@@ -601,6 +605,11 @@ static void deliver_fn (
 
 	icmap_fast_inc(service_stats_rx[service][fn_id]);
 
+	send_timestamp = totempg_deliver_timestamp_get ();
+	if (send_timestamp) {
+		stats_latency_add (service, nodeid, send_timestamp);
+	}
+
 	if (endian_conversion_required) {
 		assert(corosync_service[service]->exec_engine[fn_id].exec_endian_convert_fn != NULL);
 		corosync_service[service]->exec_engine[fn_id].exec_endian_convert_fn
@@ -615,6 +624,15 @@ int main_mcast (
         const struct iovec *iovec,
         unsigned int iov_len,
         unsigned int guarantee)
+{
+	return (main_mcast_lane (iovec, iov_len, guarantee, 0));
+}
+
+int main_mcast_lane (
+        const struct iovec *iovec,
+        unsigned int iov_len,
+        unsigned int guarantee,
+        unsigned int lane)
 {
 	const struct qb_ipc_request_header *req = iovec->iov_base;
 	int32_t service;
@@ -627,19 +645,38 @@ int main_mcast (
 		icmap_fast_inc(service_stats_tx[service][fn_id]);
 	}
 
-	return (totempg_groups_mcast_joined (corosync_group_handle, iovec, iov_len, guarantee));
+	return (totempg_groups_mcast_joined_lane (corosync_group_handle, lane,
+		iovec, iov_len, guarantee));
+}
+
+/*
+ * Lane 0 keeps the historical file name, other lanes get their own file
+ */
+static void corosync_ring_id_filename (
+	char *filename,
+	size_t filename_len,
+	unsigned int nodeid,
+	unsigned int lane)
+{
+	if (lane == 0) {
+		snprintf (filename, filename_len, "%s/ringid_%u",
+			get_state_dir(), nodeid);
+	} else {
+		snprintf (filename, filename_len, "%s/ringid_%u_lane%u",
+			get_state_dir(), nodeid, lane);
+	}
 }
 
 static void corosync_ring_id_create_or_load (
 	struct memb_ring_id *memb_ring_id,
-	unsigned int nodeid)
+	unsigned int nodeid,
+	unsigned int lane)
 {
 	int fd;
 	int res = 0;
 	char filename[PATH_MAX];
 
-	snprintf (filename, sizeof(filename), "%s/ringid_%u",
-		get_state_dir(), nodeid);
+	corosync_ring_id_filename (filename, sizeof(filename), nodeid, lane);
 	fd = open (filename, O_RDONLY);
 	/*
 	 * If file can be opened and read, read the ring id
@@ -676,14 +713,14 @@ static void corosync_ring_id_create_or_load (
 
 static void corosync_ring_id_store (
 	const struct memb_ring_id *memb_ring_id,
-	unsigned int nodeid)
+	unsigned int nodeid,
+	unsigned int lane)
 {
 	char filename[PATH_MAX];
 	int fd;
 	int res;
 
-	snprintf (filename, sizeof(filename), "%s/ringid_%u",
-		get_state_dir(), nodeid);
+	corosync_ring_id_filename (filename, sizeof(filename), nodeid, lane);
 
 	fd = creat (filename, 0600);
 	if (fd == -1) {
@@ -1028,6 +1065,7 @@ static void set_icmap_ro_keys_flag (void)
 	icmap_set_ro_access("runtime.services.", CS_TRUE, CS_TRUE);
 	icmap_set_ro_access("runtime.config.", CS_TRUE, CS_TRUE);
 	icmap_set_ro_access("runtime.totem.", CS_TRUE, CS_TRUE);
+	icmap_set_ro_access("runtime.system.", CS_TRUE, CS_TRUE);
 	icmap_set_ro_access("uidgid.config.", CS_TRUE, CS_TRUE);
 	icmap_set_ro_access("system.", CS_TRUE, CS_TRUE);
 	icmap_set_ro_access("nodelist.", CS_TRUE, CS_TRUE);
@@ -1047,6 +1085,7 @@ static void set_icmap_ro_keys_flag (void)
 	icmap_set_ro_access("totem.cluster_name", CS_FALSE, CS_TRUE);
 	icmap_set_ro_access("totem.netmtu", CS_FALSE, CS_TRUE);
 	icmap_set_ro_access("totem.threads", CS_FALSE, CS_TRUE);
+	icmap_set_ro_access("totem.lanes", CS_FALSE, CS_TRUE);
 	icmap_set_ro_access("totem.version", CS_FALSE, CS_TRUE);
 	icmap_set_ro_access("totem.nodeid", CS_FALSE, CS_TRUE);
 	icmap_set_ro_access("totem.clear_node_high_bit", CS_FALSE, CS_TRUE);
@@ -1070,6 +1109,7 @@ static void main_service_ready (void)
 	corosync_totem_stats_init ();
 	corosync_fplay_control_init ();
 	corosync_force_gather_init ();
+	affinity_reload_track_init ();
 
 	sync_init (
 		corosync_sync_callbacks_retrieve,
@@ -1229,7 +1269,7 @@ int main (int argc, char **argv, char **envp)
 	background = 1;
 	testonly = 0;
 
-	while ((ch = getopt (argc, argv, "c:ftv")) != EOF) {
+	while ((ch = getopt (argc, argv, "c:C:ftv")) != EOF) {
 
 		switch (ch) {
 			case 'c':
@@ -1242,6 +1282,17 @@ int main (int argc, char **argv, char **envp)
 					return EXIT_FAILURE;
 				}
 				break;
+			case 'C':
+				res = snprintf(corosync_config_cache_file, sizeof(corosync_config_cache_file), "%s", optarg);
+				if (res >= sizeof(corosync_config_cache_file)) {
+					fprintf (stderr, "Config cache file path too long.\n");
+					syslog (LOGSYS_LEVEL_ERROR, "Config cache file path too long.");
+
+					logsys_system_fini();
+					return EXIT_FAILURE;
+				}
+				coroparse_config_cache_set(corosync_config_cache_file);
+				break;
 			case 'f':
 				background = 0;
 				break;
@@ -1259,6 +1310,7 @@ int main (int argc, char **argv, char **envp)
 				fprintf(stderr, \
 					"usage:\n"\
 					"        -c     : Corosync config file path.\n"\
+					"        -C     : Binary config cache file path.\n"\
 					"        -f     : Start application in foreground.\n"\
 					"        -t     : Test configuration and exit.\n"\
 					"        -v     : Display version and SVN revision of Corosync and exit.\n");
@@ -1450,6 +1502,11 @@ int main (int argc, char **argv, char **envp)
 		}
 	}
 
+	if (affinity_apply (&error_string) != 0) {
+		log_printf (LOGSYS_LEVEL_ERROR, "%s", error_string);
+		corosync_exit_error (COROSYNC_DONE_MAINCONFIGREAD);
+	}
+
 	totem_config.totem_memb_ring_id_create_or_load = corosync_ring_id_create_or_load;
 	totem_config.totem_memb_ring_id_store = corosync_ring_id_store;
 
@@ -1500,10 +1557,12 @@ int main (int argc, char **argv, char **envp)
 	qb_loop_signal_add(corosync_poll_handle, QB_LOOP_HIGH,
 		SIGTERM, NULL, sig_exit_handler, NULL);
 
+	affinity_threads_snapshot ();
 	if (logsys_thread_start() != 0) {
 		log_printf (LOGSYS_LEVEL_ERROR, "Can't initialize log thread");
 		corosync_exit_error (COROSYNC_DONE_LOGCONFIGREAD);
 	}
+	affinity_threads_new_type_set (AFFINITY_THREAD_LOG);
 
 	if ((flock_err = corosync_flock (corosync_lock_file, getpid ())) != COROSYNC_DONE_EXIT) {
 		corosync_exit_error (flock_err);
@@ -1519,6 +1578,7 @@ int main (int argc, char **argv, char **envp)
 	 * Join multicast group and setup delivery
 	 *  and configuration change functions
 	 */
+	affinity_threads_snapshot ();
 	if (totempg_initialize (
 		corosync_poll_handle,
 		&totem_config) != 0) {
@@ -1526,6 +1586,15 @@ int main (int argc, char **argv, char **envp)
 		log_printf (LOGSYS_LEVEL_ERROR, "Can't initialize TOTEM layer");
 		corosync_exit_error (COROSYNC_DONE_FATAL_ERR);
 	}
+	affinity_threads_new_type_set (AFFINITY_THREAD_TRANSPORT);
+
+	/*
+	 * Place the log and transport threads, the configuration was
+	 * already validated above
+	 */
+	if (affinity_apply (&error_string) != 0) {
+		log_printf (LOGSYS_LEVEL_WARNING, "%s", error_string);
+	}
 
 	totempg_service_ready_register (
 		main_service_ready);
@@ -58,6 +58,12 @@ extern int main_mcast (
 	unsigned int iov_len,
 	unsigned int guarantee);
 
+extern int main_mcast_lane (
+	const struct iovec *iovec,
+	unsigned int iov_len,
+	unsigned int guarantee,
+	unsigned int lane);
+
 extern void message_source_set (mar_message_source_t *source, void *conn);
 
 extern int message_source_is_local (const mar_message_source_t *source);
@@ -116,6 +122,8 @@ extern void cs_ipcs_sync_state_changed(int32_t sync_in_process);
 
 extern void *cs_ipcs_private_data_get(void *conn);
 
+extern void cs_ipcs_credentials_get(void *conn, uid_t *uid, gid_t *gid);
+
 extern void cs_ipc_refcnt_inc(void *conn);
 
 extern void cs_ipc_refcnt_dec(void *conn);
@@ -124,6 +132,8 @@ extern void cs_ipc_allow_connections(int32_t allow);
 
 extern int coroparse_configparse (icmap_map_t config_map, const char **error_string);
 
+extern void coroparse_config_cache_set (const char *cache_file);
+
 extern const char *corosync_get_config_file(void);
 
 #endif /* MAIN_H_DEFINED */
@@ -0,0 +1,525 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <qb/qbdefs.h>
+#include <qb/qbutil.h>
+
+#include <corosync/logsys.h>
+#include <corosync/totem/totemip.h>
+
+#include "nameresolve.h"
+
+#define NAMERESOLVE_CACHE_HEADER	"# corosync nodelist resolution cache 1"
+
+#define NAMERESOLVE_NAME_MAX		255
+
+struct nameresolve_pool {
+	pthread_mutex_t mutex;
+
+	char *jobs;
+
+	size_t job_size;
+
+	unsigned int job_count;
+
+	unsigned int next_job;
+
+	nameresolve_job_fn_t job_fn;
+};
+
+struct nameresolve_cache_entry {
+	char name[NAMERESOLVE_NAME_MAX + 1];
+
+	enum totem_ip_version_enum ip_version;
+
+	struct totem_ip_address addr;
+
+	time_t stamp;
+};
+
+struct nameresolve_job {
+	struct nameresolve_entry *entry;
+
+	time_t *stamp;
+
+	uint64_t duration;
+};
+
+static void *nameresolve_worker (void *data)
+{
+	struct nameresolve_pool *pool = (struct nameresolve_pool *)data;
+	unsigned int job;
+
+	for (;;) {
+		pthread_mutex_lock (&pool->mutex);
+		job = pool->next_job;
+		if (job < pool->job_count) {
+			pool->next_job++;
+		}
+		pthread_mutex_unlock (&pool->mutex);
+
+		if (job >= pool->job_count) {
+			break;
+		}
+
+		pool->job_fn (pool->jobs + (size_t)job * pool->job_size);
+	}
+
+	return (NULL);
+}
+
+void nameresolve_run (
+	void *jobs,
+	size_t job_size,
+	unsigned int job_count,
+	nameresolve_job_fn_t job_fn)
+{
+	struct nameresolve_pool pool;
+	pthread_t threads[NAMERESOLVE_WORKERS_MAX];
+	unsigned int workers;
+	unsigned int started;
+	unsigned int i;
+
+	if (job_count == 0) {
+		return ;
+	}
+
+	pthread_mutex_init (&pool.mutex, NULL);
+	pool.jobs = jobs;
+	pool.job_size = job_size;
+	pool.job_count = job_count;
+	pool.next_job = 0;
+	pool.job_fn = job_fn;
+
+	workers = QB_MIN (job_count, NAMERESOLVE_WORKERS_MAX);
+
+	/*
+	 * Calling thread is one of the workers
+	 */
+	for (started = 0; started < workers - 1; started++) {
+		if (pthread_create (&threads[started], NULL, nameresolve_worker, &pool) != 0) {
+			log_printf (LOGSYS_LEVEL_DEBUG,
+			    "Can't create resolver thread, continuing with %u threads", started + 1);
+			break;
+		}
+	}
+
+	(void)nameresolve_worker (&pool);
+
+	for (i = 0; i < started; i++) {
+		pthread_join (threads[i], NULL);
+	}
+
+	pthread_mutex_destroy (&pool.mutex);
+}
+
+/*
+ * IPv4 and IPv6 literals need no resolver and are never cached. Hostnames
+ * can't contain ':', so anything with it is IPv6 (possibly with scope).
+ */
+static int nameresolve_is_numeric (const char *name)
+{
+	struct in_addr in;
+
+	return (strchr (name, ':') != NULL || inet_pton (AF_INET, name, &in) == 1);
+}
+
+static int nameresolve_cache_entry_cmp (const void *a, const void *b)
+{
+	const struct nameresolve_cache_entry *ea = (const struct nameresolve_cache_entry *)a;
+	const struct nameresolve_cache_entry *eb = (const struct nameresolve_cache_entry *)b;
+	int res;
+
+	res = strcmp (ea->name, eb->name);
+	if (res == 0) {
+		res = (int)ea->ip_version - (int)eb->ip_version;
+	}
+
+	return (res);
+}
+
+/*
+ * Parse and check one line of cache file. Returns 0 if entry is valid.
+ */
+static int nameresolve_cache_line_parse (
+	const char *line,
+	time_t now,
+	uint32_t cache_ttl,
+	struct nameresolve_cache_entry *entry)
+{
+	unsigned long long stamp;
+	unsigned int ip_version;
+	char addr_str[INET6_ADDRSTRLEN];
+	char name[NAMERESOLVE_NAME_MAX + 1];
+
+	if (sscanf (line, "%llu %u %45s %255s", &stamp, &ip_version, addr_str, name) != 4) {
+		return (-1);
+	}
+
+	if (stamp > (unsigned long long)now || now - (time_t)stamp >= (time_t)cache_ttl) {
+		return (-1);
+	}
+
+	if (nameresolve_is_numeric (name)) {
+		return (-1);
+	}
+
+	memset (entry, 0, sizeof (*entry));
+
+	if (inet_pton (AF_INET, addr_str, entry->addr.addr) == 1) {
+		entry->addr.family = AF_INET;
+	} else if (inet_pton (AF_INET6, addr_str, entry->addr.addr) == 1) {
+		entry->addr.family = AF_INET6;
+	} else {
+		return (-1);
+	}
+
+	switch (ip_version) {
+	case TOTEM_IP_VERSION_4:
+		if (entry->addr.family != AF_INET) {
+			return (-1);
+		}
+		break;
+	case TOTEM_IP_VERSION_6:
+		if (entry->addr.family != AF_INET6) {
+			return (-1);
+		}
+		break;
+	case TOTEM_IP_VERSION_4_6:
+	case TOTEM_IP_VERSION_6_4:
+		break;
+	default:
+		return (-1);
+	}
+
+	strcpy (entry->name, name);
+	entry->ip_version = ip_version;
+	entry->stamp = stamp;
+
+	return (0);
+}
+
+/*
+ * Load valid entries of cache file sorted for bsearch. Missing or broken file
+ * means empty cache.
+ */
+static struct nameresolve_cache_entry *nameresolve_cache_load (
+	const char *cache_file,
+	uint32_t cache_ttl,
+	unsigned int *entries_count)
+{
+	struct nameresolve_cache_entry *entries = NULL;
+	struct nameresolve_cache_entry *new_entries;
+	unsigned int allocated = 0;
+	unsigned int count = 0;
+	unsigned int invalid = 0;
+	char line[NAMERESOLVE_NAME_MAX + INET6_ADDRSTRLEN + 64];
+	time_t now;
+	FILE *fp;
+
+	*entries_count = 0;
+
+	fp = fopen (cache_file, "r");
+	if (fp == NULL) {
+		return (NULL);
+	}
+
+	if (fgets (line, sizeof (line), fp) == NULL ||
+	    strncmp (line, NAMERESOLVE_CACHE_HEADER "\n", sizeof (line)) != 0) {
+		log_printf (LOGSYS_LEVEL_WARNING,
+		    "Nodelist resolution cache %s has unknown format, ignoring it", cache_file);
+		fclose (fp);
+		return (NULL);
+	}
+
+	now = time (NULL);
+
+	while (fgets (line, sizeof (line), fp) != NULL) {
+		if (count == allocated) {
+			allocated = (allocated == 0 ? 64 : allocated * 2);
+			new_entries = realloc (entries, allocated * sizeof (*entries));
+			if (new_entries == NULL) {
+				break;
+			}
+			entries = new_entries;
+		}
+
+		if (nameresolve_cache_line_parse (line, now, cache_ttl, &entries[count]) == 0) {
+			count++;
+		} else {
+			invalid++;
+		}
+	}
+
+	fclose (fp);
+
+	log_printf (LOGSYS_LEVEL_DEBUG,
+	    "Nodelist resolution cache %s: %u valid, %u expired or invalid entries",
+	    cache_file, count, invalid);
+
+	if (count > 0) {
+		qsort (entries, count, sizeof (*entries), nameresolve_cache_entry_cmp);
+	}
+	*entries_count = count;
+
+	return (entries);
+}
+
+/*
+ * Write all resolved names. File is replaced atomically, so a crash can't
+ * leave half written cache behind.
+ */
+static void nameresolve_cache_save (
+	const char *cache_file,
+	const struct nameresolve_entry *entries,
+	const time_t *stamps,
+	unsigned int count)
+{
+	char tmp_file[PATH_MAX];
+	char addr_str[INET6_ADDRSTRLEN];
+	unsigned int i;
+	int fd;
+	FILE *fp;
+	int res;
+
+	if (snprintf (tmp_file, sizeof (tmp_file), "%s.tmp", cache_file) >= sizeof (tmp_file)) {
+		return ;
+	}
+
+	fd = open (tmp_file, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd == -1) {
+		LOGSYS_PERROR (errno, LOGSYS_LEVEL_DEBUG,
+		    "Can't create nodelist resolution cache %s", tmp_file);
+		return ;
+	}
+
+	fp = fdopen (fd, "w");
+	if (fp == NULL) {
+		close (fd);
+		unlink (tmp_file);
+		return ;
+	}
+
+	fprintf (fp, "%s\n", NAMERESOLVE_CACHE_HEADER);
+	for (i = 0; i < count; i++) {
+		if (entries[i].res != 0 || nameresolve_is_numeric (entries[i].name) ||
+		    strlen (entries[i].name) > NAMERESOLVE_NAME_MAX ||
+		    strpbrk (entries[i].name, " \t\n") != NULL) {
+			continue ;
+		}
+
+		if (inet_ntop (entries[i].addr.family, entries[i].addr.addr,
+		    addr_str, sizeof (addr_str)) == NULL) {
+			continue ;
+		}
+
+		fprintf (fp, "%llu %u %s %s\n", (unsigned long long)stamps[i],
+		    (unsigned int)entries[i].ip_version, addr_str, entries[i].name);
+	}
+
+	res = fflush (fp);
+	if (res == 0) {
+		res = fsync (fd);
+	}
+	if (fclose (fp) != 0) {
+		res = -1;
+	}
+
+	if (res != 0 || rename (tmp_file, cache_file) != 0) {
+		LOGSYS_PERROR (errno, LOGSYS_LEVEL_DEBUG,
+		    "Can't write nodelist resolution cache %s", cache_file);
+		unlink (tmp_file);
+	}
+}
+
+static void nameresolve_job_fn (void *data)
+{
+	struct nameresolve_job *job = (struct nameresolve_job *)data;
+	uint64_t start;
+
+	start = qb_util_nano_current_get ();
+
+	job->entry->res = totemip_parse (&job->entry->addr, job->entry->name,
+	    job->entry->ip_version);
+
+	job->duration = qb_util_nano_current_get () - start;
+}
+
+static struct nameresolve_cache_entry *nameresolve_cache_find (
+	struct nameresolve_cache_entry *cache,
+	unsigned int cache_count,
+	const struct nameresolve_entry *entry)
+{
+	struct nameresolve_cache_entry key;
+
+	if (cache_count == 0 || strlen (entry->name) > NAMERESOLVE_NAME_MAX) {
+		return (NULL);
+	}
+
+	strcpy (key.name, entry->name);
+	key.ip_version = entry->ip_version;
+
+	return (bsearch (&key, cache, cache_count, sizeof (*cache),
+	    nameresolve_cache_entry_cmp));
+}
+
+void nameresolve_entries (
+	struct nameresolve_entry *entries,
+	unsigned int count,
+	const char *cache_file,
+	uint32_t cache_ttl,
+	int cache_fallback,
+	struct nameresolve_stats *stats)
+{
+	struct nameresolve_cache_entry *cache = NULL;
+	struct nameresolve_cache_entry *found;
+	unsigned int cache_count = 0;
+	struct nameresolve_job *jobs;
+	unsigned int job_count = 0;
+	time_t *stamps;
+	time_t now;
+	uint64_t start;
+	unsigned int i;
+
+	memset (stats, 0, sizeof (*stats));
+	start = qb_util_nano_current_get ();
+
+	if (cache_file == NULL) {
+		cache_ttl = 0;
+	}
+
+	jobs = malloc (sizeof (*jobs) * (count > 0 ? count : 1));
+	stamps = malloc (sizeof (*stamps) * (count > 0 ? count : 1));
+	if (jobs == NULL || stamps == NULL) {
+		/*
+		 * Resolve serially without cache
+		 */
+		free (jobs);
+		free (stamps);
+		for (i = 0; i < count; i++) {
+			entries[i].from_cache = 0;
+			entries[i].res = totemip_parse (&entries[i].addr, entries[i].name,
+			    entries[i].ip_version);
+			stats->failed += (entries[i].res != 0);
+		}
+		stats->names = count;
+		stats->duration = qb_util_nano_current_get () - start;
+		return ;
+	}
+
+	if (cache_ttl > 0) {
+		cache = nameresolve_cache_load (cache_file, cache_ttl, &cache_count);
+	}
+
+	now = time (NULL);
+
+	for (i = 0; i < count; i++) {
+		entries[i].from_cache = 0;
+		stamps[i] = now;
+
+		if (nameresolve_is_numeric (entries[i].name)) {
+			entries[i].res = totemip_parse (&entries[i].addr, entries[i].name,
+			    entries[i].ip_version);
+			continue ;
+		}
+
+		stats->names++;
+
+		if (!cache_fallback &&
+		    (found = nameresolve_cache_find (cache, cache_count, &entries[i])) != NULL) {
+			memcpy (&entries[i].addr, &found->addr, sizeof (entries[i].addr));
+			entries[i].res = 0;
+			entries[i].from_cache = 1;
+			stamps[i] = found->stamp;
+			stats->cache_hits++;
+			continue ;
+		}
+
+		jobs[job_count].entry = &entries[i];
+		jobs[job_count].stamp = &stamps[i];
+		jobs[job_count].duration = 0;
+		job_count++;
+	}
+
+	nameresolve_run (jobs, sizeof (*jobs), job_count, nameresolve_job_fn);
+
+	for (i = 0; i < job_count; i++) {
+		if (jobs[i].entry->res != 0 &&
+		    (found = nameresolve_cache_find (cache, cache_count, jobs[i].entry)) != NULL) {
+			/*
+			 * The resolver failed, the last known address is better than none
+			 */
+			memcpy (&jobs[i].entry->addr, &found->addr, sizeof (jobs[i].entry->addr));
+			jobs[i].entry->res = 0;
+			jobs[i].entry->from_cache = 1;
+			*jobs[i].stamp = found->stamp;
+			stats->cache_hits++;
+		}
+		if (jobs[i].entry->res != 0) {
+			stats->failed++;
+		}
+		if (jobs[i].duration > stats->slowest) {
+			stats->slowest = jobs[i].duration;
+		}
+	}
+
+	/*
+	 * Rewrite the cache only if something was really resolved, warm start
+	 * served completely from cache doesn't touch the file
+	 */
+	if (cache_ttl > 0 && job_count > 0) {
+		nameresolve_cache_save (cache_file, entries, stamps, count);
+	}
+
+	free (cache);
+	free (jobs);
+	free (stamps);
+
+	stats->duration = qb_util_nano_current_get () - start;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef NAMERESOLVE_H_DEFINED
+#define NAMERESOLVE_H_DEFINED
+
+#include <stdint.h>
+#include <corosync/totem/totemip.h>
+
+/*
+ * Resolution of nodelist addresses. Names are resolved concurrently by a
+ * bounded pool of threads and results can be kept in a cache file, so warm
+ * start doesn't have to wait for the resolver.
+ */
+
+/*
+ * Maximum number of threads resolving names at once
+ */
+#define NAMERESOLVE_WORKERS_MAX		16
+
+struct nameresolve_entry {
+	/*
+	 * Filled by caller
+	 */
+	const char *name;
+	enum totem_ip_version_enum ip_version;
+	/*
+	 * Filled by nameresolve_entries. res is result of totemip_parse (0 success).
+	 */
+	struct totem_ip_address addr;
+	int res;
+	int from_cache;
+};
+
+struct nameresolve_stats {
+	unsigned int names;
+	unsigned int cache_hits;
+	unsigned int failed;
+	/*
+	 * Wall clock time of the whole resolution and time of the slowest name (ns)
+	 */
+	uint64_t duration;
+	uint64_t slowest;
+};
+
+typedef void (*nameresolve_job_fn_t) (void *job);
+
+/*
+ * Call job_fn for every job (array of job_count items of job_size bytes) from
+ * at most NAMERESOLVE_WORKERS_MAX threads. Returns after all jobs are finished.
+ * If threads can't be created, remaining jobs are run by the calling thread.
+ */
+extern void nameresolve_run (
+	void *jobs,
+	size_t job_size,
+	unsigned int job_count,
+	nameresolve_job_fn_t job_fn);
+
+/*
+ * Resolve all entries. Numeric addresses are parsed directly, names are looked
+ * up in cache_file first (entries not older than cache_ttl seconds) and the rest
+ * is resolved in parallel. With cache_fallback all names are resolved and the
+ * cache is only used for names the resolver failed on. cache_file is then
+ * rewritten with the successfully resolved names. cache_file NULL or cache_ttl
+ * 0 disables the cache.
+ */
+extern void nameresolve_entries (
+	struct nameresolve_entry *entries,
+	unsigned int count,
+	const char *cache_file,
+	uint32_t cache_ttl,
+	int cache_fallback,
+	struct nameresolve_stats *stats);
+
+#endif /* NAMERESOLVE_H_DEFINED */
@@ -35,6 +35,9 @@
 
 #include <config.h>
 
+#include <sys/time.h>
+#include <sys/resource.h>
+
 #include <qb/qblist.h>
 #include <qb/qbutil.h>
 #include <qb/qbipc_common.h>
@@ -130,6 +133,24 @@ static unsigned long long int tv1;
 static unsigned long long int tv2;
 static unsigned long long int tv_elapsed;
 
+/*
+ * CPU time (user + sys) of the whole process in usec, to compare
+ * cost of the run with different io_engine
+ */
+static unsigned long long int cpu1;
+
+static unsigned long long int pload_cpu_time_get (void)
+{
+	struct rusage usage;
+
+	if (getrusage (RUSAGE_SELF, &usage) != 0) {
+		return (0);
+	}
+
+	return ((unsigned long long int)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+		usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
 /*
  * Service engine hooks
  */
@@ -334,18 +355,20 @@ static void message_handler_req_exec_pload_mcast (
 
 	if (msgs_delivered == 0) {
 		tv1 = qb_util_nano_current_get ();
+		cpu1 = pload_cpu_time_get ();
 	}
 	msgs_delivered += 1;
 	if (msgs_delivered == msgs_wanted) {
 		tv2 = qb_util_nano_current_get ();
 		tv_elapsed = tv2 - tv1;
-		sprintf (log_buffer, "%5d Writes %d bytes per write %7.3f seconds runtime, %9.3f TP/S, %9.3f MB/S.",
+		sprintf (log_buffer, "%5d Writes %d bytes per write %7.3f seconds runtime, %9.3f TP/S, %9.3f MB/S, %7.3f seconds CPU.",
 			msgs_delivered,
 			msg_size,
 			(tv_elapsed / 1000000000.0),
 			((float)msgs_delivered) /  (tv_elapsed / 1000000000.0),
 			(((float)msgs_delivered) * ((float)msg_size) /
-				(tv_elapsed / 1000000000.0)) / (1024.0 * 1024.0));
+				(tv_elapsed / 1000000000.0)) / (1024.0 * 1024.0),
+			(pload_cpu_time_get () - cpu1) / 1000000.0);
 		log_printf (LOGSYS_LEVEL_NOTICE, "%s", log_buffer);
 		log_printf (LOGSYS_LEVEL_WARNING, "Stopping corosync the hard way");
 		if (buffer) {
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef PROBES_H_DEFINED
+#define PROBES_H_DEFINED
+
+/*
+ * USDT static probes (provider "corosync"). When built with
+ * --enable-usdt each probe is a single nop in the instruction stream
+ * until a tracer attaches to it; otherwise the macros compile away.
+ * Arguments must be cheap to evaluate because they are computed even
+ * when nothing is attached.
+ */
+#ifdef HAVE_USDT
+#include <sys/sdt.h>
+
+#define CS_PROBE(name) \
+	DTRACE_PROBE(corosync, name)
+#define CS_PROBE1(name, a1) \
+	DTRACE_PROBE1(corosync, name, a1)
+#define CS_PROBE2(name, a1, a2) \
+	DTRACE_PROBE2(corosync, name, a1, a2)
+#define CS_PROBE3(name, a1, a2, a3) \
+	DTRACE_PROBE3(corosync, name, a1, a2, a3)
+#define CS_PROBE4(name, a1, a2, a3, a4) \
+	DTRACE_PROBE4(corosync, name, a1, a2, a3, a4)
+#define CS_PROBE5(name, a1, a2, a3, a4, a5) \
+	DTRACE_PROBE5(corosync, name, a1, a2, a3, a4, a5)
+#define CS_PROBE6(name, a1, a2, a3, a4, a5, a6) \
+	DTRACE_PROBE6(corosync, name, a1, a2, a3, a4, a5, a6)
+
+#else
+
+#define CS_PROBE(name) do { } while (0)
+#define CS_PROBE1(name, a1) do { } while (0)
+#define CS_PROBE2(name, a1, a2) do { } while (0)
+#define CS_PROBE3(name, a1, a2, a3) do { } while (0)
+#define CS_PROBE4(name, a1, a2, a3, a4) do { } while (0)
+#define CS_PROBE5(name, a1, a2, a3, a4, a5) do { } while (0)
+#define CS_PROBE6(name, a1, a2, a3, a4, a5, a6) do { } while (0)
+
+#endif /* HAVE_USDT */
+
+#endif /* PROBES_H_DEFINED */
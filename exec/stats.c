@@ -42,9 +42,11 @@
 #include <unistd.h>
 #include <libknet.h>
 
+#include <qb/qbdefs.h>
 #include <qb/qblist.h>
 #include <qb/qbipcs.h>
 #include <qb/qbipc_common.h>
+#include <qb/qbutil.h>
 
 #include <corosync/corodefs.h>
 #include <corosync/coroapi.h>
@@ -71,9 +73,77 @@ static unsigned int highest_schedmiss_event;
 
 #define SCHEDMISS_PREFIX "stats.schedmiss"
 
+/*
+ * End-to-end multicast latency (send timestamp to deliver_fn), kept as
+ * log-linear histograms of microseconds in the style of HdrHistogram:
+ * values below LATENCY_SUB_BUCKETS get a bucket each, every power of two
+ * above that is split into LATENCY_SUB_BUCKETS linear buckets, so
+ * reported quantiles are within 1/LATENCY_SUB_BUCKETS of the real value.
+ */
+#define LATENCY_PREFIX "stats.latency"
+#define LATENCY_SUB_BUCKET_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_BITS 32
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+struct latency_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[LATENCY_BUCKETS];
+};
+
+/* What is exported to cmap, computed from a histogram when read */
+struct latency_summary {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t mean;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t p999;
+};
+
+struct latency_node {
+	unsigned int nodeid;
+	struct latency_hist hist;
+	struct qb_list_head list;
+};
+
+static struct latency_hist *latency_service[SERVICES_COUNT_MAX];
+QB_LIST_DECLARE (latency_node_list_head);
+static struct latency_node *latency_node_last;
+
+/*
+ * Time spent in the phases of orf token processing (totem.token_phase_stats),
+ * summarized from the log2 histograms kept by totemsrp
+ */
+#define TOKEN_PHASE_PREFIX "stats.srp.token_phase"
+
+static const char *token_phase_names[TOTEMSRP_TOKEN_PHASE_MAX] = {
+	[TOTEMSRP_TOKEN_PHASE_HOLD] = "hold",
+	[TOTEMSRP_TOKEN_PHASE_RTR] = "rtr",
+	[TOTEMSRP_TOKEN_PHASE_MCAST] = "mcast",
+	[TOTEMSRP_TOKEN_PHASE_DELIVER] = "deliver",
+	[TOTEMSRP_TOKEN_PHASE_FREE] = "free",
+	[TOTEMSRP_TOKEN_PHASE_CALLBACKS] = "callbacks",
+};
+
+struct token_phase_summary {
+	uint64_t count;
+	uint64_t total;
+	uint64_t max;
+	uint64_t mean;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+};
+
 /* Convert iterator number to text and a stats pointer */
 struct cs_stats_conv {
-	enum {STAT_PG, STAT_SRP, STAT_KNET, STAT_KNET_HANDLE, STAT_IPCSC, STAT_IPCSG, STAT_SCHEDMISS} type;
+	enum {STAT_PG, STAT_SRP, STAT_KNET, STAT_KNET_HANDLE, STAT_IPCSC, STAT_IPCSG, STAT_SCHEDMISS, STAT_LATENCY, STAT_TOKEN_PHASE, STAT_ICMAP} type;
 	const char *name;
 	const size_t offset;
 	const icmap_value_types_t value_type;
@@ -97,6 +167,9 @@ struct cs_stats_conv cs_srp_stats[] = {
 	{ STAT_SRP, "memb_commit_token_rx",   offsetof(totemsrp_stats_t, memb_commit_token_rx),   ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "token_hold_cancel_tx",   offsetof(totemsrp_stats_t, token_hold_cancel_tx),   ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "token_hold_cancel_rx",   offsetof(totemsrp_stats_t, token_hold_cancel_rx),   ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "rtr_request_tx",         offsetof(totemsrp_stats_t, rtr_request_tx),         ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "rtr_request_rx",         offsetof(totemsrp_stats_t, rtr_request_rx),         ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "mcast_fast_retx",        offsetof(totemsrp_stats_t, mcast_fast_retx),        ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "operational_entered",    offsetof(totemsrp_stats_t, operational_entered),    ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "operational_token_lost", offsetof(totemsrp_stats_t, operational_token_lost), ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "gather_entered",         offsetof(totemsrp_stats_t, gather_entered),         ICMAP_VALUETYPE_UINT64},
@@ -205,6 +278,35 @@ struct cs_stats_conv cs_schedmiss_stats[] = {
 	{ STAT_SCHEDMISS, "timestamp",    offsetof(struct schedmiss_entry, timestamp), ICMAP_VALUETYPE_UINT64},
 	{ STAT_SCHEDMISS, "delay",        offsetof(struct schedmiss_entry, delay),     ICMAP_VALUETYPE_FLOAT},
 };
+struct cs_stats_conv cs_latency_stats[] = {
+	{ STAT_LATENCY, "count",          offsetof(struct latency_summary, count),     ICMAP_VALUETYPE_UINT64},
+	{ STAT_LATENCY, "min",            offsetof(struct latency_summary, min),       ICMAP_VALUETYPE_UINT64},
+	{ STAT_LATENCY, "max",            offsetof(struct latency_summary, max),       ICMAP_VALUETYPE_UINT64},
+	{ STAT_LATENCY, "mean",           offsetof(struct latency_summary, mean),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_LATENCY, "p50",            offsetof(struct latency_summary, p50),       ICMAP_VALUETYPE_UINT64},
+	{ STAT_LATENCY, "p90",            offsetof(struct latency_summary, p90),       ICMAP_VALUETYPE_UINT64},
+	{ STAT_LATENCY, "p99",            offsetof(struct latency_summary, p99),       ICMAP_VALUETYPE_UINT64},
+	{ STAT_LATENCY, "p999",           offsetof(struct latency_summary, p999),      ICMAP_VALUETYPE_UINT64},
+};
+struct cs_stats_conv cs_token_phase_stats[] = {
+	{ STAT_TOKEN_PHASE, "count",      offsetof(struct token_phase_summary, count), ICMAP_VALUETYPE_UINT64},
+	{ STAT_TOKEN_PHASE, "total",      offsetof(struct token_phase_summary, total), ICMAP_VALUETYPE_UINT64},
+	{ STAT_TOKEN_PHASE, "max",        offsetof(struct token_phase_summary, max),   ICMAP_VALUETYPE_UINT64},
+	{ STAT_TOKEN_PHASE, "mean",       offsetof(struct token_phase_summary, mean),  ICMAP_VALUETYPE_UINT64},
+	{ STAT_TOKEN_PHASE, "p50",        offsetof(struct token_phase_summary, p50),   ICMAP_VALUETYPE_UINT64},
+	{ STAT_TOKEN_PHASE, "p90",        offsetof(struct token_phase_summary, p90),   ICMAP_VALUETYPE_UINT64},
+	{ STAT_TOKEN_PHASE, "p99",        offsetof(struct token_phase_summary, p99),   ICMAP_VALUETYPE_UINT64},
+};
+struct cs_stats_conv cs_icmap_stats[] = {
+	{ STAT_ICMAP, "arena_bytes",      offsetof(struct icmap_alloc_stats, arena_bytes),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_ICMAP, "arena_used_bytes", offsetof(struct icmap_alloc_stats, arena_used_bytes), ICMAP_VALUETYPE_UINT64},
+	{ STAT_ICMAP, "slab_allocs",      offsetof(struct icmap_alloc_stats, slab_allocs),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_ICMAP, "slab_frees",       offsetof(struct icmap_alloc_stats, slab_frees),       ICMAP_VALUETYPE_UINT64},
+	{ STAT_ICMAP, "large_allocs",     offsetof(struct icmap_alloc_stats, large_allocs),     ICMAP_VALUETYPE_UINT64},
+	{ STAT_ICMAP, "large_frees",      offsetof(struct icmap_alloc_stats, large_frees),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_ICMAP, "in_place_updates", offsetof(struct icmap_alloc_stats, in_place_updates), ICMAP_VALUETYPE_UINT64},
+	{ STAT_ICMAP, "items",            offsetof(struct icmap_alloc_stats, items),            ICMAP_VALUETYPE_UINT64},
+};
 
 #define NUM_PG_STATS (sizeof(cs_pg_stats) / sizeof(struct cs_stats_conv))
 #define NUM_SRP_STATS (sizeof(cs_srp_stats) / sizeof(struct cs_stats_conv))
@@ -212,6 +314,9 @@ struct cs_stats_conv cs_schedmiss_stats[] = {
 #define NUM_KNET_HANDLE_STATS (sizeof(cs_knet_handle_stats) / sizeof(struct cs_stats_conv))
 #define NUM_IPCSC_STATS (sizeof(cs_ipcs_conn_stats) / sizeof(struct cs_stats_conv))
 #define NUM_IPCSG_STATS (sizeof(cs_ipcs_global_stats) / sizeof(struct cs_stats_conv))
+#define NUM_LATENCY_STATS (sizeof(cs_latency_stats) / sizeof(struct cs_stats_conv))
+#define NUM_TOKEN_PHASE_STATS (sizeof(cs_token_phase_stats) / sizeof(struct cs_stats_conv))
+#define NUM_ICMAP_STATS (sizeof(cs_icmap_stats) / sizeof(struct cs_stats_conv))
 
 /* What goes in the trie */
 struct stats_item {
@@ -277,7 +382,7 @@ static void stats_rm_entry(const char *key)
 
 cs_error_t stats_map_init(const struct corosync_api_v1 *corosync_api)
 {
-	int i;
+	int i, j;
 	char param[ICMAP_KEYNAME_MAXLEN];
 
 	api = corosync_api;
@@ -296,15 +401,31 @@ cs_error_t stats_map_init(const struct corosync_api_v1 *corosync_api)
 		sprintf(param, "stats.srp.%s", cs_srp_stats[i].name);
 		stats_add_entry(param, &cs_srp_stats[i]);
 	}
+	for (j = 0; j<TOTEMSRP_TOKEN_PHASE_MAX; j++) {
+		for (i = 0; i<NUM_TOKEN_PHASE_STATS; i++) {
+			sprintf(param, TOKEN_PHASE_PREFIX ".%s.%s", token_phase_names[j], cs_token_phase_stats[i].name);
+			stats_add_entry(param, &cs_token_phase_stats[i]);
+		}
+	}
 	for (i = 0; i<NUM_IPCSG_STATS; i++) {
 		sprintf(param, "stats.ipcs.%s", cs_ipcs_global_stats[i].name);
 		stats_add_entry(param, &cs_ipcs_global_stats[i]);
 	}
+	for (i = 0; i<NUM_ICMAP_STATS; i++) {
+		sprintf(param, "stats.icmap.%s", cs_icmap_stats[i].name);
+		stats_add_entry(param, &cs_icmap_stats[i]);
+	}
 
 	/* KNET, IPCS & SCHEDMISS stats are added when appropriate */
 	return CS_OK;
 }
 
+static struct latency_hist *latency_hist_from_key(const char *key_name);
+static void latency_hist_summary(const struct latency_hist *hist, struct latency_summary *summary);
+static int token_phase_from_key(const char *key_name);
+static void token_phase_summary(const totemsrp_token_phase_stats_t *phase_stats,
+	struct token_phase_summary *summary);
+
 cs_error_t stats_map_get(const char *key_name,
 			 void *value,
 			 size_t *value_len,
@@ -317,6 +438,11 @@ cs_error_t stats_map_get(const char *key_name,
 	struct ipcs_conn_stats ipcs_conn_stats;
 	struct ipcs_global_stats ipcs_global_stats;
 	struct knet_handle_stats knet_handle_stats;
+	struct latency_summary latency_summary;
+	struct latency_hist *latency_hist;
+	struct token_phase_summary token_phase_summary_buf;
+	struct icmap_alloc_stats icmap_alloc_stats;
+	int token_phase;
 	int res;
 	int nodeid;
 	int link_no;
@@ -402,6 +528,27 @@ cs_error_t stats_map_get(const char *key_name,
 				*type = ICMAP_VALUETYPE_FLOAT;
 			}
 			break;
+		case STAT_LATENCY:
+			latency_hist = latency_hist_from_key(key_name);
+			if (latency_hist == NULL) {
+				return CS_ERR_NOT_EXIST;
+			}
+			latency_hist_summary(latency_hist, &latency_summary);
+			stats_map_set_value(statinfo, &latency_summary, value, value_len, type);
+			break;
+		case STAT_TOKEN_PHASE:
+			token_phase = token_phase_from_key(key_name);
+			if (token_phase < 0) {
+				return CS_ERR_NOT_EXIST;
+			}
+			pg_stats = api->totem_get_stats();
+			token_phase_summary(&pg_stats->srp->token_phase[token_phase], &token_phase_summary_buf);
+			stats_map_set_value(statinfo, &token_phase_summary_buf, value, value_len, type);
+			break;
+		case STAT_ICMAP:
+			icmap_get_alloc_stats(&icmap_alloc_stats);
+			stats_map_set_value(statinfo, &icmap_alloc_stats, value, value_len, type);
+			break;
 		default:
 			return CS_ERR_LIBRARY;
 	}
@@ -453,12 +600,261 @@ void stats_add_schedmiss_event(uint64_t timestamp, float delay)
 	/* Notifications get sent by the stats_updater */
 }
 
+static unsigned int latency_bucket(uint64_t value)
+{
+	unsigned int shift;
+
+	if (value < LATENCY_SUB_BUCKETS) {
+		return (value);
+	}
+	if (value >= (1ULL << LATENCY_MAX_BITS)) {
+		value = (1ULL << LATENCY_MAX_BITS) - 1;
+	}
+	shift = (63 - __builtin_clzll(value)) - LATENCY_SUB_BUCKET_BITS;
+
+	return ((shift + 1) * LATENCY_SUB_BUCKETS + (value >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+/* Highest value which falls in the bucket */
+static uint64_t latency_bucket_value(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < LATENCY_SUB_BUCKETS) {
+		return (bucket);
+	}
+	shift = bucket / LATENCY_SUB_BUCKETS - 1;
+
+	return ((((uint64_t)(bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS)) << shift) +
+	    (1ULL << shift) - 1);
+}
+
+static void latency_hist_add(struct latency_hist *hist, uint64_t value)
+{
+	if (hist->count == 0 || value < hist->min) {
+		hist->min = value;
+	}
+	if (value > hist->max) {
+		hist->max = value;
+	}
+	hist->count++;
+	hist->sum += value;
+	hist->buckets[latency_bucket(value)]++;
+}
+
+static void latency_hist_summary(const struct latency_hist *hist, struct latency_summary *summary)
+{
+	/* Quantiles in 1/1000ths, in the order of the summary fields */
+	static const unsigned int quantiles[] = { 500, 900, 990, 999 };
+	uint64_t *results[] = { &summary->p50, &summary->p90, &summary->p99, &summary->p999 };
+	uint64_t seen = 0;
+	uint64_t threshold;
+	unsigned int bucket = 0;
+	unsigned int q;
+
+	memset(summary, 0, sizeof(*summary));
+	if (hist->count == 0) {
+		return ;
+	}
+	summary->count = hist->count;
+	summary->min = hist->min;
+	summary->max = hist->max;
+	summary->mean = hist->sum / hist->count;
+
+	for (q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+		threshold = (hist->count * quantiles[q] + 999) / 1000;
+		while (seen + hist->buckets[bucket] < threshold) {
+			seen += hist->buckets[bucket];
+			bucket++;
+		}
+		*results[q] = latency_bucket_value(bucket);
+		if (*results[q] > hist->max) {
+			*results[q] = hist->max;
+		}
+	}
+}
+
+static void latency_add_keys(const char *name, unsigned int id)
+{
+	int i;
+	char param[ICMAP_KEYNAME_MAXLEN];
+
+	for (i = 0; i<NUM_LATENCY_STATS; i++) {
+		sprintf(param, LATENCY_PREFIX ".%s%u.%s", name, id, cs_latency_stats[i].name);
+		stats_add_entry(param, &cs_latency_stats[i]);
+	}
+}
+
+static void latency_rm_keys(const char *name, unsigned int id)
+{
+	int i;
+	char param[ICMAP_KEYNAME_MAXLEN];
+
+	for (i = 0; i<NUM_LATENCY_STATS; i++) {
+		sprintf(param, LATENCY_PREFIX ".%s%u.%s", name, id, cs_latency_stats[i].name);
+		stats_rm_entry(param);
+	}
+}
+
+static struct latency_node *latency_node_get(unsigned int nodeid)
+{
+	struct latency_node *node;
+	struct qb_list_head *iter;
+
+	if (latency_node_last && latency_node_last->nodeid == nodeid) {
+		return (latency_node_last);
+	}
+	qb_list_for_each(iter, &latency_node_list_head) {
+		node = qb_list_entry(iter, struct latency_node, list);
+		if (node->nodeid == nodeid) {
+			latency_node_last = node;
+			return (node);
+		}
+	}
+	return (NULL);
+}
+
+static struct latency_hist *latency_hist_from_key(const char *key_name)
+{
+	struct latency_node *node;
+	unsigned int id;
+
+	if (sscanf(key_name, LATENCY_PREFIX ".service%u.", &id) == 1) {
+		if (id >= SERVICES_COUNT_MAX) {
+			return (NULL);
+		}
+		return (latency_service[id]);
+	}
+	if (sscanf(key_name, LATENCY_PREFIX ".node%u.", &id) == 1) {
+		node = latency_node_get(id);
+		return (node ? &node->hist : NULL);
+	}
+	return (NULL);
+}
+
+static void latency_clear_stats(void)
+{
+	struct latency_node *node;
+	struct qb_list_head *iter, *tmp_iter;
+	int i;
+
+	for (i = 0; i < SERVICES_COUNT_MAX; i++) {
+		if (latency_service[i]) {
+			latency_rm_keys("service", i);
+			free(latency_service[i]);
+			latency_service[i] = NULL;
+		}
+	}
+	qb_list_for_each_safe(iter, tmp_iter, &latency_node_list_head) {
+		node = qb_list_entry(iter, struct latency_node, list);
+		latency_rm_keys("node", node->nodeid);
+		qb_list_del(&node->list);
+		free(node);
+	}
+	latency_node_last = NULL;
+}
+
+/* Called from main.c for every message which carries a send timestamp */
+void stats_latency_add(int service_id, unsigned int nodeid, uint64_t send_timestamp)
+{
+	struct latency_node *node;
+	uint64_t now = qb_util_nano_from_epoch_get();
+	uint64_t latency_us;
+
+	/*
+	 * Remote timestamps are only as good as the clock synchronization
+	 * between nodes, don't let a clock running ahead produce huge values
+	 */
+	latency_us = (now > send_timestamp) ? (now - send_timestamp) / QB_TIME_NS_IN_USEC : 0;
+
+	if (latency_service[service_id] == NULL) {
+		latency_service[service_id] = calloc(1, sizeof(struct latency_hist));
+		if (latency_service[service_id] == NULL) {
+			return ;
+		}
+		latency_add_keys("service", service_id);
+	}
+	latency_hist_add(latency_service[service_id], latency_us);
+
+	node = latency_node_get(nodeid);
+	if (node == NULL) {
+		node = calloc(1, sizeof(struct latency_node));
+		if (node == NULL) {
+			return ;
+		}
+		node->nodeid = nodeid;
+		qb_list_add(&node->list, &latency_node_list_head);
+		latency_add_keys("node", nodeid);
+		latency_node_last = node;
+	}
+	latency_hist_add(&node->hist, latency_us);
+	/* Notifications get sent by the stats_updater */
+}
+
+static int token_phase_from_key(const char *key_name)
+{
+	const char *name = key_name + strlen(TOKEN_PHASE_PREFIX ".");
+	size_t name_len;
+	int i;
+
+	if (strncmp(key_name, TOKEN_PHASE_PREFIX ".", strlen(TOKEN_PHASE_PREFIX ".")) != 0) {
+		return (-1);
+	}
+	name_len = strcspn(name, ".");
+	for (i = 0; i < TOTEMSRP_TOKEN_PHASE_MAX; i++) {
+		if (strlen(token_phase_names[i]) == name_len &&
+		    strncmp(name, token_phase_names[i], name_len) == 0) {
+			return (i);
+		}
+	}
+	return (-1);
+}
+
+/*
+ * Percentiles are the upper bound of the log2 bucket they fall in, so
+ * they are accurate to a factor of two
+ */
+static void token_phase_summary(const totemsrp_token_phase_stats_t *phase_stats,
+	struct token_phase_summary *summary)
+{
+	/* Quantiles in 1/1000ths, in the order of the summary fields */
+	static const unsigned int quantiles[] = { 500, 900, 990 };
+	uint64_t *results[] = { &summary->p50, &summary->p90, &summary->p99 };
+	uint64_t seen = 0;
+	uint64_t threshold;
+	unsigned int bucket = 0;
+	unsigned int q;
+
+	memset(summary, 0, sizeof(*summary));
+	if (phase_stats->count == 0) {
+		return ;
+	}
+	summary->count = phase_stats->count;
+	summary->total = phase_stats->total;
+	summary->max = phase_stats->max;
+	summary->mean = phase_stats->total / phase_stats->count;
+
+	for (q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+		threshold = (phase_stats->count * quantiles[q] + 999) / 1000;
+		while (bucket < TOTEMSRP_TOKEN_PHASE_BUCKETS - 1 &&
+		    seen + phase_stats->buckets[bucket] < threshold) {
+			seen += phase_stats->buckets[bucket];
+			bucket++;
+		}
+		*results[q] = (2ULL << bucket) - 1;
+		if (*results[q] > phase_stats->max) {
+			*results[q] = phase_stats->max;
+		}
+	}
+}
+
 #define STATS_CLEAR           "stats.clear."
 #define STATS_CLEAR_KNET      "stats.clear.knet"
 #define STATS_CLEAR_IPC       "stats.clear.ipc"
 #define STATS_CLEAR_TOTEM     "stats.clear.totem"
 #define STATS_CLEAR_ALL       "stats.clear.all"
 #define STATS_CLEAR_SCHEDMISS "stats.clear.schedmiss"
+#define STATS_CLEAR_LATENCY   "stats.clear.latency"
 
 cs_error_t stats_map_set(const char *key_name,
 			 const void *value,
@@ -483,10 +879,15 @@ cs_error_t stats_map_set(const char *key_name,
 		schedmiss_clear_stats();
 		cleared = 1;
 	}
+	if (strncmp(key_name, STATS_CLEAR_LATENCY, strlen(STATS_CLEAR_LATENCY)) == 0) {
+		latency_clear_stats();
+		cleared = 1;
+	}
 	if (strncmp(key_name, STATS_CLEAR_ALL, strlen(STATS_CLEAR_ALL)) == 0) {
 		totempg_stats_clear(TOTEMPG_STATS_CLEAR_TRANSPORT | TOTEMPG_STATS_CLEAR_TOTEM);
 		cs_ipcs_clear_stats();
 		schedmiss_clear_stats();
+		latency_clear_stats();
 		cleared = 1;
 	}
 	if (!cleared) {
@@ -515,13 +916,13 @@ int stats_map_is_key_ro(const char *key_name)
 	}
 }
 
-icmap_iter_t stats_map_iter_init(const char *prefix)
+void *stats_map_iter_init(const char *prefix)
 {
 	return (qb_map_pref_iter_create(stats_map, prefix));
 }
 
 
-const char *stats_map_iter_next(icmap_iter_t iter, size_t *value_len, icmap_value_types_t *type)
+const char *stats_map_iter_next(void *iter, size_t *value_len, icmap_value_types_t *type)
 {
 	const char *res;
 	struct stats_item *item;
@@ -535,7 +936,7 @@ const char *stats_map_iter_next(icmap_iter_t iter, size_t *value_len, icmap_valu
 	return res;
 }
 
-void stats_map_iter_finalize(icmap_iter_t iter)
+void stats_map_iter_finalize(void *iter)
 {
 	qb_map_iter_free(iter);
 }
@@ -50,9 +50,9 @@ cs_error_t stats_map_delete(const char *key_name);
 
 int stats_map_is_key_ro(const char *key_name);
 
-icmap_iter_t stats_map_iter_init(const char *prefix);
-const char *stats_map_iter_next(icmap_iter_t iter, size_t *value_len, icmap_value_types_t *type);
-void stats_map_iter_finalize(icmap_iter_t iter);
+void *stats_map_iter_init(const char *prefix);
+const char *stats_map_iter_next(void *iter, size_t *value_len, icmap_value_types_t *type);
+void stats_map_iter_finalize(void *iter);
 
 cs_error_t stats_map_track_add(const char *key_name,
 			 int32_t track_type,
@@ -71,3 +71,5 @@ void stats_ipcs_del_connection(int service_id, uint32_t pid, void *ptr);
 cs_error_t cs_ipcs_get_conn_stats(int service_id, uint32_t pid, void *conn_ptr, struct ipcs_conn_stats *ipcs_stats);
 
 void stats_add_schedmiss_event(uint64_t, float delay);
+
+void stats_latency_add(int service_id, unsigned int nodeid, uint64_t send_timestamp);
@@ -64,6 +64,7 @@
 
 #include "util.h"
 #include "totemconfig.h"
+#include "nameresolve.h"
 
 #define TOKEN_RETRANSMITS_BEFORE_LOSS_CONST	4
 #define TOKEN_TIMEOUT				3000
@@ -81,6 +82,9 @@
 #define MAX_MESSAGES				17
 #define MISS_COUNT_CONST			5
 #define BLOCK_UNLISTED_IPS			1
+#define LATENCY_STATS				0
+#define TOKEN_PHASE_STATS			0
+#define FAST_RETRANSMIT				0
 
 /* Currently all but PONG_COUNT match the defaults in libknet.h */
 #define KNET_PING_INTERVAL                      1000
@@ -92,6 +96,9 @@
 
 #define DEFAULT_PORT				5405
 
+#define RESOLVE_CACHE_TTL			3600
+#define RESOLVE_CACHE_FILE			"nodelist_resolve_cache"
+
 static char error_string_response[768];
 
 static void add_totem_config_notification(struct totem_config *totem_config);
@@ -142,6 +149,12 @@ static void *totem_get_param_by_name(struct totem_config *totem_config, const ch
 		return totem_config->knet_compression_model;
 	if (strcmp(param_name, "totem.block_unlisted_ips") == 0)
 		return &totem_config->block_unlisted_ips;
+	if (strcmp(param_name, "totem.latency_stats") == 0)
+		return &totem_config->latency_stats;
+	if (strcmp(param_name, "totem.token_phase_stats") == 0)
+		return &totem_config->token_phase_stats;
+	if (strcmp(param_name, "totem.fast_retransmit") == 0)
+		return &totem_config->fast_retransmit;
 
 	return NULL;
 }
@@ -363,6 +376,15 @@ void totem_volatile_config_read (struct totem_config *totem_config, icmap_map_t
 
 	totem_volatile_config_set_boolean_value(totem_config, temp_map, "totem.block_unlisted_ips", deleted_key,
 	    BLOCK_UNLISTED_IPS);
+
+	totem_volatile_config_set_boolean_value(totem_config, temp_map, "totem.latency_stats", deleted_key,
+	    LATENCY_STATS);
+
+	totem_volatile_config_set_boolean_value(totem_config, temp_map, "totem.token_phase_stats", deleted_key,
+	    TOKEN_PHASE_STATS);
+
+	totem_volatile_config_set_boolean_value(totem_config, temp_map, "totem.fast_retransmit", deleted_key,
+	    FAST_RETRANSMIT);
 }
 
 int totem_volatile_config_validate (
@@ -690,6 +712,66 @@ static int ipaddr_equal(const struct sockaddr *addr1, const struct sockaddr *add
 }
 
 
+/*
+ * Reverse lookup of one local interface address (run in parallel for all of them)
+ */
+struct local_ifaddr_job {
+	struct sockaddr *sa;
+	socklen_t salen;
+	int name_res;
+	char name[NI_MAXHOST];
+};
+
+static void local_ifaddr_job_fn(void *data)
+{
+	struct local_ifaddr_job *job = (struct local_ifaddr_job *)data;
+
+	job->name_res = getnameinfo(job->sa, job->salen,
+				    job->name, sizeof(job->name),
+				    NULL, 0, 0);
+}
+
+/*
+ * Forward lookup of one nodelist name, is_local is set if any of its addresses
+ * belongs to this node (run in parallel for all names)
+ */
+struct nodelist_name_job {
+	unsigned int node_pos;
+	char *name;
+	struct ifaddrs *ifa_list;
+	int is_local;
+};
+
+static void nodelist_name_job_fn(void *data)
+{
+	struct nodelist_name_job *job = (struct nodelist_name_job *)data;
+	struct addrinfo hints;
+	struct addrinfo *result = NULL, *rp = NULL;
+	struct ifaddrs *ifa;
+
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = 0;
+	hints.ai_protocol = IPPROTO_UDP;
+
+	if (getaddrinfo(job->name, NULL, &hints, &result)) {
+		return ;
+	}
+
+	for (rp = result; rp != NULL && !job->is_local; rp = rp->ai_next) {
+		for (ifa = job->ifa_list; ifa; ifa = ifa->ifa_next) {
+			if (ifa->ifa_addr &&
+			    ipaddr_equal(rp->ai_addr, ifa->ifa_addr)) {
+				job->is_local = 1;
+				break;
+			}
+		}
+	}
+
+	freeaddrinfo(result);
+}
+
 /* Finds the local node and returns its position in the nodelist.
  * Uses nodelist.local_node_pos as a cache to save effort
  */
@@ -708,6 +790,11 @@ static int find_local_node(icmap_map_t map, int use_cache)
 	int node_pos = -1;
 	int res;
 	struct utsname utsname;
+	struct local_ifaddr_job *ifaddr_jobs = NULL;
+	struct nodelist_name_job *name_jobs = NULL;
+	unsigned int jobs_count;
+	unsigned int jobs_allocated;
+	unsigned int i;
 
 	/* Check for cached value first */
 	if (use_cache) {
@@ -758,11 +845,21 @@ static int find_local_node(icmap_map_t map, int use_cache)
 	if (getifaddrs(&ifa_list))
 		return -1;
 
+	/*
+	 * Reverse lookups may take long with slow resolver, so do them all at once
+	 */
+	jobs_count = 0;
 	for (ifa = ifa_list; ifa; ifa = ifa->ifa_next) {
-		socklen_t salen = 0;
+		jobs_count++;
+	}
+	ifaddr_jobs = calloc(jobs_count > 0 ? jobs_count : 1, sizeof(*ifaddr_jobs));
+	if (ifaddr_jobs == NULL) {
+		freeifaddrs(ifa_list);
+		return -1;
+	}
 
-		/* Restore this */
-		strcpy(nodename2, node);
+	jobs_count = 0;
+	for (ifa = ifa_list; ifa; ifa = ifa->ifa_next) {
 		sa = ifa->ifa_addr;
 		if (!sa) {
 			continue;
@@ -771,16 +868,23 @@ static int find_local_node(icmap_map_t map, int use_cache)
 			continue;
 		}
 
+		ifaddr_jobs[jobs_count].sa = sa;
 		if (sa->sa_family == AF_INET) {
-			salen = sizeof(struct sockaddr_in);
+			ifaddr_jobs[jobs_count].salen = sizeof(struct sockaddr_in);
 		}
 		if (sa->sa_family == AF_INET6) {
-			salen = sizeof(struct sockaddr_in6);
+			ifaddr_jobs[jobs_count].salen = sizeof(struct sockaddr_in6);
 		}
+		jobs_count++;
+	}
 
-		if (getnameinfo(sa, salen,
-				nodename2, sizeof(nodename2),
-				NULL, 0, 0) == 0) {
+	nameresolve_run(ifaddr_jobs, sizeof(*ifaddr_jobs), jobs_count, local_ifaddr_job_fn);
+
+	for (i = 0; i < jobs_count; i++) {
+		sa = ifaddr_jobs[i].sa;
+
+		if (ifaddr_jobs[i].name_res == 0) {
+			strcpy(nodename2, ifaddr_jobs[i].name);
 
 			node_pos = nodelist_byname(map, nodename2, 0);
 			if (node_pos > -1) {
@@ -815,6 +919,7 @@ static int find_local_node(icmap_map_t map, int use_cache)
 	}
 
  out:
+	free(ifaddr_jobs);
 	if (found) {
 		freeifaddrs(ifa_list);
 		goto ret_found;
@@ -833,11 +938,12 @@ static int find_local_node(icmap_map_t map, int use_cache)
 	 * and use it as last.
 	 */
 
+	jobs_count = 0;
+	jobs_allocated = 0;
 	iter = icmap_iter_init_r(map, "nodelist.node.");
 	while ((iter_key = icmap_iter_next(iter, NULL, NULL)) != NULL) {
 		char *dbnodename = NULL;
-		struct addrinfo hints;
-		struct addrinfo *result = NULL, *rp = NULL;
+		struct nodelist_name_job *new_name_jobs;
 
 		res = sscanf(iter_key, "nodelist.node.%u.%s", &node_pos, name_str);
 		if (res != 2) {
@@ -853,31 +959,37 @@ static int find_local_node(icmap_map_t map, int use_cache)
 			continue;
 		}
 
-		memset(&hints, 0, sizeof(struct addrinfo));
-		hints.ai_family = AF_UNSPEC;
-		hints.ai_socktype = SOCK_DGRAM;
-		hints.ai_flags = 0;
-		hints.ai_protocol = IPPROTO_UDP;
-
-		if (getaddrinfo(dbnodename, NULL, &hints, &result)) {
-			continue;
-		}
-
-		for (rp = result; rp != NULL; rp = rp->ai_next) {
-			for (ifa = ifa_list; ifa; ifa = ifa->ifa_next) {
-				if (ifa->ifa_addr &&
-				    ipaddr_equal(rp->ai_addr, ifa->ifa_addr)) {
-					freeaddrinfo(result);
-					found = 1;
-					goto out2;
-				}
+		if (jobs_count == jobs_allocated) {
+			jobs_allocated = (jobs_allocated == 0 ? 64 : jobs_allocated * 2);
+			new_name_jobs = realloc(name_jobs, jobs_allocated * sizeof(*name_jobs));
+			if (new_name_jobs == NULL) {
+				free(dbnodename);
+				break;
 			}
+			name_jobs = new_name_jobs;
 		}
 
-		freeaddrinfo(result);
+		name_jobs[jobs_count].node_pos = node_pos;
+		name_jobs[jobs_count].name = dbnodename;
+		name_jobs[jobs_count].ifa_list = ifa_list;
+		name_jobs[jobs_count].is_local = 0;
+		jobs_count++;
 	}
-out2:
 	icmap_iter_finalize(iter);
+
+	nameresolve_run(name_jobs, sizeof(*name_jobs), jobs_count, nodelist_name_job_fn);
+
+	/*
+	 * First match in nodelist order wins, as with serial lookup
+	 */
+	for (i = 0; i < jobs_count; i++) {
+		if (!found && name_jobs[i].is_local) {
+			node_pos = name_jobs[i].node_pos;
+			found = 1;
+		}
+		free(name_jobs[i].name);
+	}
+	free(name_jobs);
 	freeifaddrs(ifa_list);
 
 ret_found:
@@ -1318,6 +1430,54 @@ static int check_things_have_not_changed(struct totem_config *totem_config, cons
 }
 
 
+/*
+ * Resolve all collected nodelist addresses at once and publish timings. On
+ * reload the admin wants the current addresses, so the cache is only a
+ * fallback then.
+ */
+static void resolve_nodelist_addrs(icmap_map_t map, struct nameresolve_entry *entries,
+				   unsigned int count, int reload)
+{
+	struct nameresolve_stats stats;
+	char cache_file[PATH_MAX];
+	uint32_t cache_ttl;
+
+	if (icmap_get_uint32_r(map, "totem.resolve_cache_ttl", &cache_ttl) != CS_OK) {
+		cache_ttl = RESOLVE_CACHE_TTL;
+	}
+
+	if (snprintf(cache_file, sizeof(cache_file), "%s/%s",
+	    get_state_dir(), RESOLVE_CACHE_FILE) >= sizeof(cache_file)) {
+		cache_ttl = 0;
+	}
+
+	nameresolve_entries(entries, count, cache_file, cache_ttl, reload, &stats);
+
+	if (stats.names > 0) {
+		log_printf(LOGSYS_LEVEL_INFO,
+		    "Resolved %u nodelist names (%u from cache, %u failed) in %0.3f ms, "
+		    "slowest %0.3f ms", stats.names, stats.cache_hits, stats.failed,
+		    (double)stats.duration / QB_TIME_NS_IN_MSEC,
+		    (double)stats.slowest / QB_TIME_NS_IN_MSEC);
+	}
+
+	icmap_set_uint32("runtime.nodelist_resolve.names", stats.names);
+	icmap_set_uint32("runtime.nodelist_resolve.cache_hits", stats.cache_hits);
+	icmap_set_uint32("runtime.nodelist_resolve.failed", stats.failed);
+	icmap_set_uint64("runtime.nodelist_resolve.duration", stats.duration / QB_TIME_NS_IN_USEC);
+	icmap_set_uint64("runtime.nodelist_resolve.slowest", stats.slowest / QB_TIME_NS_IN_USEC);
+}
+
+static void free_nodelist_addrs(struct nameresolve_entry *entries, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		free((char *)entries[i].name);
+	}
+	free(entries);
+}
+
 static int put_nodelist_members_to_config(struct totem_config *totem_config, icmap_map_t map,
 					  int reload, const char **error_string)
 {
@@ -1332,6 +1492,19 @@ static int put_nodelist_members_to_config(struct totem_config *totem_config, icm
 	unsigned int linknumber = 0;
 	int i, j;
 	int last_node_pos = -1;
+	/*
+	 * Addresses are collected first (with nodeid and link), resolved together
+	 * and only then put to member lists in the nodelist order
+	 */
+	struct nameresolve_entry *addrs = NULL;
+	struct nameresolve_entry *new_addrs;
+	unsigned int *addr_nodeids = NULL;
+	unsigned int *new_nodeids;
+	unsigned int *addr_links = NULL;
+	unsigned int *new_links;
+	unsigned int addrs_count = 0;
+	unsigned int addrs_allocated = 0;
+	unsigned int k;
 
 	/* Clear out nodelist so we can put the new one in if needed */
 	for (i = 0; i < INTERFACE_MAX; i++) {
@@ -1376,7 +1549,8 @@ static int put_nodelist_members_to_config(struct totem_config *totem_config, icm
 
 				icmap_iter_finalize(iter2);
 				icmap_iter_finalize(iter);
-				return (-1);
+				res = -1;
+				goto out_free;
 			}
 
 			if (icmap_get_string_r(map, iter_key2, &node_addr_str) != CS_OK) {
@@ -1396,8 +1570,12 @@ static int put_nodelist_members_to_config(struct totem_config *totem_config, icm
 						    "for address '%s'.", node_addr_str);
 						*error_string = error_string_response;
 						free(str);
+						free(node_addr_str);
 
-						return (-1);
+						icmap_iter_finalize(iter2);
+						icmap_iter_finalize(iter);
+						res = -1;
+						goto out_free;
 					}
 
 					log_printf(LOGSYS_LEVEL_DEBUG,
@@ -1406,27 +1584,38 @@ static int put_nodelist_members_to_config(struct totem_config *totem_config, icm
 				}
 			}
 
-			member_count = totem_config->interfaces[linknumber].member_count;
-			res = totemip_parse(&totem_config->interfaces[linknumber].member_list[member_count],
-						node_addr_str, totem_config->ip_version);
-			if (res == 0) {
-				totem_config->interfaces[linknumber].member_list[member_count].nodeid = nodeid;
-				totem_config->interfaces[linknumber].member_count++;
-				totem_config->interfaces[linknumber].configured = 1;
-			} else {
-				sprintf(error_string_response, "failed to parse node address '%s'\n", node_addr_str);
-				*error_string = error_string_response;
-
-				memset(&totem_config->interfaces[linknumber].member_list[member_count], 0,
-				       sizeof(struct totem_ip_address));
+			if (addrs_count == addrs_allocated) {
+				addrs_allocated = (addrs_allocated == 0 ? 64 : addrs_allocated * 2);
+				new_addrs = realloc(addrs, addrs_allocated * sizeof(*addrs));
+				if (new_addrs != NULL) {
+					addrs = new_addrs;
+				}
+				new_nodeids = realloc(addr_nodeids, addrs_allocated * sizeof(*addr_nodeids));
+				if (new_nodeids != NULL) {
+					addr_nodeids = new_nodeids;
+				}
+				new_links = realloc(addr_links, addrs_allocated * sizeof(*addr_links));
+				if (new_links != NULL) {
+					addr_links = new_links;
+				}
+				if (new_addrs == NULL || new_nodeids == NULL || new_links == NULL) {
+					sprintf(error_string_response, "Can't allocate memory for nodelist");
+					*error_string = error_string_response;
 
-				free(node_addr_str);
-				icmap_iter_finalize(iter2);
-				icmap_iter_finalize(iter);
-				return -1;
+					free(node_addr_str);
+					icmap_iter_finalize(iter2);
+					icmap_iter_finalize(iter);
+					res = -1;
+					goto out_free;
+				}
 			}
 
-			free(node_addr_str);
+			memset(&addrs[addrs_count], 0, sizeof(addrs[addrs_count]));
+			addrs[addrs_count].name = node_addr_str;
+			addrs[addrs_count].ip_version = totem_config->ip_version;
+			addr_nodeids[addrs_count] = nodeid;
+			addr_links[addrs_count] = linknumber;
+			addrs_count++;
 		}
 
 		icmap_iter_finalize(iter2);
@@ -1434,6 +1623,31 @@ static int put_nodelist_members_to_config(struct totem_config *totem_config, icm
 
 	icmap_iter_finalize(iter);
 
+	resolve_nodelist_addrs(map, addrs, addrs_count, reload);
+
+	for (k = 0; k < addrs_count; k++) {
+		linknumber = addr_links[k];
+		member_count = totem_config->interfaces[linknumber].member_count;
+
+		if (addrs[k].res == 0) {
+			memcpy(&totem_config->interfaces[linknumber].member_list[member_count],
+			       &addrs[k].addr, sizeof(struct totem_ip_address));
+			totem_config->interfaces[linknumber].member_list[member_count].nodeid = addr_nodeids[k];
+			totem_config->interfaces[linknumber].member_count++;
+			totem_config->interfaces[linknumber].configured = 1;
+		} else {
+			sprintf(error_string_response, "failed to parse node address '%s'\n", addrs[k].name);
+			*error_string = error_string_response;
+
+			res = -1;
+			goto out_free;
+		}
+	}
+
+	free_nodelist_addrs(addrs, addrs_count);
+	free(addr_nodeids);
+	free(addr_links);
+
 	configure_link_params(totem_config, map);
 	if (reload) {
 		log_printf(LOGSYS_LEVEL_DEBUG, "About to reconfigure links from nodelist.\n");
@@ -1443,6 +1657,13 @@ static int put_nodelist_members_to_config(struct totem_config *totem_config, icm
 		}
 	}
 	return 0;
+
+out_free:
+	free_nodelist_addrs(addrs, addrs_count);
+	free(addr_nodeids);
+	free(addr_links);
+
+	return (res);
 }
 
 static void config_convert_nodelist_to_interface(icmap_map_t map, struct totem_config *totem_config)
@@ -1769,6 +1990,19 @@ extern int totem_config_read (
 		free(str);
 	}
 
+	totem_config->io_engine = TOTEM_IO_ENGINE_POLL;
+	if (icmap_get_string("totem.io_engine", &str) == CS_OK) {
+		if (strcmp (str, "io_uring") == 0) {
+			totem_config->io_engine = TOTEM_IO_ENGINE_IO_URING;
+		} else if (strcmp (str, "poll") != 0) {
+			*error_string = "Invalid io_engine. Should be poll or io_uring";
+			free(str);
+			return -1;
+		}
+
+		free(str);
+	}
+
 	memset (totem_config->interfaces, 0,
 		sizeof (struct totem_interface) * INTERFACE_MAX);
 
@@ -1809,6 +2043,9 @@ extern int totem_config_read (
 
 	icmap_get_uint32("totem.threads", &totem_config->threads);
 
+	totem_config->lanes = 1;
+	icmap_get_uint32("totem.lanes", &totem_config->lanes);
+
 	icmap_get_uint32("totem.netmtu", &totem_config->net_mtu);
 
 	totem_config->ip_version = totem_config_get_ip_version(totem_config);
@@ -2082,6 +2319,24 @@ int totem_config_validate (
 		goto parse_error;
 	}
 
+	if (totem_config->lanes == 0 || totem_config->lanes > TOTEM_LANES_MAX) {
+		snprintf (parse_error, sizeof(parse_error),
+			  "totem.lanes must be between 1 and %u.", TOTEM_LANES_MAX);
+		error_reason = parse_error;
+		goto parse_error;
+	}
+
+	/*
+	 * Every lane needs its own set of ports, UDP multicast would need
+	 * its own multicast groups as well
+	 */
+	if (totem_config->lanes > 1 && totem_config->transport_number == TOTEM_TRANSPORT_UDP) {
+		snprintf (parse_error, sizeof(parse_error),
+			  "totem.lanes is only supported by the udpu and knet transports.");
+		error_reason = parse_error;
+		goto parse_error;
+	}
+
 	/* Only knet allows crypto */
 	if (totem_config->transport_number != TOTEM_TRANSPORT_KNET) {
 		if ((strcmp(totem_config->crypto_cipher_type, "none") != 0) ||
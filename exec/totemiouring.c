@@ -0,0 +1,501 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+
+#ifdef HAVE_LIBURING
+#include <sys/eventfd.h>
+#include <liburing.h>
+#endif
+
+#include <qb/qbdefs.h>
+#include <qb/qbloop.h>
+
+#include "totemiouring.h"
+
+#ifdef HAVE_LIBURING
+
+/*
+ * Number of receive buffers provided to the kernel (must be power of 2)
+ */
+#define TOTEMIOURING_BUFFERS		64
+
+/*
+ * Only one request (the multishot recvmsg) is ever in flight
+ */
+#define TOTEMIOURING_ENTRIES		4
+
+#define TOTEMIOURING_BGID		0
+
+struct totemiouring {
+	struct io_uring ring;
+
+	struct io_uring_buf_ring *buf_ring;
+
+	char *buffers;
+
+	/*
+	 * Size of one buffer (io_uring_recvmsg_out, name and payload)
+	 */
+	unsigned int buf_size;
+
+	/*
+	 * Maximum size of datagram
+	 */
+	unsigned int msg_size;
+
+	/*
+	 * Template for multishot recvmsg, only msg_namelen is used
+	 */
+	struct msghdr msg;
+
+	int fd;
+
+	int event_fd;
+
+	int armed;
+
+	/*
+	 * Set when multishot receive failed and recvmsg is used instead
+	 */
+	int failed;
+
+	qb_loop_t *poll_handle;
+
+	void *data;
+
+	totemiouring_deliver_fn_t deliver_fn;
+};
+
+static int totemiouring_arm (struct totemiouring *ring)
+{
+	struct io_uring_sqe *sqe;
+	int res;
+
+	sqe = io_uring_get_sqe (&ring->ring);
+	if (sqe == NULL) {
+		return (-EBUSY);
+	}
+
+	io_uring_prep_recvmsg_multishot (sqe, ring->fd, &ring->msg, MSG_TRUNC);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = TOTEMIOURING_BGID;
+	io_uring_sqe_set_data (sqe, ring);
+
+	res = io_uring_submit (&ring->ring);
+	if (res < 0) {
+		return (res);
+	}
+
+	ring->armed = 1;
+
+	return (0);
+}
+
+static void totemiouring_deliver (
+	struct totemiouring *ring,
+	void *buf,
+	int len)
+{
+	struct io_uring_recvmsg_out *out;
+	struct sockaddr_storage system_from;
+	unsigned int msg_len;
+
+	out = io_uring_recvmsg_validate (buf, len, &ring->msg);
+	if (out == NULL) {
+		return ;
+	}
+
+	memset (&system_from, 0, sizeof (system_from));
+	memcpy (&system_from, io_uring_recvmsg_name (out),
+		QB_MIN (out->namelen, ring->msg.msg_namelen));
+
+	if (out->flags & MSG_TRUNC) {
+		msg_len = out->payloadlen;
+	} else {
+		msg_len = io_uring_recvmsg_payload_length (out, len, &ring->msg);
+	}
+
+	ring->deliver_fn (ring->data,
+		io_uring_recvmsg_payload (out, &ring->msg),
+		msg_len,
+		&system_from,
+		(out->flags & MSG_TRUNC) != 0);
+}
+
+/*
+ * Used only after multishot receive failed. Returns 1 if datagram was received.
+ */
+static int totemiouring_fallback_recv (
+	struct totemiouring *ring,
+	char *buf,
+	int deliver)
+{
+	struct sockaddr_storage system_from;
+	struct msghdr msg_recv;
+	struct iovec iov;
+	ssize_t bytes_received;
+
+	iov.iov_base = buf;
+	iov.iov_len = ring->msg_size;
+
+	memset (&msg_recv, 0, sizeof (msg_recv));
+	memset (&system_from, 0, sizeof (system_from));
+	msg_recv.msg_name = &system_from;
+	msg_recv.msg_namelen = sizeof (struct sockaddr_storage);
+	msg_recv.msg_iov = &iov;
+	msg_recv.msg_iovlen = 1;
+
+	bytes_received = recvmsg (ring->fd, &msg_recv, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (bytes_received == -1) {
+		return (0);
+	}
+
+	if (deliver) {
+		ring->deliver_fn (ring->data, buf, bytes_received, &system_from,
+			(msg_recv.msg_flags & MSG_TRUNC) != 0);
+	}
+
+	return (1);
+}
+
+static int totemiouring_fallback_fn (
+	int fd,
+	int revents,
+	void *data)
+{
+	struct totemiouring *ring = (struct totemiouring *)data;
+
+	(void)totemiouring_fallback_recv (ring, ring->buffers, 1);
+
+	return (0);
+}
+
+/*
+ * Flush of failed ring. Uses second buffer, because flush may be called from
+ * deliver_fn of totemiouring_fallback_fn.
+ */
+static int totemiouring_fallback_flush (
+	struct totemiouring *ring,
+	int deliver)
+{
+	struct pollfd ufd;
+	int processed = 0;
+
+	for (;;) {
+		ufd.fd = ring->fd;
+		ufd.events = POLLIN;
+		ufd.revents = 0;
+		if (poll (&ufd, 1, 0) != 1 || !(ufd.revents & POLLIN)) {
+			break;
+		}
+
+		if (!totemiouring_fallback_recv (ring, ring->buffers + ring->buf_size,
+		    deliver)) {
+			break;
+		}
+		processed++;
+	}
+
+	return (processed);
+}
+
+/*
+ * max 0 means process everything
+ */
+static int totemiouring_process (
+	struct totemiouring *ring,
+	int deliver,
+	int max)
+{
+	struct io_uring_cqe *cqe;
+	int32_t res;
+	uint32_t flags;
+	unsigned short bid;
+	char *buf;
+	int processed = 0;
+
+	if (ring->failed) {
+		return (0);
+	}
+
+	/*
+	 * Run pending task work, so every datagram already received by the kernel
+	 * has its completion
+	 */
+	(void)io_uring_get_events (&ring->ring);
+
+	while (max == 0 || processed < max) {
+		if (io_uring_peek_cqe (&ring->ring, &cqe) != 0) {
+			break;
+		}
+
+		/*
+		 * Completion is consumed before delivery, so the deliver_fn can call
+		 * totemiouring_recv_dispatch itself (flush) and only sees newer datagrams
+		 */
+		res = cqe->res;
+		flags = cqe->flags;
+		io_uring_cqe_seen (&ring->ring, cqe);
+
+		if (!(flags & IORING_CQE_F_MORE)) {
+			ring->armed = 0;
+		}
+
+		if (res < 0) {
+			/*
+			 * -ENOBUFS means all buffers are in use, receive is armed again
+			 * below after they are returned. Anything else is permanent.
+			 */
+			if (res != -ENOBUFS) {
+				ring->failed = 1;
+				qb_loop_poll_add (ring->poll_handle, QB_LOOP_MED, ring->fd,
+					POLLIN, ring, totemiouring_fallback_fn);
+				break;
+			}
+			continue ;
+		}
+
+		if (!(flags & IORING_CQE_F_BUFFER)) {
+			continue ;
+		}
+
+		bid = flags >> IORING_CQE_BUFFER_SHIFT;
+		buf = ring->buffers + (size_t)bid * ring->buf_size;
+
+		if (deliver) {
+			totemiouring_deliver (ring, buf, res);
+		}
+		processed++;
+
+		io_uring_buf_ring_add (ring->buf_ring, buf, ring->buf_size, bid,
+			io_uring_buf_ring_mask (TOTEMIOURING_BUFFERS), 0);
+		io_uring_buf_ring_advance (ring->buf_ring, 1);
+	}
+
+	if (!ring->armed && !ring->failed) {
+		(void)totemiouring_arm (ring);
+	}
+
+	return (processed);
+}
+
+static int totemiouring_event_fn (
+	int fd,
+	int revents,
+	void *data)
+{
+	struct totemiouring *ring = (struct totemiouring *)data;
+	eventfd_t value;
+
+	(void)eventfd_read (fd, &value);
+
+	/*
+	 * Deliver at most one buffer ring worth of datagrams and let other
+	 * events of main loop run before the rest
+	 */
+	(void)totemiouring_process (ring, 1, TOTEMIOURING_BUFFERS);
+
+	if (!ring->failed && io_uring_cq_ready (&ring->ring) > 0) {
+		(void)eventfd_write (fd, 1);
+	}
+
+	return (0);
+}
+
+int totemiouring_recv_create (
+	qb_loop_t *poll_handle,
+	int fd,
+	unsigned int buf_size,
+	void *data,
+	totemiouring_deliver_fn_t deliver_fn,
+	struct totemiouring **res_ring)
+{
+	struct totemiouring *ring;
+	struct io_uring_params params;
+	struct io_uring_cqe *cqe;
+	unsigned int i;
+	int res;
+
+	ring = malloc (sizeof (struct totemiouring));
+	if (ring == NULL) {
+		return (-ENOMEM);
+	}
+	memset (ring, 0, sizeof (struct totemiouring));
+
+	ring->fd = fd;
+	ring->event_fd = -1;
+	ring->poll_handle = poll_handle;
+	ring->data = data;
+	ring->deliver_fn = deliver_fn;
+	ring->msg.msg_namelen = sizeof (struct sockaddr_storage);
+	ring->msg_size = buf_size;
+	ring->buf_size = sizeof (struct io_uring_recvmsg_out) +
+		sizeof (struct sockaddr_storage) + buf_size;
+
+	memset (&params, 0, sizeof (params));
+	res = io_uring_queue_init_params (TOTEMIOURING_ENTRIES, &ring->ring, &params);
+	if (res < 0) {
+		free (ring);
+		return (res);
+	}
+
+	ring->buffers = malloc ((size_t)ring->buf_size * TOTEMIOURING_BUFFERS);
+	if (ring->buffers == NULL) {
+		res = -ENOMEM;
+		goto error_queue_exit;
+	}
+
+	ring->buf_ring = io_uring_setup_buf_ring (&ring->ring, TOTEMIOURING_BUFFERS,
+		TOTEMIOURING_BGID, 0, &res);
+	if (ring->buf_ring == NULL) {
+		goto error_free_buffers;
+	}
+
+	for (i = 0; i < TOTEMIOURING_BUFFERS; i++) {
+		io_uring_buf_ring_add (ring->buf_ring, ring->buffers + (size_t)i * ring->buf_size,
+			ring->buf_size, i, io_uring_buf_ring_mask (TOTEMIOURING_BUFFERS), i);
+	}
+	io_uring_buf_ring_advance (ring->buf_ring, TOTEMIOURING_BUFFERS);
+
+	ring->event_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ring->event_fd == -1) {
+		res = -errno;
+		goto error_free_buf_ring;
+	}
+
+	res = io_uring_register_eventfd (&ring->ring, ring->event_fd);
+	if (res < 0) {
+		goto error_close_event_fd;
+	}
+
+	res = totemiouring_arm (ring);
+	if (res < 0) {
+		goto error_close_event_fd;
+	}
+
+	/*
+	 * Kernels without multishot recvmsg complete the request with error
+	 * right away
+	 */
+	if (io_uring_peek_cqe (&ring->ring, &cqe) == 0 && cqe->res < 0 && cqe->res != -ENOBUFS) {
+		res = -ENOTSUP;
+		goto error_close_event_fd;
+	}
+
+	res = qb_loop_poll_add (poll_handle, QB_LOOP_MED, ring->event_fd,
+		POLLIN, ring, totemiouring_event_fn);
+	if (res < 0) {
+		goto error_close_event_fd;
+	}
+
+	*res_ring = ring;
+
+	return (0);
+
+error_close_event_fd:
+	close (ring->event_fd);
+error_free_buf_ring:
+	(void)io_uring_free_buf_ring (&ring->ring, ring->buf_ring, TOTEMIOURING_BUFFERS,
+		TOTEMIOURING_BGID);
+error_free_buffers:
+	free (ring->buffers);
+error_queue_exit:
+	io_uring_queue_exit (&ring->ring);
+	free (ring);
+
+	return (res);
+}
+
+void totemiouring_recv_destroy (struct totemiouring *ring)
+{
+
+	qb_loop_poll_del (ring->poll_handle, ring->event_fd);
+	if (ring->failed) {
+		qb_loop_poll_del (ring->poll_handle, ring->fd);
+	}
+	close (ring->event_fd);
+
+	/*
+	 * Exiting the ring cancels the multishot receive
+	 */
+	(void)io_uring_free_buf_ring (&ring->ring, ring->buf_ring, TOTEMIOURING_BUFFERS,
+		TOTEMIOURING_BGID);
+	io_uring_queue_exit (&ring->ring);
+	free (ring->buffers);
+	free (ring);
+}
+
+int totemiouring_recv_dispatch (struct totemiouring *ring, int deliver)
+{
+
+	if (ring->failed) {
+		return (totemiouring_fallback_flush (ring, deliver));
+	}
+
+	return (totemiouring_process (ring, deliver, 0));
+}
+
+#else /* HAVE_LIBURING */
+
+int totemiouring_recv_create (
+	qb_loop_t *poll_handle,
+	int fd,
+	unsigned int buf_size,
+	void *data,
+	totemiouring_deliver_fn_t deliver_fn,
+	struct totemiouring **ring)
+{
+
+	return (-ENOTSUP);
+}
+
+void totemiouring_recv_destroy (struct totemiouring *ring)
+{
+}
+
+int totemiouring_recv_dispatch (struct totemiouring *ring, int deliver)
+{
+
+	return (0);
+}
+
+#endif /* HAVE_LIBURING */
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TOTEMIOURING_H_DEFINED
+#define TOTEMIOURING_H_DEFINED
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <qb/qbloop.h>
+
+/*
+ * io_uring based receive path of one totem socket. A multishot recvmsg is kept
+ * armed on the socket, datagrams are received into a ring of buffers provided
+ * to the kernel and the completions are delivered from the main loop in batches.
+ */
+struct totemiouring;
+
+/*
+ * msg is valid only during the call. truncated is set if datagram didn't fit
+ * into the buffer (msg_len is then the full length of the datagram).
+ */
+typedef void (*totemiouring_deliver_fn_t) (
+	void *data,
+	const void *msg,
+	unsigned int msg_len,
+	const struct sockaddr_storage *system_from,
+	int truncated);
+
+/*
+ * Start receiving on fd. buf_size is the maximum size of received datagram.
+ * Returns 0 on success or negative errno (-ENOTSUP when corosync is built
+ * without io_uring or kernel doesn't support it), in which case the caller
+ * should fall back to recvmsg.
+ */
+extern int totemiouring_recv_create (
+	qb_loop_t *poll_handle,
+	int fd,
+	unsigned int buf_size,
+	void *data,
+	totemiouring_deliver_fn_t deliver_fn,
+	struct totemiouring **ring);
+
+/*
+ * Stop receiving and release the ring. Must be called before the socket is
+ * closed.
+ */
+extern void totemiouring_recv_destroy (struct totemiouring *ring);
+
+/*
+ * Process all datagrams already received by the kernel. If deliver is 0 they are
+ * dropped. Returns number of processed datagrams.
+ */
+extern int totemiouring_recv_dispatch (struct totemiouring *ring, int deliver);
+
+#endif /* TOTEMIOURING_H_DEFINED */
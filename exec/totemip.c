@@ -317,6 +317,7 @@ int totemip_parse(struct totem_ip_address *totemip, const char *addr,
 	int ret;
 	int debug_ip_family;
 	int ai_family;
+	char addr_str[INET6_ADDRSTRLEN];
 
 	memset(&ahints, 0, sizeof(ahints));
 	ahints.ai_socktype = SOCK_DGRAM;
@@ -408,8 +409,13 @@ int totemip_parse(struct totem_ip_address *totemip, const char *addr,
 		debug_ip_family = 6;
 	}
 
+	/*
+	 * Local buffer instead of totemip_print, so totemip_parse can be called from
+	 * multiple threads (nodelist resolution)
+	 */
 	log_printf(LOGSYS_LEVEL_DEBUG, "totemip_parse: IPv%u address of %s resolved as %s",
-		    debug_ip_family, addr, totemip_print(totemip));
+		    debug_ip_family, addr,
+		    inet_ntop(totemip->family, totemip->addr, addr_str, sizeof(addr_str)));
 
 	freeaddrinfo(ainfo);
 
@@ -1181,7 +1181,12 @@ int totemknet_initialize (
 	if (res) {
 		KNET_LOGSYS_PERROR(errno, LOGSYS_LEVEL_WARNING, "knet_handle_enable_pmtud_notify failed");
 	}
-	global_instance = instance;
+	/*
+	 * Link status and handle stats are reported for the first lane
+	 */
+	if (totem_config->lane == 0) {
+		global_instance = instance;
+	}
 
 	/* Get an fd into knet */
 	instance->knet_fd = 0;
@@ -1357,6 +1362,34 @@ int totemknet_mcast_noflush_send (
 	return (res);
 }
 
+int totemknet_ucast_send (
+	void *knet_context,
+	const void *msg,
+	unsigned int msg_len,
+	unsigned int nodeid)
+{
+	struct totemknet_instance *instance = (struct totemknet_instance *)knet_context;
+	struct totem_ip_address target;
+
+	memset (&target, 0, sizeof (target));
+	target.nodeid = nodeid;
+
+	ucast_sendmsg (instance, &target, msg, msg_len);
+
+	return (0);
+}
+
+/*
+ * knet routes by nodeid, every node it knows about is reachable
+ */
+int totemknet_ucast_reachable (
+	void *knet_context,
+	unsigned int nodeid)
+{
+
+	return (1);
+}
+
 
 extern int totemknet_iface_check (void *knet_context)
 {
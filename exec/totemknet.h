@@ -92,6 +92,16 @@ extern int totemknet_mcast_noflush_send (
 	const void *msg,
 	unsigned int msg_len);
 
+extern int totemknet_ucast_send (
+	void *knet_context,
+	const void *msg,
+	unsigned int msg_len,
+	unsigned int nodeid);
+
+extern int totemknet_ucast_reachable (
+	void *knet_context,
+	unsigned int nodeid);
+
 extern int totemknet_recv_flush (void *knet_context);
 
 extern int totemknet_send_flush (void *knet_context);
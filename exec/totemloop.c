@@ -0,0 +1,699 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <qb/qblist.h>
+#include <qb/qbdefs.h>
+#include <qb/qbloop.h>
+
+#define LOGSYS_UTILS_ONLY 1
+#include <corosync/logsys.h>
+#include "totemloop.h"
+
+#define LOOP_PARTITIONS_MAX	PROCESSOR_COUNT_MAX
+
+struct totemloop_instance {
+	struct qb_list_head list;
+
+	qb_loop_t *totemloop_poll_handle;
+
+	struct totem_interface *totem_interface;
+
+	void *context;
+
+	void (*totemloop_deliver_fn) (
+		void *context,
+		const void *msg,
+		unsigned int msg_len,
+		const struct sockaddr_storage *system_from);
+
+	void (*totemloop_iface_change_fn) (
+		void *context,
+		const struct totem_ip_address *iface_address,
+		unsigned int ring_no);
+
+	void (*totemloop_target_set_completed) (void *context);
+
+	/*
+	 * Function and data used to log messages
+	 */
+	int totemloop_log_level_security;
+
+	int totemloop_log_level_error;
+
+	int totemloop_log_level_warning;
+
+	int totemloop_log_level_notice;
+
+	int totemloop_log_level_debug;
+
+	int totemloop_subsys_id;
+
+	void (*totemloop_log_printf) (
+		int level,
+		int subsys,
+		const char *function,
+		const char *file,
+		int line,
+		const char *format,
+		...)__attribute__((format(printf, 6, 7)));
+
+	struct totem_config *totem_config;
+
+	totemsrp_stats_t *stats;
+
+	struct totem_ip_address my_id;
+
+	struct sockaddr_storage my_sockaddr;
+
+	unsigned int token_target;
+
+	qb_loop_timer_handle timer_netif_check_timeout;
+
+	/*
+	 * Packets queued for delivery to this instance
+	 */
+	struct qb_list_head pending_list;
+
+	/*
+	 * Packets are handed up from a full sized frame, as the udp
+	 * transports do, because totemsrp reads the token's whole
+	 * retransmit list regardless of the received length
+	 */
+	char iov_buffer[FRAME_SIZE_MAX];
+};
+
+struct totemloop_packet {
+	struct qb_list_head list;
+	struct totemloop_instance *instance;
+	qb_loop_timer_handle timer;
+	struct sockaddr_storage system_from;
+	unsigned int msg_len;
+	char msg[0];
+};
+
+struct totemloop_partition {
+	unsigned int nodeid;
+	unsigned int partition;
+};
+
+static QB_LIST_DECLARE (instance_list);
+
+static struct totemloop_net_config net_config;
+
+static struct totemloop_net_stats net_stats;
+
+static struct totemloop_partition partitions[LOOP_PARTITIONS_MAX];
+
+static unsigned int partition_entries = 0;
+
+static uint64_t prng_state = 0x9E3779B97F4A7C15ULL;
+
+#define log_printf(level, format, args...)		\
+do {							\
+        instance->totemloop_log_printf (		\
+		level, instance->totemloop_subsys_id,	\
+                __FUNCTION__, __FILE__, __LINE__,	\
+		(const char *)format, ##args);		\
+} while (0);
+
+/*
+ * xorshift64* keeps loss and reorder decisions reproducible for a given seed
+ */
+static uint64_t prng_next (void)
+{
+	prng_state ^= prng_state >> 12;
+	prng_state ^= prng_state << 25;
+	prng_state ^= prng_state >> 27;
+
+	return (prng_state * 0x2545F4914F6CDD1DULL);
+}
+
+static int prng_chance (uint32_t ppm)
+{
+	if (ppm == 0) {
+		return (0);
+	}
+	return ((prng_next () % 1000000) < ppm);
+}
+
+void totemloop_net_config_set (const struct totemloop_net_config *config)
+{
+	memcpy (&net_config, config, sizeof (struct totemloop_net_config));
+}
+
+void totemloop_net_config_get (struct totemloop_net_config *config)
+{
+	memcpy (config, &net_config, sizeof (struct totemloop_net_config));
+}
+
+void totemloop_seed_set (uint64_t seed)
+{
+	/*
+	 * xorshift must never be seeded with zero
+	 */
+	prng_state = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+void totemloop_net_stats_get (struct totemloop_net_stats *stats)
+{
+	memcpy (stats, &net_stats, sizeof (struct totemloop_net_stats));
+}
+
+unsigned int totemloop_partition_get (unsigned int nodeid)
+{
+	unsigned int i;
+
+	for (i = 0; i < partition_entries; i++) {
+		if (partitions[i].nodeid == nodeid) {
+			return (partitions[i].partition);
+		}
+	}
+	return (0);
+}
+
+void totemloop_partition_set (unsigned int nodeid, unsigned int partition)
+{
+	unsigned int i;
+
+	for (i = 0; i < partition_entries; i++) {
+		if (partitions[i].nodeid == nodeid) {
+			partitions[i].partition = partition;
+			return;
+		}
+	}
+	if (partition_entries < LOOP_PARTITIONS_MAX) {
+		partitions[partition_entries].nodeid = nodeid;
+		partitions[partition_entries].partition = partition;
+		partition_entries++;
+	}
+}
+
+static void totemloop_instance_initialize (struct totemloop_instance *instance)
+{
+	memset (instance, 0, sizeof (struct totemloop_instance));
+
+	qb_list_init (&instance->list);
+	qb_list_init (&instance->pending_list);
+}
+
+/*
+ * Loop instances use 127.x.y.z addresses derived from the nodeid so that
+ * logging of the sender address stays meaningful.
+ */
+static void totemloop_address_build (
+	unsigned int nodeid,
+	struct totem_ip_address *addr,
+	struct sockaddr_storage *sockaddr)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in *)sockaddr;
+	uint32_t host_addr = (127U << 24) | (nodeid & 0x00ffffff);
+
+	memset (sockaddr, 0, sizeof (struct sockaddr_storage));
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl (host_addr);
+
+	memset (addr, 0, sizeof (struct totem_ip_address));
+	addr->nodeid = nodeid;
+	addr->family = AF_INET;
+	memcpy (addr->addr, &sin->sin_addr, sizeof (struct in_addr));
+}
+
+static void packet_deliver_fn (void *data)
+{
+	struct totemloop_packet *packet = (struct totemloop_packet *)data;
+	struct totemloop_instance *instance = packet->instance;
+
+	qb_list_del (&packet->list);
+	net_stats.packets_delivered++;
+
+	memcpy (instance->iov_buffer, packet->msg, packet->msg_len);
+
+	instance->totemloop_deliver_fn (
+		instance->context,
+		instance->iov_buffer,
+		packet->msg_len,
+		&packet->system_from);
+
+	free (packet);
+}
+
+static void packet_send (
+	struct totemloop_instance *instance,
+	struct totemloop_instance *target,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemloop_packet *packet;
+	uint64_t delay = 0;
+
+	net_stats.packets_sent++;
+	net_stats.bytes_sent += msg_len;
+
+	if (totemloop_partition_get (instance->my_id.nodeid) !=
+	    totemloop_partition_get (target->my_id.nodeid)) {
+		net_stats.packets_partitioned++;
+		return;
+	}
+
+	/*
+	 * Local delivery behaves like multicast loopback, it is never lost
+	 */
+	if (target != instance) {
+		if (prng_chance (net_config.loss_ppm)) {
+			net_stats.packets_lost++;
+			return;
+		}
+		delay = net_config.latency_ns;
+		if (net_config.jitter_ns) {
+			delay += prng_next () % net_config.jitter_ns;
+		}
+		if (prng_chance (net_config.reorder_ppm)) {
+			delay += net_config.latency_ns + net_config.jitter_ns;
+		}
+	}
+
+	packet = malloc (sizeof (struct totemloop_packet) + msg_len);
+	if (packet == NULL) {
+		log_printf (instance->totemloop_log_level_warning,
+			"Unable to allocate loop packet");
+		return;
+	}
+	packet->instance = target;
+	packet->msg_len = msg_len;
+	memcpy (&packet->system_from, &instance->my_sockaddr,
+		sizeof (struct sockaddr_storage));
+	memcpy (packet->msg, msg, msg_len);
+
+	qb_list_add_tail (&packet->list, &target->pending_list);
+
+	if (qb_loop_timer_add (target->totemloop_poll_handle,
+	    QB_LOOP_MED,
+	    delay,
+	    (void *)packet,
+	    packet_deliver_fn,
+	    &packet->timer) != 0) {
+		log_printf (instance->totemloop_log_level_warning,
+			"Unable to schedule loop packet delivery, packet dropped");
+		qb_list_del (&packet->list);
+		free (packet);
+	}
+}
+
+static void timer_function_netif_check_timeout (
+	void *data)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)data;
+
+	log_printf (instance->totemloop_log_level_notice,
+		"The network interface [%s] is now up.",
+		totemip_print (&instance->my_id));
+
+	instance->totemloop_iface_change_fn (instance->context,
+		&instance->my_id, 0);
+}
+
+int totemloop_crypto_set (
+	void *loop_context,
+	const char *cipher_type,
+	const char *hash_type)
+{
+
+	return (0);
+}
+
+int totemloop_finalize (
+	void *loop_context)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+	struct totemloop_packet *packet;
+	struct qb_list_head *list;
+	struct qb_list_head *tmp_iter;
+
+	qb_loop_timer_del (instance->totemloop_poll_handle,
+		instance->timer_netif_check_timeout);
+
+	qb_list_for_each_safe(list, tmp_iter, &(instance->pending_list)) {
+		packet = qb_list_entry (list,
+			struct totemloop_packet,
+			list);
+
+		qb_loop_timer_del (instance->totemloop_poll_handle, packet->timer);
+		qb_list_del (&packet->list);
+		free (packet);
+	}
+
+	qb_list_del (&instance->list);
+	free (instance);
+
+	return (0);
+}
+
+int totemloop_nodestatus_get (void *loop_context, unsigned int nodeid,
+			      struct totem_node_status *node_status)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+	struct totemloop_instance *peer;
+	struct qb_list_head *list;
+	struct totem_ip_address addr;
+	struct sockaddr_storage sockaddr;
+
+	qb_list_for_each(list, &instance_list) {
+		peer = qb_list_entry (list,
+			struct totemloop_instance,
+			list);
+
+		if (peer->my_id.nodeid == nodeid) {
+			node_status->nodeid = nodeid;
+			/* reachable is filled in by totemsrp */
+			node_status->link_status[0].enabled = 1;
+			node_status->link_status[0].connected = node_status->reachable;
+			node_status->link_status[0].mtu = instance->totem_config->net_mtu;
+			totemloop_address_build (nodeid, &addr, &sockaddr);
+			strncpy(node_status->link_status[0].src_ipaddr, totemip_print(&addr), KNET_MAX_HOST_LEN-1);
+		}
+	}
+	return (0);
+}
+
+int totemloop_ifaces_get (
+	void *net_context,
+	char ***status,
+	unsigned int *iface_count)
+{
+	static char *statuses[INTERFACE_MAX] = {(char*)"OK"};
+
+	if (status) {
+		*status = statuses;
+	}
+	*iface_count = 1;
+
+	return (0);
+}
+
+/*
+ * Create an instance
+ */
+int totemloop_initialize (
+	qb_loop_t *poll_handle,
+	void **loop_context,
+	struct totem_config *totem_config,
+	totemsrp_stats_t *stats,
+	void *context,
+
+	void (*deliver_fn) (
+		void *context,
+		const void *msg,
+		unsigned int msg_len,
+		const struct sockaddr_storage *system_from),
+
+	void (*iface_change_fn) (
+		void *context,
+		const struct totem_ip_address *iface_address,
+		unsigned int ring_no),
+
+	void (*mtu_changed) (
+		void *context,
+		int net_mtu),
+
+	void (*target_set_completed) (
+		void *context))
+{
+	struct totemloop_instance *instance;
+
+	instance = malloc (sizeof (struct totemloop_instance));
+	if (instance == NULL) {
+		return (-1);
+	}
+
+	totemloop_instance_initialize (instance);
+
+	instance->totem_config = totem_config;
+	instance->stats = stats;
+
+	/*
+	* Configure logging
+	*/
+	instance->totemloop_log_level_security = totem_config->totem_logging_configuration.log_level_security;
+	instance->totemloop_log_level_error = totem_config->totem_logging_configuration.log_level_error;
+	instance->totemloop_log_level_warning = totem_config->totem_logging_configuration.log_level_warning;
+	instance->totemloop_log_level_notice = totem_config->totem_logging_configuration.log_level_notice;
+	instance->totemloop_log_level_debug = totem_config->totem_logging_configuration.log_level_debug;
+	instance->totemloop_subsys_id = totem_config->totem_logging_configuration.log_subsys_id;
+	instance->totemloop_log_printf = totem_config->totem_logging_configuration.log_printf;
+
+	instance->totem_interface = &totem_config->interfaces[0];
+
+	instance->totemloop_poll_handle = poll_handle;
+
+	instance->context = context;
+	instance->totemloop_deliver_fn = deliver_fn;
+
+	instance->totemloop_iface_change_fn = iface_change_fn;
+
+	instance->totemloop_target_set_completed = target_set_completed;
+
+	totemloop_address_build (totem_config->node_id,
+		&instance->my_id, &instance->my_sockaddr);
+	totemip_copy (&instance->totem_interface->bindnet, &instance->my_id);
+	totemip_copy (&instance->totem_interface->boundto, &instance->my_id);
+
+	qb_list_add_tail (&instance->list, &instance_list);
+
+	/*
+	 * Report the interface up asynchronously like the real transports do
+	 */
+	qb_loop_timer_add (instance->totemloop_poll_handle,
+		QB_LOOP_MED,
+		100*QB_TIME_NS_IN_MSEC,
+		(void *)instance,
+		timer_function_netif_check_timeout,
+		&instance->timer_netif_check_timeout);
+
+	*loop_context = instance;
+	return (0);
+}
+
+void *totemloop_buffer_alloc (void)
+{
+	return malloc (FRAME_SIZE_MAX);
+}
+
+void totemloop_buffer_release (void *ptr)
+{
+	return free (ptr);
+}
+
+int totemloop_processor_count_set (
+	void *loop_context,
+	int processor_count)
+{
+	return (0);
+}
+
+int totemloop_recv_flush (void *loop_context)
+{
+	return (0);
+}
+
+int totemloop_send_flush (void *loop_context)
+{
+	return (0);
+}
+
+int totemloop_token_send (
+	void *loop_context,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+	struct totemloop_instance *peer;
+	struct qb_list_head *list;
+
+	qb_list_for_each(list, &instance_list) {
+		peer = qb_list_entry (list,
+			struct totemloop_instance,
+			list);
+
+		if (peer->my_id.nodeid == instance->token_target) {
+			packet_send (instance, peer, msg, msg_len);
+			break;
+		}
+	}
+
+	return (0);
+}
+
+int totemloop_mcast_flush_send (
+	void *loop_context,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+	struct totemloop_instance *peer;
+	struct qb_list_head *list;
+
+	qb_list_for_each(list, &instance_list) {
+		peer = qb_list_entry (list,
+			struct totemloop_instance,
+			list);
+
+		packet_send (instance, peer, msg, msg_len);
+	}
+
+	return (0);
+}
+
+int totemloop_mcast_noflush_send (
+	void *loop_context,
+	const void *msg,
+	unsigned int msg_len)
+{
+
+	return (totemloop_mcast_flush_send (loop_context, msg, msg_len));
+}
+
+static struct totemloop_instance *find_peer_by_nodeid (unsigned int nodeid)
+{
+	struct totemloop_instance *peer;
+	struct qb_list_head *list;
+
+	qb_list_for_each(list, &instance_list) {
+		peer = qb_list_entry (list,
+			struct totemloop_instance,
+			list);
+
+		if (peer->my_id.nodeid == nodeid) {
+			return (peer);
+		}
+	}
+
+	return (NULL);
+}
+
+int totemloop_ucast_send (
+	void *loop_context,
+	const void *msg,
+	unsigned int msg_len,
+	unsigned int nodeid)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+	struct totemloop_instance *peer;
+
+	peer = find_peer_by_nodeid (nodeid);
+	if (peer == NULL) {
+		return (-1);
+	}
+
+	packet_send (instance, peer, msg, msg_len);
+
+	return (0);
+}
+
+int totemloop_ucast_reachable (
+	void *loop_context,
+	unsigned int nodeid)
+{
+
+	return (find_peer_by_nodeid (nodeid) != NULL);
+}
+
+int totemloop_iface_check (void *loop_context)
+{
+	return (0);
+}
+
+int totemloop_iface_set (void *loop_context,
+	const struct totem_ip_address *local_addr,
+	unsigned short ip_port,
+	unsigned int iface_no)
+{
+	return (0);
+}
+
+/*
+ * Packets are handed over in memory without any transport header or
+ * encryption, so the whole configured net_mtu is usable
+ */
+void totemloop_net_mtu_adjust (void *loop_context, struct totem_config *totem_config)
+{
+}
+
+int totemloop_token_target_set (
+	void *loop_context,
+	unsigned int nodeid)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+
+	instance->token_target = nodeid;
+	instance->totemloop_target_set_completed (instance->context);
+
+	return (0);
+}
+
+int totemloop_recv_mcast_empty (
+	void *loop_context)
+{
+	return (0);
+}
+
+int totemloop_member_add (
+	void *loop_context,
+	const struct totem_ip_address *local,
+	const struct totem_ip_address *member,
+	int ring_no)
+{
+	return (0);
+}
+
+int totemloop_member_remove (
+	void *loop_context,
+	const struct totem_ip_address *member,
+	int ring_no)
+{
+	return (0);
+}
+
+int totemloop_reconfigure (
+	void *loop_context,
+	struct totem_config *totem_config)
+{
+	return (0);
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TOTEMLOOP_H_DEFINED
+#define TOTEMLOOP_H_DEFINED
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <qb/qbloop.h>
+
+#include <corosync/totem/totem.h>
+
+/*
+ * The loop transport connects every totem instance created in the same
+ * process. Packets are queued as timers on the receiving instance's loop,
+ * so together with a virtual clock the whole exchange is deterministic.
+ */
+
+/*
+ * Network model shared by all loop instances. Probabilities are expressed
+ * in parts per million.
+ */
+struct totemloop_net_config {
+	uint64_t latency_ns;
+	uint64_t jitter_ns;
+	uint32_t loss_ppm;
+	uint32_t reorder_ppm;
+};
+
+struct totemloop_net_stats {
+	uint64_t packets_sent;
+	uint64_t packets_delivered;
+	uint64_t packets_lost;
+	uint64_t packets_partitioned;
+	uint64_t bytes_sent;
+};
+
+extern void totemloop_net_config_set (const struct totemloop_net_config *net_config);
+
+extern void totemloop_net_config_get (struct totemloop_net_config *net_config);
+
+extern void totemloop_seed_set (uint64_t seed);
+
+/*
+ * Nodes can only exchange packets with nodes in the same partition.
+ * All nodes start in partition 0.
+ */
+extern void totemloop_partition_set (unsigned int nodeid, unsigned int partition);
+
+extern unsigned int totemloop_partition_get (unsigned int nodeid);
+
+extern void totemloop_net_stats_get (struct totemloop_net_stats *net_stats);
+
+/**
+ * Create an instance
+ */
+extern int totemloop_initialize (
+	qb_loop_t *poll_handle,
+	void **loop_context,
+	struct totem_config *totem_config,
+	totemsrp_stats_t *stats,
+	void *context,
+
+	void (*deliver_fn) (
+		void *context,
+		const void *msg,
+		unsigned int msg_len,
+		const struct sockaddr_storage *system_from),
+
+	void (*iface_change_fn) (
+		void *context,
+		const struct totem_ip_address *iface_address,
+		unsigned int ring_no),
+
+	void (*mtu_changed) (
+		void *context,
+		int net_mtu),
+
+	void (*target_set_completed) (
+		void *context));
+
+extern void *totemloop_buffer_alloc (void);
+
+extern void totemloop_buffer_release (void *ptr);
+
+extern int totemloop_processor_count_set (
+	void *loop_context,
+	int processor_count);
+
+extern int totemloop_token_send (
+	void *loop_context,
+	const void *msg,
+	unsigned int msg_len);
+
+extern int totemloop_mcast_flush_send (
+	void *loop_context,
+	const void *msg,
+	unsigned int msg_len);
+
+extern int totemloop_mcast_noflush_send (
+	void *loop_context,
+	const void *msg,
+	unsigned int msg_len);
+
+extern int totemloop_ucast_send (
+	void *loop_context,
+	const void *msg,
+	unsigned int msg_len,
+	unsigned int nodeid);
+
+extern int totemloop_ucast_reachable (
+	void *loop_context,
+	unsigned int nodeid);
+
+extern int totemloop_nodestatus_get (void *loop_context, unsigned int nodeid,
+				     struct totem_node_status *node_status);
+
+extern int totemloop_ifaces_get (void *loop_context,
+	char ***status,
+	unsigned int *iface_count);
+
+extern int totemloop_recv_flush (void *loop_context);
+
+extern int totemloop_send_flush (void *loop_context);
+
+extern int totemloop_iface_set (void *loop_context,
+	const struct totem_ip_address *local_addr,
+	unsigned short ip_port,
+	unsigned int iface_no);
+
+extern int totemloop_iface_check (void *loop_context);
+
+extern int totemloop_finalize (void *loop_context);
+
+extern void totemloop_net_mtu_adjust (void *loop_context, struct totem_config *totem_config);
+
+extern int totemloop_token_target_set (
+	void *loop_context,
+	unsigned int nodeid);
+
+extern int totemloop_crypto_set (
+	void *loop_context,
+	const char *cipher_type,
+	const char *hash_type);
+
+extern int totemloop_recv_mcast_empty (
+	void *loop_context);
+
+extern int totemloop_member_add (
+	void *loop_context,
+	const struct totem_ip_address *local,
+	const struct totem_ip_address *member,
+	int ring_no);
+
+extern int totemloop_member_remove (
+	void *loop_context,
+	const struct totem_ip_address *member,
+	int ring_no);
+
+extern int totemloop_reconfigure (
+	void *loop_context,
+	struct totem_config *totem_config);
+
+#endif /* TOTEMLOOP_H_DEFINED */
@@ -40,6 +40,7 @@
 #include <totemudp.h>
 #include <totemudpu.h>
 #include <totemknet.h>
+#include <totemloop.h>
 #include <totemnet.h>
 #include <qb/qbloop.h>
 
@@ -98,6 +99,16 @@ struct transport {
 		const void *msg,
 		unsigned int msg_len);
 
+	int (*ucast_send) (
+		void *transport_context,
+		const void *msg,
+		unsigned int msg_len,
+		unsigned int nodeid);
+
+	int (*ucast_reachable) (
+		void *transport_context,
+		unsigned int nodeid);
+
 	int (*recv_flush) (void *transport_context);
 
 	int (*send_flush) (void *transport_context);
@@ -177,6 +188,8 @@ struct transport transport_entries[] = {
 		.token_send = totemudp_token_send,
 		.mcast_flush_send = totemudp_mcast_flush_send,
 		.mcast_noflush_send = totemudp_mcast_noflush_send,
+		.ucast_send = totemudp_ucast_send,
+		.ucast_reachable = totemudp_ucast_reachable,
 		.recv_flush = totemudp_recv_flush,
 		.send_flush = totemudp_send_flush,
 		.iface_set = totemudp_iface_set,
@@ -202,6 +215,8 @@ struct transport transport_entries[] = {
 		.token_send = totemudpu_token_send,
 		.mcast_flush_send = totemudpu_mcast_flush_send,
 		.mcast_noflush_send = totemudpu_mcast_noflush_send,
+		.ucast_send = totemudpu_ucast_send,
+		.ucast_reachable = totemudpu_ucast_reachable,
 		.recv_flush = totemudpu_recv_flush,
 		.send_flush = totemudpu_send_flush,
 		.iface_set = totemudpu_iface_set,
@@ -227,6 +242,8 @@ struct transport transport_entries[] = {
 		.token_send = totemknet_token_send,
 		.mcast_flush_send = totemknet_mcast_flush_send,
 		.mcast_noflush_send = totemknet_mcast_noflush_send,
+		.ucast_send = totemknet_ucast_send,
+		.ucast_reachable = totemknet_ucast_reachable,
 		.recv_flush = totemknet_recv_flush,
 		.send_flush = totemknet_send_flush,
 		.iface_set = totemknet_iface_set,
@@ -243,6 +260,33 @@ struct transport transport_entries[] = {
 		.reconfigure = totemknet_reconfigure,
 		.crypto_reconfigure_phase = totemknet_crypto_reconfigure_phase,
 		.stats_clear = totemknet_stats_clear
+	},
+	{
+		.name = "Loopback",
+		.initialize = totemloop_initialize,
+		.buffer_alloc = totemloop_buffer_alloc,
+		.buffer_release = totemloop_buffer_release,
+		.processor_count_set = totemloop_processor_count_set,
+		.token_send = totemloop_token_send,
+		.mcast_flush_send = totemloop_mcast_flush_send,
+		.mcast_noflush_send = totemloop_mcast_noflush_send,
+		.ucast_send = totemloop_ucast_send,
+		.ucast_reachable = totemloop_ucast_reachable,
+		.recv_flush = totemloop_recv_flush,
+		.send_flush = totemloop_send_flush,
+		.iface_set = totemloop_iface_set,
+		.iface_check = totemloop_iface_check,
+		.finalize = totemloop_finalize,
+		.net_mtu_adjust = totemloop_net_mtu_adjust,
+		.ifaces_get = totemloop_ifaces_get,
+		.nodestatus_get = totemloop_nodestatus_get,
+		.token_target_set = totemloop_token_target_set,
+		.crypto_set = totemloop_crypto_set,
+		.recv_mcast_empty = totemloop_recv_mcast_empty,
+		.member_add = totemloop_member_add,
+		.member_remove = totemloop_member_remove,
+		.reconfigure = totemloop_reconfigure,
+		.crypto_reconfigure_phase = NULL
 	}
 };
 
@@ -449,6 +493,32 @@ int totemnet_mcast_noflush_send (
 	return (res);
 }
 
+int totemnet_ucast_send (
+	void *net_context,
+	const void *msg,
+	unsigned int msg_len,
+	unsigned int nodeid)
+{
+	struct totemnet_instance *instance = (struct totemnet_instance *)net_context;
+	int res = 0;
+
+	res = instance->transport->ucast_send (instance->transport_context, msg, msg_len, nodeid);
+
+	return (res);
+}
+
+/*
+ * Returns 1 if totemnet_ucast_send can reach nodeid
+ */
+int totemnet_ucast_reachable (
+	void *net_context,
+	unsigned int nodeid)
+{
+	struct totemnet_instance *instance = (struct totemnet_instance *)net_context;
+
+	return (instance->transport->ucast_reachable (instance->transport_context, nodeid));
+}
+
 extern int totemnet_iface_check (void *net_context)
 {
 	struct totemnet_instance *instance = (struct totemnet_instance *)net_context;
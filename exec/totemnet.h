@@ -102,6 +102,16 @@ extern int totemnet_mcast_noflush_send (
 	const void *msg,
 	unsigned int msg_len);
 
+extern int totemnet_ucast_send (
+	void *net_context,
+	const void *msg,
+	unsigned int msg_len,
+	unsigned int nodeid);
+
+extern int totemnet_ucast_reachable (
+	void *net_context,
+	unsigned int nodeid);
+
 extern int totemnet_recv_flush (void *net_context);
 
 extern int totemnet_send_flush (void *net_context);
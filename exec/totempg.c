@@ -104,18 +104,26 @@
 #include <qb/qblist.h>
 #include <qb/qbloop.h>
 #include <qb/qbipcs.h>
+#include <qb/qbutil.h>
 #include <corosync/totem/totempg.h>
 #define LOGSYS_UTILS_ONLY 1
 #include <corosync/logsys.h>
 
 #include "util.h"
 #include "totemsrp.h"
+#include "probes.h"
 
 struct totempg_mcast_header {
 	short version;
 	short type;
 };
 
+/*
+ * header.type flag: the msg_len array is followed by a uint64_t send
+ * timestamp (ns since the Epoch) for every packed message
+ */
+#define TOTEMPG_MCAST_TIMESTAMPS	0x0001
+
 #if !(defined(__i386__) || defined(__x86_64__))
 /*
  * Need align on architectures different then i386 or x86_64
@@ -131,7 +139,8 @@ struct totempg_mcast_header {
  * continuation:		Set if this message is a continuation from last message
  * msg_count			Indicates how many packed messages are contained
  * 						in the mcast.
- * Also, the size of each packed message and the messages themselves are
+ * Also, the size of each packed message, their send timestamps (only if
+ * TOTEMPG_MCAST_TIMESTAMPS is set) and the messages themselves are
  * appended to the end of this structure when sent.
  */
 struct totempg_mcast {
@@ -142,6 +151,9 @@ struct totempg_mcast {
 	/*
 	 * short msg_len[msg_count];
 	 */
+	/*
+	 * uint64_t msg_timestamp[msg_count];
+	 */
 	/*
 	 * data for messages
 	 */
@@ -150,15 +162,25 @@ struct totempg_mcast {
 /*
  * Maximum packet size for totem pg messages
  */
-#define TOTEMPG_PACKET_SIZE (totempg_totem_config->net_mtu - \
+#define TOTEMPG_PACKET_SIZE(lane) ((lane)->totem_config->net_mtu - \
 	sizeof (struct totempg_mcast))
 
 /*
- * Local variables used for packing small messages
+ * Lane n uses the configured port of every link plus n times this
  */
-static unsigned short mcast_packed_msg_lens[FRAME_SIZE_MAX];
+#define TOTEMPG_LANE_PORT_STRIDE	(2 * INTERFACE_MAX)
 
-static int mcast_packed_msg_count = 0;
+/*
+ * Maximum size of the data one lane holds back for the membership barrier.
+ * When it is reached the lanes are forced to form a new ring right away
+ * and no new messages are accepted from local senders.
+ */
+#define TOTEMPG_HELD_BYTES_MAX		(16 * MESSAGE_SIZE_MAX)
+
+/*
+ * Send timestamp of the message being delivered, 0 if it has none
+ */
+static uint64_t deliver_timestamp = 0;
 
 static int totempg_reserved = 1;
 
@@ -168,8 +190,6 @@ static totem_queue_level_changed_fn totem_queue_level_changed = NULL;
 
 static uint32_t totempg_threaded_mode = 0;
 
-static void *totemsrp_context;
-
 /*
  * Function and data used to log messages
  */
@@ -205,23 +225,44 @@ struct assembly {
 	struct qb_list_head list;
 };
 
-static void assembly_deref (struct assembly *assembly);
-
-static int callback_token_received_fn (enum totem_callback_token_type type,
-	const void *data);
-
-QB_LIST_DECLARE(assembly_list_inuse);
-
 /*
  * Free list is used both for transitional and operational assemblies
+ * of all lanes
  */
 QB_LIST_DECLARE(assembly_list_free);
 
-QB_LIST_DECLARE(assembly_list_inuse_trans);
-
 QB_LIST_DECLARE(totempg_groups_list);
 
+enum held_type {
+	HELD_MSG,
+	HELD_CONFCHG
+};
+
+/*
+ * Message or configuration change held back until the memberships of
+ * all lanes agree, see lanes_barrier_check. data holds the message or
+ * the member, left and joined lists.
+ */
+struct held_item {
+	enum held_type type;
+	unsigned int nodeid;
+	int endian_conversion_required;
+	uint64_t timestamp;
+	unsigned int msg_len;
+	enum totem_configuration_type configuration_type;
+	size_t member_list_entries;
+	size_t left_list_entries;
+	size_t joined_list_entries;
+	struct memb_ring_id ring_id;
+	struct qb_list_head list;
+	unsigned char data[];
+};
+
 /*
+ * A lane is a totemsrp ring with its own token and sequence numbers.
+ * Lane 0 delivers the configuration changes and carries everything that
+ * isn't explicitly sent on another lane.
+ *
  * Staging buffer for packed messages.  Messages are staged in this buffer
  * before sending.  Multiple messages may fit which cuts down on the
  * number of mcasts sent.  If a message doesn't completely fit, then
@@ -230,14 +271,103 @@ QB_LIST_DECLARE(totempg_groups_list);
  * the size of message data and where to place new message data.
  * fragment_contuation indicates whether the first packed message in
  * the buffer is a continuation of a previously packed fragment.
+ *
+ * fragmentation_data points into a totemsrp multicast buffer
+ * (mcast_buffer) with room in front of it for the totemsrp header and
+ * mcast_header_reserve bytes of totempg header.  When the packet is sent
+ * the header is written in front of the data and the whole buffer is
+ * handed to totemsrp, so the data is copied only once, from the caller
+ * into the staging buffer.
+ *
+ * mcast_packed_timestamps tells whether the packet being staged carries
+ * send timestamps. It is only changed while the staging buffer is empty
+ * so that the space reserved for the timestamps can't change under a
+ * partially packed message.
+ */
+struct totempg_lane {
+	unsigned int lane;
+
+	void *totemsrp_context;
+
+	struct totem_config *totem_config;
+
+	totempg_stats_t *stats;
+
+	totempg_stats_t lane_stats;
+
+	void *callback_token_received_handle;
+
+	unsigned short mcast_packed_msg_lens[FRAME_SIZE_MAX];
+
+	uint64_t mcast_packed_msg_timestamps[FRAME_SIZE_MAX];
+
+	int mcast_packed_msg_count;
+
+	int mcast_packed_timestamps;
+
+	void *mcast_buffer;
+
+	size_t mcast_buffer_headroom;
+
+	size_t mcast_buffer_size;
+
+	size_t mcast_header_reserve;
+
+	unsigned char *fragmentation_data;
+
+	int fragment_size;
+
+	int fragment_continuation;
+
+	unsigned char next_fragment;
+
+	int waiting_transack;
+
+	struct qb_list_head assembly_list_inuse;
+
+	struct qb_list_head assembly_list_inuse_trans;
+
+	/*
+	 * Membership barrier, only used with more than one lane. For lane 0
+	 * member_list is the membership last delivered to the application.
+	 */
+	int held;
+
+	int members_known;
+
+	unsigned int member_list[PROCESSOR_COUNT_MAX];
+
+	size_t member_list_entries;
+
+	struct qb_list_head held_list;
+
+	size_t held_bytes;
+};
+
+static struct totempg_lane *totempg_lanes;
+
+static unsigned int totempg_lanes_count = 1;
+
+/*
+ * Membership of the last regular configuration of lane 0 which is not
+ * delivered yet
  */
-static unsigned char *fragmentation_data;
+static unsigned int lanes_target_list[PROCESSOR_COUNT_MAX];
+
+static size_t lanes_target_entries;
+
+static int lanes_target_known = 0;
 
-static int fragment_size = 0;
+static qb_loop_t *totempg_poll_handle;
 
-static int fragment_continuation = 0;
+static qb_loop_timer_handle lanes_barrier_timer;
 
-static int totempg_waiting_transack = 0;
+static int lanes_barrier_timer_running = 0;
+
+static void assembly_deref (struct assembly *assembly);
+
+static int callback_token_received_fn (enum totem_callback_token_type type,
+	const void *data);
 
 struct totempg_group_instance {
 	void (*deliver_fn) (
@@ -261,8 +391,6 @@ struct totempg_group_instance {
 	struct qb_list_head list;
 };
 
-static unsigned char next_fragment = 1;
-
 static pthread_mutex_t totempg_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static pthread_mutex_t callback_token_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -279,24 +407,134 @@ do {								\
 
 static int msg_count_send_ok (int msg_count);
 
-static int byte_count_send_ok (int byte_count);
+static inline unsigned int packed_msg_overhead (struct totempg_lane *lane)
+{
+	return (sizeof (unsigned short) +
+		(lane->mcast_packed_timestamps ? sizeof (uint64_t) : 0));
+}
+
+/*
+ * Most totempg headers we keep room for in front of the staged data
+ */
+#define TOTEMPG_HEADER_RESERVE_MAX (sizeof (struct totempg_mcast) + \
+	128 * (sizeof (unsigned short) + sizeof (uint64_t)))
 
-static void totempg_waiting_trans_ack_cb (int waiting_trans_ack)
+static int mcast_buffer_alloc (struct totempg_lane *lane)
 {
-	log_printf(LOG_DEBUG, "waiting_trans_ack changed to %u", waiting_trans_ack);
-	totempg_waiting_transack = waiting_trans_ack;
+	size_t reserve;
+
+	lane->mcast_buffer = totemsrp_mcast_buffer_alloc (lane->totemsrp_context,
+		&lane->mcast_buffer_headroom, &lane->mcast_buffer_size);
+	if (lane->mcast_buffer == NULL) {
+		return (-1);
+	}
+	assert (lane->mcast_buffer_size >=
+		lane->mcast_buffer_headroom + TOTEMPG_PACKET_SIZE(lane));
+
+	reserve = lane->mcast_buffer_size - lane->mcast_buffer_headroom -
+		TOTEMPG_PACKET_SIZE(lane);
+	lane->mcast_header_reserve = min(reserve, TOTEMPG_HEADER_RESERVE_MAX);
+	lane->fragmentation_data = (unsigned char *)lane->mcast_buffer +
+		lane->mcast_buffer_headroom + lane->mcast_header_reserve;
+
+	return (0);
 }
 
-static struct assembly *assembly_ref (unsigned int nodeid)
+/*
+ * Send the staged packet with data_len bytes of packed data
+ */
+static int packed_msg_send (
+	struct totempg_lane *lane,
+	struct totempg_mcast *mcast,
+	size_t data_len,
+	int guarantee)
+{
+	struct iovec iovecs[4];
+	int iov_len = 0;
+	size_t header_len = 0;
+	size_t header_offset;
+	unsigned char *header;
+	void *full_buffer;
+	int res;
+	int i;
+
+	mcast->header.type = lane->mcast_packed_timestamps ? TOTEMPG_MCAST_TIMESTAMPS : 0;
+
+	iovecs[iov_len].iov_base = (void *)mcast;
+	iovecs[iov_len++].iov_len = sizeof (struct totempg_mcast);
+	iovecs[iov_len].iov_base = (void *)lane->mcast_packed_msg_lens;
+	iovecs[iov_len++].iov_len = mcast->msg_count * sizeof (unsigned short);
+	if (lane->mcast_packed_timestamps) {
+		iovecs[iov_len].iov_base = (void *)lane->mcast_packed_msg_timestamps;
+		iovecs[iov_len++].iov_len = mcast->msg_count * sizeof (uint64_t);
+	}
+	for (i = 0; i < iov_len; i++) {
+		header_len += iovecs[i].iov_len;
+	}
+
+	if (header_len <= lane->mcast_header_reserve) {
+		/*
+		 * Build the header in front of the data and hand the staging
+		 * buffer over to totemsrp
+		 */
+		header = lane->fragmentation_data - header_len;
+		header_offset = header - (unsigned char *)lane->mcast_buffer;
+		for (i = 0; i < iov_len; i++) {
+			memcpy (header, iovecs[i].iov_base, iovecs[i].iov_len);
+			header += iovecs[i].iov_len;
+		}
+
+		full_buffer = lane->mcast_buffer;
+		if (mcast_buffer_alloc (lane) == -1) {
+			lane->mcast_buffer = full_buffer;
+			return (-1);
+		}
+
+		res = totemsrp_mcast_buffer (lane->totemsrp_context, full_buffer,
+			header_offset, header_len + data_len, guarantee);
+		if (res == -1) {
+			totemsrp_mcast_buffer_release (lane->totemsrp_context,
+				lane->mcast_buffer);
+			lane->mcast_buffer = full_buffer;
+		}
+		lane->fragmentation_data = (unsigned char *)lane->mcast_buffer +
+			lane->mcast_buffer_headroom + lane->mcast_header_reserve;
+		return (res);
+	}
+
+	/*
+	 * Too many packed messages for the reserved header space, let
+	 * totemsrp copy the packet
+	 */
+	iovecs[iov_len].iov_base = (void *)lane->fragmentation_data;
+	iovecs[iov_len++].iov_len = data_len;
+
+	return (totemsrp_mcast (lane->totemsrp_context, iovecs, iov_len, guarantee));
+}
+
+static int byte_count_send_ok (int avail, int byte_count);
+
+static void totempg_waiting_trans_ack_cb (
+	struct totempg_lane *lane,
+	int waiting_trans_ack)
+{
+	log_printf(LOG_DEBUG, "waiting_trans_ack of lane %u changed to %u",
+		lane->lane, waiting_trans_ack);
+	lane->waiting_transack = waiting_trans_ack;
+}
+
+static struct assembly *assembly_ref (
+	struct totempg_lane *lane,
+	unsigned int nodeid)
 {
 	struct assembly *assembly;
 	struct qb_list_head *list;
 	struct qb_list_head *active_assembly_list_inuse;
 
-	if (totempg_waiting_transack) {
-		active_assembly_list_inuse = &assembly_list_inuse_trans;
+	if (lane->waiting_transack) {
+		active_assembly_list_inuse = &lane->assembly_list_inuse_trans;
 	} else {
-		active_assembly_list_inuse = &assembly_list_inuse;
+		active_assembly_list_inuse = &lane->assembly_list_inuse;
 	}
 
 	/*
@@ -349,7 +587,9 @@ static void assembly_deref (struct assembly *assembly)
 	qb_list_add (&assembly->list, &assembly_list_free);
 }
 
-static void assembly_deref_from_normal_and_trans (int nodeid)
+static void assembly_deref_from_normal_and_trans (
+	struct totempg_lane *lane,
+	int nodeid)
 {
 	int j;
 	struct qb_list_head *list, *tmp_iter;
@@ -358,9 +598,9 @@ static void assembly_deref_from_normal_and_trans (int nodeid)
 
 	for (j = 0; j < 2; j++) {
 		if (j == 0) {
-			active_assembly_list_inuse = &assembly_list_inuse;
+			active_assembly_list_inuse = &lane->assembly_list_inuse;
 		} else {
-			active_assembly_list_inuse = &assembly_list_inuse_trans;
+			active_assembly_list_inuse = &lane->assembly_list_inuse_trans;
 		}
 
 		qb_list_for_each_safe(list, tmp_iter, active_assembly_list_inuse) {
@@ -382,19 +622,9 @@ static inline void app_confchg_fn (
 	const unsigned int *joined_list, size_t joined_list_entries,
 	const struct memb_ring_id *ring_id)
 {
-	int i;
 	struct totempg_group_instance *instance;
 	struct qb_list_head *list;
 
-	/*
-	 * For every leaving processor, add to free list
-	 * This also has the side effect of clearing out the dataset
-	 * In the leaving processor's assembly buffer.
-	 */
-	for (i = 0; i < left_list_entries; i++) {
-		assembly_deref_from_normal_and_trans (left_list[i]);
-	}
-
 	qb_list_for_each(list, &totempg_groups_list) {
 		instance = qb_list_entry (list, struct totempg_group_instance, list);
 
@@ -571,22 +801,419 @@ static inline void app_deliver_fn (
 	}
 }
 
+static int member_list_cmp (const void *a, const void *b)
+{
+	unsigned int id_a = *(const unsigned int *)a;
+	unsigned int id_b = *(const unsigned int *)b;
+
+	return ((id_a > id_b) - (id_a < id_b));
+}
+
+/*
+ * Store a sorted copy of member_list so memberships can be compared
+ */
+static void member_list_store (
+	unsigned int *dst,
+	size_t *dst_entries,
+	const unsigned int *member_list,
+	size_t member_list_entries)
+{
+	memcpy (dst, member_list, member_list_entries * sizeof (unsigned int));
+	qsort (dst, member_list_entries, sizeof (unsigned int), member_list_cmp);
+	*dst_entries = member_list_entries;
+}
+
+static int lane_members_equal (
+	const struct totempg_lane *lane,
+	const unsigned int *member_list,
+	size_t member_list_entries)
+{
+	return (lane->members_known &&
+		lane->member_list_entries == member_list_entries &&
+		memcmp (lane->member_list, member_list,
+			member_list_entries * sizeof (unsigned int)) == 0);
+}
+
+static void lanes_barrier_force (void);
+
+/*
+ * Account item to the held queue of lane, forcing the lanes to agree once
+ * the queue gets too big
+ */
+static void held_item_add (struct totempg_lane *lane, struct held_item *item, size_t size)
+{
+	int full;
+
+	full = (lane->held_bytes >= TOTEMPG_HELD_BYTES_MAX);
+	lane->held_bytes += size;
+	qb_list_add_tail (&item->list, &lane->held_list);
+
+	if (!full && lane->held_bytes >= TOTEMPG_HELD_BYTES_MAX) {
+		log_printf (LOG_WARNING,
+			"Lane %u holds back %zu bytes, forcing new membership of the lanes",
+			lane->lane, lane->held_bytes);
+		lanes_barrier_force ();
+	}
+}
+
+/*
+ * Returns -1 when the message couldn't be stored
+ */
+static int held_msg_add (
+	struct totempg_lane *lane,
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required,
+	uint64_t timestamp)
+{
+	struct held_item *item;
+
+	item = malloc (sizeof (struct held_item) + msg_len);
+	if (item == NULL) {
+		return (-1);
+	}
+	item->type = HELD_MSG;
+	item->nodeid = nodeid;
+	item->endian_conversion_required = endian_conversion_required;
+	item->timestamp = timestamp;
+	item->msg_len = msg_len;
+	memcpy (item->data, msg, msg_len);
+	held_item_add (lane, item, sizeof (struct held_item) + msg_len);
+
+	return (0);
+}
+
+/*
+ * Returns -1 when the configuration change couldn't be stored
+ */
+static int held_confchg_add (
+	struct totempg_lane *lane,
+	enum totem_configuration_type configuration_type,
+	const unsigned int *member_list, size_t member_list_entries,
+	const unsigned int *left_list, size_t left_list_entries,
+	const unsigned int *joined_list, size_t joined_list_entries,
+	const struct memb_ring_id *ring_id)
+{
+	struct held_item *item;
+	unsigned int *lists;
+	size_t size;
+
+	size = sizeof (struct held_item) + sizeof (unsigned int) *
+		(member_list_entries + left_list_entries + joined_list_entries);
+	item = malloc (size);
+	if (item == NULL) {
+		return (-1);
+	}
+	item->type = HELD_CONFCHG;
+	item->configuration_type = configuration_type;
+	item->member_list_entries = member_list_entries;
+	item->left_list_entries = left_list_entries;
+	item->joined_list_entries = joined_list_entries;
+	memcpy (&item->ring_id, ring_id, sizeof (struct memb_ring_id));
+
+	lists = (unsigned int *)item->data;
+	memcpy (lists, member_list, member_list_entries * sizeof (unsigned int));
+	lists += member_list_entries;
+	memcpy (lists, left_list, left_list_entries * sizeof (unsigned int));
+	lists += left_list_entries;
+	memcpy (lists, joined_list, joined_list_entries * sizeof (unsigned int));
+
+	held_item_add (lane, item, size);
+
+	return (0);
+}
+
+/*
+ * Deliver everything held back on lane in the order it was received
+ */
+static void held_deliver (struct totempg_lane *lane)
+{
+	struct held_item *item;
+	unsigned int *lists;
+
+	while (!qb_list_empty (&lane->held_list)) {
+		item = qb_list_first_entry (&lane->held_list, struct held_item, list);
+		qb_list_del (&item->list);
+
+		if (item->type == HELD_MSG) {
+			deliver_timestamp = item->timestamp;
+			app_deliver_fn (item->nodeid, item->data, item->msg_len,
+				item->endian_conversion_required);
+			deliver_timestamp = 0;
+		} else {
+			lists = (unsigned int *)item->data;
+			app_confchg_fn (item->configuration_type,
+				lists, item->member_list_entries,
+				lists + item->member_list_entries,
+				item->left_list_entries,
+				lists + item->member_list_entries + item->left_list_entries,
+				item->joined_list_entries,
+				&item->ring_id);
+		}
+		free (item);
+	}
+	lane->held = 0;
+	lane->held_bytes = 0;
+}
+
+static unsigned int held_count (const struct totempg_lane *lane)
+{
+	struct qb_list_head *list;
+	unsigned int count = 0;
+
+	qb_list_for_each(list, &lane->held_list) {
+		count++;
+	}
+	return (count);
+}
+
+static void lanes_barrier_check (void);
+
+/*
+ * The memberships of the lanes didn't agree for a while. Lanes share the
+ * links, so this normally only happens when a membership change was seen
+ * by some lanes only. Make the lanes that are behind form a new ring.
+ */
+static void lanes_barrier_timer_expired (void *data)
+{
+	struct totempg_lane *lane0 = &totempg_lanes[0];
+	struct totempg_lane *lane;
+	unsigned int i;
+
+	lanes_barrier_timer_running = 0;
+
+	for (i = 1; i < totempg_lanes_count; i++) {
+		lane = &totempg_lanes[i];
+
+		if (lane0->held) {
+			if (!lanes_target_known ||
+			    lane_members_equal (lane, lanes_target_list, lanes_target_entries)) {
+				continue;
+			}
+		} else if (!lane->held || lane0->waiting_transack ||
+		    lane_members_equal (lane, lane0->member_list, lane0->member_list_entries)) {
+			continue;
+		}
+
+		log_printf (LOG_WARNING,
+			"Membership of lane %u doesn't match lane 0, %u messages of lane 0 "
+			"and %u of lane %u held back", i, held_count (lane0),
+			held_count (lane), i);
+		totemsrp_force_gather (lane->totemsrp_context);
+		if (!lane0->held && !lane0->waiting_transack) {
+			totemsrp_force_gather (lane0->totemsrp_context);
+		}
+	}
+
+	lanes_barrier_check ();
+}
+
+/*
+ * Don't wait for the barrier timer, lanes_barrier_check rearms it
+ */
+static void lanes_barrier_force (void)
+{
+
+	if (lanes_barrier_timer_running) {
+		qb_loop_timer_del (totempg_poll_handle, lanes_barrier_timer);
+	}
+	lanes_barrier_timer_expired (NULL);
+}
+
+/*
+ * Something couldn't be held back on lane. Give up the barrier for that lane
+ * rather than lose it: deliver what is held (the caller then delivers the
+ * item) and make all lanes form a new ring, so they agree again.
+ */
+static void lane_barrier_release (struct totempg_lane *lane)
+{
+	unsigned int i;
+
+	log_printf (LOG_ERR,
+		"Unable to hold back messages of lane %u, delivering them before the "
+		"lanes agree on membership", lane->lane);
+
+	held_deliver (lane);
+	if (lane->lane != 0) {
+		totemsrp_trans_ack (lane->totemsrp_context);
+	} else if (lanes_target_known) {
+		memcpy (lane->member_list, lanes_target_list,
+			lanes_target_entries * sizeof (unsigned int));
+		lane->member_list_entries = lanes_target_entries;
+		lane->members_known = 1;
+		lanes_target_known = 0;
+	}
+
+	for (i = 0; i < totempg_lanes_count; i++) {
+		totemsrp_force_gather (totempg_lanes[i].totemsrp_context);
+	}
+}
+
+/*
+ * Membership barrier between the lanes. A configuration change of lane 0
+ * and everything delivered on lane 0 after it is held back until every
+ * other lane has formed a ring with the same members. Messages of a new
+ * ring of another lane (everything after its regular configuration
+ * change) are held back until lane 0 delivered the same
+ * membership and synchronization has finished (trans_ack). This way every
+ * node delivers the messages of all lanes consistently relative to the
+ * configuration changes, at the cost of delaying delivery while the lanes
+ * agree on membership.
+ */
+static void lanes_barrier_check (void)
+{
+	struct totempg_lane *lane0 = &totempg_lanes[0];
+	struct totempg_lane *lane;
+	int waiting = 0;
+	unsigned int i;
+
+	if (lane0->held && lanes_target_known) {
+		for (i = 1; i < totempg_lanes_count; i++) {
+			if (!lane_members_equal (&totempg_lanes[i], lanes_target_list,
+			    lanes_target_entries)) {
+				break;
+			}
+		}
+
+		if (i == totempg_lanes_count) {
+			memcpy (lane0->member_list, lanes_target_list,
+				lanes_target_entries * sizeof (unsigned int));
+			lane0->member_list_entries = lanes_target_entries;
+			lane0->members_known = 1;
+			lanes_target_known = 0;
+			held_deliver (lane0);
+		}
+	}
+
+	for (i = 1; i < totempg_lanes_count; i++) {
+		lane = &totempg_lanes[i];
+
+		if (lane->held && !lane0->held && !lane0->waiting_transack &&
+		    lane0->members_known &&
+		    lane_members_equal (lane, lane0->member_list, lane0->member_list_entries)) {
+			held_deliver (lane);
+			totemsrp_trans_ack (lane->totemsrp_context);
+		}
+	}
+
+	for (i = 0; i < totempg_lanes_count; i++) {
+		if (totempg_lanes[i].held) {
+			waiting = 1;
+		}
+	}
+
+	if (waiting && !lanes_barrier_timer_running) {
+		if (qb_loop_timer_add (totempg_poll_handle, QB_LOOP_MED,
+		    (totempg_totem_config->token_timeout +
+		     totempg_totem_config->consensus_timeout) * QB_TIME_NS_IN_MSEC,
+		    NULL, lanes_barrier_timer_expired, &lanes_barrier_timer) == 0) {
+			lanes_barrier_timer_running = 1;
+		}
+	}
+	if (!waiting && lanes_barrier_timer_running) {
+		qb_loop_timer_del (totempg_poll_handle, lanes_barrier_timer);
+		lanes_barrier_timer_running = 0;
+	}
+}
+
+static void lane_app_deliver (
+	struct totempg_lane *lane,
+	unsigned int nodeid,
+	void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required,
+	uint64_t timestamp)
+{
+	if (lane->held) {
+		if (held_msg_add (lane, nodeid, msg, msg_len,
+		    endian_conversion_required, timestamp) == 0) {
+			return;
+		}
+		lane_barrier_release (lane);
+	}
+
+	deliver_timestamp = timestamp;
+	app_deliver_fn (nodeid, msg, msg_len, endian_conversion_required);
+	deliver_timestamp = 0;
+}
+
 static void totempg_confchg_fn (
+	struct totempg_lane *lane,
 	enum totem_configuration_type configuration_type,
 	const unsigned int *member_list, size_t member_list_entries,
 	const unsigned int *left_list, size_t left_list_entries,
 	const unsigned int *joined_list, size_t joined_list_entries,
 	const struct memb_ring_id *ring_id)
 {
-// TODO optimize this
-	app_confchg_fn (configuration_type,
-		member_list, member_list_entries,
-		left_list, left_list_entries,
-		joined_list, joined_list_entries,
-		ring_id);
+	int i;
+
+	/*
+	 * For every leaving processor, add to free list
+	 * This also has the side effect of clearing out the dataset
+	 * In the leaving processor's assembly buffer.
+	 */
+	for (i = 0; i < left_list_entries; i++) {
+		assembly_deref_from_normal_and_trans (lane, left_list[i]);
+	}
+
+	if (totempg_lanes_count == 1) {
+		app_confchg_fn (configuration_type,
+			member_list, member_list_entries,
+			left_list, left_list_entries,
+			joined_list, joined_list_entries,
+			ring_id);
+		return;
+	}
+
+	if (lane->lane == 0) {
+		lane->held = 1;
+		lanes_target_known = 0;
+		if (held_confchg_add (lane, configuration_type,
+		    member_list, member_list_entries,
+		    left_list, left_list_entries,
+		    joined_list, joined_list_entries,
+		    ring_id) != 0) {
+			lane_barrier_release (lane);
+			app_confchg_fn (configuration_type,
+				member_list, member_list_entries,
+				left_list, left_list_entries,
+				joined_list, joined_list_entries,
+				ring_id);
+			if (configuration_type == TOTEM_CONFIGURATION_REGULAR) {
+				member_list_store (lane->member_list, &lane->member_list_entries,
+					member_list, member_list_entries);
+				lane->members_known = 1;
+			}
+		} else if (configuration_type == TOTEM_CONFIGURATION_REGULAR) {
+			member_list_store (lanes_target_list, &lanes_target_entries,
+				member_list, member_list_entries);
+			lanes_target_known = 1;
+		}
+	} else {
+		/*
+		 * Messages of the old ring delivered in the transitional
+		 * configuration go out right away (unless an earlier ring of
+		 * this lane is still held), lane 0 holds its configuration
+		 * changes so they still come before the new membership. Only
+		 * the messages of the new ring are held.
+		 */
+		lane->members_known = 0;
+		if (configuration_type == TOTEM_CONFIGURATION_REGULAR) {
+			lane->held = 1;
+			member_list_store (lane->member_list, &lane->member_list_entries,
+				member_list, member_list_entries);
+			lane->members_known = 1;
+		}
+	}
+
+	if (configuration_type == TOTEM_CONFIGURATION_REGULAR) {
+		lanes_barrier_check ();
+	}
 }
 
 static void totempg_deliver_fn (
+	struct totempg_lane *lane,
 	unsigned int nodeid,
 	const void *msg,
 	unsigned int msg_len,
@@ -604,8 +1231,10 @@ static void totempg_deliver_fn (
 	int datasize;
 	struct iovec iov_delv;
 	size_t expected_msg_len;
+	const char *msg_timestamps = NULL;
+	uint64_t timestamp = 0;
 
-	assembly = assembly_ref (nodeid);
+	assembly = assembly_ref (lane, nodeid);
 	assert (assembly);
 
 	if (msg_len < sizeof(struct totempg_mcast)) {
@@ -622,12 +1251,16 @@ static void totempg_deliver_fn (
 
 	mcast = (struct totempg_mcast *)msg;
 	if (endian_conversion_required) {
+		mcast->header.type = swab16 (mcast->header.type);
 		mcast->msg_count = swab16 (mcast->msg_count);
 	}
 
 	msg_count = mcast->msg_count;
 	datasize = sizeof (struct totempg_mcast) +
 		msg_count * sizeof (unsigned short);
+	if (mcast->header.type & TOTEMPG_MCAST_TIMESTAMPS) {
+		datasize += msg_count * sizeof (uint64_t);
+	}
 
 	if (msg_len < datasize) {
 		log_printf(LOG_WARNING,
@@ -641,6 +1274,10 @@ static void totempg_deliver_fn (
 	data = msg;
 
 	msg_lens = (unsigned short *) (header + sizeof (struct totempg_mcast));
+	if (mcast->header.type & TOTEMPG_MCAST_TIMESTAMPS) {
+		msg_timestamps = header + sizeof (struct totempg_mcast) +
+			mcast->msg_count * sizeof (unsigned short);
+	}
 	expected_msg_len = datasize;
 	for (i = 0; i < mcast->msg_count; i++) {
 		if (endian_conversion_required) {
@@ -659,6 +1296,9 @@ static void totempg_deliver_fn (
 		return ;
 	}
 
+	CS_PROBE5 (totempg_deliver, nodeid, msg_len, mcast->msg_count,
+		mcast->fragmented, mcast->continuation);
+
 	assert((assembly->index+msg_len) < sizeof(assembly->data));
 	memcpy (&assembly->data[assembly->index], &data[datasize],
 		msg_len - datasize);
@@ -701,8 +1341,21 @@ static void totempg_deliver_fn (
 		if (continuation == assembly->last_frag_num) {
 			assembly->last_frag_num = mcast->fragmented;
 			for  (i = start; i < msg_count; i++) {
-				app_deliver_fn(nodeid, iov_delv.iov_base, iov_delv.iov_len,
-					endian_conversion_required);
+				CS_PROBE2 (totempg_app_deliver, nodeid,
+					iov_delv.iov_len);
+				if (msg_timestamps) {
+					/*
+					 * Unaligned, the msg_len array has an arbitrary length
+					 */
+					memcpy (&timestamp, &msg_timestamps[i * sizeof (uint64_t)],
+						sizeof (uint64_t));
+					if (endian_conversion_required) {
+						timestamp = swab64 (timestamp);
+					}
+				}
+				lane_app_deliver (lane, nodeid, iov_delv.iov_base,
+					iov_delv.iov_len, endian_conversion_required,
+					timestamp);
 				assembly->index += msg_lens[i];
 				iov_delv.iov_base = (void *)&assembly->data[assembly->index];
 				if (i < (msg_count - 1)) {
@@ -738,29 +1391,103 @@ static void totempg_deliver_fn (
 	}
 }
 
+/*
+ * totemsrp callbacks have no context, so every lane gets its own set
+ */
+#define TOTEMPG_LANE_CALLBACKS(n)					\
+static void totempg_deliver_fn_##n (					\
+	unsigned int nodeid,						\
+	const void *msg,						\
+	unsigned int msg_len,						\
+	int endian_conversion_required)					\
+{									\
+	totempg_deliver_fn (&totempg_lanes[n], nodeid, msg, msg_len,	\
+		endian_conversion_required);				\
+}									\
+									\
+static void totempg_confchg_fn_##n (					\
+	enum totem_configuration_type configuration_type,		\
+	const unsigned int *member_list, size_t member_list_entries,	\
+	const unsigned int *left_list, size_t left_list_entries,	\
+	const unsigned int *joined_list, size_t joined_list_entries,	\
+	const struct memb_ring_id *ring_id)				\
+{									\
+	totempg_confchg_fn (&totempg_lanes[n], configuration_type,	\
+		member_list, member_list_entries,			\
+		left_list, left_list_entries,				\
+		joined_list, joined_list_entries,			\
+		ring_id);						\
+}									\
+									\
+static void totempg_waiting_trans_ack_cb_##n (int waiting_trans_ack)	\
+{									\
+	totempg_waiting_trans_ack_cb (&totempg_lanes[n], waiting_trans_ack); \
+}
+
+#if TOTEM_LANES_MAX != 8
+#error "TOTEM_LANES_MAX doesn't match the number of lane callbacks"
+#endif
+
+TOTEMPG_LANE_CALLBACKS(0)
+TOTEMPG_LANE_CALLBACKS(1)
+TOTEMPG_LANE_CALLBACKS(2)
+TOTEMPG_LANE_CALLBACKS(3)
+TOTEMPG_LANE_CALLBACKS(4)
+TOTEMPG_LANE_CALLBACKS(5)
+TOTEMPG_LANE_CALLBACKS(6)
+TOTEMPG_LANE_CALLBACKS(7)
+
+#define TOTEMPG_LANE_CALLBACKS_ENTRY(n)					\
+	{ totempg_deliver_fn_##n, totempg_confchg_fn_##n,		\
+	  totempg_waiting_trans_ack_cb_##n }
+
+static const struct {
+	void (*deliver_fn) (
+		unsigned int nodeid,
+		const void *msg,
+		unsigned int msg_len,
+		int endian_conversion_required);
+
+	void (*confchg_fn) (
+		enum totem_configuration_type configuration_type,
+		const unsigned int *member_list, size_t member_list_entries,
+		const unsigned int *left_list, size_t left_list_entries,
+		const unsigned int *joined_list, size_t joined_list_entries,
+		const struct memb_ring_id *ring_id);
+
+	void (*waiting_trans_ack_cb_fn) (int waiting_trans_ack);
+} totempg_lane_callbacks[TOTEM_LANES_MAX] = {
+	TOTEMPG_LANE_CALLBACKS_ENTRY(0),
+	TOTEMPG_LANE_CALLBACKS_ENTRY(1),
+	TOTEMPG_LANE_CALLBACKS_ENTRY(2),
+	TOTEMPG_LANE_CALLBACKS_ENTRY(3),
+	TOTEMPG_LANE_CALLBACKS_ENTRY(4),
+	TOTEMPG_LANE_CALLBACKS_ENTRY(5),
+	TOTEMPG_LANE_CALLBACKS_ENTRY(6),
+	TOTEMPG_LANE_CALLBACKS_ENTRY(7)
+};
+
 /*
  * Totem Process Group Abstraction
  * depends on poll abstraction, POSIX, IPV4
  */
 
-void *callback_token_received_handle;
-
 int callback_token_received_fn (enum totem_callback_token_type type,
 				const void *data)
 {
+	struct totempg_lane *lane = (struct totempg_lane *)data;
 	struct totempg_mcast mcast;
-	struct iovec iovecs[3];
 
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_lock (&mcast_msg_mutex);
 	}
-	if (mcast_packed_msg_count == 0) {
+	if (lane->mcast_packed_msg_count == 0) {
 		if (totempg_threaded_mode == 1) {
 			pthread_mutex_unlock (&mcast_msg_mutex);
 		}
 		return (0);
 	}
-	if (totemsrp_avail(totemsrp_context) == 0) {
+	if (totemsrp_avail(lane->totemsrp_context) == 0) {
 		if (totempg_threaded_mode == 1) {
 			pthread_mutex_unlock (&mcast_msg_mutex);
 		}
@@ -774,21 +1501,15 @@ int callback_token_received_fn (enum totem_callback_token_type type,
 	 * Was the first message in this buffer a continuation of a
 	 * fragmented message?
 	 */
-	mcast.continuation = fragment_continuation;
-	fragment_continuation = 0;
+	mcast.continuation = lane->fragment_continuation;
+	lane->fragment_continuation = 0;
 
-	mcast.msg_count = mcast_packed_msg_count;
+	mcast.msg_count = lane->mcast_packed_msg_count;
 
-	iovecs[0].iov_base = (void *)&mcast;
-	iovecs[0].iov_len = sizeof (struct totempg_mcast);
-	iovecs[1].iov_base = (void *)mcast_packed_msg_lens;
-	iovecs[1].iov_len = mcast_packed_msg_count * sizeof (unsigned short);
-	iovecs[2].iov_base = (void *)&fragmentation_data[0];
-	iovecs[2].iov_len = fragment_size;
-	(void)totemsrp_mcast (totemsrp_context, iovecs, 3, 0);
+	(void)packed_msg_send (lane, &mcast, lane->fragment_size, 0);
 
-	mcast_packed_msg_count = 0;
-	fragment_size = 0;
+	lane->mcast_packed_msg_count = 0;
+	lane->fragment_size = 0;
 
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_unlock (&mcast_msg_mutex);
@@ -796,6 +1517,95 @@ int callback_token_received_fn (enum totem_callback_token_type type,
 	return (0);
 }
 
+/*
+ * Copy the configuration of lane 0 into the configuration of another lane,
+ * keeping the interfaces array of the lane (transports keep pointers into
+ * it) and net_mtu (each lane discovers its own)
+ */
+static void lane_config_update (
+	struct totempg_lane *lane,
+	unsigned int net_mtu)
+{
+	struct totem_interface *interfaces = lane->totem_config->interfaces;
+	int i;
+
+	memcpy (lane->totem_config, totempg_totem_config, sizeof (struct totem_config));
+	memcpy (interfaces, totempg_totem_config->interfaces,
+		sizeof (struct totem_interface) * INTERFACE_MAX);
+	for (i = 0; i < INTERFACE_MAX; i++) {
+		if (interfaces[i].ip_port) {
+			interfaces[i].ip_port += TOTEMPG_LANE_PORT_STRIDE * lane->lane;
+		}
+	}
+
+	lane->totem_config->interfaces = interfaces;
+	lane->totem_config->orig_interfaces = NULL;
+	lane->totem_config->lane = lane->lane;
+	lane->totem_config->net_mtu = net_mtu;
+}
+
+static int lane_initialize (
+	struct totempg_lane *lane,
+	unsigned int lane_no,
+	qb_loop_t *poll_handle,
+	struct totem_config *totem_config)
+{
+	int res;
+
+	lane->lane = lane_no;
+	lane->next_fragment = 1;
+	qb_list_init (&lane->assembly_list_inuse);
+	qb_list_init (&lane->assembly_list_inuse_trans);
+	qb_list_init (&lane->held_list);
+
+	if (lane_no == 0) {
+		lane->totem_config = totem_config;
+		lane->stats = &totempg_stats;
+	} else {
+		lane->totem_config = malloc (sizeof (struct totem_config));
+		if (lane->totem_config == NULL) {
+			return (-1);
+		}
+		lane->totem_config->interfaces =
+			malloc (sizeof (struct totem_interface) * INTERFACE_MAX);
+		if (lane->totem_config->interfaces == NULL) {
+			free (lane->totem_config);
+			lane->totem_config = NULL;
+			return (-1);
+		}
+		lane_config_update (lane, totem_config->net_mtu);
+		lane->stats = &lane->lane_stats;
+	}
+
+	res = totemsrp_initialize (
+		poll_handle,
+		&lane->totemsrp_context,
+		lane->totem_config,
+		lane->stats,
+		totempg_lane_callbacks[lane_no].deliver_fn,
+		totempg_lane_callbacks[lane_no].confchg_fn,
+		totempg_lane_callbacks[lane_no].waiting_trans_ack_cb_fn);
+
+	if (res == -1) {
+		return (-1);
+	}
+
+	res = mcast_buffer_alloc (lane);
+	if (res == -1) {
+		return (-1);
+	}
+
+	totemsrp_callback_token_create (
+		lane->totemsrp_context,
+		&lane->callback_token_received_handle,
+		TOTEM_CALLBACK_TOKEN_RECEIVED,
+		0,
+		callback_token_received_fn,
+		lane);
+
+	return (0);
+}
+
 /*
  * Initialize the totem process group abstraction
  */
@@ -803,6 +1613,7 @@ int totempg_initialize (
 	qb_loop_t *poll_handle,
 	struct totem_config *totem_config)
 {
+	unsigned int i;
 	int res;
 
 	totempg_totem_config = totem_config;
@@ -813,51 +1624,56 @@ int totempg_initialize (
 	totempg_log_level_debug = totem_config->totem_logging_configuration.log_level_debug;
 	totempg_log_printf = totem_config->totem_logging_configuration.log_printf;
 	totempg_subsys_id = totem_config->totem_logging_configuration.log_subsys_id;
+	totempg_poll_handle = poll_handle;
+
+	totemsrp_net_mtu_adjust (totem_config);
 
-	fragmentation_data = malloc (TOTEMPG_PACKET_SIZE);
-	if (fragmentation_data == 0) {
+	totempg_lanes_count = totem_config->lanes ? totem_config->lanes : 1;
+	totempg_lanes = calloc (totempg_lanes_count, sizeof (struct totempg_lane));
+	if (totempg_lanes == NULL) {
 		return (-1);
 	}
 
-	totemsrp_net_mtu_adjust (totem_config);
-
-	res = totemsrp_initialize (
-		poll_handle,
-		&totemsrp_context,
-		totem_config,
-		&totempg_stats,
-		totempg_deliver_fn,
-		totempg_confchg_fn,
-		totempg_waiting_trans_ack_cb);
+	qb_list_init (&totempg_groups_list);
 
-	if (res == -1) {
-		goto error_exit;
+	for (i = 0; i < totempg_lanes_count; i++) {
+		res = lane_initialize (&totempg_lanes[i], i, poll_handle, totem_config);
+		if (res == -1) {
+			goto error_exit;
+		}
 	}
 
-	totemsrp_callback_token_create (
-		totemsrp_context,
-		&callback_token_received_handle,
-		TOTEM_CALLBACK_TOKEN_RECEIVED,
-		0,
-		callback_token_received_fn,
-		0);
+	if (totempg_lanes_count > 1) {
+		log_printf (LOG_NOTICE, "Ordering messages on %u lanes", totempg_lanes_count);
+	}
 
-	totempg_size_limit = (totemsrp_avail(totemsrp_context) - 1) *
+	totempg_size_limit = (totemsrp_avail(totempg_lanes[0].totemsrp_context) - 1) *
 		(totempg_totem_config->net_mtu -
 		sizeof (struct totempg_mcast) - 16);
 
-	qb_list_init (&totempg_groups_list);
-
 error_exit:
 	return (res);
 }
 
 void totempg_finalize (void)
 {
+	struct totempg_lane *lane;
+	unsigned int i;
+
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_lock (&totempg_mutex);
 	}
-	totemsrp_finalize (totemsrp_context);
+	if (lanes_barrier_timer_running) {
+		qb_loop_timer_del (totempg_poll_handle, lanes_barrier_timer);
+		lanes_barrier_timer_running = 0;
+	}
+	for (i = 0; i < totempg_lanes_count; i++) {
+		lane = &totempg_lanes[i];
+
+		totemsrp_mcast_buffer_release (lane->totemsrp_context, lane->mcast_buffer);
+		lane->mcast_buffer = NULL;
+		totemsrp_finalize (lane->totemsrp_context);
+	}
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_unlock (&totempg_mutex);
 	}
@@ -867,13 +1683,13 @@ void totempg_finalize (void)
  * Multicast a message
  */
 static int mcast_msg (
+	struct totempg_lane *lane,
 	struct iovec *iovec_in,
 	unsigned int iov_len,
 	int guarantee)
 {
 	int res = 0;
 	struct totempg_mcast mcast;
-	struct iovec iovecs[3];
 	struct iovec iovec[64];
 	int i;
 	int dest, src;
@@ -881,11 +1697,12 @@ static int mcast_msg (
 	int copy_len = 0;
 	int copy_base = 0;
 	int total_size = 0;
+	uint64_t send_timestamp = 0;
 
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_lock (&mcast_msg_mutex);
 	}
-	totemsrp_event_signal (totemsrp_context, TOTEM_EVENT_NEW_MSG, 1);
+	totemsrp_event_signal (lane->totemsrp_context, TOTEM_EVENT_NEW_MSG, 1);
 
 	/*
 	 * Remove zero length iovectors from the list
@@ -899,10 +1716,18 @@ static int mcast_msg (
 	}
 	iov_len = dest;
 
-	max_packet_size = TOTEMPG_PACKET_SIZE -
-		(sizeof (unsigned short) * (mcast_packed_msg_count + 1));
+	if (lane->mcast_packed_msg_count == 0 && lane->fragment_size == 0) {
+		lane->mcast_packed_timestamps = totempg_totem_config->latency_stats;
+	}
+	if (lane->mcast_packed_timestamps) {
+		send_timestamp = qb_util_nano_from_epoch_get ();
+	}
+
+	max_packet_size = TOTEMPG_PACKET_SIZE(lane) -
+		(packed_msg_overhead (lane) * (lane->mcast_packed_msg_count + 1));
 
-	mcast_packed_msg_lens[mcast_packed_msg_count] = 0;
+	lane->mcast_packed_msg_lens[lane->mcast_packed_msg_count] = 0;
+	lane->mcast_packed_msg_timestamps[lane->mcast_packed_msg_count] = send_timestamp;
 
 	/*
 	 * Check if we would overwrite new message queue
@@ -911,8 +1736,9 @@ static int mcast_msg (
 		total_size += iovec[i].iov_len;
 	}
 
-	if (byte_count_send_ok (total_size + sizeof(unsigned short) *
-		(mcast_packed_msg_count)) == 0) {
+	if (byte_count_send_ok (totemsrp_avail (lane->totemsrp_context),
+		total_size + sizeof(unsigned short) *
+		(lane->mcast_packed_msg_count)) == 0) {
 
 		if (totempg_threaded_mode == 1) {
 			pthread_mutex_unlock (&mcast_msg_mutex);
@@ -925,23 +1751,23 @@ static int mcast_msg (
 	mcast.header.version = 0;
 	for (i = 0; i < iov_len; ) {
 		mcast.fragmented = 0;
-		mcast.continuation = fragment_continuation;
+		mcast.continuation = lane->fragment_continuation;
 		copy_len = iovec[i].iov_len - copy_base;
 
 		/*
 		 * If it all fits with room left over, copy it in.
-		 * We need to leave at least sizeof(short) + 1 bytes in the
+		 * We need to leave at least packed_msg_overhead() + 1 bytes in the
 		 * fragment_buffer on exit so that max_packet_size + fragment_size
 		 * doesn't exceed the size of the fragment_buffer on the next call.
 		 */
-		if ((iovec[i].iov_len + fragment_size) <
-			(max_packet_size - sizeof (unsigned short))) {
+		if ((iovec[i].iov_len + lane->fragment_size) <
+			(max_packet_size - packed_msg_overhead (lane))) {
 
-			memcpy (&fragmentation_data[fragment_size],
+			memcpy (&lane->fragmentation_data[lane->fragment_size],
 				(char *)iovec[i].iov_base + copy_base, copy_len);
-			fragment_size += copy_len;
-			mcast_packed_msg_lens[mcast_packed_msg_count] += copy_len;
-			next_fragment = 1;
+			lane->fragment_size += copy_len;
+			lane->mcast_packed_msg_lens[lane->mcast_packed_msg_count] += copy_len;
+			lane->next_fragment = 1;
 			copy_len = 0;
 			copy_base = 0;
 			i++;
@@ -951,18 +1777,11 @@ static int mcast_msg (
 		 * If it just fits or is too big, then send out what fits.
 		 */
 		} else {
-			unsigned char *data_ptr;
-
-			copy_len = min(copy_len, max_packet_size - fragment_size);
-			if( copy_len == max_packet_size )
-				data_ptr = (unsigned char *)iovec[i].iov_base + copy_base;
-			else {
-				data_ptr = fragmentation_data;
-			}
+			copy_len = min(copy_len, max_packet_size - lane->fragment_size);
 
-			memcpy (&fragmentation_data[fragment_size],
+			memcpy (&lane->fragmentation_data[lane->fragment_size],
 				(unsigned char *)iovec[i].iov_base + copy_base, copy_len);
-			mcast_packed_msg_lens[mcast_packed_msg_count] += copy_len;
+			lane->mcast_packed_msg_lens[lane->mcast_packed_msg_count] += copy_len;
 
 			/*
 			 * if we're not on the last iovec or the iovec is too large to
@@ -971,30 +1790,23 @@ static int mcast_msg (
 			 */
 			if ((i < (iov_len - 1)) ||
 					((copy_base + copy_len) < iovec[i].iov_len)) {
-				if (!next_fragment) {
-					next_fragment++;
+				if (!lane->next_fragment) {
+					lane->next_fragment++;
 				}
-				fragment_continuation = next_fragment;
-				mcast.fragmented = next_fragment++;
-				assert(fragment_continuation != 0);
+				lane->fragment_continuation = lane->next_fragment;
+				mcast.fragmented = lane->next_fragment++;
+				assert(lane->fragment_continuation != 0);
 				assert(mcast.fragmented != 0);
 			} else {
-				fragment_continuation = 0;
+				lane->fragment_continuation = 0;
 			}
 
 			/*
 			 * assemble the message and send it
 			 */
-			mcast.msg_count = ++mcast_packed_msg_count;
-			iovecs[0].iov_base = (void *)&mcast;
-			iovecs[0].iov_len = sizeof(struct totempg_mcast);
-			iovecs[1].iov_base = (void *)mcast_packed_msg_lens;
-			iovecs[1].iov_len = mcast_packed_msg_count *
-				sizeof(unsigned short);
-			iovecs[2].iov_base = (void *)data_ptr;
-			iovecs[2].iov_len = fragment_size + copy_len;
-			assert (totemsrp_avail(totemsrp_context) > 0);
-			res = totemsrp_mcast (totemsrp_context, iovecs, 3, guarantee);
+			mcast.msg_count = ++lane->mcast_packed_msg_count;
+			assert (totemsrp_avail(lane->totemsrp_context) > 0);
+			res = packed_msg_send (lane, &mcast, lane->fragment_size + copy_len, guarantee);
 			if (res == -1) {
 				goto error_exit;
 			}
@@ -1002,10 +1814,11 @@ static int mcast_msg (
 			/*
 			 * Recalculate counts and indexes for the next.
 			 */
-			mcast_packed_msg_lens[0] = 0;
-			mcast_packed_msg_count = 0;
-			fragment_size = 0;
-			max_packet_size = TOTEMPG_PACKET_SIZE - (sizeof(unsigned short));
+			lane->mcast_packed_msg_lens[0] = 0;
+			lane->mcast_packed_msg_timestamps[0] = send_timestamp;
+			lane->mcast_packed_msg_count = 0;
+			lane->fragment_size = 0;
+			max_packet_size = TOTEMPG_PACKET_SIZE(lane) - packed_msg_overhead (lane);
 
 			/*
 			 * If the iovec all fit, go to the next iovec
@@ -1029,8 +1842,8 @@ static int mcast_msg (
 	 * the last buffer just fit into the fragmentation_data buffer
 	 * and we were at the last iovec.
 	 */
-	if (mcast_packed_msg_lens[mcast_packed_msg_count]) {
-			mcast_packed_msg_count++;
+	if (lane->mcast_packed_msg_lens[lane->mcast_packed_msg_count]) {
+			lane->mcast_packed_msg_count++;
 	}
 
 error_exit:
@@ -1040,6 +1853,32 @@ error_exit:
 	return (res);
 }
 
+/*
+ * Free message queue entries, with more lanes those of the fullest lane
+ * because reservations are not made for a particular lane
+ */
+static int lanes_avail (void)
+{
+	int avail;
+	unsigned int i;
+
+	avail = totemsrp_avail (totempg_lanes[0].totemsrp_context);
+	for (i = 1; i < totempg_lanes_count; i++) {
+		avail = min(avail, totemsrp_avail (totempg_lanes[i].totemsrp_context));
+	}
+
+	/*
+	 * Back-pressure while a lane holds back too much
+	 */
+	for (i = 0; i < totempg_lanes_count; i++) {
+		if (totempg_lanes[i].held_bytes >= TOTEMPG_HELD_BYTES_MAX) {
+			avail = 0;
+		}
+	}
+
+	return (avail);
+}
+
 /*
  * Determine if a message of msg_size could be queued
  */
@@ -1048,19 +1887,17 @@ static int msg_count_send_ok (
 {
 	int avail = 0;
 
-	avail = totemsrp_avail (totemsrp_context);
+	avail = lanes_avail ();
 	totempg_stats.msg_queue_avail = avail;
 
 	return ((avail - totempg_reserved) > msg_count);
 }
 
 static int byte_count_send_ok (
+	int avail,
 	int byte_count)
 {
 	unsigned int msg_count = 0;
-	int avail = 0;
-
-	avail = totemsrp_avail (totemsrp_context);
 
 	msg_count = (byte_count / (totempg_totem_config->net_mtu - sizeof (struct totempg_mcast) - 16)) + 1;
 
@@ -1093,7 +1930,7 @@ static void send_release (
 
 static uint32_t q_level_precent_used(void)
 {
-	return (100 - (((totemsrp_avail(totemsrp_context) - totempg_reserved) * 100) / MESSAGE_QUEUE_MAX));
+	return (100 - (((lanes_avail() - totempg_reserved) * 100) / MESSAGE_QUEUE_MAX));
 }
 
 int totempg_callback_token_create (
@@ -1107,8 +1944,8 @@ int totempg_callback_token_create (
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_lock (&callback_token_mutex);
 	}
-	res = totemsrp_callback_token_create (totemsrp_context, handle_out, type, delete,
-		callback_fn, data);
+	res = totemsrp_callback_token_create (totempg_lanes[0].totemsrp_context,
+		handle_out, type, delete, callback_fn, data);
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_unlock (&callback_token_mutex);
 	}
@@ -1121,7 +1958,7 @@ void totempg_callback_token_destroy (
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_lock (&callback_token_mutex);
 	}
-	totemsrp_callback_token_destroy (totemsrp_context, handle_out);
+	totemsrp_callback_token_destroy (totempg_lanes[0].totemsrp_context, handle_out);
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_unlock (&callback_token_mutex);
 	}
@@ -1234,6 +2071,17 @@ int totempg_groups_mcast_joined (
 	const struct iovec *iovec,
 	unsigned int iov_len,
 	int guarantee)
+{
+	return (totempg_groups_mcast_joined_lane (totempg_groups_instance, 0,
+		iovec, iov_len, guarantee));
+}
+
+int totempg_groups_mcast_joined_lane (
+	void *totempg_groups_instance,
+	unsigned int lane,
+	const struct iovec *iovec,
+	unsigned int iov_len,
+	int guarantee)
 {
 	struct totempg_group_instance *instance = (struct totempg_group_instance *)totempg_groups_instance;
 	unsigned short group_len[MAX_GROUPS_PER_MSG + 1];
@@ -1261,7 +2109,11 @@ int totempg_groups_mcast_joined (
 		iovec_mcast[i + instance->groups_cnt + 1].iov_base = iovec[i].iov_base;
 	}
 
-	res = mcast_msg (iovec_mcast, iov_len + instance->groups_cnt + 1, guarantee);
+	if (lane >= totempg_lanes_count) {
+		lane = 0;
+	}
+	res = mcast_msg (&totempg_lanes[lane], iovec_mcast,
+		iov_len + instance->groups_cnt + 1, guarantee);
 
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_unlock (&totempg_mutex);
@@ -1326,7 +2178,7 @@ int totempg_groups_joined_reserve (
 		goto error_exit;
 	}
 
-	if (byte_count_send_ok (size)) {
+	if (byte_count_send_ok (lanes_avail (), size)) {
 		reserved = send_reserve (size);
 	} else {
 		reserved = 0;
@@ -1390,7 +2242,7 @@ int totempg_groups_mcast_groups (
 		iovec_mcast[i + groups_cnt + 1].iov_base = iovec[i].iov_base;
 	}
 
-	res = mcast_msg (iovec_mcast, iov_len + groups_cnt + 1, guarantee);
+	res = mcast_msg (&totempg_lanes[0], iovec_mcast, iov_len + groups_cnt + 1, guarantee);
 
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_unlock (&totempg_mutex);
@@ -1436,13 +2288,19 @@ int totempg_iface_set (
 	unsigned short ip_port,
 	unsigned int iface_no)
 {
-	int res;
+	unsigned int i;
+	int res = 0;
 
-	res = totemsrp_iface_set (
-		totemsrp_context,
-		interface_addr,
-		ip_port,
-		iface_no);
+	for (i = 0; i < totempg_lanes_count; i++) {
+		if (totemsrp_iface_set (
+			totempg_lanes[i].totemsrp_context,
+			interface_addr,
+			ip_port + TOTEMPG_LANE_PORT_STRIDE * i,
+			iface_no) == -1) {
+
+			res = -1;
+		}
+	}
 
 	return (res);
 }
@@ -1451,7 +2309,7 @@ int totempg_nodestatus_get (unsigned int nodeid,
 			    struct totem_node_status *node_status)
 {
 	memset(node_status, 0, sizeof(struct totem_node_status));
-	return totemsrp_nodestatus_get (totemsrp_context, nodeid, node_status);
+	return totemsrp_nodestatus_get (totempg_lanes[0].totemsrp_context, nodeid, node_status);
 }
 
 int totempg_ifaces_get (
@@ -1465,7 +2323,7 @@ int totempg_ifaces_get (
 	int res;
 
 	res = totemsrp_ifaces_get (
-		totemsrp_context,
+		totempg_lanes[0].totemsrp_context,
 		nodeid,
 		interface_id,
 		interfaces,
@@ -1478,7 +2336,11 @@ int totempg_ifaces_get (
 
 void totempg_event_signal (enum totem_event_type type, int value)
 {
-	totemsrp_event_signal (totemsrp_context, type, value);
+	unsigned int i;
+
+	for (i = 0; i < totempg_lanes_count; i++) {
+		totemsrp_event_signal (totempg_lanes[i].totemsrp_context, type, value);
+	}
 }
 
 void* totempg_get_stats (void)
@@ -1486,13 +2348,24 @@ void* totempg_get_stats (void)
 	return &totempg_stats;
 }
 
+uint64_t totempg_deliver_timestamp_get (void)
+{
+	return (deliver_timestamp);
+}
+
 int totempg_crypto_set (
 	const char *cipher_type,
 	const char *hash_type)
 {
-	int res;
+	unsigned int i;
+	int res = 0;
 
-	res = totemsrp_crypto_set (totemsrp_context, cipher_type, hash_type);
+	for (i = 0; i < totempg_lanes_count; i++) {
+		if (totemsrp_crypto_set (totempg_lanes[i].totemsrp_context,
+		    cipher_type, hash_type) == -1) {
+			res = -1;
+		}
+	}
 
 	return (res);
 }
@@ -1531,17 +2404,18 @@ const char *totempg_ifaces_print (unsigned int nodeid)
 
 unsigned int totempg_my_nodeid_get (void)
 {
-	return (totemsrp_my_nodeid_get(totemsrp_context));
+	return (totemsrp_my_nodeid_get(totempg_lanes[0].totemsrp_context));
 }
 
 int totempg_my_family_get (void)
 {
-	return (totemsrp_my_family_get(totemsrp_context));
+	return (totemsrp_my_family_get(totempg_lanes[0].totemsrp_context));
 }
 extern void totempg_service_ready_register (
 	void (*totem_service_ready) (void))
 {
-	totemsrp_service_ready_register (totemsrp_context, totem_service_ready);
+	totemsrp_service_ready_register (totempg_lanes[0].totemsrp_context,
+		totem_service_ready);
 }
 
 void totempg_queue_level_register_callback (totem_queue_level_changed_fn fn)
@@ -1553,49 +2427,114 @@ extern int totempg_member_add (
 	const struct totem_ip_address *member,
 	int ring_no)
 {
-	return totemsrp_member_add (totemsrp_context, member, ring_no);
+	unsigned int i;
+	int res = 0;
+
+	for (i = 0; i < totempg_lanes_count; i++) {
+		if (totemsrp_member_add (totempg_lanes[i].totemsrp_context,
+		    member, ring_no) == -1) {
+			res = -1;
+		}
+	}
+
+	return (res);
 }
 
 extern int totempg_member_remove (
 	const struct totem_ip_address *member,
 	int ring_no)
 {
-	return totemsrp_member_remove (totemsrp_context, member, ring_no);
+	unsigned int i;
+	int res = 0;
+
+	for (i = 0; i < totempg_lanes_count; i++) {
+		if (totemsrp_member_remove (totempg_lanes[i].totemsrp_context,
+		    member, ring_no) == -1) {
+			res = -1;
+		}
+	}
+
+	return (res);
 }
 
 extern int totempg_reconfigure (void)
 {
-	return totemsrp_reconfigure (totemsrp_context, totempg_totem_config);
+	unsigned int i;
+	int res = 0;
+
+	for (i = 0; i < totempg_lanes_count; i++) {
+		if (totemsrp_reconfigure (totempg_lanes[i].totemsrp_context,
+		    totempg_lanes[i].totem_config) == -1) {
+			res = -1;
+		}
+	}
+
+	return (res);
 }
 
 extern int totempg_crypto_reconfigure_phase (cfg_message_crypto_reconfig_phase_t phase)
 {
-	return totemsrp_crypto_reconfigure_phase (totemsrp_context, totempg_totem_config, phase);
+	unsigned int i;
+	int res = 0;
+
+	for (i = 0; i < totempg_lanes_count; i++) {
+		if (totemsrp_crypto_reconfigure_phase (totempg_lanes[i].totemsrp_context,
+		    totempg_lanes[i].totem_config, phase) == -1) {
+			res = -1;
+		}
+	}
+
+	return (res);
 }
 
 extern void totempg_stats_clear (int flags)
 {
+	unsigned int i;
+
 	if (flags & TOTEMPG_STATS_CLEAR_TOTEM) {
 		totempg_stats.msg_reserved = 0;
 		totempg_stats.msg_queue_avail = 0;
 	}
-	return totemsrp_stats_clear (totemsrp_context, flags);
+	for (i = 0; i < totempg_lanes_count; i++) {
+		totemsrp_stats_clear (totempg_lanes[i].totemsrp_context, flags);
+	}
 }
 
 void totempg_threaded_mode_enable (void)
 {
+	unsigned int i;
+
 	totempg_threaded_mode = 1;
-	totemsrp_threaded_mode_enable (totemsrp_context);
+	for (i = 0; i < totempg_lanes_count; i++) {
+		totemsrp_threaded_mode_enable (totempg_lanes[i].totemsrp_context);
+	}
 }
 
+/*
+ * Synchronization has finished, other lanes can deliver the messages of
+ * their new rings now
+ */
 void totempg_trans_ack (void)
 {
-	totemsrp_trans_ack (totemsrp_context);
+	totemsrp_trans_ack (totempg_lanes[0].totemsrp_context);
+
+	if (totempg_lanes_count > 1) {
+		lanes_barrier_check ();
+	}
 }
 
 void totempg_force_gather (void)
 {
-	totemsrp_force_gather(totemsrp_context);
+	unsigned int i;
+
+	for (i = 0; i < totempg_lanes_count; i++) {
+		totemsrp_force_gather (totempg_lanes[i].totemsrp_context);
+	}
+}
+
+unsigned int totempg_lanes_get (void)
+{
+	return (totempg_lanes_count);
 }
 
 /* Assumes ->orig_interfaces is already allocated */
@@ -1612,9 +2551,14 @@ void totempg_get_config(struct totem_config *config)
 void totempg_put_config(struct totem_config *config)
 {
 	struct totem_interface *temp_if = totempg_totem_config->interfaces;
+	unsigned int i;
 
 	/* Preseve the existing interfaces[] array as transports might have pointers saved */
 	memcpy(totempg_totem_config->interfaces, config->interfaces, sizeof(struct totem_interface) * INTERFACE_MAX);
 	memcpy(totempg_totem_config, config, sizeof(struct totem_config));
 	totempg_totem_config->interfaces = temp_if;
+
+	for (i = 1; i < totempg_lanes_count; i++) {
+		lane_config_update (&totempg_lanes[i], totempg_lanes[i].totem_config->net_mtu);
+	}
 }
@@ -91,6 +91,7 @@
 #include "totemconfig.h"
 
 #include "cs_queue.h"
+#include "probes.h"
 
 #define LOCALHOST_IP				inet_addr("127.0.0.1")
 #define QUEUE_RTR_ITEMS_SIZE_MAX		16384 /* allow 16384 retransmit items */
@@ -98,6 +99,7 @@
 #define RECEIVED_MESSAGE_QUEUE_SIZE_MAX		500 /* allow 500 messages to be queued */
 #define MAXIOVS					5
 #define RETRANSMIT_ENTRIES_MAX			30
+#define RTR_REQUEST_ENTRIES_MAX			32
 #define TOKEN_SIZE_MAX				64000 /* bytes */
 #define LEAVE_DUMMY_NODEID                      0
 
@@ -150,8 +152,15 @@ enum message_type {
 	MESSAGE_TYPE_MEMB_JOIN = 3,			/* membership join message */
 	MESSAGE_TYPE_MEMB_COMMIT_TOKEN = 4,	/* membership commit token */
 	MESSAGE_TYPE_TOKEN_HOLD_CANCEL = 5,	/* cancel the holding of the token */
+	MESSAGE_TYPE_RTR_REQUEST = 6,		/* fast retransmit request */
 };
 
+/*
+ * Features announced in a word appended to memb_join messages after the
+ * processor lists. Older versions neither send nor look at it.
+ */
+#define MEMB_JOIN_FEATURE_FAST_RTR		(1 << 0)
+
 enum encapsulation_type {
 	MESSAGE_ENCAPSULATED = 1,
 	MESSAGE_NOT_ENCAPSULATED = 2
@@ -165,6 +174,21 @@ struct consensus_list_item {
 	int set;
 };
 
+struct peer_features_item {
+	unsigned int nodeid;
+	unsigned int features;
+};
+
+/*
+ * Sequence numbers retransmitted to one node since this node last got the
+ * token
+ */
+struct fast_rtr_retx_item {
+	unsigned int nodeid;
+	unsigned int seq_entries;
+	unsigned int seq[RTR_REQUEST_ENTRIES_MAX];
+};
+
 
 struct token_callback_instance {
 	struct qb_list_head list;
@@ -240,6 +264,18 @@ struct token_hold_cancel {
 } __attribute__((packed));
 
 
+/*
+ * Sent to a single node to ask it to retransmit messages this node is
+ * missing without waiting for the token
+ */
+struct rtr_request {
+	struct totem_message_header header;
+	struct memb_ring_id ring_id;
+	unsigned int seq_entries;
+	unsigned int seq[0];
+} __attribute__((packed));
+
+
 struct memb_commit_token_memb_entry {
 	struct memb_ring_id ring_id;
 	unsigned int aru;
@@ -264,12 +300,17 @@ struct memb_commit_token {
  */
 }__attribute__((packed));
 
+/*
+ * buffer is what has to be released, mcast may point inside of it
+ */
 struct message_item {
+	void *buffer;
 	struct mcast *mcast;
 	unsigned int msg_len;
 };
 
 struct sort_queue_item {
+	void *buffer;
 	struct mcast *mcast;
 	unsigned int msg_len;
 };
@@ -471,11 +512,13 @@ struct totemsrp_instance {
 
 	void (*memb_ring_id_create_or_load) (
 		struct memb_ring_id *memb_ring_id,
-		unsigned int nodeid);
+		unsigned int nodeid,
+		unsigned int lane);
 
 	void (*memb_ring_id_store) (
 		const struct memb_ring_id *memb_ring_id,
-		unsigned int nodeid);
+		unsigned int nodeid,
+		unsigned int lane);
 
 	int global_seqno;
 
@@ -528,11 +571,32 @@ struct totemsrp_instance {
 	void * token_recv_event_handle;
 	void * token_sent_event_handle;
 	char commit_token_storage[40000];
+
+	/*
+	 * Fast retransmit (totem.fast_retransmit): features announced by the
+	 * last join of every node seen since the last ring was installed,
+	 * whether all members of the current ring support it and the highest
+	 * sequence number up to which missing messages were requested
+	 */
+	struct peer_features_item peer_features[PROCESSOR_COUNT_MAX];
+
+	int peer_features_entries;
+
+	int fast_rtr_enabled;
+
+	unsigned int fast_rtr_high_seq;
+
+	/*
+	 * Responder side suppression, reset on every token rotation
+	 */
+	struct fast_rtr_retx_item fast_rtr_retx[PROCESSOR_COUNT_MAX];
+
+	int fast_rtr_retx_entries;
 };
 
 struct message_handlers {
 	int count;
-	int (*handler_functions[6]) (
+	int (*handler_functions[7]) (
 		struct totemsrp_instance *instance,
 		const void *msg,
 		size_t msg_len,
@@ -617,6 +681,12 @@ static int message_handler_token_hold_cancel (
 	size_t msg_len,
 	int endian_conversion_needed);
 
+static int message_handler_rtr_request (
+	struct totemsrp_instance *instance,
+	const void *msg,
+	size_t msg_len,
+	int endian_conversion_needed);
+
 static void totemsrp_instance_initialize (struct totemsrp_instance *instance);
 
 static void srp_addr_to_nodeid (
@@ -676,14 +746,15 @@ void main_iface_change_fn (
 	unsigned int iface_no);
 
 struct message_handlers totemsrp_message_handlers = {
-	6,
+	7,
 	{
 		message_handler_orf_token,            /* MESSAGE_TYPE_ORF_TOKEN */
 		message_handler_mcast,                /* MESSAGE_TYPE_MCAST */
 		message_handler_memb_merge_detect,    /* MESSAGE_TYPE_MEMB_MERGE_DETECT */
 		message_handler_memb_join,            /* MESSAGE_TYPE_MEMB_JOIN */
 		message_handler_memb_commit_token,    /* MESSAGE_TYPE_MEMB_COMMIT_TOKEN */
-		message_handler_token_hold_cancel     /* MESSAGE_TYPE_TOKEN_HOLD_CANCEL */
+		message_handler_token_hold_cancel,    /* MESSAGE_TYPE_TOKEN_HOLD_CANCEL */
+		message_handler_rtr_request           /* MESSAGE_TYPE_RTR_REQUEST */
 	}
 };
 
@@ -802,6 +873,29 @@ static int token_event_stats_collector (enum totem_callback_token_type type, con
 	return 0;
 }
 
+static void token_phase_record (
+	struct totemsrp_instance *instance,
+	enum totemsrp_token_phase phase,
+	uint64_t elapsed)
+{
+	totemsrp_token_phase_stats_t *phase_stats = &instance->stats.token_phase[phase];
+	unsigned int bucket = 0;
+
+	if (elapsed > 1) {
+		bucket = 63 - __builtin_clzll (elapsed);
+		if (bucket >= TOTEMSRP_TOKEN_PHASE_BUCKETS) {
+			bucket = TOTEMSRP_TOKEN_PHASE_BUCKETS - 1;
+		}
+	}
+
+	phase_stats->count++;
+	phase_stats->total += elapsed;
+	if (elapsed > phase_stats->max) {
+		phase_stats->max = elapsed;
+	}
+	phase_stats->buckets[bucket]++;
+}
+
 static void totempg_mtu_changed(void *context, int net_mtu)
 {
 	struct totemsrp_instance *instance = context;
@@ -1883,6 +1977,7 @@ static void deliver_messages_from_recovery_to_regular (struct totemsrp_instance
 			 * Message is a recovery message encapsulated
 			 * in a new ring message
 			 */
+			regular_message_item.buffer = recovery_message_item->buffer;
 			regular_message_item.mcast =
 				(struct mcast *)(((char *)recovery_message_item->mcast) + sizeof (struct mcast));
 			regular_message_item.msg_len =
@@ -1925,6 +2020,107 @@ static void deliver_messages_from_recovery_to_regular (struct totemsrp_instance
 /*
  * Change states in the state machine of the membership algorithm
  */
+/*
+ * Remember the features a node announced in its last join message
+ */
+static void peer_features_set (
+	struct totemsrp_instance *instance,
+	unsigned int nodeid,
+	unsigned int features)
+{
+	int i;
+
+	for (i = 0; i < instance->peer_features_entries; i++) {
+		if (instance->peer_features[i].nodeid == nodeid) {
+			instance->peer_features[i].features = features;
+			return;
+		}
+	}
+
+	/*
+	 * Nodes which don't fit are treated as not supporting any feature
+	 */
+	if (instance->peer_features_entries < PROCESSOR_COUNT_MAX) {
+		instance->peer_features[i].nodeid = nodeid;
+		instance->peer_features[i].features = features;
+		instance->peer_features_entries++;
+	}
+}
+
+static unsigned int peer_features_get (
+	struct totemsrp_instance *instance,
+	unsigned int nodeid)
+{
+	int i;
+
+	for (i = 0; i < instance->peer_features_entries; i++) {
+		if (instance->peer_features[i].nodeid == nodeid) {
+			return (instance->peer_features[i].features);
+		}
+	}
+	return (0);
+}
+
+/*
+ * Fast retransmit needs unicast to the other nodes. The udp (multicast)
+ * transport can only reach nodes from the nodelist.
+ */
+static int fast_rtr_reachable (
+	struct totemsrp_instance *instance,
+	const struct srp_addr *list,
+	int list_entries)
+{
+	int i;
+
+	for (i = 0; i < list_entries; i++) {
+		if (list[i].nodeid != instance->my_id.nodeid &&
+		    totemnet_ucast_reachable (instance->totemnet_context, list[i].nodeid) == 0) {
+			return (0);
+		}
+	}
+	return (1);
+}
+
+/*
+ * Fast retransmit is used on a ring only if it is enabled here, every
+ * other member announced it in the join message which formed the ring and
+ * every member can be reached by unicast
+ */
+static void fast_rtr_negotiate (struct totemsrp_instance *instance)
+{
+	unsigned int nodeid;
+	int i;
+
+	instance->fast_rtr_enabled = 0;
+	instance->fast_rtr_high_seq = instance->my_high_seq_received;
+	instance->fast_rtr_retx_entries = 0;
+
+	if (instance->totem_config->fast_retransmit) {
+		for (i = 0; i < instance->my_new_memb_entries; i++) {
+			nodeid = instance->my_new_memb_list[i].nodeid;
+			if (nodeid != instance->my_id.nodeid &&
+			    (peer_features_get (instance, nodeid) & MEMB_JOIN_FEATURE_FAST_RTR) == 0) {
+				log_printf (instance->totemsrp_log_level_debug,
+					"Fast retransmit not used, node " CS_PRI_NODE_ID " doesn't support it",
+					nodeid);
+				break;
+			}
+		}
+		if (i == instance->my_new_memb_entries &&
+		    !fast_rtr_reachable (instance, instance->my_new_memb_list,
+		    instance->my_new_memb_entries)) {
+			log_printf (instance->totemsrp_log_level_debug,
+				"Fast retransmit not used, some nodes can't be reached by unicast");
+			i = 0;
+		}
+		if (i == instance->my_new_memb_entries) {
+			instance->fast_rtr_enabled = 1;
+		}
+	}
+
+	instance->peer_features_entries = 0;
+}
+
 static void memb_state_operational_enter (struct totemsrp_instance *instance)
 {
 	struct srp_addr joined_list[PROCESSOR_COUNT_MAX];
@@ -2071,7 +2267,7 @@ static void memb_state_operational_enter (struct totemsrp_instance *instance)
 			struct sort_queue_item *regular_message;
 
 			regular_message = ptr;
-			free (regular_message->mcast);
+			totemsrp_buffer_release (instance, regular_message->buffer);
 		}
 	}
 	sq_items_release (&instance->regular_sort_queue, instance->my_high_delivered);
@@ -2114,6 +2310,8 @@ static void memb_state_operational_enter (struct totemsrp_instance *instance)
 
 	my_leave_memb_clear(instance);
 
+	fast_rtr_negotiate (instance);
+
 	log_printf (instance->totemsrp_log_level_debug,
 		"entering OPERATIONAL state.");
 	log_printf (instance->totemsrp_log_level_notice,
@@ -2254,7 +2452,8 @@ static void memb_state_commit_enter (
 
 	memb_ring_id_set (instance, &instance->commit_token->ring_id);
 
-	instance->memb_ring_id_store (&instance->my_ring_id, instance->my_id.nodeid);
+	instance->memb_ring_id_store (&instance->my_ring_id, instance->my_id.nodeid,
+		instance->totem_config->lane);
 
 	instance->token_ring_id_seq = instance->my_ring_id.seq;
 
@@ -2427,8 +2626,9 @@ static void memb_state_recovery_enter (
 		messages_originated++;
 		memset (&message_item, 0, sizeof (struct message_item));
 	// TODO	 LEAK
-		message_item.mcast = totemsrp_buffer_alloc (instance);
-		assert (message_item.mcast);
+		message_item.buffer = totemsrp_buffer_alloc (instance);
+		assert (message_item.buffer);
+		message_item.mcast = message_item.buffer;
 		memset(message_item.mcast, 0, sizeof (struct mcast));
 		message_item.mcast->header.magic = TOTEM_MH_MAGIC;
 		message_item.mcast->header.version = TOTEM_MH_VERSION;
@@ -2481,6 +2681,52 @@ void totemsrp_event_signal (void *srp_context, enum totem_event_type type, int v
 	return;
 }
 
+static struct cs_queue *new_message_queue_get (struct totemsrp_instance *instance)
+{
+	if (instance->waiting_trans_ack) {
+		return (&instance->new_message_queue_trans);
+	}
+	return (&instance->new_message_queue);
+}
+
+static void new_message_queue_add (
+	struct totemsrp_instance *instance,
+	struct cs_queue *queue_use,
+	void *buffer,
+	struct mcast *mcast,
+	unsigned int msg_len,
+	int guarantee)
+{
+	struct message_item message_item;
+
+	memset (&message_item, 0, sizeof (struct message_item));
+	message_item.buffer = buffer;
+	message_item.mcast = mcast;
+	message_item.msg_len = msg_len;
+
+	/*
+	 * Set mcast header
+	 */
+	memset(message_item.mcast, 0, sizeof (struct mcast));
+	message_item.mcast->header.magic = TOTEM_MH_MAGIC;
+	message_item.mcast->header.version = TOTEM_MH_VERSION;
+	message_item.mcast->header.type = MESSAGE_TYPE_MCAST;
+	message_item.mcast->header.encapsulated = MESSAGE_NOT_ENCAPSULATED;
+
+	message_item.mcast->header.nodeid = instance->my_id.nodeid;
+	assert (message_item.mcast->header.nodeid);
+
+	message_item.mcast->guarantee = guarantee;
+	message_item.mcast->system_from = instance->my_id;
+
+	log_printf (instance->totemsrp_log_level_trace, "mcasted message added to pending queue");
+	instance->stats.mcast_tx++;
+	cs_queue_item_add (queue_use, &message_item);
+
+	CS_PROBE3 (mcast_queue, message_item.mcast, message_item.msg_len,
+		queue_use->used);
+}
+
 int totemsrp_mcast (
 	void *srp_context,
 	struct iovec *iovec,
@@ -2489,59 +2735,35 @@ int totemsrp_mcast (
 {
 	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
 	int i;
-	struct message_item message_item;
 	char *addr;
 	unsigned int addr_idx;
 	struct cs_queue *queue_use;
+	void *buffer;
 
-	if (instance->waiting_trans_ack) {
-		queue_use = &instance->new_message_queue_trans;
-	} else {
-		queue_use = &instance->new_message_queue;
-	}
+	queue_use = new_message_queue_get (instance);
 
 	if (cs_queue_is_full (queue_use)) {
 		log_printf (instance->totemsrp_log_level_debug, "queue full");
 		return (-1);
 	}
 
-	memset (&message_item, 0, sizeof (struct message_item));
-
 	/*
 	 * Allocate pending item
 	 */
-	message_item.mcast = totemsrp_buffer_alloc (instance);
-	if (message_item.mcast == 0) {
+	buffer = totemsrp_buffer_alloc (instance);
+	if (buffer == 0) {
 		goto error_mcast;
 	}
 
-	/*
-	 * Set mcast header
-	 */
-	memset(message_item.mcast, 0, sizeof (struct mcast));
-	message_item.mcast->header.magic = TOTEM_MH_MAGIC;
-	message_item.mcast->header.version = TOTEM_MH_VERSION;
-	message_item.mcast->header.type = MESSAGE_TYPE_MCAST;
-	message_item.mcast->header.encapsulated = MESSAGE_NOT_ENCAPSULATED;
-
-	message_item.mcast->header.nodeid = instance->my_id.nodeid;
-	assert (message_item.mcast->header.nodeid);
-
-	message_item.mcast->guarantee = guarantee;
-	message_item.mcast->system_from = instance->my_id;
-
-	addr = (char *)message_item.mcast;
+	addr = (char *)buffer;
 	addr_idx = sizeof (struct mcast);
 	for (i = 0; i < iov_len; i++) {
 		memcpy (&addr[addr_idx], iovec[i].iov_base, iovec[i].iov_len);
 		addr_idx += iovec[i].iov_len;
 	}
 
-	message_item.msg_len = addr_idx;
-
-	log_printf (instance->totemsrp_log_level_trace, "mcasted message added to pending queue");
-	instance->stats.mcast_tx++;
-	cs_queue_item_add (queue_use, &message_item);
+	new_message_queue_add (instance, queue_use, buffer, buffer, addr_idx,
+		guarantee);
 
 	return (0);
 
@@ -2549,6 +2771,59 @@ error_mcast:
 	return (-1);
 }
 
+void *totemsrp_mcast_buffer_alloc (
+	void *srp_context,
+	size_t *headroom,
+	size_t *size)
+{
+	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
+
+	*headroom = sizeof (struct mcast);
+	*size = FRAME_SIZE_MAX;
+
+	return (totemsrp_buffer_alloc (instance));
+}
+
+void totemsrp_mcast_buffer_release (
+	void *srp_context,
+	void *buffer)
+{
+	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
+
+	totemsrp_buffer_release (instance, buffer);
+}
+
+int totemsrp_mcast_buffer (
+	void *srp_context,
+	void *buffer,
+	size_t offset,
+	size_t len,
+	int guarantee)
+{
+	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
+	struct cs_queue *queue_use;
+
+	assert (offset >= sizeof (struct mcast));
+	assert (offset + len <= FRAME_SIZE_MAX);
+
+	queue_use = new_message_queue_get (instance);
+
+	if (cs_queue_is_full (queue_use)) {
+		log_printf (instance->totemsrp_log_level_debug, "queue full");
+		return (-1);
+	}
+
+	/*
+	 * The header goes right in front of the payload, the buffer is
+	 * queued, sent and retransmitted as is
+	 */
+	new_message_queue_add (instance, queue_use, buffer,
+		(struct mcast *)((char *)buffer + offset - sizeof (struct mcast)),
+		len + sizeof (struct mcast), guarantee);
+
+	return (0);
+}
+
 /*
  * Determine if there is room to queue a new message
  */
@@ -2657,7 +2932,7 @@ static void messages_free (
 			instance->last_released + i, &ptr);
 		if (res == 0) {
 			regular_message = ptr;
-			totemsrp_buffer_release (instance, regular_message->mcast);
+			totemsrp_buffer_release (instance, regular_message->buffer);
 		}
 		sq_items_release (&instance->regular_sort_queue,
 			instance->last_released + i);
@@ -2747,6 +3022,7 @@ static int orf_token_mcast (
 		 * Build IO vector
 		 */
 		memset (&sort_queue_item, 0, sizeof (struct sort_queue_item));
+		sort_queue_item.buffer = message_item->buffer;
 		sort_queue_item.mcast = message_item->mcast;
 		sort_queue_item.msg_len = message_item->msg_len;
 
@@ -2759,6 +3035,10 @@ static int orf_token_mcast (
 		 */
 		sq_item_add (sort_queue, &sort_queue_item, message_item->mcast->seq);
 
+		CS_PROBE4 (mcast_tx, message_item->mcast,
+			instance->my_ring_id.seq, message_item->mcast->seq,
+			message_item->msg_len);
+
 		totemnet_mcast_noflush_send (
 			instance->totemnet_context,
 			message_item->mcast,
@@ -2777,6 +3057,9 @@ static int orf_token_mcast (
 
 	update_aru (instance);
 
+	CS_PROBE4 (orf_token_mcast, instance->my_ring_id.seq, token->seq,
+		fcc_mcast_current, mcast_queue->used);
+
 	/*
 	 * Return 1 if more messages are available for single node clusters
 	 */
@@ -3314,6 +3597,7 @@ static void memb_join_message_send (struct totemsrp_instance *instance)
 	struct memb_join *memb_join = (struct memb_join *)memb_join_data;
 	char *addr;
 	unsigned int addr_idx;
+	unsigned int features = 0;
 	size_t msg_len;
 
 	memb_join->header.magic = TOTEM_MH_MAGIC;
@@ -3324,7 +3608,8 @@ static void memb_join_message_send (struct totemsrp_instance *instance)
 	assert (memb_join->header.nodeid);
 
 	msg_len = sizeof(struct memb_join) +
-	    ((instance->my_proc_list_entries + instance->my_failed_list_entries) * sizeof(struct srp_addr));
+	    ((instance->my_proc_list_entries + instance->my_failed_list_entries) * sizeof(struct srp_addr)) +
+	    sizeof(features);
 
 	if (msg_len > sizeof(memb_join_data)) {
 		log_printf (instance->totemsrp_log_level_error,
@@ -3359,6 +3644,14 @@ static void memb_join_message_send (struct totemsrp_instance *instance)
 		instance->my_failed_list_entries *
 		sizeof (struct srp_addr);
 
+	if (instance->totem_config->fast_retransmit &&
+	    fast_rtr_reachable (instance, instance->my_proc_list,
+	    instance->my_proc_list_entries)) {
+		features |= MEMB_JOIN_FEATURE_FAST_RTR;
+	}
+	memcpy (&addr[addr_idx], &features, sizeof (features));
+	addr_idx += sizeof (features);
+
 	if (instance->totem_config->send_join_timeout) {
 		usleep (random() % (instance->totem_config->send_join_timeout * 1000));
 	}
@@ -3817,6 +4110,38 @@ static int check_token_hold_cancel_sanity(
 	return (0);
 }
 
+static int check_rtr_request_sanity(
+	struct totemsrp_instance *instance,
+	const void *msg,
+	size_t msg_len,
+	int endian_conversion_needed)
+{
+	const struct rtr_request *rtr_request = (const struct rtr_request *)msg;
+	unsigned int seq_entries;
+
+	if (msg_len < sizeof(struct rtr_request)) {
+		log_printf (instance->totemsrp_log_level_security,
+		    "Received rtr_request message is too short...  ignoring.");
+
+		return (-1);
+	}
+
+	seq_entries = rtr_request->seq_entries;
+	if (endian_conversion_needed) {
+		seq_entries = swab32(seq_entries);
+	}
+
+	if (seq_entries > RTR_REQUEST_ENTRIES_MAX ||
+	    msg_len < sizeof(struct rtr_request) + seq_entries * sizeof(unsigned int)) {
+		log_printf (instance->totemsrp_log_level_security,
+		    "Received rtr_request message is too short...  ignoring.");
+
+		return (-1);
+	}
+
+	return (0);
+}
+
 /*
  * Message Handlers
  */
@@ -3839,6 +4164,10 @@ static int message_handler_orf_token (
 	unsigned int mcasted_retransmit;
 	unsigned int mcasted_regular;
 	unsigned int last_aru;
+	int phase_stats = instance->totem_config->token_phase_stats;
+	uint64_t hold_start = 0;
+	uint64_t phase_start = 0;
+	uint64_t callbacks_time = 0;
 
 #ifdef GIVEINFO
 	unsigned long long tv_current;
@@ -3859,6 +4188,9 @@ static int message_handler_orf_token (
 	if (instance->orf_token_discard) {
 		return (0);
 	}
+	if (phase_stats) {
+		hold_start = qb_util_nano_current_get ();
+	}
 #ifdef TEST_DROP_ORF_TOKEN_PERCENTAGE
 	if (random()%100 < TEST_DROP_ORF_TOKEN_PERCENTAGE) {
 		return (0);
@@ -3935,7 +4267,14 @@ static int message_handler_orf_token (
 		break;
 
 	case MEMB_STATE_OPERATIONAL:
+		if (phase_stats) {
+			phase_start = qb_util_nano_current_get ();
+		}
 		messages_free (instance, token->aru);
+		if (phase_stats) {
+			token_phase_record (instance, TOTEMSRP_TOKEN_PHASE_FREE,
+				qb_util_nano_current_get () - phase_start);
+		}
 		/*
 		 * Do NOT add break, this case should also execute code in gather case.
 		 */
@@ -3970,16 +4309,38 @@ static int message_handler_orf_token (
 			return (0); /* discard token */
 		}
 
+		/*
+		 * New rotation, fast retransmit requests may be answered again
+		 */
+		instance->fast_rtr_retx_entries = 0;
+
+		CS_PROBE6 (orf_token_rx, instance->my_ring_id.seq,
+			token->token_seq, token->seq, token->aru,
+			token->rtr_list_entries, token->backlog);
+
 		/*
 		 * Token is valid so trigger callbacks
 		 */
+		if (phase_stats) {
+			phase_start = qb_util_nano_current_get ();
+		}
 		token_callbacks_execute (instance, TOTEM_CALLBACK_TOKEN_RECEIVED);
+		if (phase_stats) {
+			callbacks_time = qb_util_nano_current_get () - phase_start;
+		}
 
 		last_aru = instance->my_last_aru;
 		instance->my_last_aru = token->aru;
 
+		if (phase_stats) {
+			phase_start = qb_util_nano_current_get ();
+		}
 		transmits_allowed = fcc_calculate (instance, token);
 		mcasted_retransmit = orf_token_rtr (instance, token, &transmits_allowed);
+		if (phase_stats) {
+			token_phase_record (instance, TOTEMSRP_TOKEN_PHASE_RTR,
+				qb_util_nano_current_get () - phase_start);
+		}
 
 		if (instance->my_token_held == 1 &&
 			(token->rtr_list_entries > 0 || mcasted_retransmit > 0)) {
@@ -3987,6 +4348,9 @@ static int message_handler_orf_token (
 			forward_token = 1;
 		}
 
+		if (phase_stats) {
+			phase_start = qb_util_nano_current_get ();
+		}
 		fcc_rtr_limit (instance, token, &transmits_allowed);
 		mcasted_regular = orf_token_mcast (instance, token, transmits_allowed);
 /*
@@ -3997,6 +4361,14 @@ printf ("token seq %d\n", token->seq);
 */
 		fcc_token_update (instance, token, mcasted_retransmit +
 			mcasted_regular);
+		if (phase_stats) {
+			token_phase_record (instance, TOTEMSRP_TOKEN_PHASE_MCAST,
+				qb_util_nano_current_get () - phase_start);
+		}
+
+		CS_PROBE5 (orf_token_processed, instance->my_ring_id.seq,
+			token->token_seq, mcasted_retransmit, mcasted_regular,
+			token->backlog);
 
 		if (sq_lt_compare (instance->my_aru, token->aru) ||
 			instance->my_id.nodeid == token->aru_addr ||
@@ -4098,6 +4470,10 @@ printf ("token seq %d\n", token->seq);
 
 			totemnet_send_flush (instance->totemnet_context);
 			token_send (instance, token, forward_token);
+			if (phase_stats) {
+				token_phase_record (instance, TOTEMSRP_TOKEN_PHASE_HOLD,
+					qb_util_nano_current_get () - hold_start);
+			}
 
 #ifdef GIVEINFO
 			tv_current = qb_util_nano_current_get ();
@@ -4108,8 +4484,15 @@ printf ("token seq %d\n", token->seq);
 				((float)tv_diff) / 1000000.0);
 #endif
 			if (instance->memb_state == MEMB_STATE_OPERATIONAL) {
+				if (phase_stats) {
+					phase_start = qb_util_nano_current_get ();
+				}
 				messages_deliver_to_app (instance, 0,
 					instance->my_high_seq_received);
+				if (phase_stats) {
+					token_phase_record (instance, TOTEMSRP_TOKEN_PHASE_DELIVER,
+						qb_util_nano_current_get () - phase_start);
+				}
 			}
 
 			/*
@@ -4124,7 +4507,15 @@ printf ("token seq %d\n", token->seq);
 				start_token_hold_retransmit_timeout (instance);
 			}
 
+			if (phase_stats) {
+				phase_start = qb_util_nano_current_get ();
+			}
 			token_callbacks_execute (instance, TOTEM_CALLBACK_TOKEN_SENT);
+			if (phase_stats) {
+				callbacks_time += qb_util_nano_current_get () - phase_start;
+				token_phase_record (instance, TOTEMSRP_TOKEN_PHASE_CALLBACKS,
+					callbacks_time);
+			}
 		}
 		break;
 	}
@@ -4233,6 +4624,11 @@ static void messages_deliver_to_app (
 			"Delivering MCAST message with seq %x to pending delivery queue",
 			mcast_header.seq);
 
+		CS_PROBE5 (deliver, sort_queue_item_p->mcast,
+			mcast_header.ring_id.seq, mcast_header.seq,
+			mcast_header.header.nodeid,
+			sort_queue_item_p->msg_len - sizeof (struct mcast));
+
 		/*
 		 * Message is locally originated multicast
 		 */
@@ -4244,6 +4640,71 @@ static void messages_deliver_to_app (
 	}
 }
 
+/*
+ * Ask nodeid to retransmit the messages up to and including high_seq
+ * which are still missing. high_seq is the previous highest sequence
+ * number received, so a message is only requested after at least one
+ * later message arrived behind the one which showed the gap, which
+ * leaves some room for reordering. Every sequence number is requested
+ * at most once this way, anything lost again is left to the token.
+ */
+static void fast_rtr_request_send (
+	struct totemsrp_instance *instance,
+	unsigned int nodeid,
+	unsigned int high_seq)
+{
+	char rtr_request_data[sizeof (struct rtr_request) +
+		RTR_REQUEST_ENTRIES_MAX * sizeof (unsigned int)];
+	struct rtr_request *rtr_request = (struct rtr_request *)rtr_request_data;
+	unsigned int seq;
+
+	if (nodeid == instance->my_id.nodeid) {
+		return;
+	}
+
+	seq = instance->fast_rtr_high_seq;
+	if (sq_lt_compare (seq, instance->my_aru)) {
+		seq = instance->my_aru;
+	}
+	if (sq_lte_compare (high_seq, seq)) {
+		return;
+	}
+
+	rtr_request->seq_entries = 0;
+	while (sq_lt_compare (seq, high_seq) &&
+	    rtr_request->seq_entries < RTR_REQUEST_ENTRIES_MAX) {
+		seq++;
+
+		if (sq_in_range (&instance->regular_sort_queue, seq) == 0) {
+			break;
+		}
+		if (sq_item_inuse (&instance->regular_sort_queue, seq) == 0) {
+			rtr_request->seq[rtr_request->seq_entries++] = seq;
+		}
+	}
+	instance->fast_rtr_high_seq = seq;
+
+	if (rtr_request->seq_entries == 0) {
+		return;
+	}
+
+	rtr_request->header.magic = TOTEM_MH_MAGIC;
+	rtr_request->header.version = TOTEM_MH_VERSION;
+	rtr_request->header.type = MESSAGE_TYPE_RTR_REQUEST;
+	rtr_request->header.encapsulated = 0;
+	rtr_request->header.nodeid = instance->my_id.nodeid;
+	assert (rtr_request->header.nodeid);
+	memcpy (&rtr_request->ring_id, &instance->my_ring_id,
+		sizeof (struct memb_ring_id));
+
+	if (totemnet_ucast_send (instance->totemnet_context, rtr_request,
+	    sizeof (struct rtr_request) +
+	    rtr_request->seq_entries * sizeof (unsigned int),
+	    nodeid) == 0) {
+		instance->stats.rtr_request_tx++;
+	}
+}
+
 /*
  * recv message handler called when MCAST message type received
  */
@@ -4257,6 +4718,8 @@ static int message_handler_mcast (
 	struct sq *sort_queue;
 	struct mcast mcast_header;
 	struct srp_addr aligned_system_from;
+	unsigned int prev_high_seq_received = 0;
+	int high_seq_advanced = 0;
 
 	if (check_mcast_sanity(instance, msg, msg_len, endian_conversion_needed) == -1) {
 		return (0);
@@ -4343,15 +4806,18 @@ static int message_handler_mcast (
 		 * Allocate new multicast memory block
 		 */
 // TODO LEAK
-		sort_queue_item.mcast = totemsrp_buffer_alloc (instance);
-		if (sort_queue_item.mcast == NULL) {
+		sort_queue_item.buffer = totemsrp_buffer_alloc (instance);
+		if (sort_queue_item.buffer == NULL) {
 			return (-1); /* error here is corrected by the algorithm */
 		}
+		sort_queue_item.mcast = sort_queue_item.buffer;
 		memcpy (sort_queue_item.mcast, msg, msg_len);
 		sort_queue_item.msg_len = msg_len;
 
 		if (sq_lt_compare (instance->my_high_seq_received,
 			mcast_header.seq)) {
+			prev_high_seq_received = instance->my_high_seq_received;
+			high_seq_advanced = 1;
 			instance->my_high_seq_received = mcast_header.seq;
 		}
 
@@ -4359,6 +4825,14 @@ static int message_handler_mcast (
 	}
 
 	update_aru (instance);
+
+	if (high_seq_advanced && instance->fast_rtr_enabled &&
+	    instance->memb_state == MEMB_STATE_OPERATIONAL &&
+	    sort_queue == &instance->regular_sort_queue) {
+		fast_rtr_request_send (instance, mcast_header.system_from.nodeid,
+			prev_high_seq_received);
+	}
+
 	if (instance->memb_state == MEMB_STATE_OPERATIONAL) {
 		messages_deliver_to_app (instance, 0, instance->my_high_seq_received);
 	}
@@ -4753,6 +5227,8 @@ static int message_handler_memb_join (
 	const struct memb_join *memb_join;
 	struct memb_join *memb_join_convert = alloca (msg_len);
 	struct srp_addr aligned_system_from;
+	size_t features_offset;
+	unsigned int features;
 
 	if (check_memb_join_sanity(instance, msg, msg_len, endian_conversion_needed) == -1) {
 		return (0);
@@ -4777,6 +5253,20 @@ static int message_handler_memb_join (
 		return (0);
 	}
 
+	if (memb_join->header.nodeid != LEAVE_DUMMY_NODEID) {
+		features_offset = sizeof (struct memb_join) +
+			(memb_join->proc_list_entries + memb_join->failed_list_entries) *
+			sizeof (struct srp_addr);
+		features = 0;
+		if (msg_len >= features_offset + sizeof (features)) {
+			memcpy (&features, (const char *)msg + features_offset, sizeof (features));
+			if (endian_conversion_needed) {
+				features = swab32 (features);
+			}
+		}
+		peer_features_set (instance, memb_join->header.nodeid, features);
+	}
+
 	if (instance->token_ring_id_seq < memb_join->ring_seq) {
 		instance->token_ring_id_seq = memb_join->ring_seq;
 	}
@@ -4935,6 +5425,114 @@ static int message_handler_token_hold_cancel (
 	return (0);
 }
 
+/*
+ * Retransmission record of nodeid for this token rotation, NULL if the table
+ * is full
+ */
+static struct fast_rtr_retx_item *fast_rtr_retx_get (
+	struct totemsrp_instance *instance,
+	unsigned int nodeid)
+{
+	struct fast_rtr_retx_item *item;
+	int i;
+
+	for (i = 0; i < instance->fast_rtr_retx_entries; i++) {
+		if (instance->fast_rtr_retx[i].nodeid == nodeid) {
+			return (&instance->fast_rtr_retx[i]);
+		}
+	}
+
+	if (instance->fast_rtr_retx_entries == PROCESSOR_COUNT_MAX) {
+		return (NULL);
+	}
+
+	item = &instance->fast_rtr_retx[instance->fast_rtr_retx_entries++];
+	item->nodeid = nodeid;
+	item->seq_entries = 0;
+
+	return (item);
+}
+
+/*
+ * Every message is sent at most once per token rotation to a requester and
+ * a requester gets at most RTR_REQUEST_ENTRIES_MAX messages per rotation
+ */
+static int message_handler_rtr_request (
+	struct totemsrp_instance *instance,
+	const void *msg,
+	size_t msg_len,
+	int endian_conversion_needed)
+{
+	const struct rtr_request *rtr_request = msg;
+	struct sort_queue_item *sort_queue_item;
+	struct fast_rtr_retx_item *retx;
+	struct memb_ring_id ring_id;
+	unsigned int seq_entries;
+	unsigned int nodeid;
+	unsigned int seq;
+	unsigned int i, j;
+	void *ptr;
+
+	if (check_rtr_request_sanity(instance, msg, msg_len, endian_conversion_needed) == -1) {
+		return (0);
+	}
+
+	if (!instance->fast_rtr_enabled ||
+	    instance->memb_state != MEMB_STATE_OPERATIONAL) {
+		return (0);
+	}
+
+	nodeid = rtr_request->header.nodeid;
+	ring_id = rtr_request->ring_id;
+	seq_entries = rtr_request->seq_entries;
+	if (endian_conversion_needed) {
+		nodeid = swab32 (nodeid);
+		ring_id.rep = swab32 (ring_id.rep);
+		ring_id.seq = swab64 (ring_id.seq);
+		seq_entries = swab32 (seq_entries);
+	}
+
+	if (memcmp (&ring_id, &instance->my_ring_id,
+		sizeof (struct memb_ring_id)) != 0) {
+
+		return (0);
+	}
+
+	retx = fast_rtr_retx_get (instance, nodeid);
+	if (retx == NULL) {
+		return (0);
+	}
+
+	for (i = 0; i < seq_entries && retx->seq_entries < RTR_REQUEST_ENTRIES_MAX; i++) {
+		seq = rtr_request->seq[i];
+		if (endian_conversion_needed) {
+			seq = swab32 (seq);
+		}
+
+		for (j = 0; j < retx->seq_entries; j++) {
+			if (retx->seq[j] == seq) {
+				break;
+			}
+		}
+		if (j < retx->seq_entries) {
+			continue;
+		}
+
+		if (sq_in_range (&instance->regular_sort_queue, seq) == 0 ||
+		    sq_item_get (&instance->regular_sort_queue, seq, &ptr) != 0) {
+			continue;
+		}
+		sort_queue_item = ptr;
+
+		if (totemnet_ucast_send (instance->totemnet_context,
+		    sort_queue_item->mcast, sort_queue_item->msg_len, nodeid) == 0) {
+			retx->seq[retx->seq_entries++] = seq;
+			instance->stats.mcast_fast_retx++;
+		}
+	}
+	return (0);
+}
+
 static int check_message_header_validity(
 	void *context,
 	const void *msg,
@@ -5049,6 +5647,9 @@ void main_deliver_fn (
 	case MESSAGE_TYPE_TOKEN_HOLD_CANCEL:
 		instance->stats.token_hold_cancel_rx++;
 		break;
+	case MESSAGE_TYPE_RTR_REQUEST:
+		instance->stats.rtr_request_rx++;
+		break;
 	default:
 		log_printf (instance->totemsrp_log_level_security,
 		    "Message received from %s has wrong type...  ignoring %d.\n",
@@ -5104,7 +5705,8 @@ void main_iface_change_fn (
 	totemip_copy (&instance->my_addrs[iface_no], iface_addr);
 
 	if (instance->iface_changes++ == 0) {
-		instance->memb_ring_id_create_or_load (&instance->my_ring_id, instance->my_id.nodeid);
+		instance->memb_ring_id_create_or_load (&instance->my_ring_id,
+			instance->my_id.nodeid, instance->totem_config->lane);
 		/*
 		 * Increase the ring_id sequence number. This doesn't follow specification.
 		 * Solves problem with restarted leader node (node with lowest nodeid) before
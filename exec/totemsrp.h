@@ -80,6 +80,29 @@ int totemsrp_mcast (
 	unsigned int iov_len,
 	int priority);
 
+/**
+ * Multicast a message built in place in a buffer obtained from
+ * totemsrp_mcast_buffer_alloc. The message starts at offset, which must
+ * be at least headroom, and the buffer is queued and retransmitted
+ * without copying. On success totemsrp owns the buffer, on failure it
+ * stays with the caller.
+ */
+void *totemsrp_mcast_buffer_alloc (
+	void *srp_context,
+	size_t *headroom,
+	size_t *size);
+
+void totemsrp_mcast_buffer_release (
+	void *srp_context,
+	void *buffer);
+
+int totemsrp_mcast_buffer (
+	void *srp_context,
+	void *buffer,
+	size_t offset,
+	size_t len,
+	int guarantee);
+
 /**
  * Return number of available messages that can be queued
  */
@@ -66,6 +66,7 @@
 #define LOGSYS_UTILS_ONLY 1
 #include <corosync/logsys.h>
 #include "totemudp.h"
+#include "totemiouring.h"
 
 #include "util.h"
 
@@ -161,6 +162,14 @@ struct totemudp_instance {
 
 	struct totemudp_socket totemudp_sockets;
 
+	/*
+	 * Receive rings of mcast_recv and token sockets when io_engine is
+	 * io_uring, otherwise NULL
+	 */
+	struct totemiouring *mcast_recv_ring;
+
+	struct totemiouring *token_ring;
+
 	struct totem_ip_address mcast_address;
 
 	int stats_sent;
@@ -207,6 +216,16 @@ static int totemudp_build_sockets (
 
 static struct totem_ip_address localhost;
 
+static void socket_recv_start (
+	struct totemudp_instance *instance,
+	int fd,
+	struct totemiouring **ring);
+
+static void socket_recv_stop (
+	struct totemudp_instance *instance,
+	int fd,
+	struct totemiouring **ring);
+
 static void totemudp_instance_initialize (struct totemudp_instance *instance)
 {
 	memset (instance, 0, sizeof (struct totemudp_instance));
@@ -387,8 +406,8 @@ int totemudp_finalize (
 	int res = 0;
 
 	if (instance->totemudp_sockets.mcast_recv > 0) {
-	 	qb_loop_poll_del (instance->totemudp_poll_handle,
-			instance->totemudp_sockets.mcast_recv);
+		socket_recv_stop (instance, instance->totemudp_sockets.mcast_recv,
+			&instance->mcast_recv_ring);
 		close (instance->totemudp_sockets.mcast_recv);
 	}
 	if (instance->totemudp_sockets.mcast_send > 0) {
@@ -401,14 +420,44 @@ int totemudp_finalize (
 		close (instance->totemudp_sockets.local_mcast_loop[1]);
 	}
 	if (instance->totemudp_sockets.token > 0) {
-		qb_loop_poll_del (instance->totemudp_poll_handle,
-			instance->totemudp_sockets.token);
+		socket_recv_stop (instance, instance->totemudp_sockets.token,
+			&instance->token_ring);
 		close (instance->totemudp_sockets.token);
 	}
 
 	return (res);
 }
 
+static void net_deliver_msg (
+	void *data,
+	const void *msg,
+	unsigned int msg_len,
+	const struct sockaddr_storage *system_from,
+	int truncated_packet)
+{
+	struct totemudp_instance *instance = (struct totemudp_instance *)data;
+
+	instance->stats_recv += msg_len;
+
+	if (truncated_packet) {
+		log_printf (instance->totemudp_log_level_error,
+				"Received too big message. This may be because something bad is happening"
+				"on the network (attack?), or you tried join more nodes than corosync is"
+				"compiled with (%u) or bug in the code (bad estimation of "
+				"the UDP_RECEIVE_FRAME_SIZE_MAX). Dropping packet.", PROCESSOR_COUNT_MAX);
+		return ;
+	}
+
+	/*
+	 * Handle incoming message
+	 */
+	instance->totemudp_deliver_fn (
+		instance->context,
+		msg,
+		msg_len,
+		system_from);
+}
+
 /*
  * Only designed to work with a message with one iov
  */
@@ -457,8 +506,6 @@ static int net_deliver_fn (
 	bytes_received = recvmsg (fd, &msg_recv, MSG_NOSIGNAL | MSG_DONTWAIT);
 	if (bytes_received == -1) {
 		return (0);
-	} else {
-		instance->stats_recv += bytes_received;
 	}
 
 	truncated_packet = 0;
@@ -477,28 +524,54 @@ static int net_deliver_fn (
 	}
 #endif
 
-	if (truncated_packet) {
-		log_printf (instance->totemudp_log_level_error,
-				"Received too big message. This may be because something bad is happening"
-				"on the network (attack?), or you tried join more nodes than corosync is"
-				"compiled with (%u) or bug in the code (bad estimation of "
-				"the UDP_RECEIVE_FRAME_SIZE_MAX). Dropping packet.", PROCESSOR_COUNT_MAX);
-		return (0);
+	net_deliver_msg (instance, iovec->iov_base, bytes_received, &system_from,
+		truncated_packet);
+
+	return (0);
+}
+
+/*
+ * mcast_recv and token sockets are received either by totemiouring (io_engine
+ * io_uring), or by one recvmsg per datagram from main loop. Local loop socket
+ * carries only our own messages and always stays on main loop.
+ */
+static void socket_recv_start (
+	struct totemudp_instance *instance,
+	int fd,
+	struct totemiouring **ring)
+{
+	int res;
+
+	if (instance->totem_config->io_engine == TOTEM_IO_ENGINE_IO_URING) {
+		res = totemiouring_recv_create (instance->totemudp_poll_handle,
+			fd, UDP_RECEIVE_FRAME_SIZE_MAX,
+			instance, net_deliver_msg, ring);
+		if (res == 0) {
+			return ;
+		}
+
+		LOGSYS_PERROR (-res, instance->totemudp_log_level_warning,
+			"Can't use io_uring for receiving, falling back to poll");
 	}
 
-	iovec->iov_len = bytes_received;
+	qb_loop_poll_add (instance->totemudp_poll_handle,
+		QB_LOOP_MED,
+		fd,
+		POLLIN, instance, net_deliver_fn);
+}
 
-	/*
-	 * Handle incoming message
-	 */
-	instance->totemudp_deliver_fn (
-		instance->context,
-		iovec->iov_base,
-		iovec->iov_len,
-		&system_from);
+static void socket_recv_stop (
+	struct totemudp_instance *instance,
+	int fd,
+	struct totemiouring **ring)
+{
 
-	iovec->iov_len = UDP_RECEIVE_FRAME_SIZE_MAX;
-	return (0);
+	if (*ring != NULL) {
+		totemiouring_recv_destroy (*ring);
+		*ring = NULL;
+	} else {
+		qb_loop_poll_del (instance->totemudp_poll_handle, fd);
+	}
 }
 
 static int netif_determine (
@@ -563,8 +636,8 @@ static void timer_function_netif_check_timeout (
 	}
 
 	if (instance->totemudp_sockets.mcast_recv > 0) {
-	 	qb_loop_poll_del (instance->totemudp_poll_handle,
-			instance->totemudp_sockets.mcast_recv);
+		socket_recv_stop (instance, instance->totemudp_sockets.mcast_recv,
+			&instance->mcast_recv_ring);
 		close (instance->totemudp_sockets.mcast_recv);
 	}
 	if (instance->totemudp_sockets.mcast_send > 0) {
@@ -577,8 +650,8 @@ static void timer_function_netif_check_timeout (
 		close (instance->totemudp_sockets.local_mcast_loop[1]);
 	}
 	if (instance->totemudp_sockets.token > 0) {
-		qb_loop_poll_del (instance->totemudp_poll_handle,
-			instance->totemudp_sockets.token);
+		socket_recv_stop (instance, instance->totemudp_sockets.token,
+			&instance->token_ring);
 		close (instance->totemudp_sockets.token);
 	}
 
@@ -614,11 +687,8 @@ static void timer_function_netif_check_timeout (
 		&instance->totemudp_sockets,
 		&instance->totem_interface->boundto);
 
-	qb_loop_poll_add (
-		instance->totemudp_poll_handle,
-		QB_LOOP_MED,
-		instance->totemudp_sockets.mcast_recv,
-		POLLIN, instance, net_deliver_fn);
+	socket_recv_start (instance, instance->totemudp_sockets.mcast_recv,
+		&instance->mcast_recv_ring);
 
 	qb_loop_poll_add (
 		instance->totemudp_poll_handle,
@@ -626,11 +696,8 @@ static void timer_function_netif_check_timeout (
 		instance->totemudp_sockets.local_mcast_loop[0],
 		POLLIN, instance, net_deliver_fn);
 
-	qb_loop_poll_add (
-		instance->totemudp_poll_handle,
-		QB_LOOP_MED,
-		instance->totemudp_sockets.token,
-		POLLIN, instance, net_deliver_fn);
+	socket_recv_start (instance, instance->totemudp_sockets.token,
+		&instance->token_ring);
 
 	totemip_copy (&instance->my_id, &instance->totem_interface->boundto);
 
@@ -1259,6 +1326,12 @@ int totemudp_recv_flush (void *udp_context)
 	for (i = 0; i < 2; i++) {
 		sock = -1;
 		if (i == 0) {
+		    if (instance->mcast_recv_ring != NULL) {
+			while (totemiouring_recv_dispatch (instance->mcast_recv_ring, 1) > 0) {
+				/* continue until ring is empty */ ;
+			}
+			continue;
+		    }
 		    sock = instance->totemudp_sockets.mcast_recv;
 		}
 		if (i == 1) {
@@ -1324,6 +1397,57 @@ int totemudp_mcast_noflush_send (
 	return (res);
 }
 
+/*
+ * Only nodes from the nodelist have a known unicast address, without a
+ * nodelist no node is reachable
+ */
+static struct totemudp_member *find_member_by_nodeid (
+	struct totemudp_instance *instance,
+	unsigned int nodeid)
+{
+	struct qb_list_head *list;
+	struct totemudp_member *member;
+
+	qb_list_for_each(list, &(instance->member_list)) {
+		member = qb_list_entry (list,
+			struct totemudp_member,
+			list);
+
+		if (member->member.nodeid == nodeid) {
+			return (member);
+		}
+	}
+	return (NULL);
+}
+
+int totemudp_ucast_send (
+	void *udp_context,
+	const void *msg,
+	unsigned int msg_len,
+	unsigned int nodeid)
+{
+	struct totemudp_instance *instance = (struct totemudp_instance *)udp_context;
+	struct totemudp_member *member;
+
+	member = find_member_by_nodeid (instance, nodeid);
+	if (member == NULL) {
+		return (-1);
+	}
+
+	ucast_sendmsg (instance, &member->member, msg, msg_len);
+
+	return (0);
+}
+
+int totemudp_ucast_reachable (
+	void *udp_context,
+	unsigned int nodeid)
+{
+	struct totemudp_instance *instance = (struct totemudp_instance *)udp_context;
+
+	return (find_member_by_nodeid (instance, nodeid) != NULL);
+}
+
 extern int totemudp_iface_check (void *udp_context)
 {
 	struct totemudp_instance *instance = (struct totemudp_instance *)udp_context;
@@ -1447,6 +1571,12 @@ extern int totemudp_recv_mcast_empty (
 	for (i = 0; i < 2; i++) {
 		sock = -1;
 		if (i == 0) {
+		    if (instance->mcast_recv_ring != NULL) {
+			if (totemiouring_recv_dispatch (instance->mcast_recv_ring, 0) > 0) {
+				msg_processed = 1;
+			}
+			continue;
+		    }
 		    sock = instance->totemudp_sockets.mcast_recv;
 		}
 		if (i == 1) {
@@ -92,6 +92,16 @@ extern int totemudp_mcast_noflush_send (
 	const void *msg,
 	unsigned int msg_len);
 
+extern int totemudp_ucast_send (
+	void *udp_context,
+	const void *msg,
+	unsigned int msg_len,
+	unsigned int nodeid);
+
+extern int totemudp_ucast_reachable (
+	void *udp_context,
+	unsigned int nodeid);
+
 extern int totemudp_nodestatus_get (void *net_context, unsigned int nodeid,
 				    struct totem_node_status *node_status);
 
@@ -67,6 +67,7 @@
 #define LOGSYS_UTILS_ONLY 1
 #include <corosync/logsys.h>
 #include "totemudpu.h"
+#include "totemiouring.h"
 
 #include "util.h"
 
@@ -82,9 +83,21 @@
 #define BIND_STATE_REGULAR	1
 #define BIND_STATE_LOOPBACK	2
 
+/*
+ * Number of buckets of member address and nodeid hashes (must be power of 2)
+ */
+#define MEMBER_HASH_SIZE	256
+
 struct totemudpu_member {
 	struct qb_list_head list;
+	struct qb_list_head addr_hash_list;
+	struct qb_list_head nodeid_hash_list;
 	struct totem_ip_address member;
+	/*
+	 * Member address converted to sockaddr (with port) once in member_add
+	 */
+	struct sockaddr_storage sockaddr;
+	int sockaddr_len;
 	int fd;
 	int active;
 };
@@ -145,6 +158,10 @@ struct totemudpu_instance {
 
 	struct qb_list_head member_list;
 
+	struct qb_list_head member_addr_hash[MEMBER_HASH_SIZE];
+
+	struct qb_list_head member_nodeid_hash[MEMBER_HASH_SIZE];
+
 	int stats_sent;
 
 	int stats_recv;
@@ -171,8 +188,17 @@ struct totemudpu_instance {
 
 	struct totem_ip_address token_target;
 
+	struct sockaddr_storage token_target_sockaddr;
+
+	int token_target_sockaddr_len;
+
 	int token_socket;
 
+	/*
+	 * Receive ring of token_socket when io_engine is io_uring, otherwise NULL
+	 */
+	struct totemiouring *token_ring;
+
 	int local_loop_sock[2];
 
 	qb_loop_timer_handle timer_merge_detect_timeout;
@@ -206,8 +232,14 @@ static void totemudpu_start_merge_detect_timeout(
 static void totemudpu_stop_merge_detect_timeout(
 	void *udpu_context);
 
+static void token_socket_recv_start (struct totemudpu_instance *instance);
+
+static void token_socket_recv_stop (struct totemudpu_instance *instance);
+
 static void totemudpu_instance_initialize (struct totemudpu_instance *instance)
 {
+	int i;
+
 	memset (instance, 0, sizeof (struct totemudpu_instance));
 
 	instance->netif_state_report = NETIF_STATE_REPORT_UP | NETIF_STATE_REPORT_DOWN;
@@ -222,6 +254,37 @@ static void totemudpu_instance_initialize (struct totemudpu_instance *instance)
 	instance->my_memb_entries = 1;
 
 	qb_list_init (&instance->member_list);
+
+	for (i = 0; i < MEMBER_HASH_SIZE; i++) {
+		qb_list_init (&instance->member_addr_hash[i]);
+		qb_list_init (&instance->member_nodeid_hash[i]);
+	}
+}
+
+/*
+ * FNV-1a of address bytes (4 for AF_INET, 16 for AF_INET6)
+ */
+static unsigned int member_addr_hash (int family, const void *addr)
+{
+	const unsigned char *ptr = addr;
+	size_t len;
+	size_t i;
+	uint32_t hash = 2166136261U;
+
+	len = (family == AF_INET6) ? sizeof(struct in6_addr) : sizeof(struct in_addr);
+
+	for (i = 0; i < len; i++) {
+		hash ^= ptr[i];
+		hash *= 16777619U;
+	}
+
+	return (hash & (MEMBER_HASH_SIZE - 1));
+}
+
+static unsigned int member_nodeid_hash (unsigned int nodeid)
+{
+
+	return ((nodeid * 2654435761U) & (MEMBER_HASH_SIZE - 1));
 }
 
 #define log_printf(level, format, args...)		\
@@ -253,15 +316,14 @@ int totemudpu_crypto_set (
 
 static inline void ucast_sendmsg (
 	struct totemudpu_instance *instance,
-	struct totem_ip_address *system_to,
+	struct sockaddr_storage *sockaddr,
+	int addrlen,
 	const void *msg,
 	unsigned int msg_len)
 {
 	struct msghdr msg_ucast;
 	int res = 0;
-	struct sockaddr_storage sockaddr;
 	struct iovec iovec;
-	int addrlen;
 	int send_sock;
 
 	iovec.iov_base = (void *)msg;
@@ -270,10 +332,8 @@ static inline void ucast_sendmsg (
 	/*
 	 * Build unicast message
 	 */
-	totemip_totemip_to_sockaddr_convert(system_to,
-		instance->totem_interface->ip_port, &sockaddr, &addrlen);
 	memset(&msg_ucast, 0, sizeof(msg_ucast));
-	msg_ucast.msg_name = &sockaddr;
+	msg_ucast.msg_name = sockaddr;
 	msg_ucast.msg_namelen = addrlen;
 	msg_ucast.msg_iov = (void *)&iovec;
 	msg_ucast.msg_iovlen = 1;
@@ -322,8 +382,6 @@ static inline void mcast_sendmsg (
 	struct msghdr msg_mcast;
 	int res = 0;
 	struct iovec iovec;
-	struct sockaddr_storage sockaddr;
-	int addrlen;
 	struct qb_list_head *list;
 	struct totemudpu_member *member;
 
@@ -335,6 +393,24 @@ static inline void mcast_sendmsg (
 	 * Build multicast message
 	 */
 	if (instance->netif_bind_state == BIND_STATE_REGULAR) {
+		msg_mcast.msg_iov = (void *)&iovec;
+		msg_mcast.msg_iovlen = 1;
+	#ifdef HAVE_MSGHDR_CONTROL
+		msg_mcast.msg_control = 0;
+	#endif
+	#ifdef HAVE_MSGHDR_CONTROLLEN
+		msg_mcast.msg_controllen = 0;
+	#endif
+	#ifdef HAVE_MSGHDR_FLAGS
+		msg_mcast.msg_flags = 0;
+	#endif
+	#ifdef HAVE_MSGHDR_ACCRIGHTS
+		msg_mcast.msg_accrights = NULL;
+	#endif
+	#ifdef HAVE_MSGHDR_ACCRIGHTSLEN
+		msg_mcast.msg_accrightslen = 0;
+	#endif
+
 		qb_list_for_each(list, &(instance->member_list)) {
 			member = qb_list_entry (list,
 				struct totemudpu_member,
@@ -346,27 +422,8 @@ static inline void mcast_sendmsg (
 				if (only_active && !member->active && !instance->send_merge_detect_message)
 					continue ;
 
-				totemip_totemip_to_sockaddr_convert(&member->member,
-					instance->totem_interface->ip_port, &sockaddr, &addrlen);
-				msg_mcast.msg_name = &sockaddr;
-				msg_mcast.msg_namelen = addrlen;
-				msg_mcast.msg_iov = (void *)&iovec;
-				msg_mcast.msg_iovlen = 1;
-			#ifdef HAVE_MSGHDR_CONTROL
-				msg_mcast.msg_control = 0;
-			#endif
-			#ifdef HAVE_MSGHDR_CONTROLLEN
-				msg_mcast.msg_controllen = 0;
-			#endif
-			#ifdef HAVE_MSGHDR_FLAGS
-				msg_mcast.msg_flags = 0;
-			#endif
-			#ifdef HAVE_MSGHDR_ACCRIGHTS
-				msg_mcast.msg_accrights = NULL;
-			#endif
-			#ifdef HAVE_MSGHDR_ACCRIGHTSLEN
-				msg_mcast.msg_accrightslen = 0;
-			#endif
+				msg_mcast.msg_name = &member->sockaddr;
+				msg_mcast.msg_namelen = member->sockaddr_len;
 
 				/*
 				 * Transmit multicast message
@@ -427,8 +484,7 @@ int totemudpu_finalize (
 	int res = 0;
 
 	if (instance->token_socket > 0) {
-		qb_loop_poll_del (instance->totemudpu_poll_handle,
-			instance->token_socket);
+		token_socket_recv_stop (instance);
 		close (instance->token_socket);
 	}
 
@@ -452,13 +508,25 @@ static struct totemudpu_member *find_member_by_sockaddr(
 	struct totemudpu_member *member;
 	struct totemudpu_member *res_member;
 	const struct totemudpu_instance *instance = (const struct totemudpu_instance *)udpu_context;
+	const void *addr;
 
 	res_member = NULL;
 
-	qb_list_for_each(list, &(instance->member_list)) {
+	switch (sa->sa_family) {
+	case AF_INET:
+		addr = &((const struct sockaddr_in *)sa)->sin_addr;
+		break;
+	case AF_INET6:
+		addr = &((const struct sockaddr_in6 *)sa)->sin6_addr;
+		break;
+	default:
+		return (NULL);
+	}
+
+	qb_list_for_each(list, &(instance->member_addr_hash[member_addr_hash(sa->sa_family, addr)])) {
 		member = qb_list_entry (list,
 			struct totemudpu_member,
-			list);
+			addr_hash_list);
 
 		if (totemip_sa_equal(&member->member, sa)) {
 			res_member = member;
@@ -469,6 +537,64 @@ static struct totemudpu_member *find_member_by_sockaddr(
 	return (res_member);
 }
 
+static struct totemudpu_member *find_member_by_nodeid(
+	const struct totemudpu_instance *instance,
+	unsigned int nodeid)
+{
+	struct qb_list_head *list;
+	struct totemudpu_member *member;
+
+	qb_list_for_each(list, &(instance->member_nodeid_hash[member_nodeid_hash(nodeid)])) {
+		member = qb_list_entry (list,
+			struct totemudpu_member,
+			nodeid_hash_list);
+
+		if (member->member.nodeid == nodeid) {
+			return (member);
+		}
+	}
+
+	return (NULL);
+}
+
+
+static void net_deliver_msg (
+	void *data,
+	const void *msg,
+	unsigned int msg_len,
+	const struct sockaddr_storage *system_from,
+	int truncated_packet)
+{
+	struct totemudpu_instance *instance = (struct totemudpu_instance *)data;
+
+	instance->stats_recv += msg_len;
+
+	if (truncated_packet) {
+		log_printf (instance->totemudpu_log_level_error,
+				"Received too big message. This may be because something bad is happening"
+				"on the network (attack?), or you tried join more nodes than corosync is"
+				"compiled with (%u) or bug in the code (bad estimation of "
+				"the UDP_RECEIVE_FRAME_SIZE_MAX). Dropping packet.", PROCESSOR_COUNT_MAX);
+		return ;
+	}
+
+	if (instance->totem_config->block_unlisted_ips &&
+	    find_member_by_sockaddr(instance, (const struct sockaddr *)system_from) == NULL) {
+		log_printf(instance->totemudpu_log_level_debug, "Packet rejected from %s",
+		    totemip_sa_print((const struct sockaddr *)system_from));
+
+		return ;
+	}
+
+	/*
+	 * Handle incoming message
+	 */
+	instance->totemudpu_deliver_fn (
+		instance->context,
+		msg,
+		msg_len,
+		system_from);
+}
 
 static int net_deliver_fn (
 	int fd,
@@ -510,8 +636,6 @@ static int net_deliver_fn (
 	bytes_received = recvmsg (fd, &msg_recv, MSG_NOSIGNAL | MSG_DONTWAIT);
 	if (bytes_received == -1) {
 		return (0);
-	} else {
-		instance->stats_recv += bytes_received;
 	}
 
 	truncated_packet = 0;
@@ -530,36 +654,49 @@ static int net_deliver_fn (
 	}
 #endif
 
-	if (truncated_packet) {
-		log_printf (instance->totemudpu_log_level_error,
-				"Received too big message. This may be because something bad is happening"
-				"on the network (attack?), or you tried join more nodes than corosync is"
-				"compiled with (%u) or bug in the code (bad estimation of "
-				"the UDP_RECEIVE_FRAME_SIZE_MAX). Dropping packet.", PROCESSOR_COUNT_MAX);
-		return (0);
-	}
+	net_deliver_msg (instance, iovec->iov_base, bytes_received, &system_from,
+		truncated_packet);
 
-	if (instance->totem_config->block_unlisted_ips &&
-	    find_member_by_sockaddr(instance, (const struct sockaddr *)&system_from) == NULL) {
-		log_printf(instance->totemudpu_log_level_debug, "Packet rejected from %s",
-		    totemip_sa_print((const struct sockaddr *)&system_from));
+	return (0);
+}
 
-		return (0);
+/*
+ * Token socket receives all traffic of the node. With io_engine io_uring it
+ * is received by totemiouring and delivered in batches, otherwise (or when
+ * io_uring is not available) one recvmsg per datagram is done from main loop.
+ */
+static void token_socket_recv_start (struct totemudpu_instance *instance)
+{
+	int res;
+
+	if (instance->totem_config->io_engine == TOTEM_IO_ENGINE_IO_URING) {
+		res = totemiouring_recv_create (instance->totemudpu_poll_handle,
+			instance->token_socket, UDP_RECEIVE_FRAME_SIZE_MAX,
+			instance, net_deliver_msg, &instance->token_ring);
+		if (res == 0) {
+			return ;
+		}
+
+		LOGSYS_PERROR (-res, instance->totemudpu_log_level_warning,
+			"Can't use io_uring for receiving, falling back to poll");
 	}
 
-	iovec->iov_len = bytes_received;
+	qb_loop_poll_add (instance->totemudpu_poll_handle,
+		QB_LOOP_MED,
+		instance->token_socket,
+		POLLIN, instance, net_deliver_fn);
+}
 
-	/*
-	 * Handle incoming message
-	 */
-	instance->totemudpu_deliver_fn (
-		instance->context,
-		iovec->iov_base,
-		iovec->iov_len,
-		&system_from);
+static void token_socket_recv_stop (struct totemudpu_instance *instance)
+{
 
-	iovec->iov_len = UDP_RECEIVE_FRAME_SIZE_MAX;
-	return (0);
+	if (instance->token_ring != NULL) {
+		totemiouring_recv_destroy (instance->token_ring);
+		instance->token_ring = NULL;
+	} else {
+		qb_loop_poll_del (instance->totemudpu_poll_handle,
+			instance->token_socket);
+	}
 }
 
 static int netif_determine (
@@ -623,8 +760,7 @@ static void timer_function_netif_check_timeout (
 	}
 
 	if (instance->token_socket > 0) {
-		qb_loop_poll_del (instance->totemudpu_poll_handle,
-			instance->token_socket);
+		token_socket_recv_stop (instance);
 		close (instance->token_socket);
 		instance->token_socket = -1;
 	}
@@ -665,10 +801,7 @@ static void timer_function_netif_check_timeout (
 		&instance->totem_interface->boundto);
 
 	if (instance->netif_bind_state == BIND_STATE_REGULAR) {
-		qb_loop_poll_add (instance->totemudpu_poll_handle,
-			QB_LOOP_MED,
-			instance->token_socket,
-			POLLIN, instance, net_deliver_fn);
+		token_socket_recv_start (instance);
 	}
 
 	totemip_copy (&instance->my_id, &instance->totem_interface->boundto);
@@ -800,10 +933,10 @@ int totemudpu_nodestatus_get (void *udpu_context, unsigned int nodeid,
 	struct qb_list_head *list;
 	struct totemudpu_member *member;
 
-	qb_list_for_each(list, &(instance->member_list)) {
+	qb_list_for_each(list, &(instance->member_nodeid_hash[member_nodeid_hash(nodeid)])) {
 		member = qb_list_entry (list,
 			struct totemudpu_member,
-			list);
+			nodeid_hash_list);
 
 		if (member->member.nodeid == nodeid) {
 			node_status->nodeid = nodeid;
@@ -1099,7 +1232,8 @@ int totemudpu_token_send (
 	struct totemudpu_instance *instance = (struct totemudpu_instance *)udpu_context;
 	int res = 0;
 
-	ucast_sendmsg (instance, &instance->token_target, msg, msg_len);
+	ucast_sendmsg (instance, &instance->token_target_sockaddr,
+		instance->token_target_sockaddr_len, msg, msg_len);
 
 	return (res);
 }
@@ -1129,6 +1263,35 @@ int totemudpu_mcast_noflush_send (
 	return (res);
 }
 
+int totemudpu_ucast_send (
+	void *udpu_context,
+	const void *msg,
+	unsigned int msg_len,
+	unsigned int nodeid)
+{
+	struct totemudpu_instance *instance = (struct totemudpu_instance *)udpu_context;
+	struct totemudpu_member *member;
+
+	member = find_member_by_nodeid(instance, nodeid);
+	if (member == NULL) {
+		return (-1);
+	}
+
+	ucast_sendmsg (instance, &member->sockaddr, member->sockaddr_len,
+		msg, msg_len);
+
+	return (0);
+}
+
+int totemudpu_ucast_reachable (
+	void *udpu_context,
+	unsigned int nodeid)
+{
+	struct totemudpu_instance *instance = (struct totemudpu_instance *)udpu_context;
+
+	return (find_member_by_nodeid(instance, nodeid) != NULL);
+}
+
 extern int totemudpu_iface_check (void *udpu_context)
 {
 	struct totemudpu_instance *instance = (struct totemudpu_instance *)udpu_context;
@@ -1151,22 +1314,18 @@ int totemudpu_token_target_set (
 {
 
 	struct totemudpu_instance *instance = (struct totemudpu_instance *)udpu_context;
-	struct qb_list_head *list;
 	struct totemudpu_member *member;
 	int res = 0;
 
-	qb_list_for_each(list, &(instance->member_list)) {
-		member = qb_list_entry (list,
-			struct totemudpu_member,
-			list);
+	member = find_member_by_nodeid(instance, nodeid);
+	if (member != NULL) {
+		memcpy (&instance->token_target, &member->member,
+			sizeof (struct totem_ip_address));
+		memcpy (&instance->token_target_sockaddr, &member->sockaddr,
+			sizeof (struct sockaddr_storage));
+		instance->token_target_sockaddr_len = member->sockaddr_len;
 
-		if (member->member.nodeid == nodeid) {
-			memcpy (&instance->token_target, &member->member,
-				sizeof (struct totem_ip_address));
-
-			instance->totemudpu_target_set_completed (instance->context);
-			break;
-		}
+		instance->totemudpu_target_set_completed (instance->context);
 	}
 	return (res);
 }
@@ -1209,11 +1368,18 @@ extern int totemudpu_recv_mcast_empty (
 	for (i = 0; i < 2; i++) {
 		sock = -1;
 		if (i == 0) {
-			if (instance->netif_bind_state == BIND_STATE_REGULAR) {
-				sock = instance->token_socket;
-			} else {
+			if (instance->netif_bind_state != BIND_STATE_REGULAR) {
 				continue;
 			}
+
+			if (instance->token_ring != NULL) {
+				if (totemiouring_recv_dispatch (instance->token_ring, 0) > 0) {
+					msg_processed = 1;
+				}
+				continue;
+			}
+
+			sock = instance->token_socket;
 		}
 		if (i == 1) {
 			sock = instance->local_loop_sock[0];
@@ -1327,7 +1493,15 @@ int totemudpu_member_add (
 		totemip_print(member));
 	qb_list_init (&new_member->list);
 	qb_list_add_tail (&new_member->list, &instance->member_list);
+	qb_list_init (&new_member->addr_hash_list);
+	qb_list_add_tail (&new_member->addr_hash_list,
+		&instance->member_addr_hash[member_addr_hash(member->family, member->addr)]);
+	qb_list_init (&new_member->nodeid_hash_list);
+	qb_list_add_tail (&new_member->nodeid_hash_list,
+		&instance->member_nodeid_hash[member_nodeid_hash(member->nodeid)]);
 	memcpy (&new_member->member, member, sizeof (struct totem_ip_address));
+	totemip_totemip_to_sockaddr_convert(&new_member->member,
+		instance->totem_interface->ip_port, &new_member->sockaddr, &new_member->sockaddr_len);
 	new_member->fd = totemudpu_create_sending_socket(udpu_context, member);
 	new_member->active = 1;
 
@@ -1348,10 +1522,11 @@ int totemudpu_member_remove (
 	/*
 	 * Find the member to remove and close its socket
 	 */
-	qb_list_for_each(list, &(instance->member_list)) {
+	qb_list_for_each(list, &(instance->member_addr_hash[member_addr_hash(token_target->family,
+	    token_target->addr)])) {
 		member = qb_list_entry (list,
 			struct totemudpu_member,
-			list);
+			addr_hash_list);
 
 		if (totemip_compare (token_target, &member->member)==0) {
 			log_printf(LOGSYS_LEVEL_NOTICE,
@@ -1372,10 +1547,13 @@ int totemudpu_member_remove (
 	}
 
 	/*
-	 * Delete the member from the list
+	 * Delete the member from the list and hashes
 	 */
 	if (found) {
-		qb_list_del (list);
+		qb_list_del (&member->list);
+		qb_list_del (&member->addr_hash_list);
+		qb_list_del (&member->nodeid_hash_list);
+		free (member);
 	}
 
 	instance = NULL;
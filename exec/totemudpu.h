@@ -92,6 +92,16 @@ extern int totemudpu_mcast_noflush_send (
 	const void *msg,
 	unsigned int msg_len);
 
+extern int totemudpu_ucast_send (
+	void *udpu_context,
+	const void *msg,
+	unsigned int msg_len,
+	unsigned int nodeid);
+
+extern int totemudpu_ucast_reachable (
+	void *udpu_context,
+	unsigned int nodeid);
+
 extern int totemudpu_nodestatus_get (void *net_context, unsigned int nodeid,
 				    struct totem_node_status *node_status);
 
@@ -188,6 +188,7 @@ struct cluster_node {
 	uint32_t    expected_votes;
 	uint32_t    flags;
 	struct      qb_list_head list;
+	struct      qb_list_head dead_list;
 };
 
 /*
@@ -205,6 +206,8 @@ static struct cluster_node *us;
 static struct qb_list_head cluster_members_list;
 static unsigned int quorum_members[PROCESSOR_COUNT_MAX];
 static unsigned int previous_quorum_members[PROCESSOR_COUNT_MAX];
+static unsigned int quorum_members_sorted[PROCESSOR_COUNT_MAX];
+static unsigned int previous_quorum_members_sorted[PROCESSOR_COUNT_MAX];
 static unsigned int atb_nodelist[PROCESSOR_COUNT_MAX];
 static int quorum_members_entries = 0;
 static int previous_quorum_members_entries = 0;
@@ -217,6 +220,28 @@ static struct memb_ring_id quorum_ringid;
 static struct cluster_node cluster_nodes[PROCESSOR_COUNT_MAX+2];
 static int cluster_nodes_entries = 0;
 
+/*
+ * nodes on cluster_members_list indexed by nodeid (open addressing),
+ * dead ones are also kept in age order for reuse once the pool is exhausted
+ */
+#define NODE_HASH_SIZE 1024
+
+static struct cluster_node *node_hash[NODE_HASH_SIZE];
+static struct qb_list_head dead_nodes_list;
+
+/*
+ * running totals over the NODESTATE_MEMBER nodes of cluster_members_list
+ * (us included, qdevice excluded). members_stale is set when the node
+ * holding the max expected_votes or the lowest/highest nodeid goes away
+ * and those have to be recomputed on next use.
+ */
+static uint32_t members_votes = 0;
+static uint32_t members_count = 0;
+static uint32_t members_expected_max = 0;
+static int members_lowest_id = 0;
+static int members_highest_id = 0;
+static int members_stale = 0;
+
 /*
  * votequorum tracking
  */
@@ -432,25 +457,204 @@ static struct default_service votequorum_service[] = {
 
 #define max(a,b) (((a) > (b)) ? (a) : (b))
 
-static void node_add_ordered(struct cluster_node *newnode)
+static unsigned int node_hash_slot(unsigned int nodeid)
 {
-	struct cluster_node *node = NULL;
+	return ((nodeid * 2654435761U) & (NODE_HASH_SIZE - 1));
+}
+
+static void node_hash_add(struct cluster_node *node)
+{
+	unsigned int slot = node_hash_slot(node->node_id);
+
+	while (node_hash[slot] != NULL) {
+		slot = (slot + 1) & (NODE_HASH_SIZE - 1);
+	}
+	node_hash[slot] = node;
+}
+
+static void node_hash_del(struct cluster_node *node)
+{
+	unsigned int slot = node_hash_slot(node->node_id);
+	unsigned int next;
+	unsigned int home;
+
+	while (node_hash[slot] != node) {
+		slot = (slot + 1) & (NODE_HASH_SIZE - 1);
+	}
+
+	/*
+	 * Move back the entries following the hole which would otherwise
+	 * become unreachable, so lookups can stop at the first empty slot
+	 */
+	next = slot;
+	for (;;) {
+		next = (next + 1) & (NODE_HASH_SIZE - 1);
+		if (node_hash[next] == NULL) {
+			break;
+		}
+		home = node_hash_slot(node_hash[next]->node_id);
+		if (((next - home) & (NODE_HASH_SIZE - 1)) >=
+		    ((next - slot) & (NODE_HASH_SIZE - 1))) {
+			node_hash[slot] = node_hash[next];
+			slot = next;
+		}
+	}
+	node_hash[slot] = NULL;
+}
+
+static struct cluster_node *node_hash_find(unsigned int nodeid)
+{
+	unsigned int slot = node_hash_slot(nodeid);
+
+	while (node_hash[slot] != NULL) {
+		if (node_hash[slot]->node_id == nodeid) {
+			return node_hash[slot];
+		}
+		slot = (slot + 1) & (NODE_HASH_SIZE - 1);
+	}
+	return NULL;
+}
+
+/*
+ * Walk the members to recompute what members_remove() could not
+ */
+static void members_refresh(void)
+{
+	struct cluster_node *node;
 	struct qb_list_head *tmp;
 
-	ENTER();
+	members_expected_max = 0;
+	members_lowest_id = 0;
+	members_highest_id = 0;
 
 	qb_list_for_each(tmp, &cluster_members_list) {
 		node = qb_list_entry(tmp, struct cluster_node, list);
-		if (newnode->node_id < node->node_id) {
-			break;
+		if (node->state != NODESTATE_MEMBER) {
+			continue;
+		}
+		members_expected_max = max(members_expected_max, node->expected_votes);
+		if (members_lowest_id == 0 || node->node_id < members_lowest_id) {
+			members_lowest_id = node->node_id;
+		}
+		if (members_highest_id == 0 || node->node_id > members_highest_id) {
+			members_highest_id = node->node_id;
 		}
 	}
+	members_stale = 0;
+}
 
-	if (!node) {
-		qb_list_add(&newnode->list, &cluster_members_list);
-	} else {
-		qb_list_add_tail(&newnode->list, &node->list);
+static void members_add(struct cluster_node *node)
+{
+	members_votes += node->votes;
+	members_count++;
+
+	if (members_count == 1) {
+		members_expected_max = node->expected_votes;
+		members_lowest_id = node->node_id;
+		members_highest_id = node->node_id;
+		members_stale = 0;
+	} else if (!members_stale) {
+		members_expected_max = max(members_expected_max, node->expected_votes);
+		if (node->node_id < members_lowest_id) {
+			members_lowest_id = node->node_id;
+		}
+		if (node->node_id > members_highest_id) {
+			members_highest_id = node->node_id;
+		}
+	}
+}
+
+static void members_remove(struct cluster_node *node)
+{
+	members_votes -= node->votes;
+	members_count--;
+
+	if ((node->expected_votes == members_expected_max) ||
+	    (node->node_id == members_lowest_id) ||
+	    (node->node_id == members_highest_id)) {
+		members_stale = 1;
+	}
+}
+
+/*
+ * Every change of state, votes or expected_votes of a node on
+ * cluster_members_list goes through these so the members_* totals
+ * stay right
+ */
+static void node_state_set(struct cluster_node *node, nodestate_t state)
+{
+	if (node->state == state) {
+		return;
+	}
+
+	if (node != qdevice) {
+		if (node->state == NODESTATE_MEMBER) {
+			members_remove(node);
+		}
+		if (node->state == NODESTATE_DEAD) {
+			qb_list_del(&node->dead_list);
+		}
+	}
+
+	node->state = state;
+
+	if (node != qdevice) {
+		if (node->state == NODESTATE_MEMBER) {
+			members_add(node);
+		}
+		if (node->state == NODESTATE_DEAD) {
+			qb_list_add_tail(&node->dead_list, &dead_nodes_list);
+		}
+	}
+}
+
+static void node_votes_set(struct cluster_node *node, uint32_t votes)
+{
+	if ((node != qdevice) && (node->state == NODESTATE_MEMBER)) {
+		members_votes = members_votes - node->votes + votes;
+	}
+	node->votes = votes;
+}
+
+static void node_expected_votes_set(struct cluster_node *node, uint32_t expected_votes)
+{
+	if ((node != qdevice) && (node->state == NODESTATE_MEMBER) && (!members_stale)) {
+		if (expected_votes > members_expected_max) {
+			members_expected_max = expected_votes;
+		} else if (node->expected_votes == members_expected_max) {
+			members_stale = 1;
+		}
 	}
+	node->expected_votes = expected_votes;
+}
+
+static uint32_t members_expected_max_get(void)
+{
+	if (members_stale) {
+		members_refresh();
+	}
+	return members_expected_max;
+}
+
+static void node_add_ordered(struct cluster_node *newnode)
+{
+	struct cluster_node *node;
+	struct qb_list_head *tmp;
+
+	ENTER();
+
+	/*
+	 * Nodes mostly show up in nodeid order, so look from the tail
+	 */
+	qb_list_for_each_reverse(tmp, &cluster_members_list) {
+		node = qb_list_entry(tmp, struct cluster_node, list);
+		if (node->node_id < newnode->node_id) {
+			qb_list_add(&newnode->list, &node->list);
+			LEAVE();
+			return;
+		}
+	}
+	qb_list_add(&newnode->list, &cluster_members_list);
 
 	LEAVE();
 }
@@ -458,7 +662,6 @@ static void node_add_ordered(struct cluster_node *newnode)
 static struct cluster_node *allocate_node(unsigned int nodeid)
 {
 	struct cluster_node *cl = NULL;
-	struct qb_list_head *tmp;
 
 	ENTER();
 
@@ -466,26 +669,24 @@ static struct cluster_node *allocate_node(unsigned int nodeid)
 		cl = (struct cluster_node *)&cluster_nodes[cluster_nodes_entries];
 		cluster_nodes_entries++;
 	} else {
-		qb_list_for_each(tmp, &cluster_members_list) {
-			cl = qb_list_entry(tmp, struct cluster_node, list);
-			if (cl->state == NODESTATE_DEAD) {
-				break;
-			}
-		}
 		/*
 		 * this should never happen
 		 */
-		if (!cl) {
+		if (qb_list_empty(&dead_nodes_list)) {
 			log_printf(LOGSYS_LEVEL_CRIT, "Unable to find memory for node " CS_PRI_NODE_ID " data!!", nodeid);
 			goto out;
 		}
-		qb_list_del(tmp);
+		cl = qb_list_first_entry(&dead_nodes_list, struct cluster_node, dead_list);
+		qb_list_del(&cl->dead_list);
+		qb_list_del(&cl->list);
+		node_hash_del(cl);
 	}
 
 	memset(cl, 0, sizeof(struct cluster_node));
 	cl->node_id = nodeid;
 	if (nodeid != VOTEQUORUM_QDEVICE_NODEID) {
 		node_add_ordered(cl);
+		node_hash_add(cl);
 	}
 
 out:
@@ -497,7 +698,6 @@ out:
 static struct cluster_node *find_node_by_nodeid(unsigned int nodeid)
 {
 	struct cluster_node *node;
-	struct qb_list_head *tmp;
 
 	ENTER();
 
@@ -511,32 +711,24 @@ static struct cluster_node *find_node_by_nodeid(unsigned int nodeid)
 		return qdevice;
 	}
 
-	qb_list_for_each(tmp, &cluster_members_list) {
-		node = qb_list_entry(tmp, struct cluster_node, list);
-		if (node->node_id == nodeid) {
-			LEAVE();
-			return node;
-		}
-	}
+	node = node_hash_find(nodeid);
 
 	LEAVE();
-	return NULL;
+	return node;
 }
 
 static void get_lowest_node_id(void)
 {
-	struct cluster_node *node = NULL;
-	struct qb_list_head *tmp;
-
 	ENTER();
 
 	lowest_node_id = us->node_id;
 
-	qb_list_for_each(tmp, &cluster_members_list) {
-		node = qb_list_entry(tmp, struct cluster_node, list);
-		if ((node->state == NODESTATE_MEMBER) &&
-		    (node->node_id < lowest_node_id)) {
-			lowest_node_id = node->node_id;
+	if (members_count) {
+		if (members_stale) {
+			members_refresh();
+		}
+		if (members_lowest_id < lowest_node_id) {
+			lowest_node_id = members_lowest_id;
 		}
 	}
 	log_printf(LOGSYS_LEVEL_DEBUG, "lowest node id: " CS_PRI_NODE_ID " us: " CS_PRI_NODE_ID, lowest_node_id, us->node_id);
@@ -547,18 +739,16 @@ static void get_lowest_node_id(void)
 
 static void get_highest_node_id(void)
 {
-	struct cluster_node *node = NULL;
-	struct qb_list_head *tmp;
-
 	ENTER();
 
 	highest_node_id = us->node_id;
 
-	qb_list_for_each(tmp, &cluster_members_list) {
-		node = qb_list_entry(tmp, struct cluster_node, list);
-		if ((node->state == NODESTATE_MEMBER) &&
-		    (node->node_id > highest_node_id)) {
-			highest_node_id = node->node_id;
+	if (members_count) {
+		if (members_stale) {
+			members_refresh();
+		}
+		if (members_highest_id > highest_node_id) {
+			highest_node_id = members_highest_id;
 		}
 	}
 	log_printf(LOGSYS_LEVEL_DEBUG, "highest node id: " CS_PRI_NODE_ID " us: " CS_PRI_NODE_ID, highest_node_id, us->node_id);
@@ -569,19 +759,13 @@ static void get_highest_node_id(void)
 
 static int check_low_node_id_partition(void)
 {
-	struct cluster_node *node = NULL;
-	struct qb_list_head *tmp;
-	int found = 0;
+	struct cluster_node *node;
+	int found;
 
 	ENTER();
 
-	qb_list_for_each(tmp, &cluster_members_list) {
-		node = qb_list_entry(tmp, struct cluster_node, list);
-		if ((node->state == NODESTATE_MEMBER) &&
-		    (node->node_id == lowest_node_id)) {
-				found = 1;
-		}
-	}
+	node = node_hash_find(lowest_node_id);
+	found = (node != NULL && node->state == NODESTATE_MEMBER);
 
 	LEAVE();
 	return found;
@@ -589,37 +773,39 @@ static int check_low_node_id_partition(void)
 
 static int check_high_node_id_partition(void)
 {
-	struct cluster_node *node = NULL;
-	struct qb_list_head *tmp;
-	int found = 0;
+	struct cluster_node *node;
+	int found;
 
 	ENTER();
 
-	qb_list_for_each(tmp, &cluster_members_list) {
-		node = qb_list_entry(tmp, struct cluster_node, list);
-		if ((node->state == NODESTATE_MEMBER) &&
-		    (node->node_id == highest_node_id)) {
-				found = 1;
-		}
-	}
+	node = node_hash_find(highest_node_id);
+	found = (node != NULL && node->state == NODESTATE_MEMBER);
 
 	LEAVE();
 	return found;
 }
 
-static int is_in_nodelist(int nodeid, unsigned int *members, int entries)
+static int nodeid_compare(const void *a, const void *b)
 {
-	int i;
+	unsigned int id_a = *(const unsigned int *)a;
+	unsigned int id_b = *(const unsigned int *)b;
+
+	return ((id_a > id_b) - (id_a < id_b));
+}
+
+/*
+ * members has to be sorted
+ */
+static int is_in_nodelist(unsigned int nodeid, const unsigned int *members, int entries)
+{
+	int res;
+
 	ENTER();
 
-	for (i=0; i<entries; i++) {
-		if (nodeid == members[i]) {
-			LEAVE();
-			return 1;
-		}
-	}
+	res = (bsearch(&nodeid, members, entries, sizeof(unsigned int), nodeid_compare) != NULL);
+
 	LEAVE();
-	return 0;
+	return res;
 }
 
 /*
@@ -656,7 +842,7 @@ static int check_auto_tie_breaker(void)
 
 	/* Assume ATB_LIST, we should never be called for ATB_NONE */
 	for (i=0; i < atb_nodelist_entries; i++) {
-		if (is_in_nodelist(atb_nodelist[i], quorum_members, quorum_members_entries)) {
+		if (is_in_nodelist(atb_nodelist[i], quorum_members_sorted, quorum_members_entries)) {
 			/*
 			 * Node is in our partition, if any of its predecessors are
 			 * in the previous quorum partition then it might be in the
@@ -664,7 +850,7 @@ static int check_auto_tie_breaker(void)
 			 * and so we can't be quorate.
 			 */
 			for (j=0; j<i; j++) {
-				if (is_in_nodelist(atb_nodelist[j], previous_quorum_members, previous_quorum_members_entries)) {
+				if (is_in_nodelist(atb_nodelist[j], previous_quorum_members_sorted, previous_quorum_members_entries)) {
 					log_printf(LOGSYS_LEVEL_DEBUG, "ATB_LIST found node " CS_PRI_NODE_ID " in previous partition but not here, quorum denied", atb_nodelist[j]);
 					LEAVE();
 					return 0;
@@ -905,12 +1091,10 @@ static void update_ev_tracking_barrier(uint32_t ev_t_barrier)
 
 static int calculate_quorum(int allow_decrease, unsigned int max_expected, unsigned int *ret_total_votes)
 {
-	struct qb_list_head *nodelist;
-	struct cluster_node *node;
-	unsigned int total_votes = 0;
-	unsigned int highest_expected = 0;
+	unsigned int total_votes;
+	unsigned int highest_expected;
 	unsigned int newquorum, q1, q2;
-	unsigned int total_nodes = 0;
+	unsigned int total_nodes;
 
 	ENTER();
 
@@ -918,18 +1102,12 @@ static int calculate_quorum(int allow_decrease, unsigned int max_expected, unsig
 		max_expected = max(ev_barrier, max_expected);
 	}
 
-	qb_list_for_each(nodelist, &cluster_members_list) {
-		node = qb_list_entry(nodelist, struct cluster_node, list);
+	highest_expected = members_expected_max_get();
+	total_votes = members_votes;
+	total_nodes = members_count;
 
-		log_printf(LOGSYS_LEVEL_DEBUG, "node " CS_PRI_NODE_ID " state=%d, votes=%u, expected=%u",
-			   node->node_id, node->state, node->votes, node->expected_votes);
-
-		if (node->state == NODESTATE_MEMBER) {
-			highest_expected = max(highest_expected, node->expected_votes);
-			total_votes += node->votes;
-			total_nodes++;
-		}
-	}
+	log_printf(LOGSYS_LEVEL_DEBUG, "members=%u, votes=%u, highest expected=%u",
+		   total_nodes, total_votes, highest_expected);
 
 	if (us->flags & NODE_FLAGS_QDEVICE_CAST_VOTE) {
 		log_printf(LOGSYS_LEVEL_DEBUG, "node 0 state=1, votes=%u", qdevice->votes);
@@ -986,7 +1164,7 @@ static void update_node_expected_votes(int new_expected_votes)
 			node = qb_list_entry(nodelist, struct cluster_node, list);
 
 			if (node->state == NODESTATE_MEMBER) {
-				node->expected_votes = new_expected_votes;
+				node_expected_votes_set(node, new_expected_votes);
 			}
 		}
 	}
@@ -1075,21 +1253,11 @@ static void are_we_quorate(unsigned int total_votes)
 
 static void get_total_votes(unsigned int *totalvotes, unsigned int *current_members)
 {
-	unsigned int total_votes = 0;
-	unsigned int cluster_members = 0;
-	struct qb_list_head *nodelist;
-	struct cluster_node *node;
+	unsigned int total_votes = members_votes;
+	unsigned int cluster_members = members_count;
 
 	ENTER();
 
-	qb_list_for_each(nodelist, &cluster_members_list) {
-		node = qb_list_entry(nodelist, struct cluster_node, list);
-		if (node->state == NODESTATE_MEMBER) {
-			cluster_members++;
-			total_votes += node->votes;
-		}
-	}
-
 	if (qdevice->votes) {
 		total_votes += qdevice->votes;
 		cluster_members++;
@@ -1122,7 +1290,7 @@ static void recalculate_quorum(int allow_decrease, int by_current_nodes)
 	 */
 	log_printf(LOGSYS_LEVEL_DEBUG, "total_votes=%d, expected_votes=%d", total_votes, us->expected_votes);
 	if (total_votes > us->expected_votes) {
-		us->expected_votes = total_votes;
+		node_expected_votes_set(us, total_votes);
 		votequorum_exec_send_expectedvotes_notification();
 	}
 
@@ -1521,15 +1689,16 @@ static char *votequorum_readconfig(int runtime)
 	}
 
 	if (have_nodelist) {
-		us->votes = node_votes;
-		us->expected_votes = node_expected_votes;
+		node_votes_set(us, node_votes);
+		node_expected_votes_set(us, node_expected_votes);
 	} else {
-		us->votes = 1;
-		(void)icmap_get_uint32("quorum.votes", &us->votes);
+		node_votes = 1;
+		(void)icmap_get_uint32("quorum.votes", &node_votes);
+		node_votes_set(us, node_votes);
 	}
 
 	if (expected_votes) {
-		us->expected_votes = expected_votes;
+		node_expected_votes_set(us, expected_votes);
 	}
 
 	/*
@@ -2133,11 +2302,11 @@ static void message_handler_req_exec_votequorum_nodeinfo (
 
 	/* Update node state */
 	node->flags = req_exec_quorum_nodeinfo->flags;
-	node->votes = req_exec_quorum_nodeinfo->votes;
-	node->state = NODESTATE_MEMBER;
+	node_votes_set(node, req_exec_quorum_nodeinfo->votes);
+	node_state_set(node, NODESTATE_MEMBER);
 
 	if (node->flags & NODE_FLAGS_LEAVING) {
-		node->state = NODESTATE_LEAVING;
+		node_state_set(node, NODESTATE_LEAVING);
 		allow_downgrade = 1;
 		by_node = 1;
 	}
@@ -2145,13 +2314,13 @@ static void message_handler_req_exec_votequorum_nodeinfo (
 	if ((!cluster_is_quorate) &&
 	    (node->flags & NODE_FLAGS_QUORATE)) {
 		allow_downgrade = 1;
-		us->expected_votes = req_exec_quorum_nodeinfo->expected_votes;
+		node_expected_votes_set(us, req_exec_quorum_nodeinfo->expected_votes);
 	}
 
 	if (node->flags & NODE_FLAGS_QUORATE || (ev_tracking)) {
-		node->expected_votes = req_exec_quorum_nodeinfo->expected_votes;
+		node_expected_votes_set(node, req_exec_quorum_nodeinfo->expected_votes);
 	} else {
-		node->expected_votes = us->expected_votes;
+		node_expected_votes_set(node, us->expected_votes);
 	}
 
 	if ((last_man_standing) && (node->votes > 1)) {
@@ -2215,7 +2384,7 @@ static void message_handler_req_exec_votequorum_reconfigure (
 		votequorum_exec_send_expectedvotes_notification();
 		update_ev_barrier(req_exec_quorum_reconfigure->value);
 		if (ev_tracking) {
-		    us->expected_votes = max(us->expected_votes, ev_tracking_barrier);
+		    node_expected_votes_set(us, max(us->expected_votes, ev_tracking_barrier));
 		}
 		recalculate_quorum(1, 0);  /* Allow decrease */
 		break;
@@ -2226,7 +2395,7 @@ static void message_handler_req_exec_votequorum_reconfigure (
 			LEAVE();
 			return;
 		}
-		node->votes = req_exec_quorum_reconfigure->value;
+		node_votes_set(node, req_exec_quorum_reconfigure->value);
 		recalculate_quorum(1, 0);  /* Allow decrease */
 		break;
 
@@ -2288,6 +2457,7 @@ static char *votequorum_exec_init_fn (struct corosync_api_v1 *api)
 	 * make sure we start clean
 	 */
 	qb_list_init(&cluster_members_list);
+	qb_list_init(&dead_nodes_list);
 	qb_list_init(&trackers_list);
 	qdevice = NULL;
 	us = NULL;
@@ -2315,8 +2485,8 @@ static char *votequorum_exec_init_fn (struct corosync_api_v1 *api)
 
 	icmap_set_uint32("runtime.votequorum.this_node_id", us->node_id);
 
-	us->state = NODESTATE_MEMBER;
-	us->votes = 1;
+	node_state_set(us, NODESTATE_MEMBER);
+	node_votes_set(us, 1);
 	us->flags |= NODE_FLAGS_FIRST;
 
 	error = votequorum_readconfig(VOTEQUORUM_READCONFIG_STARTUP);
@@ -2366,8 +2536,7 @@ static void votequorum_sync_init (
 	const unsigned int *member_list, size_t member_list_entries,
 	const struct memb_ring_id *ring_id)
 {
-	int i, j;
-	int found;
+	int i;
 	int left_nodes;
 	struct cluster_node *node;
 
@@ -2387,19 +2556,16 @@ static void votequorum_sync_init (
 	 * if somebody has left for last_man_standing
 	 */
 	left_nodes = 0;
+	memcpy(previous_quorum_members_sorted, quorum_members_sorted, sizeof(unsigned int) * quorum_members_entries);
+	memcpy(quorum_members_sorted, member_list, sizeof(unsigned int) * member_list_entries);
+	qsort(quorum_members_sorted, member_list_entries, sizeof(unsigned int), nodeid_compare);
+
 	for (i = 0; i < quorum_members_entries; i++) {
-		found = 0;
-		for (j = 0; j < member_list_entries; j++) {
-			if (quorum_members[i] == member_list[j]) {
-				found = 1;
-				break;
-			}
-		}
-		if (found == 0) {
+		if (!is_in_nodelist(quorum_members[i], quorum_members_sorted, member_list_entries)) {
 			left_nodes = 1;
 			node = find_node_by_nodeid(quorum_members[i]);
 			if (node) {
-				node->state = NODESTATE_DEAD;
+				node_state_set(node, NODESTATE_DEAD);
 			}
 		}
 	}
@@ -2508,6 +2674,111 @@ char *votequorum_init(struct corosync_api_v1 *api,
 	return (NULL);
 }
 
+/*
+ * Instance state switching, used by corosync-vqsim to run many votequorum
+ * instances in one process. Every file scope variable that changes at
+ * runtime is listed here. They are always restored to the same address,
+ * so pointers between them (us, qdevice, node lists, node_hash) stay valid.
+ */
+#define VOTEQUORUM_STATE_VAR(var) { &(var), sizeof(var) }
+
+static const struct {
+	void *addr;
+	size_t len;
+} votequorum_state_vars[] = {
+	VOTEQUORUM_STATE_VAR(corosync_api),
+	VOTEQUORUM_STATE_VAR(qdevice_name),
+	VOTEQUORUM_STATE_VAR(qdevice),
+	VOTEQUORUM_STATE_VAR(qdevice_timeout),
+	VOTEQUORUM_STATE_VAR(qdevice_sync_timeout),
+	VOTEQUORUM_STATE_VAR(qdevice_can_operate),
+	VOTEQUORUM_STATE_VAR(qdevice_reg_conn),
+	VOTEQUORUM_STATE_VAR(qdevice_master_wins),
+	VOTEQUORUM_STATE_VAR(two_node),
+	VOTEQUORUM_STATE_VAR(wait_for_all),
+	VOTEQUORUM_STATE_VAR(wait_for_all_status),
+	VOTEQUORUM_STATE_VAR(wait_for_all_autoset),
+	VOTEQUORUM_STATE_VAR(auto_tie_breaker),
+	VOTEQUORUM_STATE_VAR(initial_auto_tie_breaker),
+	VOTEQUORUM_STATE_VAR(lowest_node_id),
+	VOTEQUORUM_STATE_VAR(highest_node_id),
+	VOTEQUORUM_STATE_VAR(last_man_standing),
+	VOTEQUORUM_STATE_VAR(last_man_standing_window),
+	VOTEQUORUM_STATE_VAR(allow_downscale),
+	VOTEQUORUM_STATE_VAR(ev_barrier),
+	VOTEQUORUM_STATE_VAR(ev_tracking),
+	VOTEQUORUM_STATE_VAR(ev_tracking_barrier),
+	VOTEQUORUM_STATE_VAR(ev_tracking_fd),
+	VOTEQUORUM_STATE_VAR(quorum),
+	VOTEQUORUM_STATE_VAR(cluster_is_quorate),
+	VOTEQUORUM_STATE_VAR(us),
+	VOTEQUORUM_STATE_VAR(cluster_members_list),
+	VOTEQUORUM_STATE_VAR(quorum_members),
+	VOTEQUORUM_STATE_VAR(previous_quorum_members),
+	VOTEQUORUM_STATE_VAR(quorum_members_sorted),
+	VOTEQUORUM_STATE_VAR(previous_quorum_members_sorted),
+	VOTEQUORUM_STATE_VAR(atb_nodelist),
+	VOTEQUORUM_STATE_VAR(quorum_members_entries),
+	VOTEQUORUM_STATE_VAR(previous_quorum_members_entries),
+	VOTEQUORUM_STATE_VAR(atb_nodelist_entries),
+	VOTEQUORUM_STATE_VAR(quorum_ringid),
+	VOTEQUORUM_STATE_VAR(cluster_nodes),
+	VOTEQUORUM_STATE_VAR(cluster_nodes_entries),
+	VOTEQUORUM_STATE_VAR(node_hash),
+	VOTEQUORUM_STATE_VAR(dead_nodes_list),
+	VOTEQUORUM_STATE_VAR(members_votes),
+	VOTEQUORUM_STATE_VAR(members_count),
+	VOTEQUORUM_STATE_VAR(members_expected_max),
+	VOTEQUORUM_STATE_VAR(members_lowest_id),
+	VOTEQUORUM_STATE_VAR(members_highest_id),
+	VOTEQUORUM_STATE_VAR(members_stale),
+	VOTEQUORUM_STATE_VAR(trackers_list),
+	VOTEQUORUM_STATE_VAR(qdevice_timer),
+	VOTEQUORUM_STATE_VAR(qdevice_timer_set),
+	VOTEQUORUM_STATE_VAR(last_man_standing_timer),
+	VOTEQUORUM_STATE_VAR(last_man_standing_timer_set),
+	VOTEQUORUM_STATE_VAR(sync_nodeinfo_sent),
+	VOTEQUORUM_STATE_VAR(sync_wait_for_poll_or_timeout),
+	VOTEQUORUM_STATE_VAR(sync_in_progress),
+	VOTEQUORUM_STATE_VAR(quorum_callback),
+};
+
+#define VOTEQUORUM_STATE_VARS (sizeof(votequorum_state_vars) / sizeof(votequorum_state_vars[0]))
+
+size_t votequorum_state_size(void)
+{
+	size_t size = 0;
+	int i;
+
+	for (i = 0; i < VOTEQUORUM_STATE_VARS; i++) {
+		size += votequorum_state_vars[i].len;
+	}
+
+	return (size);
+}
+
+void votequorum_state_save(void *state)
+{
+	char *p = state;
+	int i;
+
+	for (i = 0; i < VOTEQUORUM_STATE_VARS; i++) {
+		memcpy(p, votequorum_state_vars[i].addr, votequorum_state_vars[i].len);
+		p += votequorum_state_vars[i].len;
+	}
+}
+
+void votequorum_state_restore(const void *state)
+{
+	const char *p = state;
+	int i;
+
+	for (i = 0; i < VOTEQUORUM_STATE_VARS; i++) {
+		memcpy(votequorum_state_vars[i].addr, p, votequorum_state_vars[i].len);
+		p += votequorum_state_vars[i].len;
+	}
+}
+
 /*
  * Library Handler init/fini
  */
@@ -2747,13 +3018,13 @@ static void message_handler_req_lib_votequorum_setvotes (void *conn, const void
 	 * Check votes is valid
 	 */
 	saved_votes = node->votes;
-	node->votes = req_lib_votequorum_setvotes->votes;
+	node_votes_set(node, req_lib_votequorum_setvotes->votes);
 
 	newquorum = calculate_quorum(1, 0, &total_votes);
 
 	if (newquorum < total_votes / 2 ||
 	    newquorum > total_votes) {
-		node->votes = saved_votes;
+		node_votes_set(node, saved_votes);
 		error = CS_ERR_INVALID_PARAM;
 		goto error_exit;
 	}
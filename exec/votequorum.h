@@ -41,4 +41,14 @@
 char *votequorum_init(struct corosync_api_v1 *api,
 	quorum_set_quorate_fn_t q_set_quorate_fn);
 
+/*
+ * Save/restore the whole votequorum state, for running several
+ * instances in one process (corosync-vqsim)
+ */
+size_t votequorum_state_size(void);
+
+void votequorum_state_save(void *state);
+
+void votequorum_state_restore(const void *state);
+
 #endif /* VOTEQUORUM_H_DEFINED */
@@ -63,6 +63,11 @@ typedef uint64_t cmap_iter_handle_t;
  */
 typedef uint64_t cmap_track_handle_t;
 
+/*
+ * Handle for cmap transaction
+ */
+typedef uint64_t cmap_txn_handle_t;
+
 /*
  * Maximum length of key in cmap
  */
@@ -86,6 +91,16 @@ typedef uint64_t cmap_track_handle_t;
  */
 #define CMAP_TRACK_PREFIX	8
 
+/**
+ * Changes are not sent one by one but collected and sent together once per
+ * corosync main loop iteration, so a config reload or membership change is
+ * delivered as one event. notify_fn is still called for every key, in the
+ * order of changes. Repeated modifications of one key within a batch are
+ * coalesced into one call (with the oldest old_value and the newest
+ * new_value). Like CMAP_TRACK_PREFIX, this value is only used in adding track.
+ */
+#define CMAP_TRACK_BATCH	16
+
 /**
  * Possible types of value. Binary is raw data without trailing zero with given length
  */
@@ -369,6 +384,74 @@ extern cs_error_t cmap_track_add(
  */
 extern cs_error_t cmap_track_delete(cmap_handle_t handle, cmap_track_handle_t track_handle);
 
+/**
+ * Start new transaction. Operations added by cmap_txn_set, cmap_txn_delete and
+ * cmap_txn_compare are only collected locally and sent in one request by
+ * cmap_txn_commit.
+ * @param handle cmap handle
+ * @param txn_handle handle of newly created transaction
+ */
+extern cs_error_t cmap_txn_begin(cmap_handle_t handle, cmap_txn_handle_t *txn_handle);
+
+/**
+ * Add setting of key to transaction. Arguments have same meaning as for cmap_set.
+ * CS_ERR_TOO_BIG is returned if transaction would no longer fit into one request.
+ * @param txn_handle transaction handle
+ * @param key_name name of key
+ * @param value value
+ * @param value_len length of value
+ * @param type type of value
+ */
+extern cs_error_t cmap_txn_set(
+	cmap_txn_handle_t txn_handle,
+	const char *key_name,
+	const void *value,
+	size_t value_len,
+	cmap_value_types_t type);
+
+/**
+ * Add deleting of key to transaction
+ * @param txn_handle transaction handle
+ * @param key_name name of key
+ */
+extern cs_error_t cmap_txn_delete(cmap_txn_handle_t txn_handle, const char *key_name);
+
+/**
+ * Add precondition to transaction. Transaction is applied only if key has given
+ * type and value. When value is NULL, key must not exist.
+ * @param txn_handle transaction handle
+ * @param key_name name of key
+ * @param value expected value or NULL
+ * @param value_len length of value
+ * @param type type of value
+ */
+extern cs_error_t cmap_txn_compare(
+	cmap_txn_handle_t txn_handle,
+	const char *key_name,
+	const void *value,
+	size_t value_len,
+	cmap_value_types_t type);
+
+/**
+ * Send transaction and apply all its operations atomically. Preconditions are
+ * checked first, then all sets and deletes are applied in order of adding. Either all
+ * of them succeed or the map is left unchanged. Trackers added with
+ * CMAP_TRACK_BATCH get all changes of transaction in one event.
+ *
+ * Transaction handle is released in any case.
+ *
+ * @param txn_handle transaction handle
+ * @param failed_op if not NULL, index of operation which failed (precondition
+ *        not met returns CS_ERR_FAILED_OPERATION)
+ */
+extern cs_error_t cmap_txn_commit(cmap_txn_handle_t txn_handle, uint32_t *failed_op);
+
+/**
+ * Release transaction without sending it
+ * @param txn_handle transaction handle
+ */
+extern cs_error_t cmap_txn_abort(cmap_txn_handle_t txn_handle);
+
 /** @} */
 
 #ifdef __cplusplus
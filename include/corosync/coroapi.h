@@ -37,6 +37,7 @@
 #include <config.h>
 
 #include <stdio.h>
+#include <sys/types.h>
 #ifdef HAVE_SYS_UIO_H
 #include <sys/uio.h>
 #endif
@@ -279,6 +280,16 @@ struct corosync_api_v1 {
 	int (*totem_mcast) (const struct iovec *iovec,
 			    unsigned int iov_len, unsigned int guarantee);
 
+	/*
+	 * Like totem_mcast, but ordered on one of totem_lanes_get() lanes.
+	 * Messages of different lanes are not ordered relative to each other.
+	 */
+	int (*totem_mcast_lane) (const struct iovec *iovec,
+			    unsigned int iov_len, unsigned int guarantee,
+			    unsigned int lane);
+
+	unsigned int (*totem_lanes_get) (void);
+
 	int (*totem_ifaces_get) (
 		unsigned int nodeid,
 		unsigned int *interface_ids,
@@ -453,6 +464,7 @@ struct corosync_api_v1 {
 		qb_loop_t * handle,
 		int fd);
 
+	void (*ipc_credentials_get) (void *conn, uid_t *uid, gid_t *gid);
 };
 
 #define SERVICE_ID_MAKE(a,b) ( ((a)<<16) | (b) )
@@ -156,6 +156,20 @@ typedef void (*cpg_deliver_fn_t) (
 	void *msg,
 	size_t msg_len);
 
+/**
+ * @brief The cpg_deliver_fragment_fn_t callback
+ */
+typedef void (*cpg_deliver_fragment_fn_t) (
+	cpg_handle_t handle,
+	const struct cpg_name *group_name,
+	uint32_t nodeid,
+	uint32_t pid,
+	uint64_t msg_id,
+	size_t offset,
+	size_t msg_len,
+	void *fragment,
+	size_t fragment_len);
+
 /**
  * @brief The cpg_confchg_fn_t callback
  */
@@ -191,6 +205,26 @@ typedef struct {
 } cpg_model_data_t;
 
 #define CPG_MODEL_V1_DELIVER_INITIAL_TOTEM_CONF 0x01
+/*
+ * Answer cpg_membership_get and CPG_ITERATION_ONE_GROUP iterations of
+ * joined groups from the confchg callbacks already dispatched, without
+ * asking the executive
+ */
+#define CPG_MODEL_V1_MEMBERSHIP_CACHE 0x02
+/*
+ * Read delivered messages from a ring shared with the other local members
+ * of the group instead of receiving a copy of each
+ */
+#define CPG_MODEL_V1_SHARED_DELIVERY 0x04
+/*
+ * Deliver messages of at least CPG_ZCB_DELIVER_MIN_SIZE bytes in place
+ * from memory shared with the executive. Such a message stays valid after
+ * the deliver callback returns and must be given back with
+ * cpg_zcb_deliver_release.
+ */
+#define CPG_MODEL_V1_ZCB_DELIVERY 0x08
+
+#define CPG_ZCB_DELIVER_MIN_SIZE (64 * 1024)
 
 /**
  * @brief The cpg_model_v1_data_t struct
@@ -331,6 +365,27 @@ cs_error_t cpg_mcast_joined (
 	const struct iovec *iovec,
 	unsigned int iov_len);
 
+/**
+ * @brief Multicast several messages to groups joined with cpg_join.
+ *
+ * Messages are packed into as few requests to the executive as possible
+ * and delivered in the order given, each one as if it was sent with
+ * cpg_mcast_joined.
+ *
+ * @param handle
+ * @param guarantee
+ * @param msgs Array of messages, each iovec entry is one message.
+ * @param msg_count Number of entries in msgs.
+ * @param msgs_sent If not NULL, set to the number of messages sent.  On
+ *                  CS_ERR_TRY_AGAIN the caller should resend from there.
+ */
+cs_error_t cpg_mcast_joined_batch (
+	cpg_handle_t handle,
+	cpg_guarantee_t guarantee,
+	const struct iovec *msgs,
+	unsigned int msg_count,
+	unsigned int *msgs_sent);
+
 /**
  * @brief Get membership information from cpg
  * @param handle
@@ -344,6 +399,23 @@ cs_error_t cpg_membership_get (
 	struct cpg_name *groupName,
 	struct cpg_address *member_list,
 	int *member_list_entries);
+
+/**
+ * @brief Get the membership generation of a joined group
+ *
+ * The generation is incremented for every configuration change of the
+ * group handled by cpg_dispatch, so comparing it with a saved value tells
+ * whether the membership changed.
+ *
+ * @param handle
+ * @param group_name
+ * @param generation
+ * @return CS_ERR_NOT_EXIST if the group is not joined by this handle
+ */
+cs_error_t cpg_membership_generation_get (
+	cpg_handle_t handle,
+	const struct cpg_name *group_name,
+	uint64_t *generation);
 /**
  * @brief cpg_local_get
  * @param handle
@@ -400,6 +472,27 @@ cs_error_t cpg_zcb_mcast_joined (
 	void *msg,
 	size_t msg_len);
 
+/**
+ * @brief cpg_zcb_deliver_release
+ * @param handle
+ * @param msg
+ * @return
+ */
+cs_error_t cpg_zcb_deliver_release (
+	cpg_handle_t handle,
+	void *msg);
+
+/**
+ * @brief Receive messages the sender had to split in fragments as they
+ * arrive instead of reassembled
+ * @param handle
+ * @param deliver_fragment_fn NULL to go back to reassembled delivery
+ * @return
+ */
+cs_error_t cpg_deliver_fragment_callback_set (
+	cpg_handle_t handle,
+	cpg_deliver_fragment_fn_t deliver_fragment_fn);
+
 /**
  * @brief cpg_iteration_initialize
  * @param handle
@@ -122,6 +122,11 @@ typedef struct icmap_map *icmap_map_t;
  */
 typedef qb_map_iter_t *icmap_iter_t;
 
+/**
+ * @brief Snapshot type
+ */
+typedef struct icmap_snapshot *icmap_snapshot_t;
+
 /**
  * @brief Track type
  */
@@ -474,6 +479,51 @@ extern const char *icmap_iter_next(icmap_iter_t iter, size_t *value_len, icmap_v
  */
 extern void icmap_iter_finalize(icmap_iter_t iter);
 
+/**
+ * @brief Take snapshot of all keys with given prefix (NULL for whole map).
+ *
+ * Taking snapshot is cheap (no items are copied). Changes made to map later are
+ * not visible in snapshot, so iteration over it is stable. Snapshot may outlive
+ * the map.
+ *
+ * @param prefix
+ * @return snapshot or NULL on allocation failure
+ */
+extern icmap_snapshot_t icmap_snapshot_create(const char *prefix);
+
+/**
+ * @brief icmap_snapshot_create_r
+ * @param map
+ * @param prefix
+ * @return
+ */
+extern icmap_snapshot_t icmap_snapshot_create_r(const icmap_map_t map, const char *prefix);
+
+/**
+ * @brief Return next item in snapshot (in the same order as icmap_iter_next).
+ *
+ * value_len and type are optional (= can be NULL). Returned key_name is valid
+ * until snapshot is destroyed and it is set to NULL on error.
+ *
+ * @param snapshot
+ * @param key_name
+ * @param value_len
+ * @param type
+ * @return CS_OK, CS_ERR_NO_SECTIONS when iteration is over or CS_ERR_NO_MEMORY
+ *         when snapshot could not be taken
+ */
+extern cs_error_t icmap_snapshot_iter_next(
+	icmap_snapshot_t snapshot,
+	const char **key_name,
+	size_t *value_len,
+	icmap_value_types_t *type);
+
+/**
+ * @brief Destroy snapshot
+ * @param snapshot
+ */
+extern void icmap_snapshot_destroy(icmap_snapshot_t snapshot);
+
 /**
  * @brief Add tracking function for given key_name.
  *
@@ -543,6 +593,26 @@ extern void icmap_convert_name_to_valid_name(char *key_name);
  */
 extern cs_error_t icmap_copy_map(icmap_map_t dst_map, const icmap_map_t src_map);
 
+/**
+ * @brief Statistics of the allocator used for icmap items (shared by all maps)
+ */
+struct icmap_alloc_stats {
+	uint64_t arena_bytes;		/* Bytes held in slab chunks */
+	uint64_t arena_used_bytes;	/* Bytes of slab chunks currently handed out */
+	uint64_t slab_allocs;
+	uint64_t slab_frees;
+	uint64_t large_allocs;		/* Too big for any slab class, malloc'ed */
+	uint64_t large_frees;
+	uint64_t in_place_updates;	/* Values overwritten without new allocation */
+	uint64_t items;
+};
+
+/**
+ * @brief Get statistics of icmap item allocator
+ * @param stats
+ */
+extern void icmap_get_alloc_stats(struct icmap_alloc_stats *stats);
+
 /*
  * Returns length of value of given type, or 0 for string and binary data type
  */
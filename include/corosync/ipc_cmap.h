@@ -53,6 +53,7 @@ enum req_cmap_types {
 	MESSAGE_REQ_CMAP_TRACK_ADD = 7,
 	MESSAGE_REQ_CMAP_TRACK_DELETE = 8,
 	MESSAGE_REQ_CMAP_SET_CURRENT_MAP = 9,
+	MESSAGE_REQ_CMAP_TXN_COMMIT = 10,
 };
 
 /**
@@ -70,6 +71,8 @@ enum res_cmap_types {
 	MESSAGE_RES_CMAP_TRACK_DELETE = 8,
 	MESSAGE_RES_CMAP_NOTIFY_CALLBACK = 9,
 	MESSAGE_RES_CMAP_SET_CURRENT_MAP = 10,
+	MESSAGE_RES_CMAP_NOTIFY_BATCH_CALLBACK = 11,
+	MESSAGE_RES_CMAP_TXN_COMMIT = 12,
 };
 
 enum {
@@ -250,6 +253,46 @@ struct res_lib_cmap_notify_callback {
 	mar_uint8_t new_value[];
 };
 
+/*
+ * Maximum size of one batched notification (items are split into more events
+ * if they don't fit)
+ */
+#define CMAP_NOTIFY_BATCH_MAX_SIZE	(64 * 1024)
+
+/**
+ * @brief The res_lib_cmap_notify_batch_callback struct
+ * sent to trackers added with CMAP_TRACK_BATCH
+ */
+struct res_lib_cmap_notify_batch_callback {
+	struct qb_ipc_response_header header __attribute__((aligned(8)));
+	mar_uint64_t track_inst_handle __attribute__((aligned(8)));
+	mar_uint32_t items __attribute__((aligned(8)));
+	/*
+	 * Followed by items, each of them is res_lib_cmap_notify_batch_item
+	 * padded to 8 bytes
+	 */
+	mar_uint8_t data[] __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The res_lib_cmap_notify_batch_item struct
+ */
+struct res_lib_cmap_notify_batch_item {
+	mar_uint32_t size __attribute__((aligned(8)));
+	mar_int32_t event;
+	mar_uint8_t new_value_type;
+	mar_uint8_t old_value_type;
+	mar_uint16_t key_name_len;
+	mar_uint32_t new_value_len;
+	mar_uint32_t old_value_len;
+	mar_uint32_t reserved;
+	/*
+	 * Followed by key_name (key_name_len bytes plus trailing zero), new value
+	 * and old value
+	 */
+	mar_uint8_t data[];
+};
+
 /**
  * @brief The req_lib_cmap_set_current_map struct
  * used by cmap_initialize_map()
@@ -259,5 +302,52 @@ struct req_lib_cmap_set_current_map {
 	mar_int32_t map __attribute__((aligned(8)));
 };
 
+/*
+ * Operations of transaction
+ */
+enum {
+	CMAP_TXN_OP_SET            = 0,
+	CMAP_TXN_OP_DELETE         = 1,
+	CMAP_TXN_OP_COMPARE        = 2,
+};
+
+/**
+ * @brief The req_lib_cmap_txn_commit struct
+ * used by cmap_txn_commit()
+ */
+struct req_lib_cmap_txn_commit {
+	struct qb_ipc_request_header header __attribute__((aligned(8)));
+	mar_uint32_t ops __attribute__((aligned(8)));
+	/*
+	 * Followed by ops, each of them is req_lib_cmap_txn_op padded to 8 bytes
+	 */
+	mar_uint8_t data[] __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The req_lib_cmap_txn_op struct
+ */
+struct req_lib_cmap_txn_op {
+	mar_uint32_t size __attribute__((aligned(8)));
+	mar_uint8_t op;
+	mar_uint8_t type;
+	mar_uint16_t key_name_len;
+	mar_uint32_t value_len;
+	mar_uint32_t reserved;
+	/*
+	 * Followed by key_name (key_name_len bytes plus trailing zero) and value
+	 * (value_len bytes plus trailing zero). Type 0 in CMAP_TXN_OP_COMPARE
+	 * means key must not exist.
+	 */
+	mar_uint8_t data[];
+};
+
+/**
+ * @brief The res_lib_cmap_txn_commit struct
+ */
+struct res_lib_cmap_txn_commit {
+	struct qb_ipc_response_header header __attribute__((aligned(8)));
+	mar_uint32_t failed_op __attribute__((aligned(8)));
+};
 
 #endif /* IPC_CMAP_H_DEFINED */
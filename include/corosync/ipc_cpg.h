@@ -59,6 +59,11 @@ enum req_cpg_types {
 	MESSAGE_REQ_CPG_ZC_FREE = 10,
 	MESSAGE_REQ_CPG_ZC_EXECUTE = 11,
 	MESSAGE_REQ_CPG_PARTIAL_MCAST = 12,
+	MESSAGE_REQ_CPG_MCAST_BATCH = 13,
+	MESSAGE_REQ_CPG_RING_ATTACH = 14,
+	MESSAGE_REQ_CPG_RING_START = 15,
+	MESSAGE_REQ_CPG_ZCB_DELIVER_ATTACH = 16,
+	MESSAGE_REQ_CPG_ZCB_DELIVER_START = 17,
 };
 
 /**
@@ -84,6 +89,13 @@ enum res_cpg_types {
 	MESSAGE_RES_CPG_ZC_EXECUTE = 16,
 	MESSAGE_RES_CPG_PARTIAL_DELIVER_CALLBACK = 17,
 	MESSAGE_RES_CPG_PARTIAL_SEND = 18,
+	MESSAGE_RES_CPG_MCAST_BATCH = 19,
+	MESSAGE_RES_CPG_RING_ATTACH = 20,
+	MESSAGE_RES_CPG_RING_START = 21,
+	MESSAGE_RES_CPG_RING_DELIVER_CALLBACK = 22,
+	MESSAGE_RES_CPG_ZCB_DELIVER_ATTACH = 23,
+	MESSAGE_RES_CPG_ZCB_DELIVER_START = 24,
+	MESSAGE_RES_CPG_ZCB_DELIVER_CALLBACK = 25,
 };
 
 /**
@@ -320,6 +332,36 @@ struct req_lib_cpg_partial_mcast {
 	mar_uint8_t message[] __attribute__((aligned(8)));
 };
 
+/**
+ * @brief One message of a req_lib_cpg_mcast_batch, entries follow each
+ * other padded to 8 bytes
+ */
+struct req_lib_cpg_mcast_batch_msg {
+	mar_uint32_t msglen __attribute__((aligned(8)));
+	mar_uint8_t message[] __attribute__((aligned(8)));
+};
+
+#define CPG_MCAST_BATCH_MSG_SIZE(msglen) \
+	(sizeof (struct req_lib_cpg_mcast_batch_msg) + (((msglen) + 7) & ~7))
+
+/**
+ * @brief The req_lib_cpg_mcast_batch struct
+ */
+struct req_lib_cpg_mcast_batch {
+	struct qb_ipc_request_header header __attribute__((aligned(8)));
+	mar_uint32_t guarantee __attribute__((aligned(8)));
+	mar_uint32_t msg_count __attribute__((aligned(8)));
+	mar_uint8_t messages[] __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The res_lib_cpg_mcast_batch struct
+ */
+struct res_lib_cpg_mcast_batch {
+	struct qb_ipc_response_header header __attribute__((aligned(8)));
+	mar_uint32_t msgs_sent __attribute__((aligned(8)));
+};
+
 /**
  * @brief The res_lib_cpg_mcast struct
  */
@@ -339,6 +381,152 @@ struct res_lib_cpg_deliver_callback {
 	mar_uint8_t message[] __attribute__((aligned(8)));
 };
 
+/*
+ * Shared delivery ring. The executive keeps one per group and client
+ * uid/gid, writes each delivered message into it once (as a complete
+ * res_lib_cpg_deliver_callback) and sends every local reader a small
+ * res_lib_cpg_ring_deliver_callback pointing at it. A reader stores the
+ * cursor from that event into its slot once the message is consumed, the
+ * executive never overwrites data some reader has not consumed yet.
+ */
+#define CPG_DELIVER_RING_MAGIC			0x43504752
+#define CPG_DELIVER_RING_READERS_MAX		64
+#define CPG_DELIVER_RING_DATA_SIZE		(1024 * 1024)
+
+/**
+ * @brief The cpg_deliver_ring_reader struct
+ */
+struct cpg_deliver_ring_reader {
+	mar_uint64_t cursor __attribute__((aligned(8)));
+	mar_uint8_t pad[56];
+};
+
+/**
+ * @brief The cpg_deliver_ring_header struct
+ */
+struct cpg_deliver_ring_header {
+	mar_uint32_t magic __attribute__((aligned(8)));
+	mar_uint32_t data_offset __attribute__((aligned(8)));
+	mar_uint64_t data_size __attribute__((aligned(8)));
+	struct cpg_deliver_ring_reader readers[CPG_DELIVER_RING_READERS_MAX] __attribute__((aligned(64)));
+};
+
+/**
+ * @brief The req_lib_cpg_ring_attach struct
+ */
+struct req_lib_cpg_ring_attach {
+	struct qb_ipc_request_header header __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The res_lib_cpg_ring_attach struct
+ */
+struct res_lib_cpg_ring_attach {
+	struct qb_ipc_response_header header __attribute__((aligned(8)));
+	mar_uint64_t map_size __attribute__((aligned(8)));
+	mar_uint32_t ring_id __attribute__((aligned(8)));
+	mar_uint32_t reader __attribute__((aligned(8)));
+	char path_to_file[CPG_ZC_PATH_LEN] __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The req_lib_cpg_ring_start struct
+ */
+struct req_lib_cpg_ring_start {
+	struct qb_ipc_request_header header __attribute__((aligned(8)));
+	mar_uint32_t ring_id __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The res_lib_cpg_ring_start struct
+ */
+struct res_lib_cpg_ring_start {
+	struct qb_ipc_response_header header __attribute__((aligned(8)));
+};
+
+/**
+ * Message from another node, stored in the shared delivery ring
+ */
+struct res_lib_cpg_ring_deliver_callback {
+	struct qb_ipc_response_header header __attribute__((aligned(8)));
+	mar_uint32_t ring_id __attribute__((aligned(8)));
+	mar_uint32_t reader __attribute__((aligned(8)));
+	mar_uint64_t offset __attribute__((aligned(8)));
+	mar_uint64_t cursor __attribute__((aligned(8)));
+};
+
+/*
+ * Zero-copy delivery area. The executive keeps one per connection and
+ * writes large messages (complete or reassembled from fragments) into it
+ * as a cpg_zcb_deliver_record followed by the data, then sends a small
+ * res_lib_cpg_zcb_deliver_callback with the offset of the data. The
+ * library hands that memory to the application and sets released once
+ * the application gave it back, the executive reuses the space of
+ * released records in the order they were written.
+ */
+#define CPG_ZCB_DELIVER_MAGIC			0x43505a44
+#define CPG_ZCB_DELIVER_DATA_SIZE		(16 * 1024 * 1024)
+
+/**
+ * @brief The cpg_zcb_deliver_header struct
+ */
+struct cpg_zcb_deliver_header {
+	mar_uint32_t magic __attribute__((aligned(8)));
+	mar_uint32_t data_offset __attribute__((aligned(8)));
+	mar_uint64_t data_size __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The cpg_zcb_deliver_record struct
+ */
+struct cpg_zcb_deliver_record {
+	mar_uint32_t released __attribute__((aligned(8)));
+	mar_uint32_t msglen __attribute__((aligned(8)));
+	mar_uint8_t message[] __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The req_lib_cpg_zcb_deliver_attach struct
+ */
+struct req_lib_cpg_zcb_deliver_attach {
+	struct qb_ipc_request_header header __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The res_lib_cpg_zcb_deliver_attach struct
+ */
+struct res_lib_cpg_zcb_deliver_attach {
+	struct qb_ipc_response_header header __attribute__((aligned(8)));
+	mar_uint64_t map_size __attribute__((aligned(8)));
+	char path_to_file[CPG_ZC_PATH_LEN] __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The req_lib_cpg_zcb_deliver_start struct
+ */
+struct req_lib_cpg_zcb_deliver_start {
+	struct qb_ipc_request_header header __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The res_lib_cpg_zcb_deliver_start struct
+ */
+struct res_lib_cpg_zcb_deliver_start {
+	struct qb_ipc_response_header header __attribute__((aligned(8)));
+};
+
+/**
+ * Message from another node, stored in the zero-copy delivery area
+ */
+struct res_lib_cpg_zcb_deliver_callback {
+	struct qb_ipc_response_header header __attribute__((aligned(8)));
+	mar_cpg_name_t group_name __attribute__((aligned(8)));
+	mar_uint32_t msglen __attribute__((aligned(8)));
+	mar_uint32_t nodeid __attribute__((aligned(8)));
+	mar_uint32_t pid __attribute__((aligned(8)));
+	mar_uint64_t offset __attribute__((aligned(8)));
+};
+
 /**
  * @brief The res_lib_cpg_partial_deliver_callback struct
  */
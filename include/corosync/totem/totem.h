@@ -67,6 +67,11 @@
 /* This must be <= KNET_MAX_LINK */
 #define INTERFACE_MAX		8
 
+/*
+ * Maximum number of lanes (independently ordered totemsrp rings)
+ */
+#define TOTEM_LANES_MAX		8
+
 #define BIND_MAX_RETRIES	10
 #define BIND_RETRIES_INTERVAL	100
 
@@ -142,9 +147,15 @@ enum { TOTEM_LINK_MODE_BYTES = 64 };
 typedef enum {
 	TOTEM_TRANSPORT_UDP = 0,
 	TOTEM_TRANSPORT_UDPU = 1,
-	TOTEM_TRANSPORT_KNET = 2
+	TOTEM_TRANSPORT_KNET = 2,
+	TOTEM_TRANSPORT_LOOP = 3
 } totem_transport_t;
 
+typedef enum {
+	TOTEM_IO_ENGINE_POLL = 0,
+	TOTEM_IO_ENGINE_IO_URING = 1
+} totem_io_engine_t;
+
 #define MEMB_RING_ID
 struct memb_ring_id {
 	unsigned int rep;
@@ -238,19 +249,33 @@ struct totem_config {
 
 	totem_transport_t transport_number;
 
+	totem_io_engine_t io_engine;
+
 	unsigned int miss_count_const;
 
 	enum totem_ip_version_enum ip_version;
 
 	unsigned int block_unlisted_ips;
 
+	unsigned int latency_stats;
+
+	unsigned int token_phase_stats;
+
+	unsigned int fast_retransmit;
+
+	unsigned int lanes;
+
+	unsigned int lane; /* lane of the totemsrp instance using this config */
+
 	void (*totem_memb_ring_id_create_or_load) (
 	    struct memb_ring_id *memb_ring_id,
-	    unsigned int nodeid);
+	    unsigned int nodeid,
+	    unsigned int lane);
 
 	void (*totem_memb_ring_id_store) (
 	    const struct memb_ring_id *memb_ring_id,
-	    unsigned int nodeid);
+	    unsigned int nodeid,
+	    unsigned int lane);
 };
 
 /*
@@ -115,6 +115,23 @@ extern int totempg_groups_mcast_joined (
 	unsigned int iov_len,
 	int guarantee);
 
+/**
+ * Like totempg_groups_mcast_joined, but ordered on lane (see totem.lanes)
+ * instead of lane 0. Messages of different lanes are not ordered relative
+ * to each other.
+ */
+extern int totempg_groups_mcast_joined_lane (
+	void *instance,
+	unsigned int lane,
+	const struct iovec *iovec,
+	unsigned int iov_len,
+	int guarantee);
+
+/**
+ * Number of configured lanes, at least 1
+ */
+extern unsigned int totempg_lanes_get (void);
+
 extern int totempg_groups_joined_reserve (
 	void *instance,
 	const struct iovec *iovec,
@@ -151,6 +168,13 @@ extern int totempg_nodestatus_get (unsigned int nodeid,
 
 extern void* totempg_get_stats (void);
 
+/**
+ * Send timestamp (ns since the Epoch) of the message currently being
+ * delivered or 0 if the sender didn't timestamp it (totem.latency_stats).
+ * Only meaningful when called from a deliver_fn.
+ */
+extern uint64_t totempg_deliver_timestamp_get (void);
+
 void totempg_event_signal (enum totem_event_type type, int value);
 
 extern const char *totempg_ifaces_print (unsigned int nodeid);
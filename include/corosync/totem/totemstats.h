@@ -50,6 +50,33 @@ typedef struct {
 	int backlog_calc;
 } totemsrp_token_stats_t;
 
+/*
+ * Phases of orf token processing timed when totem.token_phase_stats is set
+ */
+enum totemsrp_token_phase {
+	TOTEMSRP_TOKEN_PHASE_HOLD,	/* token received to token sent */
+	TOTEMSRP_TOKEN_PHASE_RTR,	/* retransmissions requested by the token */
+	TOTEMSRP_TOKEN_PHASE_MCAST,	/* new messages multicast */
+	TOTEMSRP_TOKEN_PHASE_DELIVER,	/* delivery to totempg after the token is sent */
+	TOTEMSRP_TOKEN_PHASE_FREE,	/* messages_free */
+	TOTEMSRP_TOKEN_PHASE_CALLBACKS,	/* token received and sent callbacks */
+	TOTEMSRP_TOKEN_PHASE_MAX
+};
+
+/*
+ * Nanoseconds spent in one phase. Bucket n counts the times in
+ * [2^n, 2^(n+1)) ns, bucket 0 also counts 0 ns and the last bucket
+ * everything above.
+ */
+#define TOTEMSRP_TOKEN_PHASE_BUCKETS 32
+
+typedef struct {
+	uint64_t count;
+	uint64_t total;
+	uint64_t max;
+	uint64_t buckets[TOTEMSRP_TOKEN_PHASE_BUCKETS];
+} totemsrp_token_phase_stats_t;
+
 typedef struct {
 	totem_stats_header_t hdr;
 	uint64_t orf_token_tx;
@@ -65,6 +92,9 @@ typedef struct {
 	uint64_t memb_commit_token_rx;
 	uint64_t token_hold_cancel_tx;
 	uint64_t token_hold_cancel_rx;
+	uint64_t rtr_request_tx;
+	uint64_t rtr_request_rx;
+	uint64_t mcast_fast_retx;
 	uint64_t operational_entered;
 	uint64_t operational_token_lost;
 	uint64_t gather_entered;
@@ -89,6 +119,8 @@ typedef struct {
 #define TOTEM_TOKEN_STATS_MAX 100
 	totemsrp_token_stats_t token[TOTEM_TOKEN_STATS_MAX];
 
+	totemsrp_token_phase_stats_t token_phase[TOTEMSRP_TOKEN_PHASE_MAX];
+
 } totemsrp_stats_t;
 
 typedef struct {
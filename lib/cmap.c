@@ -35,6 +35,7 @@
 #include <config.h>
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
@@ -66,10 +67,24 @@ struct cmap_track_inst {
 	cmap_track_handle_t track_handle;
 };
 
+struct cmap_txn_inst {
+	cmap_handle_t handle;
+	uint32_t ops;
+	/*
+	 * Serialized req_lib_cmap_txn_op items
+	 */
+	char *data;
+	size_t data_len;
+	size_t data_alloc;
+};
+
 static void cmap_inst_free (void *inst);
 
+static void cmap_txn_inst_free (void *inst);
+
 DECLARE_HDB_DATABASE(cmap_handle_t_db, cmap_inst_free);
 DECLARE_HDB_DATABASE(cmap_track_handle_t_db,NULL);
+DECLARE_HDB_DATABASE(cmap_txn_handle_t_db, cmap_txn_inst_free);
 
 /*
  * Function prototypes
@@ -83,6 +98,14 @@ static cs_error_t cmap_get_int(
 
 static cs_error_t cmap_adjust_int(cmap_handle_t handle, const char *key_name, int32_t step);
 
+static cs_error_t cmap_txn_add_op(
+	cmap_txn_handle_t txn_handle,
+	uint8_t op,
+	const char *key_name,
+	const void *value,
+	size_t value_len,
+	cmap_value_types_t type);
+
 /*
  * Function implementations
  */
@@ -170,6 +193,12 @@ static void cmap_inst_free (void *inst)
 	qb_ipcc_disconnect(cmap_inst->c);
 }
 
+static void cmap_txn_inst_free (void *inst)
+{
+	struct cmap_txn_inst *cmap_txn_inst = (struct cmap_txn_inst *)inst;
+	free(cmap_txn_inst->data);
+}
+
 cs_error_t cmap_finalize(cmap_handle_t handle)
 {
 	struct cmap_inst *cmap_inst;
@@ -237,6 +266,11 @@ cs_error_t cmap_dispatch (
 	struct qb_ipc_response_header *dispatch_data;
 	char dispatch_buf[IPC_DISPATCH_SIZE];
 	struct res_lib_cmap_notify_callback *res_lib_cmap_notify_callback;
+	struct res_lib_cmap_notify_batch_callback *res_lib_cmap_notify_batch_callback;
+	struct res_lib_cmap_notify_batch_item *batch_item;
+	const char *batch_ptr;
+	const char *batch_end;
+	uint32_t batch_items;
 	struct cmap_track_inst *cmap_track_inst;
 	struct cmap_notify_value old_val;
 	struct cmap_notify_value new_val;
@@ -322,6 +356,57 @@ cs_error_t cmap_dispatch (
 
 			(void)hdb_handle_put(&cmap_track_handle_t_db, res_lib_cmap_notify_callback->track_inst_handle);
 			break;
+		case MESSAGE_RES_CMAP_NOTIFY_BATCH_CALLBACK:
+			res_lib_cmap_notify_batch_callback = (struct res_lib_cmap_notify_batch_callback *)dispatch_data;
+
+			error = hdb_error_to_cs(hdb_handle_get(&cmap_track_handle_t_db,
+					res_lib_cmap_notify_batch_callback->track_inst_handle,
+					(void *)&cmap_track_inst));
+			if (error == CS_ERR_BAD_HANDLE) {
+				/*
+				 * User deleted tracker -> ignore error
+				 */
+				 break;
+			}
+			if (error != CS_OK) {
+				goto error_put;
+			}
+
+			batch_ptr = (const char *)res_lib_cmap_notify_batch_callback->data;
+			batch_end = (const char *)dispatch_data + dispatch_data->size;
+
+			for (batch_items = 0; batch_items < res_lib_cmap_notify_batch_callback->items &&
+			    !cmap_inst->finalize; batch_items++) {
+				batch_item = (struct res_lib_cmap_notify_batch_item *)batch_ptr;
+
+				if (batch_end - batch_ptr < (ptrdiff_t)sizeof(*batch_item) ||
+				    batch_item->size < sizeof(*batch_item) ||
+				    batch_item->size > batch_end - batch_ptr ||
+				    (size_t)batch_item->key_name_len + 1 + batch_item->new_value_len +
+				    batch_item->old_value_len > batch_item->size - sizeof(*batch_item)) {
+					break;
+				}
+
+				new_val.type = batch_item->new_value_type;
+				old_val.type = batch_item->old_value_type;
+				new_val.len = batch_item->new_value_len;
+				old_val.len = batch_item->old_value_len;
+				new_val.data = batch_item->data + batch_item->key_name_len + 1;
+				old_val.data = (((const char *)new_val.data) + new_val.len);
+
+				cmap_track_inst->notify_fn(handle,
+						cmap_track_inst->track_handle,
+						batch_item->event,
+						(char *)batch_item->data,
+						new_val,
+						old_val,
+						cmap_track_inst->user_data);
+
+				batch_ptr += batch_item->size;
+			}
+
+			(void)hdb_handle_put(&cmap_track_handle_t_db, res_lib_cmap_notify_batch_callback->track_inst_handle);
+			break;
 		default:
 			error = CS_ERR_LIBRARY;
 			goto error_put;
@@ -1117,3 +1202,225 @@ error_put:
 
 	return (error);
 }
+
+cs_error_t cmap_txn_begin(cmap_handle_t handle, cmap_txn_handle_t *txn_handle)
+{
+	cs_error_t error;
+	struct cmap_inst *cmap_inst;
+	struct cmap_txn_inst *cmap_txn_inst;
+
+	if (txn_handle == NULL) {
+		return (CS_ERR_INVALID_PARAM);
+	}
+
+	/*
+	 * Only check that handle is valid
+	 */
+	error = hdb_error_to_cs(hdb_handle_get (&cmap_handle_t_db, handle, (void *)&cmap_inst));
+	if (error != CS_OK) {
+		return (error);
+	}
+	(void)hdb_handle_put (&cmap_handle_t_db, handle);
+
+	error = hdb_error_to_cs(hdb_handle_create(&cmap_txn_handle_t_db, sizeof(*cmap_txn_inst), txn_handle));
+	if (error != CS_OK) {
+		return (error);
+	}
+
+	error = hdb_error_to_cs(hdb_handle_get(&cmap_txn_handle_t_db, *txn_handle, (void *)&cmap_txn_inst));
+	if (error != CS_OK) {
+		(void)hdb_handle_destroy(&cmap_txn_handle_t_db, *txn_handle);
+		return (error);
+	}
+
+	memset(cmap_txn_inst, 0, sizeof(*cmap_txn_inst));
+	cmap_txn_inst->handle = handle;
+
+	(void)hdb_handle_put(&cmap_txn_handle_t_db, *txn_handle);
+
+	return (CS_OK);
+}
+
+static cs_error_t cmap_txn_add_op(
+	cmap_txn_handle_t txn_handle,
+	uint8_t op,
+	const char *key_name,
+	const void *value,
+	size_t value_len,
+	cmap_value_types_t type)
+{
+	cs_error_t error;
+	struct cmap_txn_inst *cmap_txn_inst;
+	struct req_lib_cmap_txn_op *txn_op;
+	size_t key_name_len;
+	size_t op_size;
+	size_t new_alloc;
+	char *new_data;
+
+	if (key_name == NULL) {
+		return (CS_ERR_INVALID_PARAM);
+	}
+
+	key_name_len = strlen(key_name);
+	if (key_name_len >= CS_MAX_NAME_LENGTH) {
+		return (CS_ERR_NAME_TOO_LONG);
+	}
+
+	/*
+	 * Op, key with trailing zero and value with trailing zero padded to 8 bytes
+	 */
+	op_size = (sizeof(*txn_op) + key_name_len + 1 + value_len + 1 + 7) & ~((size_t)7);
+
+	error = hdb_error_to_cs(hdb_handle_get(&cmap_txn_handle_t_db, txn_handle, (void *)&cmap_txn_inst));
+	if (error != CS_OK) {
+		return (error);
+	}
+
+	if (value_len > IPC_REQUEST_SIZE ||
+	    cmap_txn_inst->data_len + op_size > IPC_REQUEST_SIZE - sizeof(struct req_lib_cmap_txn_commit)) {
+		error = CS_ERR_TOO_BIG;
+		goto error_put;
+	}
+
+	if (cmap_txn_inst->data_len + op_size > cmap_txn_inst->data_alloc) {
+		new_alloc = (cmap_txn_inst->data_alloc == 0) ? 1024 : cmap_txn_inst->data_alloc;
+		while (new_alloc < cmap_txn_inst->data_len + op_size) {
+			new_alloc *= 2;
+		}
+
+		new_data = realloc(cmap_txn_inst->data, new_alloc);
+		if (new_data == NULL) {
+			error = CS_ERR_NO_MEMORY;
+			goto error_put;
+		}
+		cmap_txn_inst->data = new_data;
+		cmap_txn_inst->data_alloc = new_alloc;
+	}
+
+	txn_op = (struct req_lib_cmap_txn_op *)(cmap_txn_inst->data + cmap_txn_inst->data_len);
+	memset(txn_op, 0, op_size);
+	txn_op->size = op_size;
+	txn_op->op = op;
+	txn_op->type = type;
+	txn_op->key_name_len = key_name_len;
+	txn_op->value_len = value_len;
+	memcpy(txn_op->data, key_name, key_name_len);
+	if (value_len > 0) {
+		memcpy(txn_op->data + key_name_len + 1, value, value_len);
+	}
+
+	cmap_txn_inst->data_len += op_size;
+	cmap_txn_inst->ops++;
+
+error_put:
+	(void)hdb_handle_put(&cmap_txn_handle_t_db, txn_handle);
+
+	return (error);
+}
+
+cs_error_t cmap_txn_set(
+	cmap_txn_handle_t txn_handle,
+	const char *key_name,
+	const void *value,
+	size_t value_len,
+	cmap_value_types_t type)
+{
+
+	if (value == NULL) {
+		return (CS_ERR_INVALID_PARAM);
+	}
+
+	return (cmap_txn_add_op(txn_handle, CMAP_TXN_OP_SET, key_name, value, value_len, type));
+}
+
+cs_error_t cmap_txn_delete(cmap_txn_handle_t txn_handle, const char *key_name)
+{
+
+	return (cmap_txn_add_op(txn_handle, CMAP_TXN_OP_DELETE, key_name, NULL, 0, 0));
+}
+
+cs_error_t cmap_txn_compare(
+	cmap_txn_handle_t txn_handle,
+	const char *key_name,
+	const void *value,
+	size_t value_len,
+	cmap_value_types_t type)
+{
+
+	if (value == NULL) {
+		return (cmap_txn_add_op(txn_handle, CMAP_TXN_OP_COMPARE, key_name, NULL, 0, 0));
+	}
+
+	return (cmap_txn_add_op(txn_handle, CMAP_TXN_OP_COMPARE, key_name, value, value_len, type));
+}
+
+cs_error_t cmap_txn_commit(cmap_txn_handle_t txn_handle, uint32_t *failed_op)
+{
+	cs_error_t error;
+	struct iovec iov[2];
+	struct cmap_inst *cmap_inst;
+	struct cmap_txn_inst *cmap_txn_inst;
+	struct req_lib_cmap_txn_commit req_lib_cmap_txn_commit;
+	struct res_lib_cmap_txn_commit res_lib_cmap_txn_commit;
+
+	error = hdb_error_to_cs(hdb_handle_get(&cmap_txn_handle_t_db, txn_handle, (void *)&cmap_txn_inst));
+	if (error != CS_OK) {
+		return (error);
+	}
+
+	error = hdb_error_to_cs(hdb_handle_get (&cmap_handle_t_db, cmap_txn_inst->handle, (void *)&cmap_inst));
+	if (error != CS_OK) {
+		goto error_txn_put;
+	}
+
+	memset(&req_lib_cmap_txn_commit, 0, sizeof(req_lib_cmap_txn_commit));
+	req_lib_cmap_txn_commit.header.size = sizeof(req_lib_cmap_txn_commit) + cmap_txn_inst->data_len;
+	req_lib_cmap_txn_commit.header.id = MESSAGE_REQ_CMAP_TXN_COMMIT;
+	req_lib_cmap_txn_commit.ops = cmap_txn_inst->ops;
+
+	iov[0].iov_base = (char *)&req_lib_cmap_txn_commit;
+	iov[0].iov_len = sizeof(req_lib_cmap_txn_commit);
+	iov[1].iov_base = cmap_txn_inst->data;
+	iov[1].iov_len = cmap_txn_inst->data_len;
+
+	memset(&res_lib_cmap_txn_commit, 0, sizeof(res_lib_cmap_txn_commit));
+
+	error = qb_to_cs_error(qb_ipcc_sendv_recv(
+		cmap_inst->c,
+		iov,
+		(cmap_txn_inst->data_len > 0 ? 2 : 1),
+		&res_lib_cmap_txn_commit,
+		sizeof (struct res_lib_cmap_txn_commit), CS_IPC_TIMEOUT_MS));
+
+	if (error == CS_OK) {
+		error = res_lib_cmap_txn_commit.header.error;
+
+		if (failed_op != NULL) {
+			*failed_op = res_lib_cmap_txn_commit.failed_op;
+		}
+	}
+
+	(void)hdb_handle_put (&cmap_handle_t_db, cmap_txn_inst->handle);
+
+error_txn_put:
+	(void)hdb_handle_put(&cmap_txn_handle_t_db, txn_handle);
+	(void)hdb_handle_destroy(&cmap_txn_handle_t_db, txn_handle);
+
+	return (error);
+}
+
+cs_error_t cmap_txn_abort(cmap_txn_handle_t txn_handle)
+{
+	cs_error_t error;
+	struct cmap_txn_inst *cmap_txn_inst;
+
+	error = hdb_error_to_cs(hdb_handle_get(&cmap_txn_handle_t_db, txn_handle, (void *)&cmap_txn_inst));
+	if (error != CS_OK) {
+		return (error);
+	}
+
+	(void)hdb_handle_put(&cmap_txn_handle_t_db, txn_handle);
+	(void)hdb_handle_destroy(&cmap_txn_handle_t_db, txn_handle);
+
+	return (CS_OK);
+}
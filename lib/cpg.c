@@ -41,6 +41,7 @@
 #include <config.h>
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -49,8 +50,10 @@
 #include <sys/mman.h>
 #include <sys/uio.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include <qb/qblist.h>
 #include <qb/qbdefs.h>
@@ -75,6 +78,11 @@
  */
 #define MAX_RETRIES 100
 
+/*
+ * Maximum number of messages sent in one cpg_mcast_joined_batch request
+ */
+#define CPG_MCAST_BATCH_MAX 1024
+
 /*
  * ZCB files have following umask (umask is same as used in libqb)
  */
@@ -87,6 +95,52 @@ struct cpg_assembly_data
 	uint32_t pid;
 	char *assembly_buf;
 	uint32_t assembly_buf_ptr;
+	/*
+	 * Callback set when the first fragment was dispatched. If not NULL, all
+	 * fragments are passed to it and assembly_buf is not used.
+	 */
+	cpg_deliver_fragment_fn_t deliver_fragment_fn;
+	uint64_t msg_id;
+	uint32_t msglen;
+};
+
+/*
+ * Membership of a joined group as seen by the last confchg dispatched
+ */
+struct cpg_membership_cache
+{
+	struct qb_list_head list;
+	struct cpg_name group_name;
+	uint64_t generation;
+	int valid;
+	int member_list_entries;
+	struct cpg_address member_list[CPG_MEMBERS_MAX];
+};
+
+/*
+ * Shared delivery ring mapped from the executive
+ */
+struct cpg_deliver_ring_map
+{
+	struct qb_list_head list;
+	uint32_t ring_id;
+	struct cpg_name group_name;
+	int leaving;
+	struct cpg_deliver_ring_header *header;
+	size_t map_size;
+	char *data;
+	uint64_t data_size;
+};
+
+/*
+ * Zero-copy delivery area mapped from the executive
+ */
+struct cpg_zcb_deliver_map
+{
+	struct cpg_zcb_deliver_header *header;
+	size_t map_size;
+	char *data;
+	uint64_t data_size;
 };
 
 struct cpg_inst {
@@ -100,6 +154,13 @@ struct cpg_inst {
 	struct qb_list_head iteration_list_head;
 	uint32_t max_msg_size;
 	struct qb_list_head assembly_list_head;
+	pthread_mutex_t membership_cache_mutex;
+	struct qb_list_head membership_cache_list_head;
+	pthread_mutex_t deliver_ring_mutex;
+	struct qb_list_head deliver_ring_list_head;
+	struct cpg_zcb_deliver_map *zcb_deliver;
+	cpg_deliver_fragment_fn_t deliver_fragment_fn;
+	uint64_t fragment_msg_id;
 };
 static void cpg_inst_free (void *inst);
 
@@ -110,6 +171,11 @@ struct cpg_iteration_instance_t {
 	qb_ipcc_connection_t *conn;
 	hdb_handle_t executive_iteration_handle;
 	struct qb_list_head list;
+	/*
+	 * CPG_ITERATION_ONE_GROUP served from the membership cache
+	 */
+	struct cpg_membership_cache *cached;
+	int cached_pos;
 };
 
 DECLARE_HDB_DATABASE(cpg_iteration_handle_t_db,NULL);
@@ -134,13 +200,483 @@ coroipcc_msg_send_reply_receive (
 static void cpg_iteration_instance_finalize (struct cpg_iteration_instance_t *cpg_iteration_instance)
 {
 	qb_list_del (&cpg_iteration_instance->list);
+	free (cpg_iteration_instance->cached);
 	hdb_handle_destroy (&cpg_iteration_handle_t_db, cpg_iteration_instance->cpg_iteration_handle);
 }
 
+/*
+ * Unlink and unmap the ring, must be called with deliver_ring_mutex held
+ * (or from cpg_inst_free)
+ */
+static void cpg_deliver_ring_map_free (struct cpg_deliver_ring_map *ring_map)
+{
+	qb_list_del (&ring_map->list);
+	munmap (ring_map->header, ring_map->map_size);
+	free (ring_map);
+}
+
 static void cpg_inst_free (void *inst)
 {
 	struct cpg_inst *cpg_inst = (struct cpg_inst *)inst;
+	struct qb_list_head *iter, *tmp_iter;
+	struct cpg_membership_cache *cache;
+	struct cpg_deliver_ring_map *ring_map;
+
 	qb_ipcc_disconnect(cpg_inst->c);
+
+	qb_list_for_each_safe(iter, tmp_iter, &(cpg_inst->membership_cache_list_head)) {
+		cache = qb_list_entry (iter, struct cpg_membership_cache, list);
+		qb_list_del (&cache->list);
+		free (cache);
+	}
+	pthread_mutex_destroy (&cpg_inst->membership_cache_mutex);
+
+	qb_list_for_each_safe(iter, tmp_iter, &(cpg_inst->deliver_ring_list_head)) {
+		ring_map = qb_list_entry (iter, struct cpg_deliver_ring_map, list);
+		cpg_deliver_ring_map_free (ring_map);
+	}
+	pthread_mutex_destroy (&cpg_inst->deliver_ring_mutex);
+
+	if (cpg_inst->zcb_deliver != NULL) {
+		munmap (cpg_inst->zcb_deliver->header, cpg_inst->zcb_deliver->map_size);
+		free (cpg_inst->zcb_deliver);
+	}
+}
+
+static struct cpg_deliver_ring_map *cpg_deliver_ring_map_find (
+	struct cpg_inst *cpg_inst,
+	uint32_t ring_id)
+{
+	struct qb_list_head *iter;
+	struct cpg_deliver_ring_map *ring_map;
+	struct cpg_deliver_ring_map *res = NULL;
+
+	pthread_mutex_lock (&cpg_inst->deliver_ring_mutex);
+	qb_list_for_each(iter, &(cpg_inst->deliver_ring_list_head)) {
+		ring_map = qb_list_entry (iter, struct cpg_deliver_ring_map, list);
+		if (ring_map->ring_id == ring_id) {
+			res = ring_map;
+			break;
+		}
+	}
+	pthread_mutex_unlock (&cpg_inst->deliver_ring_mutex);
+
+	/*
+	 * Maps are only removed by the dispatching thread or when the executive
+	 * has already dropped the ring, so res stays valid
+	 */
+	return (res);
+}
+
+static struct cpg_deliver_ring_map *cpg_deliver_ring_map_add (
+	struct cpg_inst *cpg_inst,
+	uint32_t ring_id,
+	const struct cpg_name *group_name,
+	const char *path,
+	size_t map_size)
+{
+	struct qb_list_head *iter, *tmp_iter;
+	struct cpg_deliver_ring_map *ring_map;
+	struct cpg_deliver_ring_map *old_ring_map;
+	struct cpg_deliver_ring_header *header;
+	void *addr;
+	int fd;
+
+	if (map_size < sizeof (struct cpg_deliver_ring_header)) {
+		return (NULL);
+	}
+
+	fd = open (path, O_RDWR);
+	if (fd == -1) {
+		return (NULL);
+	}
+	addr = mmap (NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+	if (addr == MAP_FAILED) {
+		return (NULL);
+	}
+
+	header = addr;
+	if (header->magic != CPG_DELIVER_RING_MAGIC ||
+	    header->data_offset < sizeof (struct cpg_deliver_ring_header) ||
+	    header->data_offset > map_size ||
+	    header->data_size > map_size - header->data_offset) {
+		munmap (addr, map_size);
+		return (NULL);
+	}
+
+	ring_map = malloc (sizeof (struct cpg_deliver_ring_map));
+	if (ring_map == NULL) {
+		munmap (addr, map_size);
+		return (NULL);
+	}
+	ring_map->ring_id = ring_id;
+	memcpy (&ring_map->group_name, group_name, sizeof (struct cpg_name));
+	ring_map->leaving = 0;
+	ring_map->header = header;
+	ring_map->map_size = map_size;
+	ring_map->data = (char *)addr + header->data_offset;
+	ring_map->data_size = header->data_size;
+
+	pthread_mutex_lock (&cpg_inst->deliver_ring_mutex);
+	/*
+	 * The executive creates a new ring for the group only after all readers
+	 * of the old one are gone, so nothing is left to be read from it
+	 */
+	qb_list_for_each_safe(iter, tmp_iter, &(cpg_inst->deliver_ring_list_head)) {
+		old_ring_map = qb_list_entry (iter, struct cpg_deliver_ring_map, list);
+		if (old_ring_map->group_name.length == group_name->length &&
+		    memcmp (old_ring_map->group_name.value, group_name->value,
+		    group_name->length) == 0) {
+			cpg_deliver_ring_map_free (old_ring_map);
+		}
+	}
+	qb_list_init (&ring_map->list);
+	qb_list_add (&ring_map->list, &cpg_inst->deliver_ring_list_head);
+	pthread_mutex_unlock (&cpg_inst->deliver_ring_mutex);
+
+	return (ring_map);
+}
+
+/*
+ * Mark (leave == 0) or unmap (leave != 0) the ring of the group the process
+ * is leaving. The ring is only unmapped when our own leave is dispatched,
+ * messages announced before it still have to be read from the ring.
+ */
+static void cpg_deliver_ring_map_leave (
+	struct cpg_inst *cpg_inst,
+	const struct cpg_name *group_name,
+	int leave)
+{
+	struct qb_list_head *iter, *tmp_iter;
+	struct cpg_deliver_ring_map *ring_map;
+
+	pthread_mutex_lock (&cpg_inst->deliver_ring_mutex);
+	qb_list_for_each_safe(iter, tmp_iter, &(cpg_inst->deliver_ring_list_head)) {
+		ring_map = qb_list_entry (iter, struct cpg_deliver_ring_map, list);
+		if (ring_map->group_name.length != group_name->length ||
+		    memcmp (ring_map->group_name.value, group_name->value,
+		    group_name->length) != 0) {
+			continue;
+		}
+
+		if (!leave) {
+			ring_map->leaving = 1;
+		} else if (ring_map->leaving) {
+			cpg_deliver_ring_map_free (ring_map);
+		}
+	}
+	pthread_mutex_unlock (&cpg_inst->deliver_ring_mutex);
+}
+
+/*
+ * Map the shared delivery ring of the group just joined. Failure is not
+ * an error, messages are then delivered as ordinary events.
+ */
+static void cpg_deliver_ring_attach (
+	struct cpg_inst *cpg_inst,
+	const struct cpg_name *group_name)
+{
+	struct iovec iov;
+	struct req_lib_cpg_ring_attach req_lib_cpg_ring_attach;
+	struct res_lib_cpg_ring_attach res_lib_cpg_ring_attach;
+	struct req_lib_cpg_ring_start req_lib_cpg_ring_start;
+	struct res_lib_cpg_ring_start res_lib_cpg_ring_start;
+	cs_error_t error;
+	struct cpg_deliver_ring_map *ring_map;
+
+	req_lib_cpg_ring_attach.header.size = sizeof (struct req_lib_cpg_ring_attach);
+	req_lib_cpg_ring_attach.header.id = MESSAGE_REQ_CPG_RING_ATTACH;
+
+	iov.iov_base = (void *)&req_lib_cpg_ring_attach;
+	iov.iov_len = sizeof (struct req_lib_cpg_ring_attach);
+
+	error = coroipcc_msg_send_reply_receive (cpg_inst->c, &iov, 1,
+		&res_lib_cpg_ring_attach, sizeof (struct res_lib_cpg_ring_attach));
+	if (error != CS_OK || res_lib_cpg_ring_attach.header.error != CS_OK) {
+		return;
+	}
+
+	res_lib_cpg_ring_attach.path_to_file[CPG_ZC_PATH_LEN - 1] = '\0';
+	ring_map = cpg_deliver_ring_map_find (cpg_inst, res_lib_cpg_ring_attach.ring_id);
+	if (ring_map != NULL) {
+		/*
+		 * Rejoined before our leave was dispatched, the ring is still in use
+		 */
+		pthread_mutex_lock (&cpg_inst->deliver_ring_mutex);
+		ring_map->leaving = 0;
+		pthread_mutex_unlock (&cpg_inst->deliver_ring_mutex);
+	} else if (cpg_deliver_ring_map_add (cpg_inst, res_lib_cpg_ring_attach.ring_id,
+	    group_name, res_lib_cpg_ring_attach.path_to_file, res_lib_cpg_ring_attach.map_size) == NULL) {
+		return;
+	}
+
+	req_lib_cpg_ring_start.header.size = sizeof (struct req_lib_cpg_ring_start);
+	req_lib_cpg_ring_start.header.id = MESSAGE_REQ_CPG_RING_START;
+	req_lib_cpg_ring_start.ring_id = res_lib_cpg_ring_attach.ring_id;
+
+	iov.iov_base = (void *)&req_lib_cpg_ring_start;
+	iov.iov_len = sizeof (struct req_lib_cpg_ring_start);
+
+	(void)coroipcc_msg_send_reply_receive (cpg_inst->c, &iov, 1,
+		&res_lib_cpg_ring_start, sizeof (struct res_lib_cpg_ring_start));
+}
+
+static struct cpg_zcb_deliver_map *cpg_zcb_deliver_map_create (
+	const char *path,
+	size_t map_size)
+{
+	struct cpg_zcb_deliver_map *zcb_map;
+	struct cpg_zcb_deliver_header *header;
+	void *addr;
+	int fd;
+
+	if (map_size < sizeof (struct cpg_zcb_deliver_header)) {
+		return (NULL);
+	}
+
+	fd = open (path, O_RDWR);
+	if (fd == -1) {
+		return (NULL);
+	}
+	addr = mmap (NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+	if (addr == MAP_FAILED) {
+		return (NULL);
+	}
+
+	header = addr;
+	if (header->magic != CPG_ZCB_DELIVER_MAGIC ||
+	    header->data_offset < sizeof (struct cpg_zcb_deliver_header) ||
+	    header->data_offset > map_size ||
+	    header->data_size > map_size - header->data_offset) {
+		munmap (addr, map_size);
+		return (NULL);
+	}
+
+	zcb_map = malloc (sizeof (struct cpg_zcb_deliver_map));
+	if (zcb_map == NULL) {
+		munmap (addr, map_size);
+		return (NULL);
+	}
+	zcb_map->header = header;
+	zcb_map->map_size = map_size;
+	zcb_map->data = (char *)addr + header->data_offset;
+	zcb_map->data_size = header->data_size;
+
+	return (zcb_map);
+}
+
+/*
+ * Map the zero-copy delivery area of the connection, once. Failure is not
+ * an error, large messages are then delivered as ordinary events.
+ */
+static void cpg_zcb_deliver_attach (struct cpg_inst *cpg_inst)
+{
+	struct iovec iov;
+	struct req_lib_cpg_zcb_deliver_attach req_lib_cpg_zcb_deliver_attach;
+	struct res_lib_cpg_zcb_deliver_attach res_lib_cpg_zcb_deliver_attach;
+	struct req_lib_cpg_zcb_deliver_start req_lib_cpg_zcb_deliver_start;
+	struct res_lib_cpg_zcb_deliver_start res_lib_cpg_zcb_deliver_start;
+	struct cpg_zcb_deliver_map *zcb_map;
+	cs_error_t error;
+
+	if (cpg_inst->zcb_deliver != NULL) {
+		return;
+	}
+
+	req_lib_cpg_zcb_deliver_attach.header.size = sizeof (struct req_lib_cpg_zcb_deliver_attach);
+	req_lib_cpg_zcb_deliver_attach.header.id = MESSAGE_REQ_CPG_ZCB_DELIVER_ATTACH;
+
+	iov.iov_base = (void *)&req_lib_cpg_zcb_deliver_attach;
+	iov.iov_len = sizeof (struct req_lib_cpg_zcb_deliver_attach);
+
+	error = coroipcc_msg_send_reply_receive (cpg_inst->c, &iov, 1,
+		&res_lib_cpg_zcb_deliver_attach, sizeof (struct res_lib_cpg_zcb_deliver_attach));
+	if (error != CS_OK || res_lib_cpg_zcb_deliver_attach.header.error != CS_OK) {
+		return;
+	}
+
+	res_lib_cpg_zcb_deliver_attach.path_to_file[CPG_ZC_PATH_LEN - 1] = '\0';
+	zcb_map = cpg_zcb_deliver_map_create (res_lib_cpg_zcb_deliver_attach.path_to_file,
+		res_lib_cpg_zcb_deliver_attach.map_size);
+	if (zcb_map == NULL) {
+		return;
+	}
+
+	req_lib_cpg_zcb_deliver_start.header.size = sizeof (struct req_lib_cpg_zcb_deliver_start);
+	req_lib_cpg_zcb_deliver_start.header.id = MESSAGE_REQ_CPG_ZCB_DELIVER_START;
+
+	iov.iov_base = (void *)&req_lib_cpg_zcb_deliver_start;
+	iov.iov_len = sizeof (struct req_lib_cpg_zcb_deliver_start);
+
+	error = coroipcc_msg_send_reply_receive (cpg_inst->c, &iov, 1,
+		&res_lib_cpg_zcb_deliver_start, sizeof (struct res_lib_cpg_zcb_deliver_start));
+	if (error != CS_OK || res_lib_cpg_zcb_deliver_start.header.error != CS_OK) {
+		munmap (zcb_map->header, zcb_map->map_size);
+		free (zcb_map);
+		return;
+	}
+
+	cpg_inst->zcb_deliver = zcb_map;
+}
+
+/*
+ * Record holding the message a zero-copy deliver callback points at, NULL
+ * if it doesn't fit the area
+ */
+static struct cpg_zcb_deliver_record *cpg_zcb_deliver_record_get (
+	const struct cpg_zcb_deliver_map *zcb_map,
+	uint64_t offset,
+	uint64_t msglen)
+{
+	const size_t message_offset = offsetof (struct cpg_zcb_deliver_record, message);
+
+	if (offset < message_offset || offset > zcb_map->data_size ||
+	    msglen > zcb_map->data_size - offset ||
+	    ((offset - message_offset) & 7) != 0) {
+		return (NULL);
+	}
+
+	return ((struct cpg_zcb_deliver_record *)(zcb_map->data + offset - message_offset));
+}
+
+/*
+ * Message a ring deliver callback points at, NULL if it doesn't fit the ring
+ */
+static struct res_lib_cpg_deliver_callback *cpg_deliver_ring_record (
+	struct cpg_deliver_ring_map *ring_map,
+	uint64_t offset)
+{
+	struct res_lib_cpg_deliver_callback *res;
+
+	if (offset > ring_map->data_size ||
+	    ring_map->data_size - offset < sizeof (struct res_lib_cpg_deliver_callback)) {
+		return (NULL);
+	}
+
+	res = (struct res_lib_cpg_deliver_callback *)(ring_map->data + offset);
+	if (res->header.size > ring_map->data_size - offset ||
+	    res->header.size < sizeof (struct res_lib_cpg_deliver_callback) ||
+	    res->msglen > res->header.size - sizeof (struct res_lib_cpg_deliver_callback)) {
+		return (NULL);
+	}
+
+	return (res);
+}
+
+/*
+ * Must be called with membership_cache_mutex held
+ */
+static struct cpg_membership_cache *cpg_membership_cache_find (
+	struct cpg_inst *cpg_inst,
+	const struct cpg_name *group_name)
+{
+	struct qb_list_head *iter;
+	struct cpg_membership_cache *cache;
+
+	qb_list_for_each(iter, &(cpg_inst->membership_cache_list_head)) {
+		cache = qb_list_entry (iter, struct cpg_membership_cache, list);
+		if (cache->group_name.length == group_name->length &&
+		    memcmp (cache->group_name.value, group_name->value, group_name->length) == 0) {
+			return (cache);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * The entry is created before the join is sent so no confchg can be missed,
+ * it stays invalid until the first one is dispatched
+ */
+static cs_error_t cpg_membership_cache_add (
+	struct cpg_inst *cpg_inst,
+	const struct cpg_name *group_name)
+{
+	struct cpg_membership_cache *cache;
+	cs_error_t error = CS_OK;
+
+	pthread_mutex_lock (&cpg_inst->membership_cache_mutex);
+	if (cpg_membership_cache_find (cpg_inst, group_name) == NULL) {
+		cache = malloc (sizeof (struct cpg_membership_cache));
+		if (cache == NULL) {
+			error = CS_ERR_NO_MEMORY;
+		} else {
+			memset (cache, 0, sizeof (struct cpg_membership_cache));
+			memcpy (&cache->group_name, group_name, sizeof (struct cpg_name));
+			qb_list_init (&cache->list);
+			qb_list_add (&cache->list, &cpg_inst->membership_cache_list_head);
+		}
+	}
+	pthread_mutex_unlock (&cpg_inst->membership_cache_mutex);
+
+	return (error);
+}
+
+static void cpg_membership_cache_del (
+	struct cpg_inst *cpg_inst,
+	const struct cpg_name *group_name)
+{
+	struct cpg_membership_cache *cache;
+
+	pthread_mutex_lock (&cpg_inst->membership_cache_mutex);
+	cache = cpg_membership_cache_find (cpg_inst, group_name);
+	if (cache != NULL) {
+		qb_list_del (&cache->list);
+		free (cache);
+	}
+	pthread_mutex_unlock (&cpg_inst->membership_cache_mutex);
+}
+
+static void cpg_membership_cache_update (
+	struct cpg_inst *cpg_inst,
+	const struct cpg_name *group_name,
+	const struct cpg_address *member_list,
+	int member_list_entries)
+{
+	struct cpg_membership_cache *cache;
+
+	pthread_mutex_lock (&cpg_inst->membership_cache_mutex);
+	cache = cpg_membership_cache_find (cpg_inst, group_name);
+	if (cache != NULL) {
+		memcpy (cache->member_list, member_list,
+			member_list_entries * sizeof (struct cpg_address));
+		cache->member_list_entries = member_list_entries;
+		cache->valid = 1;
+		cache->generation++;
+	}
+	pthread_mutex_unlock (&cpg_inst->membership_cache_mutex);
+}
+
+/*
+ * Returns a copy of the cached membership when the cache is enabled and
+ * valid for the group, NULL otherwise
+ */
+static struct cpg_membership_cache *cpg_membership_cache_copy (
+	struct cpg_inst *cpg_inst,
+	const struct cpg_name *group_name)
+{
+	struct cpg_membership_cache *cache;
+	struct cpg_membership_cache *copy = NULL;
+
+	if (cpg_inst->model_data.model != CPG_MODEL_V1 ||
+	    (cpg_inst->model_v1_data.flags & CPG_MODEL_V1_MEMBERSHIP_CACHE) == 0) {
+		return (NULL);
+	}
+
+	pthread_mutex_lock (&cpg_inst->membership_cache_mutex);
+	cache = cpg_membership_cache_find (cpg_inst, group_name);
+	if (cache != NULL && cache->valid) {
+		copy = malloc (sizeof (struct cpg_membership_cache));
+		if (copy != NULL) {
+			memcpy (copy, cache, sizeof (struct cpg_membership_cache));
+			qb_list_init (&copy->list);
+		}
+	}
+	pthread_mutex_unlock (&cpg_inst->membership_cache_mutex);
+
+	return (copy);
 }
 
 static void cpg_inst_finalize (struct cpg_inst *cpg_inst, hdb_handle_t handle)
@@ -206,6 +742,14 @@ cs_error_t cpg_model_initialize (
 		goto error_destroy;
 	}
 
+	/*
+	 * Set up first, cpg_inst_free relies on it on the error paths
+	 */
+	pthread_mutex_init(&cpg_inst->membership_cache_mutex, NULL);
+	qb_list_init(&cpg_inst->membership_cache_list_head);
+	pthread_mutex_init(&cpg_inst->deliver_ring_mutex, NULL);
+	qb_list_init(&cpg_inst->deliver_ring_list_head);
+
 	cpg_inst->c = qb_ipcc_connect ("cpg", IPC_REQUEST_SIZE);
 	if (cpg_inst->c == NULL) {
 		error = qb_to_cs_error(-errno);
@@ -216,7 +760,9 @@ cs_error_t cpg_model_initialize (
 		switch (model) {
 		case CPG_MODEL_V1:
 			memcpy (&cpg_inst->model_v1_data, model_data, sizeof (cpg_model_v1_data_t));
-			if ((cpg_inst->model_v1_data.flags & ~(CPG_MODEL_V1_DELIVER_INITIAL_TOTEM_CONF)) != 0) {
+			if ((cpg_inst->model_v1_data.flags & ~(CPG_MODEL_V1_DELIVER_INITIAL_TOTEM_CONF |
+			    CPG_MODEL_V1_MEMBERSHIP_CACHE | CPG_MODEL_V1_SHARED_DELIVERY |
+			    CPG_MODEL_V1_ZCB_DELIVERY)) != 0) {
 				error = CS_ERR_INVALID_PARAM;
 
 				goto error_destroy;
@@ -377,6 +923,10 @@ cs_error_t cpg_dispatch (
 	struct cpg_inst *cpg_inst;
 	struct res_lib_cpg_confchg_callback *res_cpg_confchg_callback;
 	struct res_lib_cpg_deliver_callback *res_cpg_deliver_callback;
+	struct res_lib_cpg_ring_deliver_callback *res_cpg_ring_deliver_callback;
+	struct cpg_deliver_ring_map *ring_map;
+	struct res_lib_cpg_zcb_deliver_callback *res_cpg_zcb_deliver_callback;
+	struct cpg_zcb_deliver_record *zcb_record;
 	struct res_lib_cpg_partial_deliver_callback *res_cpg_partial_deliver_callback;
 	struct res_lib_cpg_totem_confchg_callback *res_cpg_totem_confchg_callback;
 	struct cpg_inst cpg_inst_copy;
@@ -469,6 +1019,81 @@ cs_error_t cpg_dispatch (
 					res_cpg_deliver_callback->msglen);
 				break;
 
+			case MESSAGE_RES_CPG_RING_DELIVER_CALLBACK:
+				res_cpg_ring_deliver_callback = (struct res_lib_cpg_ring_deliver_callback *)dispatch_data;
+
+				ring_map = cpg_deliver_ring_map_find (cpg_inst,
+					res_cpg_ring_deliver_callback->ring_id);
+				if (ring_map == NULL ||
+				    res_cpg_ring_deliver_callback->reader >= CPG_DELIVER_RING_READERS_MAX) {
+					error = CS_ERR_LIBRARY;
+					goto error_put;
+				}
+
+				res_cpg_deliver_callback = cpg_deliver_ring_record (ring_map,
+					res_cpg_ring_deliver_callback->offset);
+				if (res_cpg_deliver_callback == NULL) {
+					error = CS_ERR_LIBRARY;
+					goto error_put;
+				}
+
+				if (cpg_inst_copy.model_v1_data.cpg_deliver_fn != NULL) {
+					marshall_from_mar_cpg_name_t (
+						&group_name,
+						&res_cpg_deliver_callback->group_name);
+
+					cpg_inst_copy.model_v1_data.cpg_deliver_fn (handle,
+						&group_name,
+						res_cpg_deliver_callback->nodeid,
+						res_cpg_deliver_callback->pid,
+						&res_cpg_deliver_callback->message,
+						res_cpg_deliver_callback->msglen);
+				}
+
+				/*
+				 * Message is consumed, the executive may reuse its space
+				 */
+				__sync_synchronize ();
+				ring_map->header->readers[res_cpg_ring_deliver_callback->reader].cursor =
+					res_cpg_ring_deliver_callback->cursor;
+				break;
+
+			case MESSAGE_RES_CPG_ZCB_DELIVER_CALLBACK:
+				res_cpg_zcb_deliver_callback = (struct res_lib_cpg_zcb_deliver_callback *)dispatch_data;
+
+				if (cpg_inst_copy.zcb_deliver == NULL) {
+					error = CS_ERR_LIBRARY;
+					goto error_put;
+				}
+				zcb_record = cpg_zcb_deliver_record_get (cpg_inst_copy.zcb_deliver,
+					res_cpg_zcb_deliver_callback->offset,
+					res_cpg_zcb_deliver_callback->msglen);
+				if (zcb_record == NULL) {
+					error = CS_ERR_LIBRARY;
+					goto error_put;
+				}
+
+				if (cpg_inst_copy.model_v1_data.cpg_deliver_fn == NULL) {
+					zcb_record->released = 1;
+					break;
+				}
+
+				marshall_from_mar_cpg_name_t (
+					&group_name,
+					&res_cpg_zcb_deliver_callback->group_name);
+
+				/*
+				 * The message stays in the area until the application
+				 * calls cpg_zcb_deliver_release
+				 */
+				cpg_inst_copy.model_v1_data.cpg_deliver_fn (handle,
+					&group_name,
+					res_cpg_zcb_deliver_callback->nodeid,
+					res_cpg_zcb_deliver_callback->pid,
+					zcb_record->message,
+					res_cpg_zcb_deliver_callback->msglen);
+				break;
+
 			case MESSAGE_RES_CPG_PARTIAL_DELIVER_CALLBACK:
 				res_cpg_partial_deliver_callback = (struct res_lib_cpg_partial_deliver_callback *)dispatch_data;
 
@@ -510,18 +1135,50 @@ cs_error_t cpg_dispatch (
 
 					assembly_data->nodeid = res_cpg_partial_deliver_callback->nodeid;
 					assembly_data->pid = res_cpg_partial_deliver_callback->pid;
-					assembly_data->assembly_buf = malloc(res_cpg_partial_deliver_callback->msglen);
-					if (!assembly_data->assembly_buf) {
-						free(assembly_data);
-						error = CS_ERR_NO_MEMORY;
-						goto error_put;
+					assembly_data->deliver_fragment_fn = cpg_inst_copy.deliver_fragment_fn;
+					assembly_data->msg_id = ++cpg_inst->fragment_msg_id;
+					assembly_data->msglen = res_cpg_partial_deliver_callback->msglen;
+					assembly_data->assembly_buf = NULL;
+					if (assembly_data->deliver_fragment_fn == NULL) {
+						assembly_data->assembly_buf = malloc(res_cpg_partial_deliver_callback->msglen);
+						if (!assembly_data->assembly_buf) {
+							free(assembly_data);
+							error = CS_ERR_NO_MEMORY;
+							goto error_put;
+						}
 					}
 					assembly_data->assembly_buf_ptr = 0;
 					qb_list_init (&assembly_data->list);
 
 					qb_list_add (&assembly_data->list, &cpg_inst->assembly_list_head);
 				}
-				if (assembly_data) {
+				if (assembly_data &&
+				    res_cpg_partial_deliver_callback->fraglen > assembly_data->msglen - assembly_data->assembly_buf_ptr) {
+					/*
+					 * More data than the sender announced, drop the message
+					 */
+					qb_list_del (&assembly_data->list);
+					free(assembly_data->assembly_buf);
+					free(assembly_data);
+					assembly_data = NULL;
+				}
+				if (assembly_data && assembly_data->deliver_fragment_fn != NULL) {
+					assembly_data->deliver_fragment_fn (handle,
+						&group_name,
+						res_cpg_partial_deliver_callback->nodeid,
+						res_cpg_partial_deliver_callback->pid,
+						assembly_data->msg_id,
+						assembly_data->assembly_buf_ptr,
+						assembly_data->msglen,
+						res_cpg_partial_deliver_callback->message,
+						res_cpg_partial_deliver_callback->fraglen);
+					assembly_data->assembly_buf_ptr += res_cpg_partial_deliver_callback->fraglen;
+
+					if (res_cpg_partial_deliver_callback->type == LIBCPG_PARTIAL_LAST) {
+						qb_list_del (&assembly_data->list);
+						free(assembly_data);
+					}
+				} else if (assembly_data) {
 					memcpy(assembly_data->assembly_buf + assembly_data->assembly_buf_ptr,
 						res_cpg_partial_deliver_callback->message, res_cpg_partial_deliver_callback->fraglen);
 					assembly_data->assembly_buf_ptr += res_cpg_partial_deliver_callback->fraglen;
@@ -542,10 +1199,6 @@ cs_error_t cpg_dispatch (
 				break;
 
 			case MESSAGE_RES_CPG_CONFCHG_CALLBACK:
-				if (cpg_inst_copy.model_v1_data.cpg_confchg_fn == NULL) {
-					break;
-				}
-
 				res_cpg_confchg_callback = (struct res_lib_cpg_confchg_callback *)dispatch_data;
 
 				for (i = 0; i < res_cpg_confchg_callback->member_list_entries; i++) {
@@ -569,14 +1222,27 @@ cs_error_t cpg_dispatch (
 					&group_name,
 					&res_cpg_confchg_callback->group_name);
 
-				cpg_inst_copy.model_v1_data.cpg_confchg_fn (handle,
-					&group_name,
+				cpg_membership_cache_update (cpg_inst, &group_name,
 					member_list,
-					res_cpg_confchg_callback->member_list_entries,
-					left_list,
-					res_cpg_confchg_callback->left_list_entries,
-					joined_list,
-					res_cpg_confchg_callback->joined_list_entries);
+					res_cpg_confchg_callback->member_list_entries);
+
+				for (i = 0; i < res_cpg_confchg_callback->left_list_entries; i++) {
+					if (left_list[i].pid == getpid () &&
+					    left_list[i].reason == CPG_REASON_LEAVE) {
+						cpg_deliver_ring_map_leave (cpg_inst, &group_name, 1);
+					}
+				}
+
+				if (cpg_inst_copy.model_v1_data.cpg_confchg_fn != NULL) {
+					cpg_inst_copy.model_v1_data.cpg_confchg_fn (handle,
+						&group_name,
+						member_list,
+						res_cpg_confchg_callback->member_list_entries,
+						left_list,
+						res_cpg_confchg_callback->left_list_entries,
+						joined_list,
+						res_cpg_confchg_callback->joined_list_entries);
+				}
 
 				/*
 				 * If member left while his partial packet was being assembled, assembly data must be removed from list
@@ -668,7 +1334,9 @@ cs_error_t cpg_join (
 
 	switch (cpg_inst->model_data.model) {
 	case CPG_MODEL_V1:
-		req_lib_cpg_join.flags = cpg_inst->model_v1_data.flags;
+		req_lib_cpg_join.flags = cpg_inst->model_v1_data.flags &
+			~(CPG_MODEL_V1_MEMBERSHIP_CACHE | CPG_MODEL_V1_SHARED_DELIVERY |
+			  CPG_MODEL_V1_ZCB_DELIVERY);
 		break;
 	}
 
@@ -678,17 +1346,38 @@ cs_error_t cpg_join (
 	iov[0].iov_base = (void *)&req_lib_cpg_join;
 	iov[0].iov_len = sizeof (struct req_lib_cpg_join);
 
+	error = cpg_membership_cache_add (cpg_inst, group);
+	if (error != CS_OK) {
+		goto error_exit;
+	}
+
 	do {
 		error = coroipcc_msg_send_reply_receive (cpg_inst->c, iov, 1,
 			&response, sizeof (struct res_lib_cpg_join));
 
 		if (error != CS_OK) {
-			goto error_exit;
+			goto error_cache_del;
 		}
 	} while (response.header.error == CS_ERR_BUSY);
 
 	error = response.header.error;
 
+	if (error == CS_OK && cpg_inst->model_data.model == CPG_MODEL_V1 &&
+	    (cpg_inst->model_v1_data.flags & CPG_MODEL_V1_SHARED_DELIVERY)) {
+		cpg_deliver_ring_attach (cpg_inst, group);
+	}
+	if (error == CS_OK && cpg_inst->model_data.model == CPG_MODEL_V1 &&
+	    (cpg_inst->model_v1_data.flags & CPG_MODEL_V1_ZCB_DELIVERY)) {
+		cpg_zcb_deliver_attach (cpg_inst);
+	}
+
+error_cache_del:
+	/*
+	 * Keep the entry on CS_ERR_EXIST, the group is already joined
+	 */
+	if (error != CS_OK && error != CS_ERR_EXIST) {
+		cpg_membership_cache_del (cpg_inst, group);
+	}
 error_exit:
 	hdb_handle_put (&cpg_handle_t_db, handle);
 
@@ -734,6 +1423,11 @@ cs_error_t cpg_leave (
 
 	error = res_lib_cpg_leave.header.error;
 
+	if (error == CS_OK) {
+		cpg_membership_cache_del (cpg_inst, group);
+		cpg_deliver_ring_map_leave (cpg_inst, group, 0);
+	}
+
 error_exit:
 	hdb_handle_put (&cpg_handle_t_db, handle);
 
@@ -751,6 +1445,7 @@ cs_error_t cpg_membership_get (
 	struct iovec iov;
 	struct req_lib_cpg_membership_get req_lib_cpg_membership_get;
 	struct res_lib_cpg_membership_get res_lib_cpg_membership_get;
+	struct cpg_membership_cache *cached;
 	unsigned int i;
 
 	if (group_name->length > CPG_MAX_NAME_LENGTH) {
@@ -768,6 +1463,15 @@ cs_error_t cpg_membership_get (
 		return (error);
 	}
 
+	cached = cpg_membership_cache_copy (cpg_inst, group_name);
+	if (cached != NULL) {
+		*member_list_entries = cached->member_list_entries;
+		memcpy (member_list, cached->member_list,
+			cached->member_list_entries * sizeof (struct cpg_address));
+		free (cached);
+		goto error_exit;
+	}
+
 	req_lib_cpg_membership_get.header.size = sizeof (struct req_lib_cpg_membership_get);
 	req_lib_cpg_membership_get.header.id = MESSAGE_REQ_CPG_MEMBERSHIP;
 
@@ -803,6 +1507,41 @@ error_exit:
 	return (error);
 }
 
+cs_error_t cpg_membership_generation_get (
+	cpg_handle_t handle,
+	const struct cpg_name *group_name,
+	uint64_t *generation)
+{
+	cs_error_t error;
+	struct cpg_inst *cpg_inst;
+	struct cpg_membership_cache *cache;
+
+	if (group_name->length > CPG_MAX_NAME_LENGTH) {
+		return (CS_ERR_NAME_TOO_LONG);
+	}
+	if (generation == NULL) {
+		return (CS_ERR_INVALID_PARAM);
+	}
+
+	error = hdb_error_to_cs (hdb_handle_get (&cpg_handle_t_db, handle, (void *)&cpg_inst));
+	if (error != CS_OK) {
+		return (error);
+	}
+
+	pthread_mutex_lock (&cpg_inst->membership_cache_mutex);
+	cache = cpg_membership_cache_find (cpg_inst, group_name);
+	if (cache != NULL) {
+		*generation = cache->generation;
+	} else {
+		error = CS_ERR_NOT_EXIST;
+	}
+	pthread_mutex_unlock (&cpg_inst->membership_cache_mutex);
+
+	hdb_handle_put (&cpg_handle_t_db, handle);
+
+	return (error);
+}
+
 cs_error_t cpg_local_get (
 	cpg_handle_t handle,
 	unsigned int *local_nodeid)
@@ -1047,6 +1786,65 @@ error_exit:
 	return (error);
 }
 
+cs_error_t cpg_zcb_deliver_release (
+	cpg_handle_t handle,
+	void *msg)
+{
+	cs_error_t error;
+	struct cpg_inst *cpg_inst;
+	struct cpg_zcb_deliver_record *zcb_record;
+
+	error = hdb_error_to_cs (hdb_handle_get (&cpg_handle_t_db, handle, (void *)&cpg_inst));
+	if (error != CS_OK) {
+		return (error);
+	}
+
+	if (cpg_inst->zcb_deliver == NULL || (char *)msg < cpg_inst->zcb_deliver->data ||
+	    (char *)msg >= cpg_inst->zcb_deliver->data + cpg_inst->zcb_deliver->data_size) {
+		error = CS_ERR_NOT_EXIST;
+		goto error_put;
+	}
+
+	zcb_record = cpg_zcb_deliver_record_get (cpg_inst->zcb_deliver,
+		(char *)msg - cpg_inst->zcb_deliver->data, 0);
+	if (zcb_record == NULL) {
+		error = CS_ERR_NOT_EXIST;
+		goto error_put;
+	}
+
+	/*
+	 * Done with the message, the executive may reuse its space
+	 */
+	__sync_synchronize ();
+	zcb_record->released = 1;
+
+error_put:
+	hdb_handle_put (&cpg_handle_t_db, handle);
+	return (error);
+}
+
+cs_error_t cpg_deliver_fragment_callback_set (
+	cpg_handle_t handle,
+	cpg_deliver_fragment_fn_t deliver_fragment_fn)
+{
+	cs_error_t error;
+	struct cpg_inst *cpg_inst;
+
+	error = hdb_error_to_cs (hdb_handle_get (&cpg_handle_t_db, handle, (void *)&cpg_inst));
+	if (error != CS_OK) {
+		return (error);
+	}
+
+	/*
+	 * Messages already being reassembled are still delivered whole
+	 */
+	cpg_inst->deliver_fragment_fn = deliver_fragment_fn;
+
+	hdb_handle_put (&cpg_handle_t_db, handle);
+
+	return (CS_OK);
+}
+
 cs_error_t cpg_zcb_mcast_joined (
 	cpg_handle_t handle,
 	cpg_guarantee_t guarantee,
@@ -1237,6 +2035,122 @@ error_exit:
 	return (error);
 }
 
+cs_error_t cpg_mcast_joined_batch (
+	cpg_handle_t handle,
+	cpg_guarantee_t guarantee,
+	const struct iovec *msgs,
+	unsigned int msg_count,
+	unsigned int *msgs_sent)
+{
+	static const char pad[8];
+	cs_error_t error;
+	struct cpg_inst *cpg_inst;
+	struct iovec *iov = NULL;
+	struct req_lib_cpg_mcast_batch req_lib_cpg_mcast_batch;
+	struct req_lib_cpg_mcast_batch_msg *batch_msgs = NULL;
+	struct res_lib_cpg_mcast_batch res_lib_cpg_mcast_batch;
+	unsigned int sent = 0;
+	unsigned int count;
+	unsigned int iov_len;
+	size_t msg_len;
+	size_t size;
+
+	if (msgs_sent) {
+		*msgs_sent = 0;
+	}
+	if (msgs == NULL && msg_count > 0) {
+		return (CS_ERR_INVALID_PARAM);
+	}
+
+	error = hdb_error_to_cs (hdb_handle_get (&cpg_handle_t_db, handle, (void *)&cpg_inst));
+	if (error != CS_OK) {
+		return (error);
+	}
+
+	/*
+	 * Every message takes its header, its data and maybe some padding
+	 */
+	iov = malloc ((CPG_MCAST_BATCH_MAX * 3 + 1) * sizeof (struct iovec));
+	batch_msgs = malloc (CPG_MCAST_BATCH_MAX * sizeof (struct req_lib_cpg_mcast_batch_msg));
+	if (iov == NULL || batch_msgs == NULL) {
+		error = CS_ERR_NO_MEMORY;
+		goto error_exit;
+	}
+
+	while (error == CS_OK && sent < msg_count) {
+		/*
+		 * Messages too big for a request go out on their own, in order
+		 */
+		if (msgs[sent].iov_len > cpg_inst->max_msg_size) {
+			error = send_fragments (cpg_inst, guarantee, msgs[sent].iov_len,
+				&msgs[sent], 1);
+			if (error == CS_OK) {
+				sent++;
+			}
+			continue;
+		}
+
+		size = sizeof (struct req_lib_cpg_mcast_batch);
+		iov_len = 1;
+		for (count = 0; sent + count < msg_count && count < CPG_MCAST_BATCH_MAX; count++) {
+			msg_len = msgs[sent + count].iov_len;
+			if (msg_len > cpg_inst->max_msg_size ||
+			    (count > 0 && size + CPG_MCAST_BATCH_MSG_SIZE (msg_len) > cpg_inst->max_msg_size)) {
+				break;
+			}
+
+			batch_msgs[count].msglen = msg_len;
+			iov[iov_len].iov_base = (void *)&batch_msgs[count];
+			iov[iov_len++].iov_len = sizeof (struct req_lib_cpg_mcast_batch_msg);
+			if (msg_len > 0) {
+				iov[iov_len].iov_base = msgs[sent + count].iov_base;
+				iov[iov_len++].iov_len = msg_len;
+			}
+			if (CPG_MCAST_BATCH_MSG_SIZE (msg_len) - sizeof (struct req_lib_cpg_mcast_batch_msg) > msg_len) {
+				iov[iov_len].iov_base = (void *)pad;
+				iov[iov_len++].iov_len = CPG_MCAST_BATCH_MSG_SIZE (msg_len) -
+					sizeof (struct req_lib_cpg_mcast_batch_msg) - msg_len;
+			}
+			size += CPG_MCAST_BATCH_MSG_SIZE (msg_len);
+		}
+
+		req_lib_cpg_mcast_batch.header.size = size;
+		req_lib_cpg_mcast_batch.header.id = MESSAGE_REQ_CPG_MCAST_BATCH;
+		req_lib_cpg_mcast_batch.guarantee = guarantee;
+		req_lib_cpg_mcast_batch.msg_count = count;
+
+		iov[0].iov_base = (void *)&req_lib_cpg_mcast_batch;
+		iov[0].iov_len = sizeof (struct req_lib_cpg_mcast_batch);
+
+		/*
+		 * A request refused before reaching the handler is answered
+		 * with a bare header, nothing was sent then
+		 */
+		res_lib_cpg_mcast_batch.msgs_sent = 0;
+
+		error = coroipcc_msg_send_reply_receive (cpg_inst->c, iov, iov_len,
+			&res_lib_cpg_mcast_batch,
+			sizeof (struct res_lib_cpg_mcast_batch));
+
+		if (error == CS_OK) {
+			sent += res_lib_cpg_mcast_batch.msgs_sent;
+			error = res_lib_cpg_mcast_batch.header.error;
+		}
+	}
+
+error_exit:
+	free (iov);
+	free (batch_msgs);
+
+	if (msgs_sent) {
+		*msgs_sent = sent;
+	}
+
+	hdb_handle_put (&cpg_handle_t_db, handle);
+
+	return (error);
+}
+
 cs_error_t cpg_iteration_initialize(
 	cpg_handle_t handle,
 	cpg_iteration_type_t iteration_type,
@@ -1286,9 +2200,26 @@ cs_error_t cpg_iteration_initialize(
 	}
 
 	cpg_iteration_instance->conn = cpg_inst->c;
+	cpg_iteration_instance->cached = NULL;
+	cpg_iteration_instance->cached_pos = 0;
 
 	qb_list_init (&cpg_iteration_instance->list);
 
+	if (iteration_type == CPG_ITERATION_ONE_GROUP) {
+		cpg_iteration_instance->cached = cpg_membership_cache_copy (cpg_inst, group);
+	}
+	if (cpg_iteration_instance->cached != NULL) {
+		cpg_iteration_instance->executive_iteration_handle = 0;
+		cpg_iteration_instance->cpg_iteration_handle = *cpg_iteration_handle;
+
+		qb_list_add (&cpg_iteration_instance->list, &cpg_inst->iteration_list_head);
+
+		hdb_handle_put (&cpg_iteration_handle_t_db, *cpg_iteration_handle);
+		hdb_handle_put (&cpg_handle_t_db, handle);
+
+		return (CS_OK);
+	}
+
 	req_lib_cpg_iterationinitialize.header.size = sizeof (struct req_lib_cpg_iterationinitialize);
 	req_lib_cpg_iterationinitialize.header.id = MESSAGE_REQ_CPG_ITERATIONINITIALIZE;
 	req_lib_cpg_iterationinitialize.iteration_type = iteration_type;
@@ -1349,6 +2280,19 @@ cs_error_t cpg_iteration_next(
 		goto error_exit;
 	}
 
+	if (cpg_iteration_instance->cached != NULL) {
+		if (cpg_iteration_instance->cached_pos >= cpg_iteration_instance->cached->member_list_entries) {
+			error = CS_ERR_NO_SECTIONS;
+			goto error_put;
+		}
+		memcpy (&description->group, &cpg_iteration_instance->cached->group_name,
+			sizeof (struct cpg_name));
+		description->nodeid = cpg_iteration_instance->cached->member_list[cpg_iteration_instance->cached_pos].nodeid;
+		description->pid = cpg_iteration_instance->cached->member_list[cpg_iteration_instance->cached_pos].pid;
+		cpg_iteration_instance->cached_pos++;
+		goto error_put;
+	}
+
 	req_lib_cpg_iterationnext.header.size = sizeof (struct req_lib_cpg_iterationnext);
 	req_lib_cpg_iterationnext.header.id = MESSAGE_REQ_CPG_ITERATIONNEXT;
 	req_lib_cpg_iterationnext.iteration_handle = cpg_iteration_instance->executive_iteration_handle;
@@ -1395,6 +2339,13 @@ cs_error_t cpg_iteration_finalize (
 		goto error_exit;
 	}
 
+	if (cpg_iteration_instance->cached != NULL) {
+		cpg_iteration_instance_finalize (cpg_iteration_instance);
+		hdb_handle_put (&cpg_iteration_handle_t_db, handle);
+
+		return (CS_OK);
+	}
+
 	req_lib_cpg_iterationfinalize.header.size = sizeof (struct req_lib_cpg_iterationfinalize);
 	req_lib_cpg_iterationfinalize.header.id = MESSAGE_REQ_CPG_ITERATIONFINALIZE;
 	req_lib_cpg_iterationfinalize.iteration_handle = cpg_iteration_instance->executive_iteration_handle;
@@ -45,6 +45,10 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
 #include <errno.h>
 #include <poll.h>
 
@@ -72,6 +76,10 @@
 #define SAM_RP_MASK_C(pol)	(pol & (~SAM_RECOVERY_POLICY_CMAP))
 #define SAM_RP_MASK(pol)	(pol & (~(SAM_RECOVERY_POLICY_QUORUM | SAM_RECOVERY_POLICY_CMAP)))
 
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
 enum sam_internal_status_t {
 	SAM_INTERNAL_STATUS_NOT_INITIALIZED = 0,
 	SAM_INTERNAL_STATUS_INITIALIZED,
@@ -108,6 +116,17 @@ enum sam_cmap_key_t {
 	SAM_CMAP_KEY_STATE,
 };
 
+/*
+ * Health checks are passed from the child to the parent in memory shared
+ * between them, so sam_hc_send doesn't need any system call. The child
+ * bumps counter and stores the (monotonic) time of the health check, the
+ * parent only looks at it when the time interval expires.
+ */
+struct sam_hc_slot {
+	uint64_t counter;
+	uint64_t timestamp;
+};
+
 static struct {
 	int time_interval;
 	sam_recovery_policy_t recovery_policy;
@@ -119,9 +138,12 @@ static struct {
 	int warn_signal;
 	int am_i_child;
 
+	struct sam_hc_slot *hc_slot;
+
 	sam_hc_callback_t hc_callback;
 	pthread_t cb_thread;
-	int cb_rpipe_fd, cb_wpipe_fd;
+	int cb_rfd, cb_wfd;
+	int cb_status;
 	int cb_registered;
 
 	void *user_data;
@@ -428,6 +450,52 @@ static cs_error_t sam_read_reply (
 	return (CS_OK);
 }
 
+static void sam_hc_slot_update (void)
+{
+	struct sam_hc_slot *hc_slot = sam_internal_data.hc_slot;
+	uint64_t now = cs_timestamp_get ();
+	uint64_t timestamp;
+
+	/*
+	 * Both the application and the callback thread may send health checks,
+	 * never move the timestamp back
+	 */
+	do {
+		timestamp = __sync_fetch_and_add (&hc_slot->timestamp, 0);
+		if (timestamp >= now) {
+			break;
+		}
+	} while (!__sync_bool_compare_and_swap (&hc_slot->timestamp, timestamp, now));
+
+	(void)__sync_fetch_and_add (&hc_slot->counter, 1);
+}
+
+/*
+ * Tell the health check callback thread that sam_start or sam_stop was called.
+ * The status itself is passed in memory, the fd only wakes the thread up.
+ */
+static cs_error_t sam_cb_status_set (int status)
+{
+#ifndef HAVE_SYS_EVENTFD_H
+	char command = 0;
+#endif
+
+	sam_internal_data.cb_status = status;
+	__sync_synchronize ();
+
+#ifdef HAVE_SYS_EVENTFD_H
+	if (eventfd_write (sam_internal_data.cb_wfd, 1) != 0) {
+		return (CS_ERR_LIBRARY);
+	}
+#else
+	if (sam_safe_write (sam_internal_data.cb_wfd, &command, sizeof (command)) != sizeof (command)) {
+		return (CS_ERR_LIBRARY);
+	}
+#endif
+
+	return (CS_OK);
+}
+
 cs_error_t sam_data_getsize (size_t *size)
 {
 	if (size == NULL) {
@@ -624,7 +692,7 @@ cs_error_t sam_start (void)
 	}
 
 	if (sam_internal_data.hc_callback)
-		if (sam_safe_write (sam_internal_data.cb_wpipe_fd, &command, sizeof (command)) != sizeof (command))
+		if (sam_cb_status_set (1) != CS_OK)
 			return (CS_ERR_LIBRARY);
 
 	sam_internal_data.internal_status = SAM_INTERNAL_STATUS_STARTED;
@@ -669,7 +737,7 @@ cs_error_t sam_stop (void)
 	}
 
 	if (sam_internal_data.hc_callback)
-		if (sam_safe_write (sam_internal_data.cb_wpipe_fd, &command, sizeof (command)) != sizeof (command))
+		if (sam_cb_status_set (0) != CS_OK)
 			return (CS_ERR_LIBRARY);
 
 	sam_internal_data.internal_status = SAM_INTERNAL_STATUS_REGISTERED;
@@ -679,16 +747,11 @@ cs_error_t sam_stop (void)
 
 cs_error_t sam_hc_send (void)
 {
-	char command;
-
 	if (sam_internal_data.internal_status != SAM_INTERNAL_STATUS_STARTED) {
 		return (CS_ERR_BAD_HANDLE);
 	}
 
-	command = SAM_COMMAND_HB;
-
-	if (sam_safe_write (sam_internal_data.child_fd_out, &command, sizeof (command)) != sizeof (command))
-		return (CS_ERR_LIBRARY);
+	sam_hc_slot_update ();
 
 	return (CS_OK);
 }
@@ -713,6 +776,11 @@ cs_error_t sam_finalize (void)
 
 	free (sam_internal_data.user_data);
 
+	if (sam_internal_data.hc_slot != NULL && !sam_internal_data.cb_registered) {
+		munmap (sam_internal_data.hc_slot, sizeof (struct sam_hc_slot));
+		sam_internal_data.hc_slot = NULL;
+	}
+
 exit_error:
 	return (CS_OK);
 }
@@ -953,18 +1021,22 @@ error_reply:
 
 static cs_error_t sam_parent_kill_child (
 	int *action,
-	pid_t child_pid)
+	pid_t child_pid,
+	uint64_t *hc_deadline)
 {
 	/*
 	 *  Kill child process
 	 */
 	if (!sam_internal_data.term_send) {
 		/*
-		 * We didn't send warn_signal yet.
+		 * We didn't send warn_signal yet. Child gets whole time_interval
+		 * to handle it before SIGKILL is sent.
 		 */
 		kill (child_pid, sam_internal_data.warn_signal);
 
 		sam_internal_data.term_send = 1;
+		*hc_deadline = cs_timestamp_get () +
+			sam_internal_data.time_interval * CS_TIME_NS_IN_MSEC;
 	} else {
 		/*
 		 * We sent child warning. Now, we will not be so nice
@@ -978,7 +1050,8 @@ static cs_error_t sam_parent_kill_child (
 
 static cs_error_t sam_parent_mark_child_failed (
 	int *action,
-	pid_t child_pid)
+	pid_t child_pid,
+	uint64_t *hc_deadline)
 {
 	sam_recovery_policy_t recpol;
 
@@ -989,7 +1062,7 @@ static cs_error_t sam_parent_mark_child_failed (
 	    (SAM_RP_MASK_C (recpol) ? SAM_RECOVERY_POLICY_CMAP : 0) |
 	    (SAM_RP_MASK_Q (recpol) ? SAM_RECOVERY_POLICY_QUORUM : 0);
 
-	return (sam_parent_kill_child (action, child_pid));
+	return (sam_parent_kill_child (action, child_pid, hc_deadline));
 }
 
 static cs_error_t sam_parent_data_store (
@@ -1036,6 +1109,36 @@ error_reply:
 	return (sam_parent_reply_send (err, parent_fd_in, parent_fd_out));
 }
 
+/*
+ * Look for health checks the child sent since the last call and move the
+ * deadline accordingly. Returns -1 if the deadline has passed.
+ */
+static int sam_parent_hc_check (
+	uint64_t *hc_counter,
+	uint64_t *hc_deadline)
+{
+	struct sam_hc_slot *hc_slot = sam_internal_data.hc_slot;
+	uint64_t counter;
+	uint64_t deadline;
+
+	counter = __sync_fetch_and_add (&hc_slot->counter, 0);
+	if (counter != *hc_counter) {
+		*hc_counter = counter;
+
+		deadline = __sync_fetch_and_add (&hc_slot->timestamp, 0) +
+			sam_internal_data.time_interval * CS_TIME_NS_IN_MSEC;
+		if (deadline > *hc_deadline) {
+			*hc_deadline = deadline;
+		}
+
+		if (sam_internal_data.recovery_policy & SAM_RECOVERY_POLICY_CMAP) {
+			sam_cmap_update_key (SAM_CMAP_KEY_LAST_HC, NULL);
+		}
+	}
+
+	return (cs_timestamp_get () >= *hc_deadline ? -1 : 0);
+}
+
 static enum sam_parent_action_t sam_parent_handler (
 	int parent_fd_in,
 	int parent_fd_out,
@@ -1051,8 +1154,13 @@ static enum sam_parent_action_t sam_parent_handler (
 	nfds_t nfds;
 	cs_error_t err;
 	sam_recovery_policy_t recpol;
+	uint64_t hc_counter;
+	uint64_t hc_deadline;
+	uint64_t now;
 
 	status = 0;
+	hc_counter = 0;
+	hc_deadline = 0;
 
 	action = SAM_PARENT_ACTION_CONTINUE;
 	recpol = sam_internal_data.recovery_policy;
@@ -1064,7 +1172,18 @@ static enum sam_parent_action_t sam_parent_handler (
 		nfds = 1;
 
 		if (status == 1 && sam_internal_data.time_interval != 0) {
-			time_interval = sam_internal_data.time_interval;
+			/*
+			 * Sleep until the last health check (or command) gets too old
+			 */
+			now = cs_timestamp_get ();
+			if (hc_deadline <= now) {
+				time_interval = 0;
+			} else if (hc_deadline - now >= (uint64_t)INT_MAX * CS_TIME_NS_IN_MSEC) {
+				time_interval = INT_MAX;
+			} else {
+				time_interval = (hc_deadline - now + CS_TIME_NS_IN_MSEC - 1) /
+					CS_TIME_NS_IN_MSEC;
+			}
 		} else {
 			time_interval = -1;
 		}
@@ -1094,8 +1213,8 @@ static enum sam_parent_action_t sam_parent_handler (
 			 */
 			if (status == 0) {
 				action = SAM_PARENT_ACTION_QUIT;
-			} else {
-				sam_parent_kill_child (&action, child_pid);
+			} else if (sam_parent_hc_check (&hc_counter, &hc_deadline) != 0) {
+				sam_parent_kill_child (&action, child_pid, &hc_deadline);
 			}
 		}
 
@@ -1127,6 +1246,12 @@ static enum sam_parent_action_t sam_parent_handler (
 					sam_cmap_update_key (SAM_CMAP_KEY_LAST_HC, NULL);
 				}
 
+				/*
+				 * Every command counts as a health check
+				 */
+				hc_deadline = cs_timestamp_get () +
+					sam_internal_data.time_interval * CS_TIME_NS_IN_MSEC;
+
 				/*
 				 * We have read command
 				 */
@@ -1176,7 +1301,7 @@ static enum sam_parent_action_t sam_parent_handler (
 					break;
 				case SAM_COMMAND_MARK_FAILED:
 					status = 1;
-					sam_parent_mark_child_failed (&action, child_pid);
+					sam_parent_mark_child_failed (&action, child_pid, &hc_deadline);
 					break;
 				}
 			} /* if (pfds[0].revents != 0) */
@@ -1190,7 +1315,7 @@ static enum sam_parent_action_t sam_parent_handler (
 
 				if (status == 1 &&
 				    (!sam_internal_data.quorate || (err != CS_ERR_TRY_AGAIN && err != CS_OK))) {
-					sam_parent_kill_child (&action, child_pid);
+					sam_parent_kill_child (&action, child_pid, &hc_deadline);
 				}
 			}
 		} /* select_error > 0 */
@@ -1217,6 +1342,19 @@ cs_error_t sam_register (
 
 	recpol = sam_internal_data.recovery_policy;
 
+	if (sam_internal_data.hc_slot == NULL) {
+		/*
+		 * Anonymous shared mapping, inherited by every child we fork
+		 */
+		sam_internal_data.hc_slot = mmap (NULL, sizeof (struct sam_hc_slot),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (sam_internal_data.hc_slot == MAP_FAILED) {
+			sam_internal_data.hc_slot = NULL;
+			error = CS_ERR_NO_MEMORY;
+			goto error_exit;
+		}
+	}
+
 	if (recpol & SAM_RECOVERY_POLICY_CMAP) {
 		/*
 		 * Register to cmap
@@ -1252,6 +1390,9 @@ cs_error_t sam_register (
 
 		sam_internal_data.term_send = 0;
 
+		sam_internal_data.hc_slot->counter = 0;
+		sam_internal_data.hc_slot->timestamp = 0;
+
 		pid = fork ();
 
 		if (pid == -1) {
@@ -1345,8 +1486,11 @@ static void *hc_callback_thread (void *unused_param)
 {
 	int poll_error;
 	int status;
-	ssize_t bytes_readed;
+#ifdef HAVE_SYS_EVENTFD_H
+	eventfd_t value;
+#else
 	char command;
+#endif
 	int time_interval, tmp_time_interval;
 	int counter;
 	struct pollfd pfds;
@@ -1357,7 +1501,7 @@ static void *hc_callback_thread (void *unused_param)
 	time_interval = sam_internal_data.time_interval >> 2;
 
 	while (1) {
-		pfds.fd = sam_internal_data.cb_rpipe_fd;
+		pfds.fd = sam_internal_data.cb_rfd;
 		pfds.events = POLLIN;
 		pfds.revents = 0;
 
@@ -1384,15 +1528,22 @@ static void *hc_callback_thread (void *unused_param)
 		}
 
 		if (poll_error > 0) {
-			bytes_readed = sam_safe_read (sam_internal_data.cb_rpipe_fd, &command, 1);
-
-			if (bytes_readed > 0) {
-				if (status == 0 && command == SAM_COMMAND_START)
-					status = 1;
-
-				if (status == 1 && command == SAM_COMMAND_STOP)
-					status = 0;
+#ifdef HAVE_SYS_EVENTFD_H
+			if (eventfd_read (sam_internal_data.cb_rfd, &value) != 0) {
+				continue;
+			}
+#else
+			if (sam_safe_read (sam_internal_data.cb_rfd, &command, 1) <= 0) {
+				continue;
+			}
+#endif
 
+			/*
+			 * Once the callback failed, stay stopped
+			 */
+			__sync_synchronize ();
+			if (status != 3) {
+				status = sam_internal_data.cb_status;
 			}
 		}
 	}
@@ -1407,8 +1558,10 @@ cs_error_t sam_hc_callback_register (sam_hc_callback_t cb)
 {
 	cs_error_t error = CS_OK;
 	pthread_attr_t thread_attr;
+#ifndef HAVE_SYS_EVENTFD_H
 	int pipe_error;
 	int pipe_fd[2];
+#endif
 
 	if (sam_internal_data.internal_status != SAM_INTERNAL_STATUS_REGISTERED) {
 		return (CS_ERR_BAD_HANDLE);
@@ -1432,6 +1585,14 @@ cs_error_t sam_hc_callback_register (sam_hc_callback_t cb)
 		return (CS_ERR_INVALID_PARAM);
 	}
 
+#ifdef HAVE_SYS_EVENTFD_H
+	sam_internal_data.cb_rfd = eventfd (0, EFD_CLOEXEC);
+	if (sam_internal_data.cb_rfd == -1) {
+		error = CS_ERR_LIBRARY;
+		goto error_exit;
+	}
+	sam_internal_data.cb_wfd = sam_internal_data.cb_rfd;
+#else
 	pipe_error = pipe (pipe_fd);
 
 	if (pipe_error != 0) {
@@ -1442,8 +1603,9 @@ cs_error_t sam_hc_callback_register (sam_hc_callback_t cb)
 		goto error_exit;
 	}
 
-	sam_internal_data.cb_rpipe_fd = pipe_fd[0];
-	sam_internal_data.cb_wpipe_fd = pipe_fd[1];
+	sam_internal_data.cb_rfd = pipe_fd[0];
+	sam_internal_data.cb_wfd = pipe_fd[1];
+#endif
 
 	/*
 	 * Create thread attributes
@@ -1481,9 +1643,11 @@ cs_error_t sam_hc_callback_register (sam_hc_callback_t cb)
 error_attr_destroy_exit:
 	pthread_attr_destroy(&thread_attr);
 error_close_fd_exit:
-	sam_internal_data.cb_rpipe_fd = sam_internal_data.cb_wpipe_fd = 0;
-	close (pipe_fd[0]);
-	close (pipe_fd[1]);
+	close (sam_internal_data.cb_rfd);
+	if (sam_internal_data.cb_wfd != sam_internal_data.cb_rfd) {
+		close (sam_internal_data.cb_wfd);
+	}
+	sam_internal_data.cb_rfd = sam_internal_data.cb_wfd = 0;
 error_exit:
 	return (error);
 }
@@ -105,24 +105,39 @@ static cpg_callbacks_t callbacks = {
 #define ONE_MEG 1048576
 static char data[ONE_MEG];
 
+#define BATCH_MAX 4096
+static struct iovec batch_iov[BATCH_MAX];
+
 static void cpg_benchmark (
 	cpg_handle_t handle_in,
-	int write_size)
+	int write_size,
+	unsigned int batch)
 {
 	struct timeval tv1, tv2, tv_elapsed;
 	struct iovec iov;
 	unsigned int res;
+	unsigned int sent = 0;
+	unsigned int i;
 
 	alarm_notice = 0;
 	iov.iov_base = data;
 	iov.iov_len = write_size;
+	for (i = 0; i < batch; i++) {
+		batch_iov[i] = iov;
+	}
 
 	write_count = 0;
 	alarm (10);
 
 	gettimeofday (&tv1, NULL);
 	do {
-		res = cpg_mcast_joined (handle_in, CPG_TYPE_AGREED, &iov, 1);
+		if (batch > 1) {
+			res = cpg_mcast_joined_batch (handle_in, CPG_TYPE_AGREED,
+				&batch_iov[sent], batch - sent, &i);
+			sent = (sent + i) % batch;
+		} else {
+			res = cpg_mcast_joined (handle_in, CPG_TYPE_AGREED, &iov, 1);
+		}
 	} while (alarm_notice == 0 && (res == CS_OK || res == CS_ERR_TRY_AGAIN));
 	gettimeofday (&tv2, NULL);
 	timersub (&tv2, &tv1, &tv_elapsed);
@@ -153,11 +168,35 @@ static void* dispatch_thread (void *arg)
 	return NULL;
 }
 
-int main (void) {
+static void usage (const char *cmd)
+{
+	printf ("%s [-b batch]\n\n", cmd);
+	printf ("  -b    send messages in batches of this size with cpg_mcast_joined_batch (max %d)\n", BATCH_MAX);
+}
+
+int main (int argc, char *argv[]) {
 	unsigned int size;
+	unsigned int batch = 1;
 	int i;
+	int opt;
 	unsigned int res;
 
+	while ((opt = getopt (argc, argv, "b:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			batch = strtoul (optarg, NULL, 0);
+			if (batch < 1 || batch > BATCH_MAX) {
+				usage (argv[0]);
+				exit (1);
+			}
+			break;
+		case 'h':
+		default:
+			usage (argv[0]);
+			exit (1);
+		}
+	}
+
 	qb_log_init("cpgbench", LOG_USER, LOG_EMERG);
 	qb_log_ctl(QB_LOG_SYSLOG, QB_LOG_CONF_ENABLED, QB_FALSE);
 	qb_log_filter_ctl(QB_LOG_STDERR, QB_LOG_FILTER_ADD,
@@ -180,7 +219,7 @@ int main (void) {
 	}
 
 	for (i = 0; i < 10; i++) { /* number of repetitions - up to 50k */
-		cpg_benchmark (handle, size);
+		cpg_benchmark (handle, size, batch);
 		signal (SIGALRM, sigalrm_handler);
 		size *= 5;
 		if (size >= (ONE_MEG - 100)) {
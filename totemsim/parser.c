@@ -0,0 +1,351 @@
+/* Parses the scenario commands */
+
+#include <config.h>
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <errno.h>
+
+#include "totemsim.h"
+
+static void do_usage(void)
+{
+	printf("  Nodes are numbered from 1, all of them start in partition 0\n");
+	printf("  Times are in ms unless a unit (ns, us, ms, s) is given\n");
+	printf("\n");
+	printf("nodes      <n>\n");
+	printf("           create and start nodes 1..<n>\n");
+	printf("up         <nodeid>[,<nodeid>...]\n");
+	printf("           restart stopped nodes\n");
+	printf("down       <nodeid>[,<nodeid>...]\n");
+	printf("           stop nodes cleanly (leave message is sent)\n");
+	printf("crash      <nodeid>[,<nodeid>...]\n");
+	printf("           stop nodes without sending a leave message\n");
+	printf("partition  <partition>:<nodeid>[,<nodeid>...] [...]\n");
+	printf("           move nodes to a partition (netsplit)\n");
+	printf("merge      put every node back in partition 0\n");
+	printf("net        latency|jitter <time> or loss|reorder <percent>\n");
+	printf("           set the network model\n");
+	printf("totem      <parameter> <value>\n");
+	printf("           set a totem timeout/constant for nodes started afterwards\n");
+	printf("seed       <n>\n");
+	printf("           reseed the loss/reorder generator\n");
+	printf("load       <msgs per second per node> <size> | off\n");
+	printf("           generate a constant message rate on every node\n");
+	printf("flood      <size>\n");
+	printf("           keep every node's send queue full\n");
+	printf("run        <time>\n");
+	printf("           advance the virtual clock and report the phase\n");
+	printf("settle     <timeout>\n");
+	printf("           run until the membership converges, fail on timeout\n");
+	printf("show       show network and node status\n");
+	printf("\n");
+}
+
+typedef int (*cmd_routine_t)(int argc, char **argv);
+
+static int run_nodes_cmd(int argc, char **argv);
+static int run_up_cmd(int argc, char **argv);
+static int run_down_cmd(int argc, char **argv);
+static int run_crash_cmd(int argc, char **argv);
+static int run_partition_cmd(int argc, char **argv);
+static int run_merge_cmd(int argc, char **argv);
+static int run_net_cmd(int argc, char **argv);
+static int run_totem_cmd(int argc, char **argv);
+static int run_seed_cmd(int argc, char **argv);
+static int run_load_cmd(int argc, char **argv);
+static int run_flood_cmd(int argc, char **argv);
+static int run_run_cmd(int argc, char **argv);
+static int run_settle_cmd(int argc, char **argv);
+static int run_show_cmd(int argc, char **argv);
+static int run_help_cmd(int argc, char **argv);
+
+static struct cmd_list_struct {
+	const char *cmd;
+	int min_args;
+	cmd_routine_t cmd_runner;
+} cmd_list[] = {
+	{ "nodes", 2, run_nodes_cmd},
+	{ "up", 2, run_up_cmd},
+	{ "down", 2, run_down_cmd},
+	{ "crash", 2, run_crash_cmd},
+	{ "partition", 2, run_partition_cmd},
+	{ "split", 2, run_partition_cmd},
+	{ "merge", 1, run_merge_cmd},
+	{ "join", 1, run_merge_cmd},
+	{ "net", 3, run_net_cmd},
+	{ "totem", 3, run_totem_cmd},
+	{ "seed", 2, run_seed_cmd},
+	{ "load", 2, run_load_cmd},
+	{ "flood", 2, run_flood_cmd},
+	{ "run", 2, run_run_cmd},
+	{ "settle", 2, run_settle_cmd},
+	{ "show", 1, run_show_cmd},
+	{ "help", 1, run_help_cmd},
+};
+static int num_cmds = (sizeof(cmd_list)) / sizeof(struct cmd_list_struct);
+#define MAX_ARGS 64
+
+static int parse_uint64(const char *string, uint64_t *value)
+{
+	char *end;
+
+	errno = 0;
+	*value = strtoull(string, &end, 0);
+	if (errno || end == string || *end != '\0') {
+		return (-1);
+	}
+	return (0);
+}
+
+/* Times default to ms, returns the value in ms */
+static int parse_duration_ms(const char *string, uint64_t *value)
+{
+	char *end;
+	double v;
+
+	errno = 0;
+	v = strtod(string, &end);
+	if (errno || end == string || v < 0) {
+		return (-1);
+	}
+	if (*end == '\0' || strcmp(end, "ms") == 0) {
+		*value = (uint64_t)v;
+	} else if (strcmp(end, "s") == 0) {
+		*value = (uint64_t)(v * 1000);
+	} else {
+		return (-1);
+	}
+	return (0);
+}
+
+/* Takes a <nodeid>[,<nodeid>]... list. Returns the number of nodes or -1 */
+static int parse_nodelist(char *string, unsigned int *nodes, int max_nodes)
+{
+	char *saveptr = NULL;
+	char *tok;
+	uint64_t nodeid;
+	int count = 0;
+
+	for (tok = strtok_r(string, ",", &saveptr); tok;
+	     tok = strtok_r(NULL, ",", &saveptr)) {
+		if (parse_uint64(tok, &nodeid) != 0 || nodeid == 0 || count == max_nodes) {
+			fprintf(stderr, "Invalid node list entry '%s'\n", tok);
+			return (-1);
+		}
+		nodes[count++] = nodeid;
+	}
+	return (count);
+}
+
+static int run_node_list_cmd(int argc, char **argv, int (*fn)(unsigned int nodeid))
+{
+	unsigned int nodes[TOTEMSIM_MAX_NODES];
+	int num_nodes;
+	int res = 0;
+	int i, j;
+
+	for (i = 1; i < argc; i++) {
+		num_nodes = parse_nodelist(argv[i], nodes, TOTEMSIM_MAX_NODES);
+		if (num_nodes < 0) {
+			return (-1);
+		}
+		for (j = 0; j < num_nodes; j++) {
+			if (fn(nodes[j]) != 0) {
+				res = -1;
+			}
+		}
+	}
+	return (res);
+}
+
+int parse_input_command(const char *line, int lineno)
+{
+	char *argv[MAX_ARGS];
+	char *saveptr = NULL;
+	char *cmd;
+	char *tok;
+	int argc = 0;
+	int ret = -1;
+	int valid_cmd = 0;
+	int i;
+
+	/* '#' starts a comment */
+	if (line[0] == '#') {
+		return (0);
+	}
+
+	cmd = strdup(line);
+	if (cmd == NULL) {
+		return (-1);
+	}
+
+	for (tok = strtok_r(cmd, " \t", &saveptr); tok && argc < MAX_ARGS;
+	     tok = strtok_r(NULL, " \t", &saveptr)) {
+		argv[argc++] = tok;
+	}
+
+	/* Ignore null commands */
+	if (argc < 1) {
+		free(cmd);
+		return (0);
+	}
+
+	/* Dispatch command */
+	for (i=0; i<num_cmds; i++) {
+		if (strcasecmp(argv[0], cmd_list[i].cmd) == 0) {
+			if (argc < cmd_list[i].min_args) {
+				break;
+			}
+			ret = cmd_list[i].cmd_runner(argc, argv);
+			valid_cmd = 1;
+		}
+	}
+	if (!valid_cmd) {
+		fprintf(stderr, "line %d: invalid command '%s'\n", lineno, line);
+		do_usage();
+	} else if (ret != 0) {
+		fprintf(stderr, "line %d: command failed '%s'\n", lineno, line);
+	}
+	free(cmd);
+
+	return (ret);
+}
+
+static int run_nodes_cmd(int argc, char **argv)
+{
+	uint64_t count;
+
+	if (parse_uint64(argv[1], &count) != 0) {
+		return (-1);
+	}
+	return (cmd_nodes(count));
+}
+
+static int run_up_cmd(int argc, char **argv)
+{
+	return (run_node_list_cmd(argc, argv, cmd_node_up));
+}
+
+static int run_down_cmd(int argc, char **argv)
+{
+	return (run_node_list_cmd(argc, argv, cmd_node_down));
+}
+
+static int run_crash_cmd(int argc, char **argv)
+{
+	return (run_node_list_cmd(argc, argv, cmd_node_crash));
+}
+
+static int run_partition_cmd(int argc, char **argv)
+{
+	unsigned int nodes[TOTEMSIM_MAX_NODES];
+	uint64_t partition;
+	char *colon;
+	int num_nodes;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		colon = strchr(argv[i], ':');
+		if (colon == NULL) {
+			fprintf(stderr, "Partition must be given as <partition>:<nodelist>\n");
+			return (-1);
+		}
+		*colon = '\0';
+		if (parse_uint64(argv[i], &partition) != 0) {
+			return (-1);
+		}
+		num_nodes = parse_nodelist(colon + 1, nodes, TOTEMSIM_MAX_NODES);
+		if (num_nodes < 0) {
+			return (-1);
+		}
+		if (cmd_partition(partition, nodes, num_nodes) != 0) {
+			return (-1);
+		}
+	}
+	return (0);
+}
+
+static int run_merge_cmd(int argc, char **argv)
+{
+	return (cmd_merge());
+}
+
+static int run_net_cmd(int argc, char **argv)
+{
+	return (cmd_net(argv[1], argv[2]));
+}
+
+static int run_totem_cmd(int argc, char **argv)
+{
+	return (cmd_totem(argv[1], argv[2]));
+}
+
+static int run_seed_cmd(int argc, char **argv)
+{
+	uint64_t seed;
+
+	if (parse_uint64(argv[1], &seed) != 0) {
+		return (-1);
+	}
+	return (cmd_seed(seed));
+}
+
+static int run_load_cmd(int argc, char **argv)
+{
+	uint64_t rate;
+	uint64_t size;
+
+	if (strcasecmp(argv[1], "off") == 0) {
+		return (cmd_load(0, 0));
+	}
+	if (argc < 3 || parse_uint64(argv[1], &rate) != 0 ||
+	    parse_uint64(argv[2], &size) != 0) {
+		return (-1);
+	}
+	return (cmd_load(rate, size));
+}
+
+static int run_flood_cmd(int argc, char **argv)
+{
+	uint64_t size;
+
+	if (parse_uint64(argv[1], &size) != 0) {
+		return (-1);
+	}
+	return (cmd_flood(size));
+}
+
+static int run_run_cmd(int argc, char **argv)
+{
+	uint64_t duration;
+
+	if (parse_duration_ms(argv[1], &duration) != 0) {
+		return (-1);
+	}
+	return (cmd_run(duration));
+}
+
+static int run_settle_cmd(int argc, char **argv)
+{
+	uint64_t timeout;
+
+	if (parse_duration_ms(argv[1], &timeout) != 0) {
+		return (-1);
+	}
+	return (cmd_settle(timeout));
+}
+
+static int run_show_cmd(int argc, char **argv)
+{
+	cmd_show();
+	return (0);
+}
+
+static int run_help_cmd(int argc, char **argv)
+{
+	do_usage();
+	return (0);
+}
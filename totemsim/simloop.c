@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Discrete event scheduler with a virtual clock.
+ *
+ * The totem code only uses the timer part of the qb_loop API and
+ * qb_util_nano_current_get() to read the time. Those symbols are defined
+ * here so they take precedence over the libqb ones, which lets many totem
+ * instances share one process and one clock. Events firing at the same
+ * virtual time are dispatched in the order they were queued, so a run is
+ * fully reproducible.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <qb/qbdefs.h>
+#include <qb/qbloop.h>
+#include <qb/qbutil.h>
+
+#include "totemsim.h"
+
+struct qb_loop {
+	void *user_data;
+};
+
+struct sim_event {
+	uint64_t expire;
+	uint64_t seq;
+	uint32_t generation;
+	int heap_idx;
+	int in_use;
+	qb_loop_t *loop;
+	qb_loop_timer_dispatch_fn dispatch_fn;
+	void *data;
+};
+
+static struct sim_event *events = NULL;
+static unsigned int events_size = 0;
+
+static unsigned int *free_slots = NULL;
+static unsigned int free_slots_entries = 0;
+
+static unsigned int *heap = NULL;
+static unsigned int heap_entries = 0;
+
+static uint64_t sim_now = 0;
+static uint64_t sim_seq = 0;
+static uint64_t sim_dispatched = 0;
+static qb_loop_t *sim_current = NULL;
+
+static int event_before(unsigned int a, unsigned int b)
+{
+	if (events[a].expire != events[b].expire) {
+		return (events[a].expire < events[b].expire);
+	}
+	return (events[a].seq < events[b].seq);
+}
+
+static void heap_swap(unsigned int i, unsigned int j)
+{
+	unsigned int tmp = heap[i];
+
+	heap[i] = heap[j];
+	heap[j] = tmp;
+	events[heap[i]].heap_idx = i;
+	events[heap[j]].heap_idx = j;
+}
+
+static void heap_up(unsigned int i)
+{
+	while (i > 0 && event_before(heap[i], heap[(i - 1) / 2])) {
+		heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void heap_down(unsigned int i)
+{
+	unsigned int smallest;
+	unsigned int child;
+
+	for (;;) {
+		smallest = i;
+		child = 2 * i + 1;
+		if (child < heap_entries && event_before(heap[child], heap[smallest])) {
+			smallest = child;
+		}
+		child++;
+		if (child < heap_entries && event_before(heap[child], heap[smallest])) {
+			smallest = child;
+		}
+		if (smallest == i) {
+			return;
+		}
+		heap_swap(i, smallest);
+		i = smallest;
+	}
+}
+
+static void heap_remove(unsigned int i)
+{
+	heap_entries--;
+	if (i == heap_entries) {
+		return;
+	}
+	heap[i] = heap[heap_entries];
+	events[heap[i]].heap_idx = i;
+	heap_up(i);
+	heap_down(events[heap[i]].heap_idx);
+}
+
+static int events_grow(void)
+{
+	unsigned int new_size = events_size ? events_size * 2 : 1024;
+	struct sim_event *new_events;
+	unsigned int *new_free;
+	unsigned int *new_heap;
+	unsigned int i;
+
+	new_events = realloc(events, new_size * sizeof(struct sim_event));
+	if (new_events == NULL) {
+		return (-1);
+	}
+	events = new_events;
+
+	new_free = realloc(free_slots, new_size * sizeof(unsigned int));
+	if (new_free == NULL) {
+		return (-1);
+	}
+	free_slots = new_free;
+
+	new_heap = realloc(heap, new_size * sizeof(unsigned int));
+	if (new_heap == NULL) {
+		return (-1);
+	}
+	heap = new_heap;
+
+	/*
+	 * Push in reverse so low slots are handed out first
+	 */
+	for (i = new_size; i > events_size; i--) {
+		memset(&events[i - 1], 0, sizeof(struct sim_event));
+		events[i - 1].generation = 1;
+		free_slots[free_slots_entries++] = i - 1;
+	}
+	events_size = new_size;
+
+	return (0);
+}
+
+static void slot_release(unsigned int slot)
+{
+	events[slot].in_use = 0;
+	events[slot].generation++;
+	free_slots[free_slots_entries++] = slot;
+}
+
+/*
+ * A handle encodes the slot and its generation so that deleting a timer
+ * which already fired (and whose slot was reused) is harmless.
+ */
+static int handle_to_slot(qb_loop_timer_handle th, unsigned int *slot)
+{
+	uint32_t index = (uint32_t)(th & 0xffffffff);
+	uint32_t generation = (uint32_t)(th >> 32);
+
+	if (index == 0 || index > events_size) {
+		return (-1);
+	}
+	if (!events[index - 1].in_use || events[index - 1].generation != generation) {
+		return (-1);
+	}
+	*slot = index - 1;
+	return (0);
+}
+
+qb_loop_t *simloop_create(void *user_data)
+{
+	qb_loop_t *loop;
+
+	loop = malloc(sizeof(struct qb_loop));
+	if (loop == NULL) {
+		return (NULL);
+	}
+	loop->user_data = user_data;
+	return (loop);
+}
+
+void simloop_destroy(qb_loop_t *loop)
+{
+	unsigned int slot;
+
+	/*
+	 * Drop every event still queued for this loop, the owner is gone
+	 */
+	for (slot = 0; slot < events_size; slot++) {
+		if (events[slot].in_use && events[slot].loop == loop) {
+			heap_remove(events[slot].heap_idx);
+			slot_release(slot);
+		}
+	}
+	if (sim_current == loop) {
+		sim_current = NULL;
+	}
+	free(loop);
+}
+
+void *simloop_user_data_get(qb_loop_t *loop)
+{
+	if (loop == NULL) {
+		return (NULL);
+	}
+	return (loop->user_data);
+}
+
+qb_loop_t *simloop_current_get(void)
+{
+	return (sim_current);
+}
+
+uint64_t simloop_now(void)
+{
+	return (sim_now);
+}
+
+uint64_t simloop_events_dispatched(void)
+{
+	return (sim_dispatched);
+}
+
+void simloop_run_until(uint64_t end_time)
+{
+	struct sim_event *ev;
+	qb_loop_timer_dispatch_fn dispatch_fn;
+	void *data;
+	unsigned int slot;
+
+	while (heap_entries > 0 && events[heap[0]].expire <= end_time) {
+		slot = heap[0];
+		ev = &events[slot];
+
+		heap_remove(0);
+
+		sim_now = ev->expire;
+		sim_current = ev->loop;
+		dispatch_fn = ev->dispatch_fn;
+		data = ev->data;
+
+		/*
+		 * Release before dispatch so the callback may re-arm or delete
+		 * its own handle safely
+		 */
+		slot_release(slot);
+
+		sim_dispatched++;
+		dispatch_fn(data);
+	}
+	sim_current = NULL;
+	if (end_time > sim_now) {
+		sim_now = end_time;
+	}
+}
+
+/*
+ * libqb interposition
+ */
+int32_t qb_loop_timer_add(qb_loop_t *l, enum qb_loop_priority p,
+	uint64_t nsec_duration, void *data,
+	qb_loop_timer_dispatch_fn dispatch_fn,
+	qb_loop_timer_handle *timer_handle_out)
+{
+	struct sim_event *ev;
+	unsigned int slot;
+
+	assert(l != NULL);
+
+	if (free_slots_entries == 0 && events_grow() != 0) {
+		return (-ENOMEM);
+	}
+	slot = free_slots[--free_slots_entries];
+	ev = &events[slot];
+
+	ev->expire = sim_now + nsec_duration;
+	ev->seq = sim_seq++;
+	ev->in_use = 1;
+	ev->loop = l;
+	ev->dispatch_fn = dispatch_fn;
+	ev->data = data;
+
+	ev->heap_idx = heap_entries;
+	heap[heap_entries++] = slot;
+	heap_up(ev->heap_idx);
+
+	if (timer_handle_out) {
+		*timer_handle_out = ((uint64_t)ev->generation << 32) | (slot + 1);
+	}
+	return (0);
+}
+
+int32_t qb_loop_timer_del(qb_loop_t *l, qb_loop_timer_handle th)
+{
+	unsigned int slot;
+
+	if (handle_to_slot(th, &slot) != 0) {
+		return (-EINVAL);
+	}
+	heap_remove(events[slot].heap_idx);
+	slot_release(slot);
+
+	return (0);
+}
+
+int32_t qb_loop_timer_is_running(qb_loop_t *l, qb_loop_timer_handle th)
+{
+	unsigned int slot;
+
+	return (handle_to_slot(th, &slot) == 0 ? QB_TRUE : QB_FALSE);
+}
+
+uint64_t qb_loop_timer_expire_time_get(struct qb_loop *l, qb_loop_timer_handle th)
+{
+	unsigned int slot;
+
+	if (handle_to_slot(th, &slot) != 0) {
+		return (0);
+	}
+	return (events[slot].expire);
+}
+
+uint64_t qb_loop_timer_expire_time_remaining(struct qb_loop *l, qb_loop_timer_handle th)
+{
+	unsigned int slot;
+
+	if (handle_to_slot(th, &slot) != 0) {
+		return (0);
+	}
+	return (events[slot].expire - sim_now);
+}
+
+int32_t qb_loop_job_add(qb_loop_t *l, enum qb_loop_priority p, void *data,
+	qb_loop_job_dispatch_fn dispatch_fn)
+{
+	return (qb_loop_timer_add(l, p, 0, data, dispatch_fn, NULL));
+}
+
+uint64_t qb_util_nano_current_get(void)
+{
+	return (sim_now);
+}
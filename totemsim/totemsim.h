@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TOTEMSIM_H_DEFINED
+#define TOTEMSIM_H_DEFINED
+
+#include <stdint.h>
+#include <qb/qbloop.h>
+
+/*
+ * Nodes are numbered 1..TOTEMSIM_MAX_NODES and their nodeid is the same
+ */
+#define TOTEMSIM_MAX_NODES	64
+
+/* simloop.c - virtual clock and event queue */
+extern qb_loop_t *simloop_create(void *user_data);
+extern void simloop_destroy(qb_loop_t *loop);
+extern void *simloop_user_data_get(qb_loop_t *loop);
+extern qb_loop_t *simloop_current_get(void);
+extern uint64_t simloop_now(void);
+extern void simloop_run_until(uint64_t end_time);
+extern uint64_t simloop_events_dispatched(void);
+
+/* tsmain.c - commands run by the scenario parser */
+extern int cmd_nodes(int num_nodes);
+extern int cmd_node_down(unsigned int nodeid);
+extern int cmd_node_crash(unsigned int nodeid);
+extern int cmd_node_up(unsigned int nodeid);
+extern int cmd_partition(unsigned int partition, const unsigned int *nodes, int num_nodes);
+extern int cmd_merge(void);
+extern int cmd_net(const char *key, const char *value);
+extern int cmd_totem(const char *key, const char *value);
+extern int cmd_load(uint32_t rate, uint32_t size);
+extern int cmd_flood(uint32_t size);
+extern int cmd_run(uint64_t duration_ms);
+extern int cmd_settle(uint64_t timeout_ms);
+extern int cmd_seed(uint64_t seed);
+extern void cmd_show(void);
+
+/* parser.c */
+extern int parse_input_command(const char *line, int lineno);
+
+#endif /* TOTEMSIM_H_DEFINED */
@@ -0,0 +1,1140 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Deterministic multi-node totem simulator.
+ *
+ * Every simulated node is a real totemsrp instance using the loop transport.
+ * All of them run in this process on a shared virtual clock (see simloop.c)
+ * so a scenario produces the same results on every run for a given seed.
+ * totempg is a process-wide singleton, so load is generated directly on top
+ * of totemsrp.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <qb/qbdefs.h>
+#include <qb/qbloop.h>
+
+#include <corosync/corotypes.h>
+#include <corosync/icmap.h>
+#include <corosync/logsys.h>
+#include <corosync/totem/totem.h>
+#include <corosync/totem/totemstats.h>
+#include "../exec/totemsrp.h"
+#include "../exec/totemconfig.h"
+#include "../exec/totemloop.h"
+
+#include "totemsim.h"
+
+#define SIM_MSG_MAGIC		0x7351u
+#define SIM_TICK_NS		QB_TIME_NS_IN_MSEC
+#define SIM_FLOOD_BURST		1000
+
+#define HIST_SUB_BITS		4
+#define HIST_SUB_BUCKETS	(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS		(64 * HIST_SUB_BUCKETS)
+
+struct sim_msg_header {
+	uint32_t magic;
+	uint32_t sender;
+	uint64_t seq;
+	uint64_t send_time;
+} __attribute__((packed));
+
+/*
+ * Log-linear histogram, 16 sub-buckets per power of two
+ * gives about 6% precision over the whole 64-bit range
+ */
+struct sim_histogram {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+struct sim_phase {
+	uint64_t start_time;
+	uint64_t originated;
+	uint64_t throttled;
+	uint64_t delivered;
+	uint64_t delivered_bytes;
+	uint64_t order_errors;
+	uint64_t confchgs;
+	struct totemloop_net_stats net_start;
+	struct sim_histogram latency;
+};
+
+struct sim_node {
+	unsigned int nodeid;
+	int created;
+	int up;
+	qb_loop_t *loop;
+	void *srp_context;
+	struct totem_config totem_config;
+	struct totem_interface interfaces[INTERFACE_MAX];
+	totempg_stats_t pg_stats;
+
+	unsigned int members[TOTEMSIM_MAX_NODES];
+	size_t member_entries;
+	int waiting_trans_ack;
+	struct memb_ring_id ring_id;
+
+	qb_loop_timer_handle load_timer;
+	uint64_t load_credit;
+	uint64_t send_seq;
+	uint64_t last_seq[TOTEMSIM_MAX_NODES + 1];
+};
+
+struct sim_totem_params {
+	unsigned int token_timeout;
+	unsigned int token_retransmits_before_loss_const;
+	unsigned int token_retransmit_timeout;
+	unsigned int token_hold_timeout;
+	unsigned int join_timeout;
+	unsigned int consensus_timeout;
+	unsigned int merge_timeout;
+	unsigned int downcheck_timeout;
+	unsigned int fail_to_recv_const;
+	unsigned int seqno_unchanged_const;
+	unsigned int max_network_delay;
+	unsigned int window_size;
+	unsigned int max_messages;
+	unsigned int miss_count_const;
+};
+
+static struct sim_node nodes[TOTEMSIM_MAX_NODES + 1];
+static int num_nodes = 0;
+
+/* Ring ids survive a node restart, like the ringid file does */
+static struct memb_ring_id ring_id_store[TOTEMSIM_MAX_NODES + 1];
+
+static struct sim_totem_params totem_params;
+
+static uint32_t load_rate = 0;
+static uint32_t load_size = 0;
+static int load_flood = 0;
+
+static struct sim_phase phase;
+static struct sim_histogram total_latency;
+static int phase_number = 0;
+
+static int recovery_pending = 0;
+static uint64_t recovery_start;
+static char recovery_event[64];
+static struct sim_histogram total_recovery;
+
+static int log_level = LOGSYS_LEVEL_WARNING;
+static FILE *output_file;
+
+const char *corosync_get_config_file(void);
+void totemconfig_commit_new_params(struct totem_config *totem_config, icmap_map_t map);
+
+static void recovery_check(void);
+
+/*
+ * Histograms
+ */
+static unsigned int hist_index(uint64_t value)
+{
+	unsigned int msb;
+
+	if (value < HIST_SUB_BUCKETS) {
+		return (value);
+	}
+	msb = 63 - __builtin_clzll(value);
+	return ((msb - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS +
+		((value >> (msb - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1)));
+}
+
+static uint64_t hist_bucket_high(unsigned int index)
+{
+	unsigned int shift;
+	uint64_t mantissa;
+
+	if (index < HIST_SUB_BUCKETS) {
+		return (index);
+	}
+	shift = index / HIST_SUB_BUCKETS - 1;
+	mantissa = HIST_SUB_BUCKETS + (index % HIST_SUB_BUCKETS);
+	return (((mantissa + 1) << shift) - 1);
+}
+
+static void hist_record(struct sim_histogram *hist, uint64_t value)
+{
+	hist->buckets[hist_index(value)]++;
+	hist->count++;
+	hist->sum += value;
+	if (value > hist->max) {
+		hist->max = value;
+	}
+}
+
+static uint64_t hist_percentile(const struct sim_histogram *hist, unsigned int permille)
+{
+	uint64_t want;
+	uint64_t seen = 0;
+	uint64_t high;
+	unsigned int i;
+
+	if (hist->count == 0) {
+		return (0);
+	}
+	want = (hist->count * permille + 999) / 1000;
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen >= want) {
+			high = hist_bucket_high(i);
+			return (high < hist->max ? high : hist->max);
+		}
+	}
+	return (hist->max);
+}
+
+static double ns_to_ms(uint64_t ns)
+{
+	return ((double)ns / QB_TIME_NS_IN_MSEC);
+}
+
+/*
+ * Callbacks from totem
+ */
+static struct sim_node *current_node(void)
+{
+	return (simloop_user_data_get(simloop_current_get()));
+}
+
+static void sim_log_printf (
+	int level,
+	int subsys,
+	const char *function_name,
+	const char *file_name,
+	int file_line,
+	const char *format, ...) __attribute__((format(printf, 6, 7)));
+
+static void sim_log_printf (
+	int level,
+	int subsys,
+	const char *function_name,
+	const char *file_name,
+	int file_line,
+	const char *format, ...)
+{
+	struct sim_node *node;
+	va_list ap;
+
+	if (level > log_level) {
+		return;
+	}
+	node = current_node();
+
+	fprintf(stderr, "%12.3f [%3u] %s: ",
+		ns_to_ms(simloop_now()), node ? node->nodeid : 0, function_name);
+	va_start(ap, format);
+	vfprintf(stderr, format, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+}
+
+static void sim_ring_id_create_or_load (
+	struct memb_ring_id *memb_ring_id,
+	unsigned int nodeid,
+	unsigned int lane)
+{
+	if (ring_id_store[nodeid].rep == 0) {
+		ring_id_store[nodeid].rep = nodeid;
+		ring_id_store[nodeid].seq = 0;
+	}
+	memcpy(memb_ring_id, &ring_id_store[nodeid], sizeof(struct memb_ring_id));
+}
+
+static void sim_ring_id_store (
+	const struct memb_ring_id *memb_ring_id,
+	unsigned int nodeid,
+	unsigned int lane)
+{
+	memcpy(&ring_id_store[nodeid], memb_ring_id, sizeof(struct memb_ring_id));
+}
+
+static void sim_deliver_fn (
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required)
+{
+	struct sim_node *node = current_node();
+	const struct sim_msg_header *header = msg;
+	uint64_t latency;
+
+	if (node == NULL || msg_len < sizeof(struct sim_msg_header) ||
+	    header->magic != SIM_MSG_MAGIC ||
+	    header->sender == 0 || header->sender > TOTEMSIM_MAX_NODES) {
+		return;
+	}
+
+	if (header->seq <= node->last_seq[header->sender]) {
+		phase.order_errors++;
+	}
+	node->last_seq[header->sender] = header->seq;
+
+	latency = simloop_now() - header->send_time;
+	hist_record(&phase.latency, latency);
+	hist_record(&total_latency, latency);
+
+	phase.delivered++;
+	phase.delivered_bytes += msg_len;
+}
+
+static void sim_trans_ack_fn(void *data)
+{
+	struct sim_node *node = data;
+
+	if (node->up) {
+		totemsrp_trans_ack(node->srp_context);
+	}
+}
+
+static void sim_confchg_fn (
+	enum totem_configuration_type configuration_type,
+	const unsigned int *member_list, size_t member_list_entries,
+	const unsigned int *left_list, size_t left_list_entries,
+	const unsigned int *joined_list, size_t joined_list_entries,
+	const struct memb_ring_id *ring_id)
+{
+	struct sim_node *node = current_node();
+	qb_loop_timer_handle th;
+
+	if (node == NULL) {
+		return;
+	}
+
+	phase.confchgs++;
+	if (configuration_type != TOTEM_CONFIGURATION_REGULAR) {
+		return;
+	}
+
+	if (member_list_entries > TOTEMSIM_MAX_NODES) {
+		member_list_entries = TOTEMSIM_MAX_NODES;
+	}
+	memcpy(node->members, member_list, member_list_entries * sizeof(unsigned int));
+	node->member_entries = member_list_entries;
+	memcpy(&node->ring_id, ring_id, sizeof(struct memb_ring_id));
+
+	/*
+	 * Synchronization is instantaneous in the simulator
+	 */
+	qb_loop_timer_add(node->loop, QB_LOOP_MED, 0, node, sim_trans_ack_fn, &th);
+}
+
+static void sim_waiting_trans_ack_fn (int waiting_trans_ack)
+{
+	struct sim_node *node = current_node();
+
+	if (node == NULL) {
+		return;
+	}
+	node->waiting_trans_ack = waiting_trans_ack;
+	if (!waiting_trans_ack) {
+		recovery_check();
+	}
+}
+
+/*
+ * Load generation
+ */
+static int node_send(struct sim_node *node, uint32_t size)
+{
+	char buf[FRAME_SIZE_MAX];
+	struct sim_msg_header *header = (struct sim_msg_header *)buf;
+	struct iovec iov;
+
+	if (totemsrp_avail(node->srp_context) <= 0) {
+		return (-1);
+	}
+
+	memset(buf, 0, size);
+	header->magic = SIM_MSG_MAGIC;
+	header->sender = node->nodeid;
+	header->seq = ++node->send_seq;
+	header->send_time = simloop_now();
+
+	iov.iov_base = buf;
+	iov.iov_len = size;
+	if (totemsrp_mcast(node->srp_context, &iov, 1, 0) != 0) {
+		node->send_seq--;
+		return (-1);
+	}
+	return (0);
+}
+
+static void load_timer_fn(void *data)
+{
+	struct sim_node *node = data;
+	int i;
+
+	if (load_flood) {
+		for (i = 0; i < SIM_FLOOD_BURST; i++) {
+			if (node_send(node, load_size) != 0) {
+				phase.throttled++;
+				break;
+			}
+			phase.originated++;
+		}
+	} else {
+		node->load_credit += load_rate;
+		while (node->load_credit >= 1000) {
+			node->load_credit -= 1000;
+			if (node_send(node, load_size) != 0) {
+				phase.throttled++;
+				continue;
+			}
+			phase.originated++;
+		}
+	}
+
+	if (load_rate || load_flood) {
+		qb_loop_timer_add(node->loop, QB_LOOP_MED, SIM_TICK_NS,
+			node, load_timer_fn, &node->load_timer);
+	}
+}
+
+static void load_timer_start(struct sim_node *node)
+{
+	qb_loop_timer_del(node->loop, node->load_timer);
+	node->load_credit = 0;
+	if ((load_rate || load_flood) && node->up) {
+		qb_loop_timer_add(node->loop, QB_LOOP_MED, SIM_TICK_NS,
+			node, load_timer_fn, &node->load_timer);
+	}
+}
+
+/*
+ * Membership convergence tracking
+ */
+static int node_converged(struct sim_node *node)
+{
+	unsigned int partition = totemloop_partition_get(node->nodeid);
+	size_t expected = 0;
+	size_t i;
+	int n;
+
+	if (node->waiting_trans_ack) {
+		return (0);
+	}
+	for (n = 1; n <= num_nodes; n++) {
+		if (!nodes[n].up || totemloop_partition_get(n) != partition) {
+			continue;
+		}
+		for (i = 0; i < node->member_entries; i++) {
+			if (node->members[i] == n) {
+				break;
+			}
+		}
+		if (i == node->member_entries) {
+			return (0);
+		}
+		expected++;
+	}
+	return (expected == node->member_entries);
+}
+
+static void recovery_start_event(const char *event)
+{
+	recovery_pending = 1;
+	recovery_start = simloop_now();
+	snprintf(recovery_event, sizeof(recovery_event), "%s", event);
+}
+
+static int cluster_converged(void)
+{
+	int n;
+
+	for (n = 1; n <= num_nodes; n++) {
+		if (nodes[n].up && !node_converged(&nodes[n])) {
+			return (0);
+		}
+	}
+	return (1);
+}
+
+static void recovery_check(void)
+{
+	uint64_t recovery_time;
+
+	if (!recovery_pending || !cluster_converged()) {
+		return;
+	}
+	recovery_pending = 0;
+	recovery_time = simloop_now() - recovery_start;
+	hist_record(&total_recovery, recovery_time);
+
+	fprintf(output_file, "%12.3f recovery after %s: %.3f ms\n",
+		ns_to_ms(simloop_now()), recovery_event, ns_to_ms(recovery_time));
+}
+
+/*
+ * Nodes
+ */
+static void node_totem_config_init(struct sim_node *node)
+{
+	struct totem_config *tc = &node->totem_config;
+
+	memset(tc, 0, sizeof(struct totem_config));
+	memset(node->interfaces, 0, sizeof(node->interfaces));
+
+	tc->interfaces = node->interfaces;
+	tc->interfaces[0].configured = 1;
+	tc->node_id = node->nodeid;
+	tc->transport_number = TOTEM_TRANSPORT_LOOP;
+
+	tc->token_timeout = totem_params.token_timeout;
+	tc->token_retransmits_before_loss_const = totem_params.token_retransmits_before_loss_const;
+	tc->token_retransmit_timeout = totem_params.token_retransmit_timeout;
+	tc->token_hold_timeout = totem_params.token_hold_timeout;
+	tc->join_timeout = totem_params.join_timeout;
+	tc->consensus_timeout = totem_params.consensus_timeout;
+	tc->merge_timeout = totem_params.merge_timeout;
+	tc->downcheck_timeout = totem_params.downcheck_timeout;
+	tc->fail_to_recv_const = totem_params.fail_to_recv_const;
+	tc->seqno_unchanged_const = totem_params.seqno_unchanged_const;
+	tc->max_network_delay = totem_params.max_network_delay;
+	tc->window_size = totem_params.window_size;
+	tc->max_messages = totem_params.max_messages;
+	tc->miss_count_const = totem_params.miss_count_const;
+
+	tc->net_mtu = 1500;
+	totemsrp_net_mtu_adjust(tc);
+
+	tc->totem_logging_configuration.log_printf = sim_log_printf;
+	tc->totem_logging_configuration.log_level_security = LOGSYS_LEVEL_WARNING;
+	tc->totem_logging_configuration.log_level_error = LOGSYS_LEVEL_ERROR;
+	tc->totem_logging_configuration.log_level_warning = LOGSYS_LEVEL_WARNING;
+	tc->totem_logging_configuration.log_level_notice = LOGSYS_LEVEL_NOTICE;
+	tc->totem_logging_configuration.log_level_debug = LOGSYS_LEVEL_DEBUG;
+	tc->totem_logging_configuration.log_level_trace = LOGSYS_LEVEL_TRACE;
+
+	tc->totem_memb_ring_id_create_or_load = sim_ring_id_create_or_load;
+	tc->totem_memb_ring_id_store = sim_ring_id_store;
+}
+
+static int node_start(struct sim_node *node)
+{
+	node->loop = simloop_create(node);
+	if (node->loop == NULL) {
+		return (-1);
+	}
+
+	node_totem_config_init(node);
+	node->member_entries = 0;
+	node->waiting_trans_ack = 1;
+	node->load_timer = 0;
+	memset(node->last_seq, 0, sizeof(node->last_seq));
+
+	if (totemsrp_initialize(node->loop, &node->srp_context,
+	    &node->totem_config, &node->pg_stats,
+	    sim_deliver_fn, sim_confchg_fn, sim_waiting_trans_ack_fn) != 0) {
+		simloop_destroy(node->loop);
+		node->loop = NULL;
+		return (-1);
+	}
+	node->up = 1;
+	load_timer_start(node);
+
+	return (0);
+}
+
+static void node_stop(struct sim_node *node)
+{
+	node->up = 0;
+	totemsrp_finalize(node->srp_context);
+	simloop_destroy(node->loop);
+	node->loop = NULL;
+	node->srp_context = NULL;
+	node->member_entries = 0;
+}
+
+static struct sim_node *node_get(unsigned int nodeid)
+{
+	if (nodeid == 0 || nodeid > (unsigned int)num_nodes) {
+		fprintf(stderr, "Invalid nodeid %u (1-%d)\n", nodeid, num_nodes);
+		return (NULL);
+	}
+	return (&nodes[nodeid]);
+}
+
+/*
+ * Commands
+ */
+int cmd_nodes(int count)
+{
+	int n;
+
+	if (count < 1 || count > TOTEMSIM_MAX_NODES) {
+		fprintf(stderr, "Number of nodes must be between 1 and %d\n", TOTEMSIM_MAX_NODES);
+		return (-1);
+	}
+	if (count <= num_nodes) {
+		fprintf(stderr, "%d nodes already exist\n", num_nodes);
+		return (-1);
+	}
+
+	for (n = num_nodes + 1; n <= count; n++) {
+		nodes[n].nodeid = n;
+		nodes[n].created = 1;
+	}
+	n = num_nodes + 1;
+	num_nodes = count;
+	for (; n <= count; n++) {
+		if (node_start(&nodes[n]) != 0) {
+			fprintf(stderr, "Unable to start node %d\n", n);
+			return (-1);
+		}
+	}
+	recovery_start_event("startup");
+	return (0);
+}
+
+int cmd_node_down(unsigned int nodeid)
+{
+	struct sim_node *node = node_get(nodeid);
+
+	if (node == NULL || !node->up) {
+		return (-1);
+	}
+	node_stop(node);
+	recovery_start_event("node down");
+	return (0);
+}
+
+/*
+ * A crash is a stop without the leave message reaching anyone: the node is
+ * moved to a private partition for the duration of the finalize.
+ */
+int cmd_node_crash(unsigned int nodeid)
+{
+	struct sim_node *node = node_get(nodeid);
+	unsigned int partition;
+
+	if (node == NULL || !node->up) {
+		return (-1);
+	}
+	partition = totemloop_partition_get(nodeid);
+	totemloop_partition_set(nodeid, 0x80000000u | nodeid);
+	node_stop(node);
+	totemloop_partition_set(nodeid, partition);
+	recovery_start_event("node crash");
+	return (0);
+}
+
+int cmd_node_up(unsigned int nodeid)
+{
+	struct sim_node *node = node_get(nodeid);
+
+	if (node == NULL || node->up) {
+		return (-1);
+	}
+	if (node_start(node) != 0) {
+		return (-1);
+	}
+	recovery_start_event("node up");
+	return (0);
+}
+
+int cmd_partition(unsigned int partition, const unsigned int *nodelist, int entries)
+{
+	int i;
+
+	for (i = 0; i < entries; i++) {
+		if (node_get(nodelist[i]) == NULL) {
+			return (-1);
+		}
+		totemloop_partition_set(nodelist[i], partition);
+	}
+	recovery_start_event("partition");
+	return (0);
+}
+
+int cmd_merge(void)
+{
+	int n;
+
+	for (n = 1; n <= num_nodes; n++) {
+		totemloop_partition_set(n, 0);
+	}
+	recovery_start_event("merge");
+	return (0);
+}
+
+static int parse_time_ns(const char *value, uint64_t *ns)
+{
+	char *end;
+	double v;
+
+	errno = 0;
+	v = strtod(value, &end);
+	if (errno || end == value || v < 0) {
+		return (-1);
+	}
+	if (*end == '\0' || strcmp(end, "ms") == 0) {
+		*ns = (uint64_t)(v * QB_TIME_NS_IN_MSEC);
+	} else if (strcmp(end, "us") == 0) {
+		*ns = (uint64_t)(v * QB_TIME_NS_IN_USEC);
+	} else if (strcmp(end, "ns") == 0) {
+		*ns = (uint64_t)v;
+	} else if (strcmp(end, "s") == 0) {
+		*ns = (uint64_t)(v * QB_TIME_NS_IN_SEC);
+	} else {
+		return (-1);
+	}
+	return (0);
+}
+
+static int parse_percent_ppm(const char *value, uint32_t *ppm)
+{
+	char *end;
+	double v;
+
+	errno = 0;
+	v = strtod(value, &end);
+	if (errno || end == value || (*end != '\0' && strcmp(end, "%") != 0) ||
+	    v < 0 || v > 100) {
+		return (-1);
+	}
+	*ppm = (uint32_t)(v * 10000);
+	return (0);
+}
+
+int cmd_net(const char *key, const char *value)
+{
+	struct totemloop_net_config net_config;
+	int res = -1;
+
+	totemloop_net_config_get(&net_config);
+
+	if (strcasecmp(key, "latency") == 0) {
+		res = parse_time_ns(value, &net_config.latency_ns);
+	} else if (strcasecmp(key, "jitter") == 0) {
+		res = parse_time_ns(value, &net_config.jitter_ns);
+	} else if (strcasecmp(key, "loss") == 0) {
+		res = parse_percent_ppm(value, &net_config.loss_ppm);
+	} else if (strcasecmp(key, "reorder") == 0) {
+		res = parse_percent_ppm(value, &net_config.reorder_ppm);
+	}
+	if (res != 0) {
+		fprintf(stderr, "Invalid network parameter %s %s\n", key, value);
+		return (-1);
+	}
+
+	totemloop_net_config_set(&net_config);
+	return (0);
+}
+
+/*
+ * Derived timeouts follow totem_volatile_config_read()
+ */
+static void totem_params_derive(void)
+{
+	totem_params.token_retransmit_timeout = (int)(totem_params.token_timeout /
+		(totem_params.token_retransmits_before_loss_const + 0.2));
+	totem_params.token_hold_timeout = (int)(totem_params.token_retransmit_timeout * 0.8 - (1000/HZ));
+	totem_params.consensus_timeout = (int)(float)(1.2 * totem_params.token_timeout);
+}
+
+static void totem_params_init(void)
+{
+	totem_params.token_timeout = 3000;
+	totem_params.token_retransmits_before_loss_const = 4;
+	totem_params.join_timeout = 50;
+	totem_params.merge_timeout = 200;
+	totem_params.downcheck_timeout = 1000;
+	totem_params.fail_to_recv_const = 2500;
+	totem_params.seqno_unchanged_const = 30;
+	totem_params.max_network_delay = 50;
+	totem_params.window_size = 50;
+	totem_params.max_messages = 17;
+	totem_params.miss_count_const = 5;
+	totem_params_derive();
+}
+
+int cmd_totem(const char *key, const char *value)
+{
+	static const struct {
+		const char *key;
+		size_t offset;
+	} keys[] = {
+		{ "token", offsetof(struct sim_totem_params, token_timeout) },
+		{ "token_retransmits_before_loss_const", offsetof(struct sim_totem_params, token_retransmits_before_loss_const) },
+		{ "token_retransmit", offsetof(struct sim_totem_params, token_retransmit_timeout) },
+		{ "hold", offsetof(struct sim_totem_params, token_hold_timeout) },
+		{ "join", offsetof(struct sim_totem_params, join_timeout) },
+		{ "consensus", offsetof(struct sim_totem_params, consensus_timeout) },
+		{ "merge", offsetof(struct sim_totem_params, merge_timeout) },
+		{ "downcheck", offsetof(struct sim_totem_params, downcheck_timeout) },
+		{ "fail_recv_const", offsetof(struct sim_totem_params, fail_to_recv_const) },
+		{ "seqno_unchanged_const", offsetof(struct sim_totem_params, seqno_unchanged_const) },
+		{ "max_network_delay", offsetof(struct sim_totem_params, max_network_delay) },
+		{ "window_size", offsetof(struct sim_totem_params, window_size) },
+		{ "max_messages", offsetof(struct sim_totem_params, max_messages) },
+		{ "miss_count_const", offsetof(struct sim_totem_params, miss_count_const) },
+	};
+	unsigned int i;
+	unsigned long v;
+	char *end;
+
+	errno = 0;
+	v = strtoul(value, &end, 10);
+	if (errno || end == value || *end != '\0') {
+		fprintf(stderr, "Invalid value %s for totem.%s\n", value, key);
+		return (-1);
+	}
+
+	for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+		if (strcasecmp(key, keys[i].key) == 0) {
+			*(unsigned int *)((char *)&totem_params + keys[i].offset) = v;
+			if (strcasecmp(key, "token") == 0 ||
+			    strcasecmp(key, "token_retransmits_before_loss_const") == 0) {
+				totem_params_derive();
+			}
+			if (num_nodes) {
+				fprintf(stderr, "totem.%s only applies to nodes started from now on\n", key);
+			}
+			return (0);
+		}
+	}
+	fprintf(stderr, "Unknown totem parameter %s\n", key);
+	return (-1);
+}
+
+int cmd_seed(uint64_t seed)
+{
+	totemloop_seed_set(seed);
+	return (0);
+}
+
+static int load_size_check(uint32_t size)
+{
+	uint32_t max_size = 1500;
+	struct totem_config tc;
+
+	memset(&tc, 0, sizeof(tc));
+	tc.net_mtu = max_size;
+	totemsrp_net_mtu_adjust(&tc);
+
+	if (size < sizeof(struct sim_msg_header) || size > tc.net_mtu) {
+		fprintf(stderr, "Message size must be between %zu and %u\n",
+			sizeof(struct sim_msg_header), tc.net_mtu);
+		return (-1);
+	}
+	return (0);
+}
+
+static void load_restart(void)
+{
+	int n;
+
+	for (n = 1; n <= num_nodes; n++) {
+		if (nodes[n].up) {
+			load_timer_start(&nodes[n]);
+		}
+	}
+}
+
+int cmd_load(uint32_t rate, uint32_t size)
+{
+	if (rate && load_size_check(size) != 0) {
+		return (-1);
+	}
+	load_flood = 0;
+	load_rate = rate;
+	load_size = size;
+	load_restart();
+	return (0);
+}
+
+int cmd_flood(uint32_t size)
+{
+	if (load_size_check(size) != 0) {
+		return (-1);
+	}
+	load_flood = 1;
+	load_rate = 0;
+	load_size = size;
+	load_restart();
+	return (0);
+}
+
+static void phase_begin(void)
+{
+	memset(&phase, 0, sizeof(phase));
+	phase.start_time = simloop_now();
+	totemloop_net_stats_get(&phase.net_start);
+}
+
+static void phase_report(uint64_t wall_ns)
+{
+	struct totemloop_net_stats net_end;
+	uint64_t duration = simloop_now() - phase.start_time;
+	double secs = (double)duration / QB_TIME_NS_IN_SEC;
+	int up = 0;
+	int n;
+
+	for (n = 1; n <= num_nodes; n++) {
+		up += nodes[n].up;
+	}
+	totemloop_net_stats_get(&net_end);
+
+	fprintf(output_file, "%12.3f phase %d: %.3f s, %d/%d nodes up\n",
+		ns_to_ms(simloop_now()), ++phase_number, secs, up, num_nodes);
+	if (secs > 0) {
+		fprintf(output_file, "    throughput: originated %llu (%.1f msg/s) delivered %llu (%.1f msg/s, %.3f MB/s) throttled %llu\n",
+			(unsigned long long)phase.originated, phase.originated / secs,
+			(unsigned long long)phase.delivered, phase.delivered / secs,
+			phase.delivered_bytes / secs / (1024 * 1024),
+			(unsigned long long)phase.throttled);
+	}
+	fprintf(output_file, "    latency: p50 %.3f ms p90 %.3f ms p99 %.3f ms max %.3f ms\n",
+		ns_to_ms(hist_percentile(&phase.latency, 500)),
+		ns_to_ms(hist_percentile(&phase.latency, 900)),
+		ns_to_ms(hist_percentile(&phase.latency, 990)),
+		ns_to_ms(phase.latency.max));
+	fprintf(output_file, "    network: packets %llu lost %llu partitioned %llu, confchgs %llu, order errors %llu\n",
+		(unsigned long long)(net_end.packets_sent - phase.net_start.packets_sent),
+		(unsigned long long)(net_end.packets_lost - phase.net_start.packets_lost),
+		(unsigned long long)(net_end.packets_partitioned - phase.net_start.packets_partitioned),
+		(unsigned long long)phase.confchgs,
+		(unsigned long long)phase.order_errors);
+	fprintf(output_file, "    simulator: %llu events in %.3f s wall clock\n",
+		(unsigned long long)simloop_events_dispatched(),
+		(double)wall_ns / QB_TIME_NS_IN_SEC);
+}
+
+static uint64_t wall_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * QB_TIME_NS_IN_SEC + ts.tv_nsec);
+}
+
+int cmd_run(uint64_t duration_ms)
+{
+	uint64_t wall_start = wall_clock_ns();
+
+	phase_begin();
+	simloop_run_until(simloop_now() + duration_ms * QB_TIME_NS_IN_MSEC);
+	phase_report(wall_clock_ns() - wall_start);
+
+	return (phase.order_errors ? -1 : 0);
+}
+
+/*
+ * Run until the membership has converged, in small steps so
+ * the reported recovery time is not affected
+ */
+int cmd_settle(uint64_t timeout_ms)
+{
+	uint64_t end = simloop_now() + timeout_ms * QB_TIME_NS_IN_MSEC;
+
+	recovery_check();
+	while (recovery_pending && simloop_now() < end) {
+		simloop_run_until(simloop_now() + QB_TIME_NS_IN_MSEC);
+		recovery_check();
+	}
+	if (recovery_pending) {
+		fprintf(output_file, "%12.3f membership did not converge within %llu ms after %s\n",
+			ns_to_ms(simloop_now()), (unsigned long long)timeout_ms, recovery_event);
+		return (-1);
+	}
+	return (0);
+}
+
+void cmd_show(void)
+{
+	struct totemloop_net_config net_config;
+	size_t i;
+	int n;
+
+	totemloop_net_config_get(&net_config);
+	fprintf(output_file, "%12.3f network: latency %.3f ms jitter %.3f ms loss %.4f%% reorder %.4f%%\n",
+		ns_to_ms(simloop_now()),
+		ns_to_ms(net_config.latency_ns), ns_to_ms(net_config.jitter_ns),
+		net_config.loss_ppm / 10000.0, net_config.reorder_ppm / 10000.0);
+
+	for (n = 1; n <= num_nodes; n++) {
+		fprintf(output_file, "    node %3d: %-4s partition %u ring " CS_PRI_RING_ID " members",
+			n, nodes[n].up ? "up" : "down",
+			totemloop_partition_get(n),
+			nodes[n].ring_id.rep, (uint64_t)nodes[n].ring_id.seq);
+		for (i = 0; i < nodes[n].member_entries; i++) {
+			fprintf(output_file, " %u", nodes[n].members[i]);
+		}
+		fprintf(output_file, "\n");
+	}
+}
+
+static void summary_report(void)
+{
+	fprintf(output_file, "summary: virtual time %.3f s, %llu events\n",
+		ns_to_ms(simloop_now()) / 1000,
+		(unsigned long long)simloop_events_dispatched());
+	fprintf(output_file, "    latency: samples %llu p50 %.3f ms p99 %.3f ms max %.3f ms\n",
+		(unsigned long long)total_latency.count,
+		ns_to_ms(hist_percentile(&total_latency, 500)),
+		ns_to_ms(hist_percentile(&total_latency, 990)),
+		ns_to_ms(total_latency.max));
+	fprintf(output_file, "    recovery: events %llu mean %.3f ms max %.3f ms\n",
+		(unsigned long long)total_recovery.count,
+		total_recovery.count ? ns_to_ms(total_recovery.sum / total_recovery.count) : 0.0,
+		ns_to_ms(total_recovery.max));
+}
+
+/*
+ * Keep the linker happy, these are only reachable from the
+ * daemon's configuration and knet code paths
+ */
+const char *corosync_get_config_file(void)
+{
+	return (COROSYSCONFDIR "/corosync.conf");
+}
+
+void totemconfig_commit_new_params(struct totem_config *totem_config, icmap_map_t map)
+{
+}
+
+void stats_knet_add_member(knet_node_id_t nodeid, uint8_t link)
+{
+}
+
+void stats_knet_del_member(knet_node_id_t nodeid, uint8_t link)
+{
+}
+
+void stats_knet_add_handle(void)
+{
+}
+
+static void usage(const char *name)
+{
+	printf("Usage:\n");
+	printf("%s [-v] [-s seed] [-o <output file>] [<scenario file>]\n", name);
+	printf("      -v    increase verbosity of totem logging (can be repeated)\n");
+	printf("      -s    seed for the network loss and reorder decisions\n");
+	printf("      -o    write the report to a file instead of stdout\n");
+	printf("  The scenario is read from stdin if no file is given.\n");
+	printf("  Type 'help' in a scenario for a list of commands.\n");
+}
+
+int main(int argc, char **argv)
+{
+	char line[1024];
+	char *output_file_name = NULL;
+	FILE *input_file = stdin;
+	int lineno = 0;
+	int errors = 0;
+	size_t len;
+	int ch;
+
+	while ((ch = getopt (argc, argv, "vs:o:h")) != EOF) {
+		switch (ch) {
+		case 'v':
+			if (log_level < LOGSYS_LEVEL_TRACE) {
+				log_level++;
+			}
+			break;
+		case 's':
+			totemloop_seed_set(strtoull(optarg, NULL, 0));
+			break;
+		case 'o':
+			output_file_name = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			exit(0);
+		}
+	}
+
+	if (optind < argc) {
+		input_file = fopen(argv[optind], "r");
+		if (!input_file) {
+			fprintf(stderr, "Unable to open %s: %s\n", argv[optind], strerror(errno));
+			exit(2);
+		}
+	}
+
+	if (output_file_name) {
+		output_file = fopen(output_file_name, "w");
+		if (!output_file) {
+			fprintf(stderr, "Unable to open %s for output: %s\n", output_file_name, strerror(errno));
+			exit(3);
+		}
+	}
+	else {
+		output_file = stdout;
+	}
+
+	totem_params_init();
+
+	while (fgets(line, sizeof(line), input_file)) {
+		lineno++;
+		len = strlen(line);
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+			line[--len] = '\0';
+		}
+		if (parse_input_command(line, lineno) != 0) {
+			errors++;
+		}
+	}
+
+	summary_report();
+
+	if (input_file != stdin) {
+		fclose(input_file);
+	}
+	if (output_file != stdout) {
+		fclose(output_file);
+	}
+
+	return (errors ? 1 : 0);
+}
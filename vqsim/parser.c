@@ -36,6 +36,8 @@ static void do_usage(void)
 	printf("           enable/disable synchronous execution of commands (wait for completion)\n");
 	printf("assert     on|off (default off)\n");
 	printf("           Abort the simulation run if a timeout expires\n");
+	printf("report     on|off (default off)\n");
+	printf("           Print quorum decision time and message counts after each synchronous command\n");
 	printf("show       Show current nodes status\n");
 	printf("exit\n\n");
 }
@@ -55,6 +57,7 @@ static int run_assert_cmd(int argc, char **argv);
 static int run_autofence_cmd(int argc, char **argv);
 static int run_qdevice_cmd(int argc, char **argv);
 static int run_sync_cmd(int argc, char **argv);
+static int run_report_cmd(int argc, char **argv);
 
 static struct cmd_list_struct {
 	const char *cmd;
@@ -72,6 +75,7 @@ static struct cmd_list_struct {
 	{ "timeout", 1, run_timeout_cmd},
 	{ "sync", 1, run_sync_cmd},
 	{ "assert", 1, run_assert_cmd},
+	{ "report", 1, run_report_cmd},
 	{ "exit", 0, run_exit_cmd},
 	{ "quit", 0, run_exit_cmd},
 	{ "q", 0, run_exit_cmd},
@@ -258,16 +262,22 @@ static int run_up_cmd(int argc, char **argv)
 
 static int run_down_cmd(int argc, char **argv)
 {
-	int nodeid;
-	int i;
+	int partition;
+	int num_nodes;
+	int *nodelist;
+	int i,j;
 	int succeeded = 0;
 
 	cmd_start_sync_command();
 
 	for (i=1; i<argc; i++) {
-		nodeid = atoi(argv[1]);
-		if (!cmd_stop_node(nodeid)) {
-			succeeded++;
+		if (parse_partition_nodelist(argv[i], &partition, &num_nodes, &nodelist) == 0) {
+			for (j=0; j<num_nodes; j++) {
+				if (!cmd_stop_node(nodelist[j])) {
+					succeeded++;
+				}
+			}
+			free(nodelist);
 		}
 	}
 	return succeeded;
@@ -411,8 +421,28 @@ static int run_assert_cmd(int argc, char **argv)
 	return 0;
 }
 
+static int run_report_cmd(int argc, char **argv)
+{
+	int onoff = -1;
+
+	if (strcasecmp(argv[1], "on") == 0) {
+		onoff = 1;
+	}
+	if (strcasecmp(argv[1], "off") == 0) {
+		onoff = 0;
+	}
+	if (onoff == -1) {
+		fprintf(stderr, "ERR: report value must be 'on' or 'off'\n");
+	}
+	else {
+		cmd_set_report(onoff);
+	}
+	return 0;
+}
+
 static int run_exit_cmd(int argc, char **argv)
 {
+	cmd_print_report_totals();
 	cmd_stop_all_nodes();
 	exit(0);
 }
@@ -1,12 +1,13 @@
 /*
   This is a Votequorum object in the parent process. it's really just a conduit for the forked
-  votequorum entity
+  votequorum entity, or for the in-process one when running with -i
 */
 
 #include <qb/qblog.h>
 #include <qb/qbloop.h>
 #include <qb/qbipcc.h>
 #include <netinet/in.h>
+#include <assert.h>
 
 #include "../exec/votequorum.h"
 #include "vqsim.h"
@@ -16,9 +17,17 @@ struct vq_instance
 	int nodeid;
 	int vq_socket;
 	pid_t pid;
+	struct vq_inproc_node *inproc;
 };
 
-vq_object_t vq_create_instance(qb_loop_t *poll_loop, int nodeid)
+static int use_inproc;
+
+void vq_set_inproc(int onoff)
+{
+	use_inproc = onoff;
+}
+
+vq_object_t vq_create_instance(qb_loop_t *poll_loop, int nodeid, void *user_data)
 {
 	struct vq_instance *instance = malloc(sizeof(struct vq_instance));
 	if (!instance) {
@@ -26,6 +35,18 @@ vq_object_t vq_create_instance(qb_loop_t *poll_loop, int nodeid)
 	}
 
 	instance->nodeid = nodeid;
+	instance->vq_socket = -1;
+	instance->pid = 0;
+	instance->inproc = NULL;
+
+	if (use_inproc) {
+		instance->inproc = inproc_create_node(poll_loop, nodeid, user_data);
+		if (!instance->inproc) {
+			free(instance);
+			return NULL;
+		}
+		return instance;
+	}
 
 	if (fork_new_instance(nodeid, &instance->vq_socket, &instance->pid)) {
 		free(instance);
@@ -47,6 +68,11 @@ void vq_quit(vq_object_t instance)
 	struct vqsim_msg_header msg;
 	int res;
 
+	if (vqi->inproc) {
+		inproc_quit(vqi->inproc, 0);
+		return;
+	}
+
 	msg.type = VQMSG_QUIT;
 	msg.from_nodeid = 0;
 	msg.param = 0;
@@ -63,6 +89,11 @@ int vq_quit_if_inquorate(vq_object_t instance)
 	struct vqsim_msg_header msg;
 	int res;
 
+	if (vqi->inproc) {
+		inproc_quit(vqi->inproc, 1);
+		return 0;
+	}
+
 	msg.type = VQMSG_QUORUMQUIT;
 	msg.from_nodeid = 0;
 	msg.param = 0;
@@ -81,6 +112,11 @@ int vq_set_nodelist(vq_object_t instance, struct memb_ring_id *ring_id, int *nod
 	struct vqsim_sync_msg *msg = (void*)msgbuf;
 	int res;
 
+	if (vqi->inproc) {
+		inproc_set_nodelist(vqi->inproc, ring_id, nodeids, nodeids_entries);
+		return 0;
+	}
+
 	msg->header.type = VQMSG_SYNC;
 	msg->header.from_nodeid = 0;
 	msg->header.param = 0;
@@ -102,6 +138,11 @@ int vq_set_qdevice(vq_object_t instance, struct memb_ring_id *ring_id, int onoff
 	struct vqsim_msg_header msg;
 	int res;
 
+	if (vqi->inproc) {
+		inproc_set_qdevice(vqi->inproc, onoff);
+		return 0;
+	}
+
 	msg.type = VQMSG_QDEVICE;
 	msg.from_nodeid = 0;
 	msg.param = onoff;
@@ -119,3 +160,22 @@ int vq_get_parent_fd(vq_object_t instance)
 
 	return vqi->vq_socket;
 }
+
+int vq_send_exec(vq_object_t instance, const char *msg, int len)
+{
+	struct vq_instance *vqi = instance;
+	ssize_t write_res;
+
+	if (vqi->inproc) {
+		inproc_send_exec(vqi->inproc, msg, len);
+		return 0;
+	}
+
+	write_res = write(vqi->vq_socket, msg, len);
+	/*
+	 * Read counterpart is not ready for receiving non-complete message so
+	 * ensure all required information was send.
+	 */
+	assert(write_res == len);
+	return 0;
+}
@@ -1,10 +1,12 @@
 #include <config.h>
 
 #include <stdio.h>
+#include <inttypes.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <qb/qblog.h>
 #include <qb/qbloop.h>
+#include <qb/qbutil.h>
 #include <sys/poll.h>
 #include <netinet/in.h>
 #include <sys/queue.h>
@@ -63,6 +65,22 @@ static int waiting_for_sync = 0;
 static int is_tty;
 static int assert_on_timeout;
 static uint64_t command_timeout = 250000000L;
+static int report;
+
+/*
+ * Counters for 'report', per command and for the whole run.
+ * A delivery is one exec message handed to one node.
+ */
+struct vq_stats {
+	uint64_t exec_msgs;
+	uint64_t deliveries;
+	uint64_t quorum_msgs;
+};
+static struct vq_stats cmd_stats;
+static struct vq_stats total_stats;
+static uint64_t cmd_start_time;
+static uint64_t cmd_last_quorum_time;
+static uint64_t total_settle_time;
 
 static struct vq_node *find_by_pid(pid_t pid);
 static void send_partition_to_nodes(struct vq_partition *partition, int newring);
@@ -138,19 +156,48 @@ static void print_quorum_state(struct vq_node *node)
 static void propogate_vq_message(struct vq_node *vqn, const char *msg, int len)
 {
 	struct vq_node *other_vqn;
-	ssize_t write_res;
+
+	cmd_stats.exec_msgs++;
 
 	/* Send it to everyone in that node's partition (including itself) */
 	TAILQ_FOREACH(other_vqn, &vqn->partition->nodelist, entries) {
-		write_res = write(other_vqn->fd, msg, len);
-		/*
-		 * Read counterpart is not ready for receiving non-complete message so
-		 * ensure all required information was send.
-		 */
-		assert(write_res == len);
+		vq_send_exec(other_vqn->instance, msg, len);
+		cmd_stats.deliveries++;
 	}
 }
 
+static void stats_add(struct vq_stats *to, const struct vq_stats *from)
+{
+	to->exec_msgs += from->exec_msgs;
+	to->deliveries += from->deliveries;
+	to->quorum_msgs += from->quorum_msgs;
+}
+
+/* Called when a synchronous command has completed or timed out */
+static void print_cmd_report(int settled)
+{
+	uint64_t settle_time = cmd_last_quorum_time > cmd_start_time ?
+		cmd_last_quorum_time - cmd_start_time : 0;
+
+	if (settled) {
+		fprintf(output_file, "#report: quorum decided in %.3f ms",
+			(double)settle_time / QB_TIME_NS_IN_MSEC);
+		total_settle_time += settle_time;
+	} else {
+		fprintf(output_file, "#report: not settled");
+	}
+	fprintf(output_file, ", %"PRIu64" messages, %"PRIu64" deliveries, %"PRIu64" quorum updates\n",
+		cmd_stats.exec_msgs, cmd_stats.deliveries, cmd_stats.quorum_msgs);
+}
+
+static void reset_cmd_stats(void)
+{
+	stats_add(&total_stats, &cmd_stats);
+	memset(&cmd_stats, 0, sizeof(cmd_stats));
+	cmd_start_time = qb_util_nano_current_get();
+	cmd_last_quorum_time = cmd_start_time;
+}
+
 
 static void cmd_show_prompt_if_needed(void)
 {
@@ -165,8 +212,12 @@ static void cmd_show_prompt_if_needed(void)
 
 }
 
-void resume_kb_input(int show_status)
+static void resume_kb_input_report(int show_status, int settled)
 {
+	if (report && waiting_for_sync) {
+		print_cmd_report(settled);
+	}
+
 	/* If running synchronously, we don't display
 	   the quorum messages as they come in. So run 'show' commamnd
 	*/
@@ -190,6 +241,11 @@ void resume_kb_input(int show_status)
 	cmd_show_prompt_if_needed();
 }
 
+void resume_kb_input(int show_status)
+{
+	resume_kb_input_report(show_status, 1);
+}
+
 /* Return true (1) if all nodes in each partition have the same ring id, false(0) otherwise */
 static int all_nodes_consistent(void)
 {
@@ -210,58 +266,71 @@ static int all_nodes_consistent(void)
 	return 1;
 }
 
+/* Message from a node, read from its socket or passed directly by an in-process node */
+void vq_node_message(void *node_data, char *msgbuf, int msglen)
+{
+	struct vqsim_msg_header *msg;
+	struct vqsim_quorum_msg *qmsg;
+	struct vq_node *vqn = node_data;
+
+	if (msglen < sizeof(*msg)) {
+		fprintf(stderr, "Received message is too short\n");
+		return;
+	}
+
+	msg = (void*)msgbuf;
+	switch (msg->type) {
+	case VQMSG_QUORUM:
+		qmsg = (void*)msgbuf;
+		/*
+		 * Check length of message.
+		 * SOCK_SEQPACKET is used so this check is not strictly needed.
+		 */
+		if (msglen < sizeof(*qmsg) ||
+		    qmsg->view_list_entries > MAX_NODES ||
+		    msglen < sizeof(*qmsg) + sizeof(qmsg->view_list[0]) * qmsg->view_list_entries) {
+			fprintf(stderr, "Received quorum message is too short or corrupted\n");
+			return;
+		}
+		cmd_stats.quorum_msgs++;
+		cmd_last_quorum_time = qb_util_nano_current_get();
+		save_quorum_state(vqn, qmsg);
+		if (!sync_cmds) {
+			print_quorum_state(vqn);
+		}
+
+		/* Have the partitions stabilised? */
+		if (sync_cmds && waiting_for_sync &&
+		    all_nodes_consistent()) {
+			qb_loop_timer_del(poll_loop, kb_timer);
+			resume_kb_input(sync_cmds);
+		}
+		break;
+	case VQMSG_EXEC:
+		/* Message from votequorum, pass around the partition */
+		propogate_vq_message(vqn, msgbuf, msglen);
+		break;
+	case VQMSG_QUIT:
+	case VQMSG_SYNC:
+	case VQMSG_QDEVICE:
+	case VQMSG_QUORUMQUIT:
+		/* not used here */
+		break;
+	}
+}
+
 static int vq_parent_read_fn(int32_t fd, int32_t revents, void *data)
 {
 	char msgbuf[8192];
 	int msglen;
-	struct vqsim_msg_header *msg;
-	struct vqsim_quorum_msg *qmsg;
 	struct vq_node *vqn = data;
 
 	if (revents == POLLIN) {
 		msglen = read(fd, msgbuf, sizeof(msgbuf));
 		if (msglen < 0) {
 			perror("read failed");
-		} else if (msglen < sizeof(*msg)) {
-			fprintf(stderr, "Received message is too short\n");
 		} else {
-			msg = (void*)msgbuf;
-			switch (msg->type) {
-			case VQMSG_QUORUM:
-				qmsg = (void*)msgbuf;
-				/*
-				 * Check length of message.
-				 * SOCK_SEQPACKET is used so this check is not strictly needed.
-				 */
-				if (msglen < sizeof(*qmsg) ||
-				    qmsg->view_list_entries > MAX_NODES ||
-				    msglen < sizeof(*qmsg) + sizeof(qmsg->view_list[0]) * qmsg->view_list_entries) {
-					fprintf(stderr, "Received quorum message is too short or corrupted\n");
-					return (0);
-				}
-				save_quorum_state(vqn, qmsg);
-				if (!sync_cmds) {
-					print_quorum_state(vqn);
-				}
-
-				/* Have the partitions stabilised? */
-				if (sync_cmds && waiting_for_sync &&
-				    all_nodes_consistent()) {
-					qb_loop_timer_del(poll_loop, kb_timer);
-					resume_kb_input(sync_cmds);
-				}
-				break;
-			case VQMSG_EXEC:
-				/* Message from votequorum, pass around the partition */
-				propogate_vq_message(vqn, msgbuf, msglen);
-				break;
-			case VQMSG_QUIT:
-			case VQMSG_SYNC:
-			case VQMSG_QDEVICE:
-			case VQMSG_QUORUMQUIT:
-				/* not used here */
-				break;
-			}
+			vq_node_message(vqn, msgbuf, msglen);
 		}
 	}
 	if (revents == POLLERR) {
@@ -319,32 +388,41 @@ static void remove_node(struct vq_node *node)
 	send_partition_to_nodes(part, 1);
 }
 
+/* A node has gone, its child process exited or the in-process node was stopped */
+void vq_node_quit(void *node_data, int exit_code)
+{
+	struct vq_node *vqn = node_data;
+	const char *exit_status="";
+	char text[132];
+
+	switch (exit_code) {
+	case 0:
+		exit_status = "(on request)";
+		break;
+	case 1:
+		exit_status = "(autofenced)";
+		break;
+	default:
+		sprintf(text, "(exit code %d)", exit_code);
+		exit_status = text;
+		break;
+	}
+	printf("%d:" CS_PRI_NODE_ID ": Quit %s\n", vqn->partition->num, vqn->nodeid, exit_status);
+
+	remove_node(vqn);
+}
+
 static int32_t sigchld_handler(int32_t sig, void *data)
 {
 	pid_t pid;
 	int status;
 	struct vq_node *vqn;
-	const char *exit_status="";
-	char text[132];
 
 	pid = wait(&status);
 	if (WIFEXITED(status)) {
 		vqn = find_by_pid(pid);
 		if (vqn) {
-			switch (WEXITSTATUS(status)) {
-			case 0:
-				exit_status = "(on request)";
-				break;
-			case 1:
-				exit_status = "(autofenced)";
-				break;
-			default:
-				sprintf(text, "(exit code %d)", WEXITSTATUS(status));
-				break;
-			}
-			printf("%d:" CS_PRI_NODE_ID ": Quit %s\n", vqn->partition->num, vqn->nodeid, exit_status);
-
-			remove_node(vqn);
+			vq_node_quit(vqn, WEXITSTATUS(status));
 		}
 		else {
 			fprintf(stderr, "Unknown child %d exited with status %d\n", pid, WEXITSTATUS(status));
@@ -366,7 +444,7 @@ static int32_t sigchld_handler(int32_t sig, void *data)
 static void send_partition_to_nodes(struct vq_partition *partition, int newring)
 {
 	struct vq_node *vqn;
-	int nodelist[MAX_NODES];
+	int nodelist[PROCESSOR_COUNT_MAX];
 	int nodes = 0;
 	int first = 1;
 
@@ -377,6 +455,11 @@ static void send_partition_to_nodes(struct vq_partition *partition, int newring)
 
 	/* Build the node list */
 	TAILQ_FOREACH(vqn, &partition->nodelist, entries) {
+		if (nodes == PROCESSOR_COUNT_MAX) {
+			fprintf(stderr, "ERR: partition %d has more than %d nodes\n",
+				partition->num, PROCESSOR_COUNT_MAX);
+			return;
+		}
 		nodelist[nodes++] = vqn->nodeid;
 		if (first) {
 			partition->ring_id.nodeid = vqn->nodeid;
@@ -408,7 +491,10 @@ static pid_t create_node(int nodeid, int partno)
 	newvq = malloc(sizeof(struct vq_node));
 	if (newvq) {
 		newvq->last_quorate = -1;  /* mark "uninitialized" */
-		newvq->instance = vq_create_instance(poll_loop, nodeid);
+		/* An in-process node reports its quorum state from vq_create_instance */
+		newvq->partition = &partitions[partno];
+		newvq->nodeid = nodeid;
+		newvq->instance = vq_create_instance(poll_loop, nodeid, newvq);
 		if (!newvq->instance) {
 			fprintf(stderr,
 			        "ERR: could not create vq instance nodeid " CS_PRI_NODE_ID "\n",
@@ -416,12 +502,11 @@ static pid_t create_node(int nodeid, int partno)
 			free(newvq);
 			return (pid_t) -1;
 		}
-		newvq->partition = &partitions[partno];
-		newvq->nodeid = nodeid;
 		newvq->fd = vq_get_parent_fd(newvq->instance);
 		TAILQ_INSERT_TAIL(&partitions[partno].nodelist, newvq, entries);
 
-		if (qb_loop_poll_add(poll_loop,
+		if (newvq->fd >= 0 &&
+		    qb_loop_poll_add(poll_loop,
 				     QB_LOOP_MED,
 				     newvq->fd,
 				     POLLIN | POLLERR,
@@ -519,6 +604,8 @@ static struct vq_node *find_by_pid(pid_t pid)
  */
 void cmd_start_sync_command()
 {
+	reset_cmd_stats();
+
 	if (sync_cmds) {
 		qb_loop_poll_del(poll_loop, STDIN_FILENO);
 		qb_loop_timer_add(poll_loop,
@@ -649,6 +736,24 @@ void cmd_set_assert(int onoff)
 	assert_on_timeout = onoff;
 }
 
+void cmd_set_report(int onoff)
+{
+	report = onoff;
+}
+
+void cmd_print_report_totals(void)
+{
+	if (!report) {
+		return;
+	}
+
+	stats_add(&total_stats, &cmd_stats);
+	memset(&cmd_stats, 0, sizeof(cmd_stats));
+	fprintf(output_file, "#report: total quorum decision time %.3f ms, %"PRIu64" messages, %"PRIu64" deliveries, %"PRIu64" quorum updates\n",
+		(double)total_settle_time / QB_TIME_NS_IN_MSEC,
+		total_stats.exec_msgs, total_stats.deliveries, total_stats.quorum_msgs);
+}
+
 void cmd_update_all_partitions(int newring)
 {
 	int i;
@@ -679,7 +784,7 @@ static void finish_wait_timeout(void *data)
 		}
 	}
 
-	resume_kb_input(sync_cmds);
+	resume_kb_input_report(sync_cmds, 0);
 }
 
 void cmd_set_timeout(uint64_t seconds)
@@ -731,7 +836,7 @@ static int stdin_read_fn(int32_t fd, int32_t revents, void *data)
 
 static void start_kb_input_timeout(void *data)
 {
-	resume_kb_input(1);
+	resume_kb_input_report(1, 0);
 }
 
 static void usage(char *program)
@@ -743,6 +848,7 @@ static void usage(char *program)
 	printf("    -c     config file. defaults to /etc/corosync/corosync.conf\n");
 	printf("    -o     output file. defaults to stdout\n");
 	printf("    -n     no synchronization (on adding a node)\n");
+	printf("    -i     run all nodes inside the vqsim process instead of forking them\n");
 	printf("    -h     display this help text\n");
 	printf("\n");
 	printf("%s always takes input from STDIN, but cannot use a file.\n", program);
@@ -756,7 +862,7 @@ int main(int argc, char **argv)
 	int ch;
 	char *output_file_name = NULL;
 
-	while ((ch = getopt (argc, argv, "c:o:nh")) != EOF) {
+	while ((ch = getopt (argc, argv, "c:o:nih")) != EOF) {
 		switch (ch) {
 		case 'c':
 			if (strlen(optarg) >= sizeof(sizeof(corosync_config_file) - 1)) {
@@ -771,6 +877,9 @@ int main(int argc, char **argv)
 		case 'n':
 			sync_cmds = 0;
 			break;
+		case 'i':
+			vq_set_inproc(1);
+			break;
 		default:
 			usage(argv[0]);
 			exit(0);
@@ -826,6 +935,7 @@ int main(int argc, char **argv)
 
 /* Create a full cluster of nodes from corosync.conf */
 	read_corosync_conf();
+	reset_cmd_stats();
 	if (create_nodes_from_config() && sync_cmds) {
 		/* Delay kb input handling by 1 second when we've just
 		   added the nodes from corosync.conf; expect that
@@ -47,20 +47,32 @@ struct vqsim_lib_msg
 	char libmsg[];
 };
 
-#define MAX_NODES 1024
-#define MAX_PARTITIONS 16
+#define MAX_NODES 4096
+#define MAX_PARTITIONS 64
+
+struct vq_inproc_node;
 
 /* In vq_object.c */
-vq_object_t vq_create_instance(qb_loop_t *poll_loop, int nodeid);
+void vq_set_inproc(int onoff);
+vq_object_t vq_create_instance(qb_loop_t *poll_loop, int nodeid, void *user_data);
 void vq_quit(vq_object_t instance);
 int vq_set_nodelist(vq_object_t instance, struct memb_ring_id *ring_id, int *nodeids, int nodeids_entries);
 int vq_get_parent_fd(vq_object_t instance);
 int vq_set_qdevice(vq_object_t instance, struct memb_ring_id *ring_id, int onoff);
 int vq_quit_if_inquorate(vq_object_t instance);
+int vq_send_exec(vq_object_t instance, const char *msg, int len);
 pid_t vq_get_pid(vq_object_t instance);
 
 /* in vqsim_vq_engine.c - effectively the constructor */
 int fork_new_instance(int nodeid, int *vq_sock, pid_t *child_pid);
+void set_local_node_pos(int nodeid);
+
+/* In vqsim_inproc_engine.c - all nodes in the vqsim process */
+struct vq_inproc_node *inproc_create_node(qb_loop_t *poll_loop, int nodeid, void *user_data);
+void inproc_quit(struct vq_inproc_node *node, int if_inquorate);
+void inproc_set_nodelist(struct vq_inproc_node *node, struct memb_ring_id *ring_id, int *nodeids, int nodeids_entries);
+void inproc_set_qdevice(struct vq_inproc_node *node, int onoff);
+void inproc_send_exec(struct vq_inproc_node *node, const char *msg, int len);
 
 /* In parser.c */
 void parse_input_command(char *cmd);
@@ -79,4 +91,8 @@ void cmd_qdevice_poll(int nodeid, int onoff);
 void cmd_show_node_states(void);
 void cmd_set_timeout(uint64_t seconds);
 void cmd_start_sync_command(void);
+void cmd_set_report(int onoff);
+void cmd_print_report_totals(void);
 void resume_kb_input(int show_state);
+void vq_node_message(void *node_data, char *msgbuf, int msglen);
+void vq_node_quit(void *node_data, int exit_code);
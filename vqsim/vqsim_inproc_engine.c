@@ -0,0 +1,788 @@
+/* This is the in-process alternative to vqsim_vq_engine.c (vqsim -i).
+   Every 'node' is a saved copy of the votequorum state which is switched
+   in before votequorum is called on behalf of that node, so thousands of
+   nodes can share the vqsim process and its poll loop.
+
+   Exec messages are queued and delivered in batches, switching the state
+   once per node and batch rather than once per message. Like the sync
+   barrier in corosync, a new ring is only activated once all its members
+   have finished sync_process and the messages sent so far are delivered.
+*/
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <qb/qblist.h>
+#include <qb/qbloop.h>
+#include <qb/qbipc_common.h>
+#include <netinet/in.h>
+
+#include "../exec/votequorum.h"
+#include "../exec/service.h"
+#include "../include/corosync/corotypes.h"
+#include "../include/corosync/votequorum.h"
+#include "../include/corosync/ipc_votequorum.h"
+#include <corosync/logsys.h>
+#include <corosync/coroapi.h>
+
+#include "icmap.h"
+#include "vqsim.h"
+
+#define QDEVICE_NAME "VQsim_qdevice"
+
+/* How long to wait before calling sync_process again if it is not finished */
+#define SYNC_RETRY_NS 10000000ULL
+
+/* Queued messages are kept 8 byte aligned in the inbox/outbox buffers */
+#define MSG_ALIGN(len) (((len) + 7) & ~7)
+
+typedef enum {
+	NODE_SYNC_NONE,
+	NODE_SYNC_PROCESS,
+	NODE_SYNC_DONE,
+} node_sync_state_t;
+
+struct inproc_timer {
+	qb_loop_timer_handle handle;
+	struct vq_inproc_node *node;
+	void (*timer_fn) (void *data);
+	void *data;
+	struct qb_list_head list;
+};
+
+struct inproc_msg {
+	struct vq_inproc_node *node; /* sender, only used in the outbox */
+	size_t len;
+	char data[] __attribute__((aligned(8)));
+};
+
+struct msg_queue {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+struct vq_inproc_node {
+	int nodeid;
+	void *user_data;
+	void *state;
+	char *private_data;
+	cs_error_t last_lib_error;
+	int we_are_quorate;
+	struct memb_ring_id quorum_ring_id;
+
+	/* Ring being synced */
+	struct memb_ring_id sync_ring_id;
+	size_t sync_ring_entries;
+	node_sync_state_t sync_state;
+	qb_loop_timer_handle sync_timer;
+
+	int qdevice_registered;
+	qb_loop_timer_handle qdevice_timer;
+
+	struct qb_list_head timers;
+
+	/* Exec messages waiting to be delivered to this node */
+	struct msg_queue inbox;
+	int inbox_pending;
+	struct qb_list_head pending_list;
+
+	int quit_pending;
+	int quit_code;
+	struct qb_list_head quit_list;
+
+	struct qb_list_head list;
+};
+
+static struct corosync_service_engine *engine;
+static qb_loop_t *poll_loop;
+static void *fake_conn = (void*)1;
+static unsigned int qdevice_timeout = VOTEQUORUM_QDEVICE_DEFAULT_TIMEOUT;
+
+/* votequorum state as it is before the first node is initialised */
+static void *initial_state;
+static size_t state_size;
+
+/* The node whose state is currently in votequorum */
+static struct vq_inproc_node *current_node;
+
+static QB_LIST_DECLARE(nodes_list_head);
+static QB_LIST_DECLARE(pending_list_head);
+static QB_LIST_DECLARE(quit_list_head);
+
+/* Exec messages sent by any node, in send (ie. agreed) order */
+static struct msg_queue outbox;
+
+static int job_scheduled;
+static int sync_check_needed;
+
+static void node_switch(struct vq_inproc_node *node)
+{
+	if (node == current_node) {
+		return;
+	}
+
+	if (current_node) {
+		votequorum_state_save(current_node->state);
+	}
+	votequorum_state_restore(node->state);
+	current_node = node;
+}
+
+static struct inproc_msg *msg_queue_append(struct msg_queue *queue, size_t len)
+{
+	size_t needed = queue->len + sizeof(struct inproc_msg) + MSG_ALIGN(len);
+	size_t new_size;
+	char *new_buf;
+	struct inproc_msg *msg;
+
+	if (needed > queue->size) {
+		new_size = queue->size ? queue->size : 4096;
+		while (new_size < needed) {
+			new_size *= 2;
+		}
+		new_buf = realloc(queue->buf, new_size);
+		if (!new_buf) {
+			fprintf(stderr, "Out of memory error\n");
+			exit(-1);
+		}
+		queue->buf = new_buf;
+		queue->size = new_size;
+	}
+
+	msg = (struct inproc_msg *)(queue->buf + queue->len);
+	msg->node = NULL;
+	msg->len = len;
+	queue->len = needed;
+
+	return msg;
+}
+
+static struct inproc_msg *msg_queue_next(struct msg_queue *queue, size_t *pos)
+{
+	struct inproc_msg *msg;
+
+	if (*pos >= queue->len) {
+		return NULL;
+	}
+	msg = (struct inproc_msg *)(queue->buf + *pos);
+	*pos += sizeof(struct inproc_msg) + MSG_ALIGN(msg->len);
+
+	return msg;
+}
+
+static void inproc_job_fn(void *data);
+
+static void schedule_job(void)
+{
+	if (!job_scheduled) {
+		qb_loop_job_add(poll_loop, QB_LOOP_MED, NULL, inproc_job_fn);
+		job_scheduled = 1;
+	}
+}
+
+/*
+ * Node timers. The node is switched in before the callback is run
+ */
+static void inproc_timer_fn(void *data)
+{
+	struct inproc_timer *timer = data;
+	struct vq_inproc_node *node = timer->node;
+	void (*timer_fn) (void *data) = timer->timer_fn;
+	void *timer_data = timer->data;
+
+	qb_list_del(&timer->list);
+	free(timer);
+
+	node_switch(node);
+	timer_fn(timer_data);
+}
+
+static int node_timer_add(struct vq_inproc_node *node,
+	unsigned long long nanosec_duration,
+	void *data,
+	void (*timer_fn) (void *data),
+	qb_loop_timer_handle *handle)
+{
+	struct inproc_timer *timer;
+	int res;
+
+	timer = malloc(sizeof(*timer));
+	if (!timer) {
+		return -ENOMEM;
+	}
+	timer->node = node;
+	timer->timer_fn = timer_fn;
+	timer->data = data;
+
+	res = qb_loop_timer_add(poll_loop, QB_LOOP_MED, nanosec_duration,
+				timer, inproc_timer_fn, &timer->handle);
+	if (res) {
+		free(timer);
+		return res;
+	}
+	qb_list_add_tail(&timer->list, &node->timers);
+
+	if (handle) {
+		*handle = timer->handle;
+	}
+	return 0;
+}
+
+/* Deleting a timer which has already fired is harmless */
+static void node_timer_del(struct vq_inproc_node *node, qb_loop_timer_handle handle)
+{
+	struct qb_list_head *iter, *tmp_iter;
+	struct inproc_timer *timer;
+
+	qb_list_for_each_safe(iter, tmp_iter, &node->timers) {
+		timer = qb_list_entry(iter, struct inproc_timer, list);
+		if (timer->handle == handle) {
+			qb_loop_timer_del(poll_loop, handle);
+			qb_list_del(&timer->list);
+			free(timer);
+			return;
+		}
+	}
+}
+
+/*
+ * corosync_api support, always called with the node switched in
+ */
+static void api_error_memory_failure(void) __attribute__((noreturn));
+static void api_error_memory_failure()
+{
+	fprintf(stderr, "Out of memory error\n");
+	exit(-1);
+}
+
+static void api_timer_delete(corosync_timer_handle_t th)
+{
+	node_timer_del(current_node, th);
+}
+
+static int api_timer_add_duration (
+        unsigned long long nanosec_duration,
+        void *data,
+        void (*timer_fn) (void *data),
+        corosync_timer_handle_t *handle)
+{
+	return node_timer_add(current_node, nanosec_duration, data, timer_fn, handle);
+}
+
+static unsigned int api_totem_nodeid_get(void)
+{
+	return current_node->nodeid;
+}
+
+static int api_totem_mcast(const struct iovec *iov, unsigned int iovlen, unsigned int type)
+{
+	struct vqsim_exec_msg *execmsg;
+	struct inproc_msg *msg;
+	size_t total = sizeof(struct vqsim_exec_msg);
+	char *p;
+	int i;
+
+	for (i=0; i<iovlen; i++) {
+		total += iov[i].iov_len;
+	}
+
+	/* Handed to the controller for the partition on the next job run */
+	msg = msg_queue_append(&outbox, total);
+	msg->node = current_node;
+
+	execmsg = (struct vqsim_exec_msg *)msg->data;
+	execmsg->header.type = VQMSG_EXEC;
+	execmsg->header.from_nodeid = current_node->nodeid;
+	execmsg->header.param = 0;
+
+	p = execmsg->execmsg;
+	for (i=0; i<iovlen; i++) {
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+
+	schedule_job();
+	return 0;
+}
+
+static void *api_ipc_private_data_get(void *conn)
+{
+	return current_node->private_data;
+}
+
+static int api_ipc_response_send(void *conn, const void *msg, size_t len)
+{
+	const struct qb_ipc_response_header *qb_header = msg;
+
+	/* Save the error so we can return it */
+	current_node->last_lib_error = qb_header->error;
+	return 0;
+}
+
+static struct corosync_api_v1 corosync_api = {
+	.error_memory_failure = api_error_memory_failure,
+	.timer_delete = api_timer_delete,
+	.timer_add_duration = api_timer_add_duration,
+	.totem_nodeid_get = api_totem_nodeid_get,
+	.totem_mcast = api_totem_mcast,
+	.ipc_private_data_get = api_ipc_private_data_get,
+	.ipc_response_send = api_ipc_response_send,
+};
+
+/* Callback from Votequorum to tell us about the quorum state */
+static void quorum_fn(const unsigned int *view_list,
+		      size_t view_list_entries,
+		      int quorate, struct memb_ring_id *ring_id)
+{
+	char msgbuf[sizeof(struct vqsim_quorum_msg) + sizeof(unsigned int) * view_list_entries];
+	struct vqsim_quorum_msg *quorum_msg = (void*) msgbuf;
+
+	current_node->we_are_quorate = quorate;
+	memcpy(&current_node->quorum_ring_id, ring_id, sizeof(*ring_id));
+
+	quorum_msg->header.type = VQMSG_QUORUM;
+	quorum_msg->header.from_nodeid = current_node->nodeid;
+	quorum_msg->header.param = 0;
+	quorum_msg->quorate = quorate;
+	memcpy(&quorum_msg->ring_id, ring_id, sizeof(*ring_id));
+	quorum_msg->view_list_entries = view_list_entries;
+	memcpy(quorum_msg->view_list, view_list, sizeof(unsigned int)*view_list_entries);
+
+	vq_node_message(current_node->user_data, msgbuf, sizeof(msgbuf));
+}
+
+/*
+ * Sync
+ */
+static void sync_dispatch_fn(void *data)
+{
+	struct vq_inproc_node *node = data;
+
+	node->sync_timer = 0;
+	if (engine->sync_process()) {
+		node_timer_add(node, SYNC_RETRY_NS, node, sync_dispatch_fn, &node->sync_timer);
+	}
+	else {
+		node->sync_state = NODE_SYNC_DONE;
+		sync_check_needed = 1;
+		schedule_job();
+	}
+}
+
+static void node_sync_init(struct vq_inproc_node *node,
+	const unsigned int *trans_list, size_t trans_list_entries,
+	const unsigned int *member_list, size_t member_list_entries,
+	const struct memb_ring_id *ring_id)
+{
+	node_switch(node);
+
+	if (node->sync_timer) {
+		node_timer_del(node, node->sync_timer);
+		node->sync_timer = 0;
+	}
+
+	engine->sync_init(trans_list, trans_list_entries,
+			  member_list, member_list_entries,
+			  ring_id);
+
+	memcpy(&node->sync_ring_id, ring_id, sizeof(*ring_id));
+	node->sync_ring_entries = member_list_entries;
+	node->sync_state = NODE_SYNC_PROCESS;
+
+	node_timer_add(node, 0, node, sync_dispatch_fn, &node->sync_timer);
+}
+
+static int same_sync_ring(const struct vq_inproc_node *a, const struct vq_inproc_node *b)
+{
+	return (a->sync_ring_id.nodeid == b->sync_ring_id.nodeid &&
+		a->sync_ring_id.seq == b->sync_ring_id.seq);
+}
+
+/* Activate every ring whose members have all finished sync_process */
+static void activate_synced_rings(void)
+{
+	struct qb_list_head *iter, *iter2;
+	struct vq_inproc_node *node, *other;
+	size_t done;
+
+	qb_list_for_each(iter, &nodes_list_head) {
+		node = qb_list_entry(iter, struct vq_inproc_node, list);
+		if (node->sync_state != NODE_SYNC_DONE) {
+			continue;
+		}
+
+		done = 0;
+		qb_list_for_each(iter2, &nodes_list_head) {
+			other = qb_list_entry(iter2, struct vq_inproc_node, list);
+			if (other->sync_state == NODE_SYNC_DONE && same_sync_ring(node, other)) {
+				done++;
+			}
+		}
+		if (done < node->sync_ring_entries) {
+			continue;
+		}
+
+		qb_list_for_each(iter2, &nodes_list_head) {
+			other = qb_list_entry(iter2, struct vq_inproc_node, list);
+			if (other->sync_state == NODE_SYNC_DONE && same_sync_ring(node, other)) {
+				other->sync_state = NODE_SYNC_NONE;
+				node_switch(other);
+				engine->sync_activate();
+			}
+		}
+	}
+}
+
+/*
+ * Message delivery
+ */
+static void node_deliver(struct vq_inproc_node *node)
+{
+	struct inproc_msg *msg;
+	struct vqsim_exec_msg *execmsg;
+	struct qb_ipc_request_header *qb_header;
+	size_t pos = 0;
+
+	if (node->inbox.len == 0) {
+		return;
+	}
+
+	node_switch(node);
+
+	/* Handlers only append to the outbox so the inbox is stable here */
+	while ((msg = msg_queue_next(&node->inbox, &pos)) != NULL) {
+		execmsg = (struct vqsim_exec_msg *)msg->data;
+		qb_header = (struct qb_ipc_request_header *)execmsg->execmsg;
+
+		engine->exec_engine[qb_header->id & 0xFFFF].exec_handler_fn(execmsg->execmsg,
+			execmsg->header.from_nodeid);
+	}
+	node->inbox.len = 0;
+}
+
+static void deliver_pending(void)
+{
+	struct vq_inproc_node *node;
+
+	while (!qb_list_empty(&pending_list_head)) {
+		node = qb_list_first_entry(&pending_list_head, struct vq_inproc_node, pending_list);
+		qb_list_del(&node->pending_list);
+		node->inbox_pending = 0;
+
+		node_deliver(node);
+	}
+}
+
+/* Pass the sent messages to the controller, which queues them on the partition members */
+static void flush_outbox(void)
+{
+	struct inproc_msg *msg;
+	size_t pos = 0;
+
+	while ((msg = msg_queue_next(&outbox, &pos)) != NULL) {
+		if (msg->node) {
+			vq_node_message(msg->node->user_data, msg->data, msg->len);
+		}
+	}
+	outbox.len = 0;
+}
+
+static void node_destroy(struct vq_inproc_node *node)
+{
+	struct qb_list_head *iter, *tmp_iter;
+	struct inproc_timer *timer;
+	struct inproc_msg *msg;
+	size_t pos = 0;
+
+	qb_list_for_each_safe(iter, tmp_iter, &node->timers) {
+		timer = qb_list_entry(iter, struct inproc_timer, list);
+		qb_loop_timer_del(poll_loop, timer->handle);
+		qb_list_del(&timer->list);
+		free(timer);
+	}
+
+	/* Messages it sent but which have not left yet are lost with it */
+	while ((msg = msg_queue_next(&outbox, &pos)) != NULL) {
+		if (msg->node == node) {
+			msg->node = NULL;
+		}
+	}
+
+	if (node->inbox_pending) {
+		qb_list_del(&node->pending_list);
+	}
+	qb_list_del(&node->list);
+
+	if (current_node == node) {
+		current_node = NULL;
+	}
+
+	free(node->inbox.buf);
+	free(node->private_data);
+	free(node->state);
+	free(node);
+}
+
+static void process_quits(void)
+{
+	struct vq_inproc_node *node;
+	void *user_data;
+	int exit_code;
+
+	while (!qb_list_empty(&quit_list_head)) {
+		node = qb_list_first_entry(&quit_list_head, struct vq_inproc_node, quit_list);
+		qb_list_del(&node->quit_list);
+
+		user_data = node->user_data;
+		exit_code = node->quit_code;
+		node_destroy(node);
+
+		/* The controller removes it from its partition and starts a new ring */
+		vq_node_quit(user_data, exit_code);
+	}
+}
+
+static void inproc_job_fn(void *data)
+{
+	job_scheduled = 0;
+
+	do {
+		flush_outbox();
+		deliver_pending();
+		if (sync_check_needed) {
+			sync_check_needed = 0;
+			activate_synced_rings();
+		}
+	} while (outbox.len || !qb_list_empty(&pending_list_head));
+
+	process_quits();
+}
+
+/*
+ * qdevice, as in vqsim_vq_engine.c
+ */
+static int send_lib_msg(struct vq_inproc_node *node, int type, void *msg)
+{
+	node_switch(node);
+
+	/* Clear this as not all lib functions return a response immediately */
+	node->last_lib_error = CS_OK;
+
+	engine->lib_engine[type].lib_handler_fn(fake_conn, msg);
+
+	return node->last_lib_error;
+}
+
+static int poll_qdevice(struct vq_inproc_node *node, int onoff)
+{
+	struct req_lib_votequorum_qdevice_poll pollmsg;
+	int res;
+
+	pollmsg.cast_vote = onoff;
+	pollmsg.ring_id.nodeid = node->quorum_ring_id.nodeid;
+	pollmsg.ring_id.seq = node->quorum_ring_id.seq;
+	strcpy(pollmsg.name, QDEVICE_NAME);
+
+	res = send_lib_msg(node, MESSAGE_REQ_VOTEQUORUM_QDEVICE_POLL, &pollmsg);
+	if (res != CS_OK) {
+		fprintf(stderr, CS_PRI_NODE_ID ": qdevice poll failed: %d\n", node->nodeid, res);
+	}
+	return res;
+}
+
+static void start_qdevice_poll(struct vq_inproc_node *node, int longwait);
+
+static void qdevice_dispatch_fn(void *data)
+{
+	struct vq_inproc_node *node = data;
+
+	node->qdevice_timer = 0;
+	if (poll_qdevice(node, 1) == CS_OK) {
+		start_qdevice_poll(node, 0);
+	}
+}
+
+static void start_qdevice_poll(struct vq_inproc_node *node, int longwait)
+{
+	unsigned long long timeout;
+
+	timeout = (unsigned long long)qdevice_timeout*500000; /* Half the corosync timeout */
+	if (longwait) {
+		timeout *= 2;
+	}
+
+	node_timer_add(node, timeout, node, qdevice_dispatch_fn, &node->qdevice_timer);
+}
+
+void inproc_set_qdevice(struct vq_inproc_node *node, int onoff)
+{
+	struct req_lib_votequorum_qdevice_register regmsg;
+	int res;
+
+	if (onoff) {
+		if (!node->qdevice_registered) {
+			strcpy(regmsg.name, QDEVICE_NAME);
+			if ( (res=send_lib_msg(node, MESSAGE_REQ_VOTEQUORUM_QDEVICE_REGISTER, &regmsg)) == CS_OK) {
+				node->qdevice_registered = 1;
+				start_qdevice_poll(node, 1);
+			}
+			else {
+				fprintf(stderr, CS_PRI_NODE_ID ": qdevice registration failed: %d\n", node->nodeid, res);
+			}
+		}
+		else {
+			if (!node->qdevice_timer) {
+				start_qdevice_poll(node, 0);
+			}
+		}
+	}
+	else {
+		poll_qdevice(node, 0);
+		node_timer_del(node, node->qdevice_timer);
+		node->qdevice_timer = 0;
+	}
+	schedule_job();
+}
+
+/*
+ * Called from vq_object.c
+ */
+void inproc_send_exec(struct vq_inproc_node *node, const char *buf, int len)
+{
+	struct inproc_msg *msg;
+
+	msg = msg_queue_append(&node->inbox, len);
+	memcpy(msg->data, buf, len);
+
+	if (!node->inbox_pending) {
+		qb_list_add_tail(&node->pending_list, &pending_list_head);
+		node->inbox_pending = 1;
+	}
+	schedule_job();
+}
+
+void inproc_set_nodelist(struct vq_inproc_node *node, struct memb_ring_id *ring_id, int *nodeids, int nodeids_entries)
+{
+	/* Messages of the old ring are delivered before the new one is installed */
+	if (node->inbox_pending) {
+		qb_list_del(&node->pending_list);
+		node->inbox_pending = 0;
+	}
+	node_deliver(node);
+
+	/* Votequorum doesn't use the transitional node list :-) */
+	node_sync_init(node, NULL, 0,
+		       (unsigned int *)nodeids, nodeids_entries,
+		       ring_id);
+}
+
+void inproc_quit(struct vq_inproc_node *node, int if_inquorate)
+{
+	if (node->quit_pending) {
+		return;
+	}
+	if (if_inquorate && node->we_are_quorate) {
+		return;
+	}
+
+	node->quit_pending = 1;
+	node->quit_code = if_inquorate ? 1 : 0;
+	qb_list_add_tail(&node->quit_list, &quit_list_head);
+	schedule_job();
+}
+
+static int inproc_engine_init(qb_loop_t *loop)
+{
+	poll_loop = loop;
+	engine = votequorum_get_service_engine_ver0();
+
+	state_size = votequorum_state_size();
+	initial_state = malloc(state_size);
+	if (!initial_state) {
+		return -1;
+	}
+	votequorum_state_save(initial_state);
+
+	if (icmap_get_uint32("quorum.device.timeout", &qdevice_timeout) != CS_OK) {
+		qdevice_timeout = VOTEQUORUM_QDEVICE_DEFAULT_TIMEOUT;
+	}
+
+	/*
+	 * All nodes share one icmap, so votequorum's config tracking would
+	 * run for whichever node happens to be switched in when another node
+	 * sets nodelist.local_node_pos. Look like a config reload is in
+	 * progress to keep it quiet.
+	 */
+	icmap_set_uint8("config.totemconfig_reload_in_progress", 1);
+
+	return 0;
+}
+
+struct vq_inproc_node *inproc_create_node(qb_loop_t *loop, int nodeid, void *user_data)
+{
+	struct vq_inproc_node *node;
+	const char *error_string;
+	unsigned int trans_list[1] = {nodeid};
+	unsigned int member_list[1] = {nodeid};
+	struct memb_ring_id ring_id;
+
+	if (!engine && inproc_engine_init(loop)) {
+		return NULL;
+	}
+
+	node = calloc(1, sizeof(*node));
+	if (!node) {
+		return NULL;
+	}
+	node->nodeid = nodeid;
+	node->user_data = user_data;
+	qb_list_init(&node->timers);
+	node->state = malloc(state_size);
+	node->private_data = malloc(engine->private_data_size);
+	if (!node->state || !node->private_data) {
+		goto error_free;
+	}
+
+	/* Start from a clean votequorum */
+	memcpy(node->state, initial_state, state_size);
+	node_switch(node);
+	qb_list_add_tail(&node->list, &nodes_list_head);
+
+	set_local_node_pos(nodeid);
+
+	error_string = votequorum_init(&corosync_api, quorum_fn);
+	if (error_string) {
+		fprintf(stderr, "Votequorum init failed: %s\n", error_string);
+		goto error_destroy;
+	}
+
+	error_string = engine->exec_init_fn(&corosync_api);
+	if (error_string) {
+		fprintf(stderr, "votequorum exec init failed: %s\n", error_string);
+		goto error_destroy;
+	}
+
+	engine->lib_init_fn(fake_conn);
+
+	/* Start with a cluster with just us in it */
+	ring_id.nodeid = nodeid;
+	ring_id.seq = 1;
+	node_sync_init(node, trans_list, 1, member_list, 1, &ring_id);
+
+	return node;
+
+error_destroy:
+	node_destroy(node);
+	return NULL;
+
+error_free:
+	free(node->private_data);
+	free(node->state);
+	free(node);
+	return NULL;
+}
@@ -183,15 +183,16 @@ char *get_run_dir()
  * It needs to be here rather than at main config read time as it's
  * (obviously) going to be different for each instance.
  */
-static void set_local_node_pos(struct corosync_api_v1 *api)
+void set_local_node_pos(int nodeid)
 {
 	icmap_iter_t iter;
 	uint32_t node_pos;
 	char name_str[ICMAP_KEYNAME_MAXLEN];
-	uint32_t nodeid;
+	uint32_t node_nodeid;
 	const char *iter_key;
 	int res;
 	int found = 0;
+	int nodes = 0;
 
 	iter = icmap_iter_init("nodelist.node.");
 	while ((iter_key = icmap_iter_next(iter, NULL, NULL)) != NULL) {
@@ -203,16 +204,20 @@ static void set_local_node_pos(struct corosync_api_v1 *api)
 			continue;
 		}
 
-		res = icmap_get_uint32(iter_key, &nodeid);
+		res = icmap_get_uint32(iter_key, &node_nodeid);
 		if (res == CS_OK) {
-			if (nodeid == our_nodeid) {
+			nodes++;
+			if (node_nodeid == nodeid) {
 				found = 1;
 				res = icmap_set_uint32("nodelist.local_node_pos", node_pos);
 				assert(res == CS_OK);
 			}
 		}
 	}
-	if (!found) {
+	icmap_iter_finalize(iter);
+
+	/* Without a nodelist votes come from quorum.votes/expected_votes */
+	if (!found && nodes) {
 		/* This probably indicates a dynamically-added node
 		 * set the pos to zero and use the votes of the
 		 * first node in corosync.conf
@@ -461,7 +466,7 @@ int fork_new_instance(int nodeid, int *vq_sock, pid_t *childpid)
 		qdevice_timeout = VOTEQUORUM_QDEVICE_DEFAULT_TIMEOUT;
 	}
 
-	set_local_node_pos(&corosync_api);
+	set_local_node_pos(our_nodeid);
 	load_quorum_instance(&corosync_api);
 
 	qb_loop_poll_add(poll_loop,